@@ -25,6 +25,8 @@
 #ifndef BOOST_IR_H
 #define BOOST_IR_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -117,6 +119,7 @@ enum class IRNodeType : short {
     LoopNest,
     IfThenElse,
     Move,
+    LetStmt,
     // Exprs
     Unary,
     Binary,
@@ -132,6 +135,7 @@ enum class IRNodeType : short {
     FloatImm,
     StringImm,
     Dom,
+    Let,
     // Operations
     ComputeOp,
     PlaceholderOp
@@ -152,14 +156,16 @@ enum class IRNodeType : short {
     X(UIntImm)          \
     X(FloatImm)         \
     X(StringImm)        \
-    X(Dom)
+    X(Dom)              \
+    X(Let)
 
 
 #define IRNODE_STMT_TYPE\
     X(Kernel)           \
     X(LoopNest)         \
     X(IfThenElse)       \
-    X(Move)
+    X(Move)             \
+    X(LetStmt)
 
 
 #define IRNODE_GROUP_TYPE     \
@@ -196,12 +202,21 @@ class Operation;
  */ 
 class IRNode {
  public:
-    IRNode(const IRNodeType _type) : _node_type(_type) {}
+    IRNode(const IRNodeType _type) : _node_type(_type) {
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+    }
 
     IRNodeType node_type() const {
         return this->_node_type;
     }
 
+    /**
+     * nodes constructed so far in this process, for pass statistics
+     */ 
+    static uint64_t allocations() {
+        return allocations_.load(std::memory_order_relaxed);
+    }
+
     virtual ~IRNode() = default;
 
     /**
@@ -214,6 +229,8 @@ class IRNode {
      * indicate the concrete type of this IR node
      */ 
     IRNodeType _node_type;
+
+    static std::atomic<uint64_t> allocations_;
 };
 
 
@@ -904,6 +921,32 @@ class Index : public ExprNode, public std::enable_shared_from_this<Index> {
 };
 
 
+/**
+ * let binding: evaluate body with var bound to value
+ * - var: a scalar Var (no args)
+ */ 
+class Let : public ExprNode, public std::enable_shared_from_this<Let> {
+ public:
+    Expr var;
+    Expr value;
+    Expr body;
+
+    Let(Type _type, Expr _var, Expr _value, Expr _body) : ExprNode(_type, IRNodeType::Let),
+        var(_var), value(_value), body(_body) {}
+
+    Expr mutate_expr(IRMutator *mutator) const;
+    void visit_node(IRVisitor *visitor) const;
+    // template <typename R, typename... Args>
+    // R visit_(IRFunctor<R(Args...)> *functor, Args... args) const;
+
+    static Expr make(Type t, Expr _var, Expr _value, Expr _body) {
+        return std::make_shared<const Let>(t, _var, _value, _body);
+    }
+
+    static const IRNodeType node_type_ = IRNodeType::Let;
+};
+
+
 /**
  * loop nest
  * - block: if index_list is empty, it means a block of statements
@@ -996,6 +1039,32 @@ class Move : public StmtNode, public std::enable_shared_from_this<Move> {
 };
 
 
+/**
+ * let binding statement: execute body with var bound to value
+ * - var: a scalar Var (no args)
+ */ 
+class LetStmt : public StmtNode, public std::enable_shared_from_this<LetStmt> {
+ public:
+    Expr var;
+    Expr value;
+    Stmt body;
+
+    LetStmt(Expr _var, Expr _value, Stmt _body) :
+        StmtNode(IRNodeType::LetStmt), var(_var), value(_value), body(_body) {}
+
+    Stmt mutate_stmt(IRMutator *mutator) const;
+    void visit_node(IRVisitor *visitor) const;
+    // template <typename R, typename... Args>
+    // R visit_(IRFunctor<R(Args...)> *functor, Args... args) const;
+    
+    static Stmt make(Expr _var, Expr _value, Stmt _body) {
+        return std::make_shared<const LetStmt>(_var, _value, _body);
+    }
+
+    static const IRNodeType node_type_ = IRNodeType::LetStmt;
+};
+
+
 enum class KernelType : uint8_t {
     CPU,
     GPU
@@ -80,6 +80,7 @@ class ExprFunctor<R(const Expr&, Args...)> {
    virtual R visit(Ref<const Ramp> op, Args... args) VISIT_DEFAULT
    virtual R visit(Ref<const Index> op, Args... args) VISIT_DEFAULT
    virtual R visit(Ref<const Dom> op, Args... args) VISIT_DEFAULT
+   virtual R visit(Ref<const Let> op, Args... args) VISIT_DEFAULT
   #undef FUNCTOR
  private:
 };
@@ -101,6 +102,7 @@ class StmtFunctor<R(const Stmt&, Args...)> {
    virtual R visit(Ref<const LoopNest> op, Args... args) VISIT_DEFAULT
    virtual R visit(Ref<const IfThenElse> op, Args... args) VISIT_DEFAULT
    virtual R visit(Ref<const Move> op, Args... args) VISIT_DEFAULT
+   virtual R visit(Ref<const LetStmt> op, Args... args) VISIT_DEFAULT
   #undef FUNCTOR
  private:
 };
@@ -52,9 +52,11 @@ class IRMutator {
     virtual Expr visit(Ref<const Ramp>);
     virtual Expr visit(Ref<const Index>);
     virtual Expr visit(Ref<const Dom>);
+    virtual Expr visit(Ref<const Let>);
     virtual Stmt visit(Ref<const LoopNest>);
     virtual Stmt visit(Ref<const IfThenElse>);
     virtual Stmt visit(Ref<const Move>);
+    virtual Stmt visit(Ref<const LetStmt>);
     virtual Group visit(Ref<const Kernel>);
     virtual Operation visit(Ref<const PlaceholderOp>);
     virtual Operation visit(Ref<const ComputeOp>);
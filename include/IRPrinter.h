@@ -82,9 +82,11 @@ class IRPrinter : public IRVisitor {
     void visit(Ref<const Ramp>) override;
     void visit(Ref<const Index>) override;
     void visit(Ref<const Dom>) override;
+    void visit(Ref<const Let>) override;
     void visit(Ref<const LoopNest>) override;
     void visit(Ref<const IfThenElse>) override;
     void visit(Ref<const Move>) override;
+    void visit(Ref<const LetStmt>) override;
     void visit(Ref<const Kernel>) override;
     void visit(Ref<const PlaceholderOp>) override;
     void visit(Ref<const ComputeOp>) override;
@@ -48,9 +48,11 @@ class IRVisitor {
     virtual void visit(Ref<const Ramp>);
     virtual void visit(Ref<const Index>);
     virtual void visit(Ref<const Dom>);
+    virtual void visit(Ref<const Let>);
     virtual void visit(Ref<const LoopNest>);
     virtual void visit(Ref<const IfThenElse>);
     virtual void visit(Ref<const Move>);
+    virtual void visit(Ref<const LetStmt>);
     virtual void visit(Ref<const Kernel>);
     virtual void visit(Ref<const PlaceholderOp>);
     virtual void visit(Ref<const ComputeOp>);
@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#ifndef BOOST_ACCUMULATE_H
+#define BOOST_ACCUMULATE_H
+
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * keep the partial sums of reductions in locals
+ * - dst = dst + e or dst = e + dst, the statements of the innermost
+ *   Reduce loops with each dst invariant in them, load and store dst
+ *   once per point of the enclosing loops:
+ *     acc = dst; for (k) acc = acc + e; dst = acc;
+ *   several statements, e.g. from unroll and jam, sum into a local each
+ * - with several accumulators, the innermost reduce loop of constant
+ *   Dom is unrolled over them to break the dependence chain, then they
+ *   are summed; this reassociates floating point sums
+ * - a vector_reduce_add(v) term, see Vectorizer, sums into a vector
+ *   accumulator with one horizontal sum at the end
+ * - locals are Vars without args, declared by their Move of MemToLocal
+ *   and written back by one of LocalToMem; run it after the other
+ *   passes, which take Vars without args for immutable bindings
+ */
+class Accumulator : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  explicit Accumulator(int accumulators) : accumulators_(accumulators) {}
+
+  Stmt visit(Ref<const LoopNest>) override;
+
+ private:
+  struct Sum {
+    Ref<const Move> move;
+    Expr value;
+    bool vector = false;
+    std::vector<Expr> accs;
+  };
+
+  // the loops of reduce around body with locals, undefined if body is
+  // not made of reductions
+  Stmt accumulate(const std::vector<Expr> &reduce, const std::vector<Stmt> &body);
+
+  int accumulators_;
+  int count_ = 0;
+};
+
+
+Stmt accumulate(const Stmt &stmt, int accumulators = 1);
+
+Group accumulate(const Group &group, int accumulators = 1);
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_ACCUMULATE_H
@@ -25,6 +25,9 @@
 #ifndef BOOST_ARITH_H
 #define BOOST_ARITH_H
 
+#include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 
@@ -50,18 +53,53 @@ class Bounds {
 };
 
 
-template<typename T>
+// checks of Matrix accesses, compiled out unless built with BOOST_DEBUG
+#ifdef BOOST_DEBUG
+#define MATRIX_ASSERT(cond) ASSERT(cond)
+#else
+#define MATRIX_ASSERT(cond) if (true) {} else ASSERT(cond)
+#endif
+
+
+/**
+ * dense row-major matrix of arithmetic values
+ * - a value type: copies are deep, moves steal the heap buffer
+ * - matrices of at most InlineCapacity elements (after padding) live
+ *   inline without heap allocation
+ * - rows start at row_align bytes boundaries and are padded with zeros to
+ *   a multiple of row_align bytes, row operations run over whole vector
+ *   lanes without a scalar tail
+ * - accesses and row/column indices are only checked when built with BOOST_DEBUG
+ */
+template<typename T, int InlineCapacity = 64>
 class Matrix {
  public:
-  Matrix(int height, int width) : width_(width), height_(height) {
-    ptr = new T[width * height];
+  static const int row_align = 32;
+  static const int lanes = row_align / sizeof(T) > 0 ? row_align / sizeof(T) : 1;
+
+  Matrix(int height = 0, int width = 0) : ptr_(inline_), heap_(nullptr), capacity_(InlineCapacity), height_(0), width_(0), stride_(0) {
+    resize(height, width);
+  }
+
+  Matrix(const Matrix &other) : ptr_(inline_), heap_(nullptr), capacity_(InlineCapacity), height_(0), width_(0), stride_(0) {
+    *this = other;
+  }
+
+  Matrix(Matrix &&other) : ptr_(inline_), heap_(nullptr), capacity_(InlineCapacity), height_(0), width_(0), stride_(0) {
+    *this = std::move(other);
   }
+
   ~Matrix() {
-    if (ptr != nullptr) {
-      delete []ptr;
-    }
+    delete []heap_;
   }
 
+  Matrix &operator=(const Matrix &other);
+
+  Matrix &operator=(Matrix &&other);
+
+  // reshape to height x width zeros, reuses the buffer if it is large enough
+  void resize(int height, int width);
+
   int height() const {
     return height_;
   }
@@ -70,9 +108,19 @@ class Matrix {
     return width_;
   }
 
+  // elements between the starts of two rows
+  int stride() const {
+    return stride_;
+  }
+
   T *operator[](int id) {
-    ASSERT(id < height_) << "index out of height range: " << id << " vs. " << height_ << "\n";
-    return (ptr + id * width_);
+    MATRIX_ASSERT(id >= 0 && id < height_) << "index out of height range: " << id << " vs. " << height_ << "\n";
+    return ptr_ + id * stride_;
+  }
+
+  const T *operator[](int id) const {
+    MATRIX_ASSERT(id >= 0 && id < height_) << "index out of height range: " << id << " vs. " << height_ << "\n";
+    return ptr_ + id * stride_;
   }
 
   void swap_row(int i, int j);
@@ -83,17 +131,70 @@ class Matrix {
 
   void scale_col(int j, T factor);
 
+  // row j += row i * factor
   void add_row(int i, int j, T factor);
 
+  // col j += col i * factor
   void add_col(int i, int j, T factor);
 
-  void row_transform(int i, int j, T s, T t, T f, T g);
+  // (row i, row j) = (row i * s + row j * t, row i * g + row j * h)
+  void row_transform(int i, int j, T s, T t, T g, T h);
 
-  void col_transform(int i, int j, T s, T t, T f, T g);
+  // (col i, col j) = (col i * s + col j * t, col i * g + col j * h)
+  void col_transform(int i, int j, T s, T t, T g, T h);
 
  private:
-  T *ptr;
-  int width_, height_;
+  T *ptr_;
+  // owns ptr_ unless the matrix is inline, ptr_ is heap_ rounded up to row_align
+  T *heap_;
+  // elements available from ptr_
+  size_t capacity_;
+  int height_, width_, stride_;
+  alignas(row_align) T inline_[InlineCapacity];
+};
+
+
+/**
+ * integer matrix of at most max_dim x max_dim with inline storage
+ * - no heap allocation
+ * - 64-bit elements, the row/column operations throw std::overflow_error
+ *   instead of wrapping around
+ * - the storage is a private Matrix, only accesses, swaps and the checked
+ *   operations are exposed, so neither resize nor scale_row can bypass
+ *   the shape and overflow checks
+ */
+class SmallMatrix : private Matrix<int64_t, 16 * 16> {
+  typedef Matrix<int64_t, 16 * 16> Storage;
+
+ public:
+  static const int max_dim = 16;
+
+  SmallMatrix(int height = 0, int width = 0);
+
+  using Storage::height;
+  using Storage::width;
+  using Storage::operator[];
+  using Storage::swap_row;
+  using Storage::swap_col;
+
+  // becomes the dim x dim identity
+  void set_identity(int dim);
+
+  void negate_row(int i);
+
+  void negate_col(int j);
+
+  // row j += row i * factor
+  void add_row(int i, int j, int64_t factor);
+
+  // col j += col i * factor
+  void add_col(int i, int j, int64_t factor);
+
+  // (row i, row j) = (row i * s + row j * t, row i * g + row j * h)
+  void row_transform(int i, int j, int64_t s, int64_t t, int64_t g, int64_t h);
+
+  // (col i, col j) = (col i * s + col j * t, col i * g + col j * h)
+  void col_transform(int i, int j, int64_t s, int64_t t, int64_t g, int64_t h);
 };
 
 
@@ -103,12 +204,78 @@ bool divisible(int a, int b);
 int ext_euclidean(int a, int b, int &x, int &y);
 
 
+int64_t ext_euclidean(int64_t a, int64_t b, int64_t &x, int64_t &y);
+
+
+/**
+ * smith normal form: U * trans * V = D, trans is overwritten by D
+ * - D is diagonal, d_0 | d_1 | ... | d_{dim-1} > 0, returns dim (the rank)
+ * - U and V are unimodular
+ * - matrices with at most one non-zero per row and column (permutations,
+ *   diagonals, most access patterns) only need pivoting
+ * - others are brought to hermite normal form first, pivots are always
+ *   the values of least magnitude to slow down coefficient growth
+ * - throws std::overflow_error if a coefficient exceeds 64 bits
+ */
+int smith_normalize(SmallMatrix &trans, SmallMatrix &U, SmallMatrix &V);
+
+
 int smith_normalize(Matrix<int> &trans, Matrix<int> &U, Matrix<int> &V);
 
 
+/**
+ * smith_normalize results of one coefficient matrix
+ */
+class SmithNormalForm {
+ public:
+  SmallMatrix U;
+  SmallMatrix V;
+  // d_0 | d_1 | ... | d_{rank-1}
+  std::vector<int64_t> diagonal;
+  int rank;
+};
+
+
+/**
+ * content-addressed cache of smith normal forms
+ * - the key is the bytes of (rows, cols, coefficients), so identical
+ *   access patterns from different kernels share one entry
+ * - returned references stay valid until clear()
+ */
+class SmithCache {
+ public:
+  SmithCache() : hits_(0), misses_(0) {}
+
+  // throws std::overflow_error like smith_normalize, failures are not cached
+  const SmithNormalForm &get(const SmallMatrix &trans);
+
+  size_t hits() const {
+    return hits_;
+  }
+
+  size_t misses() const {
+    return misses_;
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  void clear();
+
+ private:
+  std::unordered_map<std::string, SmithNormalForm> entries_;
+  size_t hits_;
+  size_t misses_;
+};
+
+
 std::vector<Expr> relax_matrix_array_product(Matrix<int> &m, std::vector<Expr> &v);
 
 
+std::vector<Expr> relax_matrix_array_product(const SmallMatrix &m, std::vector<Expr> &v);
+
+
 Expr add(const Expr &a, const Expr &b);
 
 
@@ -178,6 +345,207 @@ Expr lt(const Expr &a, const Expr &b);
 Expr le(const Expr &a, const Expr &b);
 
 
+/**
+ * affine form sum(coeff * symbol) + constant over integer symbols
+ * - terms are sorted by symbol and never hold zero coefficients,
+ *   so equal forms have equal representations
+ * - arithmetic is checked, overflow throws std::overflow_error
+ */
+class LinearForm {
+ public:
+  using Term = std::pair<std::string, int64_t>;
+
+  LinearForm() : constant_(0) {}
+
+  explicit LinearForm(int64_t constant) : constant_(constant) {}
+
+  LinearForm(const std::string &symbol, int64_t coeff) : constant_(0) {
+    if (coeff != 0) {
+      terms_.emplace_back(symbol, coeff);
+    }
+  }
+
+  /**
+   * extract the form of an integer index expression in one pass
+   * return false if the expression is not affine, e.g. i * j or i // 2
+   * symbols receives the Index nodes met, if given
+   */
+  static bool from_expr(const Expr &expr, LinearForm &form,
+    std::unordered_map<std::string, Expr> *symbols = nullptr);
+
+  // rebuild with the folding builders, symbols maps names to their Index nodes
+  Expr to_expr(Type type, const std::unordered_map<std::string, Expr> &symbols) const;
+
+  const std::vector<Term> &terms() const {
+    return terms_;
+  }
+
+  int64_t constant() const {
+    return constant_;
+  }
+
+  bool is_constant() const {
+    return terms_.empty();
+  }
+
+  // 0 for absent symbols
+  int64_t coeff(const std::string &symbol) const;
+
+  LinearForm &operator+=(const LinearForm &other);
+
+  LinearForm &operator-=(const LinearForm &other);
+
+  LinearForm &operator*=(int64_t factor);
+
+  // replace symbol by value
+  LinearForm substitute(const std::string &symbol, const LinearForm &value) const;
+
+  bool operator==(const LinearForm &other) const {
+    return constant_ == other.constant_ && terms_ == other.terms_;
+  }
+
+  bool operator!=(const LinearForm &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  // terms_ += factor * other.terms_, one merge of the sorted lists
+  void merge(const std::vector<Term> &other, int64_t factor);
+
+  std::vector<Term> terms_;
+  int64_t constant_;
+};
+
+
+LinearForm operator+(LinearForm a, const LinearForm &b);
+
+
+LinearForm operator-(LinearForm a, const LinearForm &b);
+
+
+LinearForm operator*(LinearForm a, int64_t factor);
+
+
+std::ostream &operator<<(std::ostream &out, const LinearForm &form);
+
+
+/**
+ * bounds of one loop level
+ * symbol >= ceil(lower[i].first / lower[i].second) for all i,
+ * symbol <= floor(upper[i].first / upper[i].second) for all i,
+ * the divisors are positive
+ */
+class LoopBounds {
+ public:
+  std::string symbol;
+  std::vector<std::pair<LinearForm, int64_t>> lower;
+  std::vector<std::pair<LinearForm, int64_t>> upper;
+};
+
+
+/**
+ * conjunction of affine constraints form >= 0 over integer symbols
+ * - constraints are normalized: coefficients are divided by their gcd and
+ *   the constant is rounded down (integer tightening), parallel
+ *   constraints keep the tightest constant, true constants are dropped
+ * - project_out is Fourier-Motzkin elimination, it is exact over the
+ *   rationals and over-approximates the integer projection
+ */
+class IntegerSet {
+ public:
+  // FM may square the constraint count per elimination, give up beyond this
+  static const size_t max_constraints = 1024;
+
+  IntegerSet() : empty_(false) {}
+
+  // form >= 0
+  void add_ge(const LinearForm &form);
+
+  // form == 0
+  void add_eq(const LinearForm &form);
+
+  // lo <= symbol < hi
+  void add_range(const std::string &symbol, int64_t lo, int64_t hi);
+
+  const std::vector<LinearForm> &constraints() const {
+    return constraints_;
+  }
+
+  // true if a constraint reduced to a negative constant, an empty set
+  // may still report false as FM is not exact on integers
+  bool is_empty() const {
+    return empty_;
+  }
+
+  IntegerSet project_out(const std::string &symbol) const;
+
+  /**
+   * nested loop bounds for the symbols in order, outermost first
+   * - bounds of order[k] use order[0..k) and symbols not in order only,
+   *   order[k+1..] are projected out
+   * - every constraint holds on the innermost level it involves, so the
+   *   loop nest enumerates exactly the integer points of the set
+   * - return false if the projection exceeds max_constraints
+   */
+  bool loop_bounds(const std::vector<std::string> &order, std::vector<LoopBounds> &bounds) const;
+
+ private:
+  std::vector<LinearForm> constraints_;
+  bool empty_;
+};
+
+
+std::ostream &operator<<(std::ostream &out, const IntegerSet &set);
+
+
+/**
+ * one end of an ExtRange
+ * - a concrete integer when known, bounds from Dom extents nearly always are,
+ *   integer arithmetic on them never allocates IR nodes
+ * - otherwise a symbolic Expr
+ * - converts to Expr on use, integers become int32 constants
+ */
+class RangeBound {
+ public:
+  RangeBound() : is_int_(false), value_(0) {}
+
+  RangeBound(int value) : is_int_(true), value_(value) {}
+
+  RangeBound(int64_t value) : is_int_(true), value_(value) {}
+
+  // integer constants are stored as integers
+  RangeBound(const Expr &expr);
+
+  bool is_int() const {
+    return is_int_;
+  }
+
+  // only valid if is_int()
+  int64_t value() const {
+    return value_;
+  }
+
+  bool defined() const {
+    return is_int_ || expr_.defined();
+  }
+
+  const Expr &expr() const;
+
+  operator Expr() const {
+    return expr();
+  }
+
+ private:
+  bool is_int_;
+  int64_t value_;
+  // built lazily for integers
+  mutable Expr expr_;
+};
+
+
+std::ostream &operator<<(std::ostream &out, const RangeBound &bound);
+
+
 enum class ExtRangeType : uint8_t {
   LORC,  // left open right close
   LORO,  // left open right open
@@ -186,10 +554,13 @@ enum class ExtRangeType : uint8_t {
 };
 
 
+/**
+ * [left, right), either end may be infinite
+ */
 class ExtRange {
  public:
-  Expr left;
-  Expr right;
+  RangeBound left;
+  RangeBound right;
   bool left_inf;
   bool right_inf;
 
@@ -207,7 +578,7 @@ class ExtRange {
   ExtRange(const ExtRange &&range) : left(std::move(range.left)), right(std::move(range.right)),
     left_inf(std::move(range.left_inf)), right_inf(std::move(range.right_inf)) {}
 
-  ExtRange(Expr l, Expr r, bool li, bool ri) : left(l), right(r), left_inf(li), right_inf(ri) {}
+  ExtRange(RangeBound l, RangeBound r, bool li, bool ri) : left(l), right(r), left_inf(li), right_inf(ri) {}
 
   ExtRange &operator=(ExtRange &range) {
     left = range.left;
@@ -245,7 +616,7 @@ class ExtRange {
 
   ExtRange floor_mod(int factor);
 
-  ExtRangeType range_type() {
+  ExtRangeType range_type() const {
     if (left_inf && right_inf) {
       return ExtRangeType::LORO;
     } else if (left_inf && !right_inf) {
@@ -259,6 +630,12 @@ class ExtRange {
 };
 
 
+/**
+ * infer the ranges of indices from the range of an expression of them
+ * - integer ranges use interval arithmetic, where the other operand of
+ *   Add/Sub/Mul/FloorDiv is bounded by the Dom of its indices
+ * - symbolic ranges are only propagated through constant operands
+ */
 class RangeInference : public IRVisitor {
  private:
   std::vector<ExtRange> scope_;
@@ -266,9 +643,8 @@ class RangeInference : public IRVisitor {
   std::unordered_map<std::string, ExtRange> range_map;
   RangeInference(ExtRange init) { scope_.push_back(init); }
 
-  void do_infer(const Expr &expr) {
-    expr.visit_expr(this);
-  }
+  // affine expressions of one index are solved in closed form
+  void do_infer(const Expr &expr);
 
  protected:
   // list of functions to override.
@@ -277,8 +653,12 @@ class RangeInference : public IRVisitor {
   // only for Neg
   void visit(Ref<const Unary> op) override;
 
-  // only for Add/Sub/Mul
+  // Add/Sub/Mul/FloorDiv/FloorMod
   void visit(Ref<const Binary> op) override;
+
+ private:
+  // visit expr within range
+  void infer(const Expr &expr, const ExtRange &range);
 };
 
 
@@ -26,6 +26,7 @@
 #define BOOST_AUTODIFF_H
 
 #include <unordered_set>
+#include <functional>
 #include <string>
 
 #include "IR.h"
@@ -187,46 +188,28 @@ class EliminateIndexFloorDivAndMod : public ExprFunctor<Expr(const Expr&)> {
   Expr visit(Ref<const Dom> op) override {
     return Dom::make(op->type(), visit_expr(op->begin), visit_expr(op->extent));
   }
+
+  Expr visit(Ref<const Let> op) override {
+    return Let::make(op->type(), op->var, visit_expr(op->value), visit_expr(op->body));
+  }
 };
 
 
-// TODO: how do we handle complex type casting?
-class ExtractIndexCoefficients : public ExprFunctor<void(const Expr&)> {
+/**
+ * coefficients of an affine index expression by index name,
+ * the constant is stored under const_tag, see Arith::LinearForm
+ */
+class ExtractIndexCoefficients {
   using VType = int;
  public:
   ExtractIndexCoefficients(
     const std::string &const_tag) : const_tag_(const_tag) {
   }
 
-  void get_coefficients(const Expr& expr, std::unordered_map<std::string, VType> &result) {
-    result[const_tag_] = (VType)0;
-    scope_.push_back(&result);
-    visit_expr(expr);
-  }
-
- protected:
-  void visit(Ref<const IntImm> op) override {
-    (*(scope_.back()))[const_tag_] = (VType)op->value();
-  }
-
-  void visit(Ref<const UIntImm> op) override {
-    (*(scope_.back()))[const_tag_] = (VType)op->value();
-  }
+  // throws std::invalid_argument for non-affine expressions
+  void get_coefficients(const Expr& expr, std::unordered_map<std::string, VType> &result);
 
-  void visit(Ref<const FloatImm> op) override UNEXPECTED
-  void visit(Ref<const StringImm> op) override UNEXPECTED
-  void visit(Ref<const Unary> op) override;
-  void visit(Ref<const Binary> op) override;
-  void visit(Ref<const Select> op) override UNEXPECTED
-  void visit(Ref<const Compare> op) override UNEXPECTED
-  void visit(Ref<const Call> op) override UNEXPECTED
-  void visit(Ref<const Var> op) override UNEXPECTED
-  void visit(Ref<const Cast> op) override UNEXPECTED
-  void visit(Ref<const Ramp> op) override UNEXPECTED
-  void visit(Ref<const Index> op) override;
-  void visit(Ref<const Dom> op) override UNEXPECTED
  private:
-  std::vector<std::unordered_map<std::string, VType>*> scope_;
   std::string const_tag_;
 };
 
@@ -264,6 +247,53 @@ class FloorDivModEntryHash {
 };
 
 
+/**
+ * iteration space of one gradient contribution
+ * - reduce_axis: relaxed indices introduced by smith normal form
+ * - conditions: guards (bound checkers) of the contribution
+ * - divisibility: (expr, factor) pairs, expr % factor == 0 is required
+ * - equalities: exprs that must be zero (when rows > dims)
+ */
+class GradIterSpace {
+ public:
+  std::vector<Expr> reduce_axis;
+  std::vector<Expr> conditions;
+  std::vector<std::pair<Expr, int>> divisibility;
+  std::vector<Expr> equalities;
+};
+
+
+/**
+ * derivative rule of an intrinsic call
+ * takes the arguments and the forward output of the call,
+ * returns the partial derivative to each argument
+ * the output is given so that rules like sigmoid' = y * (1 - y)
+ * need not recompute the call
+ */
+typedef std::function<std::vector<Expr>(
+  const std::vector<Expr> &args, const Expr &output)> DerivativeRule;
+
+
+/**
+ * map from Call::func_name to its derivative rule
+ */
+class DerivativeRegistry {
+ public:
+  static DerivativeRegistry &global();
+
+  void register_rule(const std::string &func_name, DerivativeRule rule);
+
+  bool has_rule(const std::string &func_name) const;
+
+  const DerivativeRule &get_rule(const std::string &func_name) const;
+
+ private:
+  // registers the builtin rules
+  DerivativeRegistry();
+  std::unordered_map<std::string, DerivativeRule> rules_;
+};
+
+
 void solve_floor_div_mod(const SubstituteContext &context,
   std::unordered_set<FloorDivModEntry, FloorDivModEntryHash> &s);
 
@@ -279,8 +309,50 @@ void solve_substitutions(SubstituteContext &context,
 
 
 
-Stmt grad_stmt(Expr expr, std::vector<Expr> call_args, std::vector<int> call_args_index, 
-    Ref<const Var> grad_to, Ref<const Var> doutput);
+/**
+ * forward_outputs: (sub-expression of expr, tensor access holding its forward value)
+ * pairs, the derivative of a materialized call reads the tensor instead of
+ * recomputing the call
+ */
+Stmt grad_stmt(Expr expr, std::vector<Expr> call_args, std::vector<int> call_args_index,
+    Ref<const Var> grad_to, Ref<const Var> doutput,
+    std::vector<std::pair<Expr, Expr>> forward_outputs={});
+
+
+/**
+ * lower the gradient to loops: a block of an initialization nest
+ * and accumulation nests
+ * - every access to grad_to is one contribution with its own iteration space
+ * - contributions writing each element at most once (e.g. shifted accesses
+ *   B[i + 1, j]) are summed in the initialization nest, so the gradient
+ *   buffer is written by one pass instead of one pass per access
+ * - strided: turn divisibility/equality constraints into strided
+ *   iterations instead of guards
+ */
+Stmt grad_loop_nest(Expr expr, std::vector<Expr> call_args, std::vector<int> call_args_index,
+    Ref<const Var> grad_to, Ref<const Var> doutput, bool strided=true,
+    std::vector<std::pair<Expr, Expr>> forward_outputs={});
+
+
+/**
+ * forward side of a Select: save the condition as a bitmask packed
+ * along the last index (one bit per element, 32 per uint32 word)
+ * - mask: the bitmask access at index_list
+ * - saved: (cond, bit of mask), pass it in forward_outputs so that
+ *   the backward reads the bit instead of evaluating cond again
+ */
+Stmt save_bitmask(Expr cond, std::vector<Expr> index_list, const std::string &name,
+    Expr &mask, std::pair<Expr, Expr> &saved);
+
+
+/**
+ * forward of a max reduction that also saves the argmax:
+ * out = max of value over reduce_list, arg = flattened position of the max
+ * - routed: select(arg == position, value, 0), differentiate it to get
+ *   the gradient of the max, which only reads arg
+ */
+Stmt save_argmax(Expr value, Expr out, std::vector<Expr> reduce_list, const std::string &name,
+    Expr &arg, Expr &routed);
 
 }  // namespace Autodiff
 
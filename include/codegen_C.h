@@ -26,9 +26,11 @@
 #define BOOST_CODEGEN_C_H
 
 #include <string>
-#include <sstream>
+#include <vector>
+#include <utility>
 
 #include "IRVisitor.h"
+#include "codegen_sink.h"
 
 using namespace Boost::Internal;
 
@@ -37,18 +39,77 @@ namespace Boost {
 
 namespace codegen {
 
+/**
+ * code of vector types
+ * - GccVector: GCC vector extensions; the kernel carries the target
+ *   attribute of its ISA, so variants for several ISAs can share one
+ *   translation unit, see print_dispatch
+ * - EigenPacket: the packet math of the vendored Eigen; the translation
+ *   unit must be compiled for the ISA, e.g. -mavx2 -mfma, and include
+ *   the Eigen headers
+ */
+enum class VectorBackend : uint8_t {
+    GccVector,
+    EigenPacket
+};
+
+
+// Native: whatever the translation unit is compiled for; SSE: SSE4.2
+enum class VectorISA : uint8_t {
+    Native,
+    SSE,
+    AVX2,
+    AVX512
+};
+
+
+// lanes of a register of isa holding elements of type t
+int vector_lanes(VectorISA isa, const Type &t);
+
+
 class CodeGen_C : public Internal::IRVisitor {
  public:
     CodeGen_C() : IRVisitor() {
         indent = 0;
         print_range = false;
         print_arg = false;
+        in_parallel = false;
+        omp_collapse = true;
+        vector_backend = VectorBackend::GccVector;
+        vector_isa = VectorISA::Native;
     }
+
+    // schedule clause of the pragmas of Thread loops, e.g. "dynamic, 4",
+    // none if empty
+    std::string omp_schedule;
+    // collapse perfectly nested Thread loops into one pragma
+    bool omp_collapse;
+    VectorBackend vector_backend;
+    VectorISA vector_isa;
+
     std::string print_type(const Type &t);
     std::string print(const Expr&);
     std::string print(const Stmt&);
     std::string print(const Group&);
 
+    /**
+     * write the source to sink, without building it in memory first;
+     * kernels emitted one after another share one translation unit
+     */
+    void emit(const Expr&, Sink &sink);
+    void emit(const Stmt&, Sink &sink);
+    void emit(const Group&, Sink &sink);
+
+    /**
+     * variants of one kernel, named <kernel>_<isa>, then the kernel
+     * itself calling the first variant the CPU supports; list them from
+     * the widest ISA to the narrowest, with GccVector
+     * - every variant but the native one is guarded by __builtin_cpu_supports
+     * - the native variant, the last one printed again if none is given,
+     *   is the fallback, compiled for the translation unit
+     */
+    std::string print_dispatch(const std::vector<std::pair<VectorISA, Group>> &variants);
+
     void print_indent() {
         for (int i = 0; i < indent; ++i)
             oss << " ";
@@ -76,17 +137,34 @@ class CodeGen_C : public Internal::IRVisitor {
     void visit(Ref<const Ramp>) override;
     void visit(Ref<const Index>) override;
     void visit(Ref<const Dom>) override;
+    void visit(Ref<const Let>) override;
     void visit(Ref<const LoopNest>) override;
     void visit(Ref<const IfThenElse>) override;
     void visit(Ref<const Move>) override;
+    void visit(Ref<const LetStmt>) override;
     void visit(Ref<const Kernel>) override;
     void visit(Ref<const PlaceholderOp>) override;
     void visit(Ref<const ComputeOp>) override;
  private:
-    std::ostringstream oss;
+    // the Thread loops starting at index k of op run by one pragma
+    int parallel_loops(Ref<const LoopNest> op, size_t k);
+
+    // typedef of t, or its Eigen packet
+    std::string print_vector_type(const Type &t);
+
+    // typedefs or includes of the vector types of a kernel
+    void print_vector_prelude(const std::string &kernel, const std::vector<Type> &types);
+
+    // element access of op, Ramp args give their base
+    void print_access(Ref<const Var> op);
+
+    Emitter oss;
+    // size of the last printed source, reserved for the next one
+    size_t size_hint = 0;
     int indent;
     bool print_range;
     bool print_arg;
+    bool in_parallel;
 };
 
 }  // namespace codegen
@@ -0,0 +1,224 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef BOOST_CODEGEN_SINK_H
+#define BOOST_CODEGEN_SINK_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+
+namespace Boost {
+
+namespace codegen {
+
+/**
+ * destination of generated source
+ */
+class Sink {
+ public:
+  virtual ~Sink() = default;
+
+  virtual void write(const char *data, size_t size) = 0;
+
+  virtual void flush() {}
+};
+
+
+/**
+ * growable char arena, kept across kernels so one translation unit is
+ * built without copies
+ */
+class ArenaSink : public Sink {
+ public:
+  void write(const char *data, size_t size) override {
+    buffer_.append(data, size);
+  }
+
+  void reserve(size_t size) {
+    buffer_.reserve(size);
+  }
+
+  const char *data() const {
+    return buffer_.data();
+  }
+
+  size_t size() const {
+    return buffer_.size();
+  }
+
+  const std::string &str() const {
+    return buffer_;
+  }
+
+  // move the text out and leave the arena empty
+  std::string take() {
+    std::string ret;
+    ret.swap(buffer_);
+    return ret;
+  }
+
+  void clear() {
+    buffer_.clear();
+  }
+
+ private:
+  std::string buffer_;
+};
+
+
+/**
+ * an open file descriptor, written by write(2); the fd is not closed
+ */
+class FdSink : public Sink {
+ public:
+  explicit FdSink(int fd) : fd_(fd) {}
+
+  void write(const char *data, size_t size) override;
+
+ private:
+  int fd_;
+};
+
+
+/**
+ * a file mapped in memory, grown by doubling and truncated to the text
+ * written when closed
+ */
+class MmapSink : public Sink {
+ public:
+  explicit MmapSink(const std::string &path, size_t capacity = 1 << 20);
+
+  ~MmapSink() override {
+    close();
+  }
+
+  MmapSink(const MmapSink &) = delete;
+  MmapSink &operator=(const MmapSink &) = delete;
+
+  void write(const char *data, size_t size) override;
+
+  void flush() override;
+
+  void close();
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  void map(size_t capacity);
+
+  int fd_ = -1;
+  char *data_ = nullptr;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+};
+
+
+/**
+ * buffered text output over a Sink with hand-rolled number formatting
+ * - integers are printed digit by digit, floating point values print
+ *   like std::ostream defaults (%g), integral ones without snprintf
+ */
+class Emitter {
+ public:
+  void reset(Sink *sink) {
+    flush();
+    sink_ = sink;
+  }
+
+  void flush() {
+    if (sink_ != nullptr && size_ != 0) {
+      sink_->write(buffer_, size_);
+    }
+    size_ = 0;
+  }
+
+  void write(const char *data, size_t size) {
+    if (size_ + size > kBufferSize) {
+      flush();
+      if (size > kBufferSize) {
+        sink_->write(data, size);
+        return;
+      }
+    }
+    std::memcpy(buffer_ + size_, data, size);
+    size_ += size;
+  }
+
+  Emitter &operator<<(const char *str) {
+    write(str, std::strlen(str));
+    return *this;
+  }
+
+  Emitter &operator<<(const std::string &str) {
+    write(str.data(), str.size());
+    return *this;
+  }
+
+  Emitter &operator<<(char c) {
+    if (size_ == kBufferSize) {
+      flush();
+    }
+    buffer_[size_++] = c;
+    return *this;
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, Emitter &>::type
+  operator<<(T value) {
+    write_int((int64_t)value);
+    return *this;
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, Emitter &>::type
+  operator<<(T value) {
+    write_uint((uint64_t)value);
+    return *this;
+  }
+
+  Emitter &operator<<(double value);
+
+ private:
+  static const size_t kBufferSize = 1 << 14;
+
+  void write_uint(uint64_t value);
+
+  void write_int(int64_t value);
+
+  Sink *sink_ = nullptr;
+  char buffer_[kBufferSize];
+  size_t size_ = 0;
+};
+
+}  // namespace codegen
+
+}  // namespace Boost
+
+
+#endif  // BOOST_CODEGEN_SINK_H
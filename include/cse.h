@@ -0,0 +1,114 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef BOOST_CSE_H
+#define BOOST_CSE_H
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * values that are never worth a binding: constants, indices, Ramp, Let
+ * and Vars without args
+ */
+bool is_leaf(const Expr &expr);
+
+// LetStmts binding lets around stmt, the first one outermost
+Stmt wrap_lets(const std::vector<std::pair<Expr, Expr>> &lets, Stmt stmt);
+
+
+/**
+ * global value numbering of the expressions of one statement
+ * - every structurally distinct subexpression gets an entry
+ * - children are numbered only at the first occurrence of a value,
+ *   so uses counts the distinct parents plus the roots
+ * - branches of Select and bodies of Let are not entered: they are not
+ *   always evaluated, so they never make a value worth hoisting
+ */
+class ExprNumbering {
+ public:
+  struct Entry {
+    Expr expr;
+    int uses;
+    // no loads, no calls, no select and no division by a variable:
+    // can be evaluated ahead of a guard
+    bool safe;
+  };
+
+  std::vector<Entry> entries;
+
+  int number(const Expr &expr);
+
+  int lookup(const Expr &expr) const;
+
+ private:
+  std::unordered_map<Expr, int, Utils::ExprHash, Utils::ExprEqual> table_;
+};
+
+
+/**
+ * hoist repeated subexpressions of every Move into LetStmts
+ * - for a loop body of several Moves, the values they share are bound
+ *   once, before the first Move using them, unless they read an array
+ *   or local the body writes
+ * - for IfThenElse, the safe values shared by the guard and its body
+ *   are bound before the guard
+ */
+class CommonSubexprEliminator : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+  Stmt visit(Ref<const LoopNest>) override;
+  Stmt visit(Ref<const Move>) override;
+  Stmt visit(Ref<const IfThenElse>) override;
+
+ private:
+  Utils::NameGenerator name_generator_;
+};
+
+
+Stmt common_subexpr_elimination(const Stmt &stmt);
+
+Group common_subexpr_elimination(const Group &group);
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_CSE_H
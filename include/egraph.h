@@ -0,0 +1,211 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef BOOST_EGRAPH_H
+#define BOOST_EGRAPH_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * cost of one evaluation of an operation, roughly in cycles
+ * - leaves (constants, indices) are free, a Var access costs load plus
+ *   its index arithmetic
+ */
+class CostModel {
+ public:
+  int add = 1;      // add, sub, neg, compare, logic
+  int mul = 1;
+  int div = 10;     // div, mod and their floor versions
+  int load = 2;
+  int call = 20;
+  int select = 1;
+  int cast = 1;
+
+  int cost(const Expr &expr) const;
+};
+
+
+class EGraphOptions {
+ public:
+  CostModel cost;
+  // budgets of one expression, saturation stops at the first one exceeded
+  size_t max_nodes = 4000;
+  int max_iterations = 8;
+  double max_millis = 20;
+};
+
+
+class EGraphStats {
+ public:
+  int exprs = 0;
+  int improved = 0;
+  int iterations = 0;
+  // saturated: no rule added anything before a budget ran out
+  int saturated = 0;
+  size_t max_nodes = 0;
+  double millis = 0;
+  long long cost_before = 0;
+  long long cost_after = 0;
+};
+
+
+std::ostream &operator<<(std::ostream &out, const EGraphStats &stats);
+
+
+/**
+ * e-graph over the Expr IR
+ * - e-nodes are operations over e-classes, an e-class is a set of
+ *   equivalent e-nodes; Var accesses are operations over their args,
+ *   constants, indices and the remaining nodes are leaves
+ * - constants are folded when all children of a node are constant
+ * - rules are applied to all matches of one iteration at once, then
+ *   congruence is restored by rebuild
+ * - extract gives the cheapest expression of an e-class by the cost model
+ */
+class EGraph {
+ public:
+  struct ENode {
+    IRNodeType kind;
+    int op;
+    Type type;
+    std::vector<int> children;
+    // data of leaves, and the name, shape or callee of the others
+    Expr payload;
+  };
+
+  class ENodeHash {
+   public:
+    size_t operator()(const ENode &node) const;
+  };
+
+  class ENodeEqual {
+   public:
+    bool operator()(const ENode &a, const ENode &b) const;
+  };
+
+  int add(const Expr &expr);
+
+  int find(int id) const;
+
+  // true if the classes were different
+  bool merge(int a, int b);
+
+  void rebuild();
+
+  // apply the rules until nothing changes or a budget runs out
+  void saturate(const EGraphOptions &options, EGraphStats &stats);
+
+  Expr extract(int id, const CostModel &model) const;
+
+  size_t num_nodes() const {
+    return memo_.size();
+  }
+
+  size_t num_classes() const;
+
+ private:
+  using Subst = std::unordered_map<std::string, int>;
+  using Deadline = std::chrono::steady_clock::time_point;
+
+  int add_node(ENode node);
+
+  // merge the class of node with its value over constant children
+  void fold(const ENode &node, int id);
+
+  // one iteration of all rules, false if nothing changed
+  bool apply_rules(const EGraphOptions &options, Deadline deadline);
+
+  void match(const Expr &pattern, int id, const std::vector<std::vector<ENode>> &members,
+             const Subst &subst, std::vector<Subst> &results) const;
+
+  int instantiate(const Expr &pattern, const Subst &subst, Type type);
+
+  ENode canonical(const ENode &node) const;
+
+  std::vector<std::vector<ENode>> class_members() const;
+
+  mutable std::vector<int> parent_;
+  std::vector<Type> types_;
+  // constant value of a class, by root
+  std::unordered_map<int, Expr> consts_;
+  std::unordered_map<ENode, int, ENodeHash, ENodeEqual> memo_;
+};
+
+
+/**
+ * rewrite the Move values and guards of stmt through an e-graph each,
+ * keeping the result when it is cheaper
+ * - floating point rules hold over the reals, not bit for bit, like
+ *   -ffast-math; the pass is optional, run it before CodeGen_C
+ */
+class EGraphOptimizer : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  EGraphOptimizer(const EGraphOptions &options) : options_(options) {}
+
+  Stmt visit(Ref<const Move>) override;
+  Stmt visit(Ref<const IfThenElse>) override;
+
+  const EGraphStats &stats() const {
+    return stats_;
+  }
+
+ private:
+  Expr optimize(const Expr &expr);
+
+  EGraphOptions options_;
+  EGraphStats stats_;
+};
+
+
+Stmt egraph_optimize(const Stmt &stmt, const EGraphOptions &options = EGraphOptions(),
+                     EGraphStats *stats = nullptr);
+
+Group egraph_optimize(const Group &group, const EGraphOptions &options = EGraphOptions(),
+                      EGraphStats *stats = nullptr);
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_EGRAPH_H
@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef BOOST_LICM_H
+#define BOOST_LICM_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * loop-invariant code motion
+ * - a LoopNest of several indices is split into one LoopNest per index
+ * - the maximal subexpressions of Move values, Move destination args and
+ *   guards that do not change in the innermost enclosing loops are bound
+ *   by LetStmts at the outermost level where all their operands are
+ *   defined, just before the loop they no longer depend on
+ * - loads of arrays written in the nest and impure calls never move;
+ *   values that are not safe (see ExprNumbering) only leave loops with a
+ *   positive constant extent and never leave a guard
+ * - branches of Select and bodies of Let stay in place
+ */
+class LoopInvariantCodeMotion : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+  Stmt visit(Ref<const LoopNest>) override;
+  Stmt visit(Ref<const IfThenElse>) override;
+  Stmt visit(Ref<const Move>) override;
+  Stmt visit(Ref<const LetStmt>) override;
+
+ private:
+  struct Level {
+    std::string index;
+    // the loop of this level has a positive constant extent
+    bool runs;
+    // bindings put around the loop of the next level
+    std::vector<std::pair<Expr, Expr>> lets;
+  };
+
+  // level an expression evaluated at depth can be bound at, depth if it
+  // can't move
+  int target_level(const Expr &expr, int depth) const;
+
+  // bind the invariant parts of an expression evaluated at depth, the
+  // values bound are hoisted further the same way
+  Expr hoist(const Expr &expr, int depth);
+
+  Expr hoist_operands(const Expr &expr, int depth);
+
+  int depth() const {
+    return (int)levels_.size() - 1;
+  }
+
+  Utils::NameGenerator name_generator_;
+  // the root level holds the bindings put before the outermost loop
+  std::vector<Level> levels_ = {Level{"", true, {}}};
+  std::vector<int> guards_;
+  // level of the LetStmt vars in scope
+  std::unordered_map<std::string, int> bound_;
+  std::vector<std::string> written_;
+};
+
+
+/**
+ * one LoopNest per index, the bodies stay in the innermost one
+ */
+Stmt split_loop_nest(const Stmt &stmt);
+
+Stmt loop_invariant_code_motion(const Stmt &stmt);
+
+Group loop_invariant_code_motion(const Group &group);
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_LICM_H
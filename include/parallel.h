@@ -0,0 +1,88 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#ifndef BOOST_PARALLEL_H
+#define BOOST_PARALLEL_H
+
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * whether the iterations of the loop of index over body may run in
+ * parallel, with the reason in why if not
+ * - Reduce indices never run in parallel
+ * - every written array must have an affine arg whose coefficient of
+ *   index exceeds the span of the loops inside body, so iterations write
+ *   disjoint elements; scalars can't be written, except the locals
+ *   declared in body, see Accumulator
+ * - a written array is only read at the elements written, and no call
+ *   has side effects
+ * - args are compared with the let bindings in body inlined, so the index
+ *   arithmetic bound by LICM, CSE and strength reduction still counts
+ */
+bool parallel_legal(const Expr &index, const std::vector<Stmt> &body, std::string &why);
+
+
+/**
+ * mark the outermost Spatial loops of each loop nest as Thread
+ * - up to max_loops perfectly nested loops of constant Doms, for
+ *   collapse; legal ones only, see parallel_legal
+ */
+class Parallelizer : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  explicit Parallelizer(int max_loops) : max_loops_(max_loops) {}
+
+  Stmt visit(Ref<const LoopNest>) override;
+
+ private:
+  int max_loops_;
+};
+
+
+Stmt parallelize(const Stmt &stmt, int max_loops = 1);
+
+Group parallelize(const Group &group, int max_loops = 1);
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_PARALLEL_H
@@ -0,0 +1,177 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef BOOST_PASS_MANAGER_H
+#define BOOST_PASS_MANAGER_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "debug.h"
+#include "IR.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * passes to run, in order
+ * - a step repeats its passes until an iteration leaves the IR unchanged,
+ *   at most max_iterations times; a single pass is a step of one iteration
+ */
+class Pipeline {
+ public:
+  struct Step {
+    std::vector<std::string> passes;
+    int max_iterations;
+  };
+
+  std::string name;
+  std::vector<Step> steps;
+
+  Pipeline &then(const std::string &pass) {
+    steps.push_back(Step{{pass}, 1});
+    return *this;
+  }
+
+  Pipeline &fixpoint(const std::vector<std::string> &passes, int max_iterations = 4) {
+    steps.push_back(Step{passes, max_iterations});
+    return *this;
+  }
+
+  /**
+   * -O0: nothing
+   * -O1: simplify
+   * -O2: simplify_bounds, cse, licm
+   * -O3: simplify_bounds, cse, strength_reduce (licm included), unroll,
+   *      accumulate
+   * the levels keep floating point results, up to the order of sums
+   */
+  static Pipeline preset(int level);
+
+  /**
+   * -Ofast: -O3 with [simplify_bounds, egraph] as its first step;
+   * egraph rewrites floating point like -ffast-math
+   */
+  static Pipeline preset_fast();
+
+  /**
+   * "-O2", "-Ofast", or passes separated by commas where [a, b] is a fixpoint
+   * step, e.g. "simplify_bounds, [egraph, simplify], cse"
+   * return false on a syntax error
+   */
+  static bool parse(const std::string &spec, Pipeline &pipeline);
+};
+
+
+/**
+ * time, IR size and allocations of one pass, summed over its runs
+ * - nodes: IR nodes of the input and the output, as trees
+ * - allocations: IR nodes constructed while the pass ran
+ */
+class PassStats {
+ public:
+  std::string name;
+  int runs = 0;
+  double millis = 0;
+  uint64_t nodes_before = 0;
+  uint64_t nodes_after = 0;
+  uint64_t allocations = 0;
+};
+
+
+/**
+ * registry of named Expr, Stmt and Group passes running pipelines over
+ * them; the built-in passes are registered at construction
+ * - a pass may exist for some of the three levels only, running a
+ *   pipeline skips the passes missing at its level with an error
+ */
+class PassManager {
+ public:
+  using ExprPass = std::function<Expr(const Expr &)>;
+  using StmtPass = std::function<Stmt(const Stmt &)>;
+  using GroupPass = std::function<Group(const Group &)>;
+
+  PassManager();
+
+  void add_expr_pass(const std::string &name, ExprPass pass);
+
+  void add_stmt_pass(const std::string &name, StmtPass pass);
+
+  void add_group_pass(const std::string &name, GroupPass pass);
+
+  bool has_pass(const std::string &name) const;
+
+  Expr run(const Pipeline &pipeline, const Expr &expr);
+
+  Stmt run(const Pipeline &pipeline, const Stmt &stmt);
+
+  Group run(const Pipeline &pipeline, const Group &group);
+
+  // in the order the passes first ran
+  const std::vector<PassStats> &stats() const {
+    return stats_;
+  }
+
+  void reset_stats() {
+    stats_.clear();
+    stat_ids_.clear();
+  }
+
+  /**
+   * {"passes": [{"name": ..., "runs": ..., "millis": ..., "nodes_before": ...,
+   * "nodes_after": ..., "allocations": ...}, ...], "millis": ...}
+   */
+  void write_json(std::ostream &out) const;
+
+ private:
+  struct Entry {
+    ExprPass expr;
+    StmtPass stmt;
+    GroupPass group;
+  };
+
+  template <typename T, typename F>
+  T run_impl(const Pipeline &pipeline, const T &node, F get);
+
+  PassStats &stats_of(const std::string &name);
+
+  std::unordered_map<std::string, Entry> passes_;
+  std::vector<PassStats> stats_;
+  std::unordered_map<std::string, size_t> stat_ids_;
+};
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_PASS_MANAGER_H
@@ -0,0 +1,132 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#ifndef BOOST_SCHEDULE_H
+#define BOOST_SCHEDULE_H
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include "debug.h"
+#include "IR.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * loop transformations of one perfect loop nest, lowered into nested
+ * LoopNests of one index each
+ * - the nest is the index_list of a ComputeOp, or a LoopNest whose body
+ *   is a single LoopNest down to the innermost one
+ * - split and fuse need loops of constant begin and extent; a loop whose
+ *   Dom depends on other indices must stay inside their loops
+ * - indices are identified by name; split and fuse give new indices
+ *   named after their parents, the body is rewritten in terms of the
+ *   loops left when lowering
+ * - a split whose factor does not divide the extent has a tail: the
+ *   extent of the inner loop becomes min(factor, extent - outer * factor)
+ *   when it runs inside the outer one, otherwise the body is guarded
+ * - like reordering the index_list itself, no dependence is checked:
+ *   the body must allow any order of its iterations, as a single Move
+ *   accumulating over Reduce indices does
+ */
+class Schedule {
+ public:
+  explicit Schedule(const Operation &op);
+
+  explicit Schedule(const Stmt &loop_nest);
+
+  // index = outer * factor + inner, inner in [0, factor)
+  void split(const Expr &index, int64_t factor, Expr &outer, Expr &inner);
+
+  // outer = fused / extent(inner), inner = fused % extent(inner); outer
+  // must run right around inner, both of the same IndexType
+  void fuse(const Expr &outer, const Expr &inner, Expr &fused);
+
+  // put indices at the positions they hold now, in the given order
+  void reorder(const std::vector<Expr> &indices);
+
+  // split x and y, then order the loops x_outer, y_outer, x_inner, y_inner
+  void tile(const Expr &x, const Expr &y, int64_t x_factor, int64_t y_factor,
+            Expr &x_outer, Expr &y_outer, Expr &x_inner, Expr &y_inner);
+
+  // run the loop of index in parallel, see CodeGen_C for the legality
+  void parallel(const Expr &index);
+
+  // run the loop of index by vectors, see Vectorizer
+  void vectorize(const Expr &index);
+
+  // unroll the loop of index fully, see Unroller
+  void unroll(const Expr &index);
+
+  // current loops, outermost first
+  const std::vector<Expr> &loops() const {
+    return loops_;
+  }
+
+  Stmt lower() const;
+
+ private:
+  // base * factor + inner < extent, for splits with a tail
+  struct Tail {
+    Expr base;
+    Expr inner;
+    int64_t factor;
+    int64_t extent;
+  };
+
+  void init(const std::vector<Expr> &index_list, const std::vector<Stmt> &body_list);
+
+  int position(const Expr &index) const;
+
+  int position(const std::string &name) const;
+
+  // replace index by value in the values of the original indices and tails
+  void substitute(const Expr &index, const Expr &value);
+
+  // index names not used in the nest yet, name itself if possible
+  std::string fresh_name(const std::string &name);
+
+  std::unordered_set<std::string> names_;
+  std::vector<Expr> loops_;
+  std::vector<Stmt> body_list_;
+  // original indices and their values in terms of the current loops
+  std::vector<Expr> indices_;
+  std::vector<Expr> values_;
+  std::vector<Tail> tails_;
+};
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_SCHEDULE_H
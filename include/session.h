@@ -0,0 +1,61 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef BOOST_SESSION_H
+#define BOOST_SESSION_H
+
+#include <ostream>
+
+#include "arith.h"
+
+namespace Boost {
+
+/**
+ * state shared by all the kernels compiled in one process
+ * - smith_cache: smith normal forms of access coefficient matrices,
+ *   gemm-like A[i, k] or conv-like I[n, c, p + r, q + s] accesses
+ *   repeat across kernels
+ */
+class Session {
+ public:
+  static Session &global();
+
+  Arith::SmithCache &smith_cache() {
+    return smith_cache_;
+  }
+
+  // drop all cached results and statistics
+  void reset();
+
+  // hit/miss statistics, one line per cache
+  friend std::ostream &operator<<(std::ostream &out, const Session &session);
+
+ private:
+  Arith::SmithCache smith_cache_;
+};
+
+}  // namespace Boost
+
+
+#endif  // BOOST_SESSION_H
@@ -26,7 +26,9 @@
 #define BOOST_SIMPLIFY_H
 
 #include <memory>
+#include <string>
 #include <vector>
+#include <functional>
 #include <unordered_map>
 
 #include "debug.h"
@@ -43,16 +45,143 @@ using namespace Internal;
 
 namespace Simplify {
 
-class SimplifyUnitElement : IRMutator {
+/**
+ * wildcard bindings of a matched pattern
+ */
+using Bindings = std::unordered_map<std::string, Expr>;
+
+
+/**
+ * rewrite rule lhs => rhs
+ * - patterns are plain expressions over wildcards: Index nodes named
+ *   x, y, z match any expression, c0, c1, c2 match constants only, a
+ *   wildcard used twice matches equal expressions
+ * - constants in lhs match constants of the same value and any type
+ * - rhs is instantiated with the Arith builders, so constants fold
+ * - the rule applies to expressions of its domain only, when cond, if any,
+ *   holds on the bindings
+ */
+class Rule {
+ public:
+  enum class Domain : uint8_t {
+    Any,
+    Int,
+    Float
+  };
+
+  Rule(Expr lhs, Expr rhs, Domain domain = Domain::Any,
+       std::function<bool(const Bindings&)> cond = nullptr) :
+       lhs_(lhs), rhs_(rhs), domain_(domain), cond_(cond) {}
+
+  bool apply(const Expr &expr, Expr &result) const;
+
+  static Expr wildcard(const std::string &name);
+
+ private:
+  Expr lhs_;
+  Expr rhs_;
+  Domain domain_;
+  std::function<bool(const Bindings&)> cond_;
+};
+
+
+/**
+ * rule driven algebraic simplifier
+ * - children first, then the rules of the node until none applies
+ * - constants of commutative operations go right, integer operands are
+ *   put in a canonical order
+ * - integer sums are flattened, like terms combined and rebuilt with
+ *   positive terms first; integer compares fold through the difference
+ *   of their sides
+ * - floating point rules are IEEE identities only: x * 0, x - x and
+ *   reassociation are left to the egraph pass, which assumes -ffast-math
+ * - Select, IfThenElse with a constant condition take their branch
+ * - changed() tells whether a rule applied since the last reset
+ */
+class Simplifier : public IRMutator {
  public:
   using IRMutator::mutate;
   using IRMutator::visit;
   Expr visit(Ref<const Unary>) override;
   Expr visit(Ref<const Binary>) override;
+  Expr visit(Ref<const Compare>) override;
+  Expr visit(Ref<const Select>) override;
+  Stmt visit(Ref<const IfThenElse>) override;
+
+  bool changed() const {
+    return changed_;
+  }
+
+  void reset() {
+    changed_ = false;
+  }
+
+ protected:
+  // apply the rules of the node kind of expr until none applies
+  Expr rewrite(const Expr &expr);
+
+  bool changed_ = false;
 };
 
 
-Expr simplify_unit_element(const Expr &expr);
+/**
+ * simplifier that also knows the range of every integer index
+ * - an Index ranges over its Dom, whose ends may use outer indices
+ * - x / c, x // c fold to a constant and x % c, x %% c to x - k * c when
+ *   the range of x lies within one period of c
+ * - integer compares fold when the range of the difference of their sides
+ *   decides them, e.g. 0 <= p + r for loop indices p and r
+ * - select(a > b, a, b) and the other min / max forms take the branch the
+ *   ranges decide
+ */
+class BoundsSimplifier : public Simplifier {
+ public:
+  using Simplifier::mutate;
+  using Simplifier::visit;
+  Expr visit(Ref<const Binary>) override;
+  Expr visit(Ref<const Compare>) override;
+  Expr visit(Ref<const Select>) override;
+};
+
+
+/**
+ * simplify until no rule applies, at most max_passes passes
+ */
+const int max_passes = 8;
+
+Expr simplify(const Expr &expr);
+
+Stmt simplify(const Stmt &stmt);
+
+Group simplify(const Group &group);
+
+
+/**
+ * constant range [lo, hi] of an integer expression, both ends included
+ * - false unless it is integer arithmetic over constants and indices with
+ *   bounded Doms
+ */
+bool const_bounds(const Expr &expr, int64_t &lo, int64_t &hi);
+
+Expr simplify_bounds(const Expr &expr);
+
+Stmt simplify_bounds(const Stmt &stmt);
+
+Group simplify_bounds(const Group &group);
+
+
+/**
+ * arithmetic nodes: Unary, Binary, Compare, Select and Call,
+ * Index domains excluded
+ */
+int count_ops(const Expr &expr);
+
+
+/**
+ * arithmetic nodes evaluated per iteration of the innermost loops,
+ * summed over all innermost loop nests of stmt
+ */
+int inner_loop_ops(const Stmt &stmt);
 
 }  // namespace Simplify
 
@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#ifndef BOOST_STRENGTH_REDUCE_H
+#define BOOST_STRENGTH_REDUCE_H
+
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * strength reduction of index arithmetic
+ * - an access of rank > 1 is linearized by its shape, A<M, N>[i, j]
+ *   becomes A[i * N + j]: a single arg over a shape of higher rank is an
+ *   offset into the row-major storage, CodeGen_C prints it so
+ * - the terms of an offset are ordered by the loop they change in, the
+ *   outermost first, so the partial offset of the enclosing loops is one
+ *   invariant subexpression
+ * - integer floor division and modulo by a power of two become shifts
+ *   and masks, truncating ones too when the dividend is never negative
+ */
+class StrengthReducer : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+  Expr visit(Ref<const Binary>) override;
+  Expr visit(Ref<const Var>) override;
+  Stmt visit(Ref<const LoopNest>) override;
+
+ private:
+  // position of the loop an expression changes in, 0 for none
+  int level(const Expr &expr) const;
+
+  Expr linearize(Ref<const Var> op, const std::vector<Expr> &args) const;
+
+  // indices of the enclosing loops, the outermost first
+  std::vector<std::string> loops_;
+};
+
+
+/**
+ * strength reduction followed by loop_invariant_code_motion, which binds
+ * the partial offsets once per iteration of their own loop, so an inner
+ * loop only adds index * stride to the offset of its parent
+ */
+Stmt strength_reduce(const Stmt &stmt);
+
+Group strength_reduce(const Group &group);
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_STRENGTH_REDUCE_H
@@ -159,6 +159,20 @@ class Type {
         return ((int)lanes_list.size() == 1) && ((int)lanes_list[0] == 1);
     }
 
+    // number of elements, 1 for scalars
+    int lanes() const {
+        int ret = 1;
+        for (size_t i = 0; i < lanes_list.size(); ++i) {
+            ret *= (int)lanes_list[i];
+        }
+        return ret;
+    }
+
+    // the vector of lanes elements of this element type
+    Type with_lanes(int lanes) const {
+        return Type(code, bits, LanesList({static_cast<uint16_t>(lanes)}));
+    }
+
     bool is_int() const {
         return this->code == TypeCode::Int;
     }
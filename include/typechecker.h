@@ -35,6 +35,7 @@
 #include <Eigen/Dense>
 
 #include "IRVisitor.h"
+#include "arith.h"
 
 using namespace Boost::Internal;
 
@@ -186,38 +187,14 @@ namespace Boost
       std::stack<std::string> op_stack; // consider using enum
     };
 
-    /* Buggy impl, only supports i, j, i+(-j)... */
-    class ArgVisitor : public Internal::IRVisitor
-    {
-    public:
-      ArgVisitor() : IRVisitor() {}
-      ArgVisitor(int _shape) : IRVisitor(), shape(_shape) {}
-      IndexConstraint retrieve()
-      {
-        auto names = std::vector<std::string>();
-        auto mat = Eigen::MatrixXd(1, index_weight.size());
-        auto shapes = Eigen::VectorXd(1);
-
-        int i = 0;
-        for (auto it = index_weight.begin(); it != index_weight.end(); ++it)
-        {
-          names.push_back(it->first);
-          mat(0, i++) = it->second;
-        }
-        shapes(0) = shape;
-        return IndexConstraint(names, mat, shapes);
-      }
-
-      // void visit(Ref<const IntImm>) override;
-      // void visit(Ref<const FloatImm>) override;
-      void visit(Ref<const Unary>) override;
-      void visit(Ref<const Binary>) override;
-      void visit(Ref<const Index>) override;
-
-    private:
-      int shape;
-      std::map<std::string, int> index_weight;
-    };
+    /**
+     * constraint of one tensor argument on the extents of its indices
+     * - an affine argument sum(c_k * i_k) + b of a dimension of size shape
+     *   reaches shape - 1 at the largest indices, which gives
+     *   sum(c_k * extent_k) = shape - 1 - b + sum(c_k)
+     * - throws TypecheckException for non-affine arguments
+     */
+    IndexConstraint arg_constraint(const Expr &arg, int shape);
   } // namespace Typechecker
 
 } // namespace Boost
@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#ifndef BOOST_UNROLL_H
+#define BOOST_UNROLL_H
+
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+class UnrollOptions {
+ public:
+  // Spatial and Reduce loops of constant extents up to this are unrolled
+  int max_extent = 8;
+  // copies of the Spatial loop right around the innermost Reduce loops
+  // jammed into them, 1 for none
+  int jam = 4;
+  // IR nodes the body of an unrolled or jammed loop may grow to
+  uint64_t max_nodes = 1024;
+};
+
+
+/**
+ * full unrolling, innermost loops first
+ * - loops of constant Dom marked Unrolled, and Spatial or Reduce ones of
+ *   at most max_extent iterations around no other loop, become a copy of
+ *   their body per iteration, while the copies fit in max_nodes; marked
+ *   ones over the budget stay loops with a warning
+ * - the bindings and locals declared in the body are renamed per copy
+ */
+class Unroller : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  explicit Unroller(const UnrollOptions &options) : options_(options) {}
+
+  Stmt visit(Ref<const LoopNest>) override;
+
+ private:
+  UnrollOptions options_;
+};
+
+
+/**
+ * unroll and jam, outermost loops first
+ * - for (o) for (k...) body, the loops of k the innermost Reduce loops
+ *   and o Spatial of constant Dom, becomes
+ *     for (o_outer) for (k...) { body(o_outer * jam + 0); ...; body(o_outer * jam + jam - 1) }
+ *   and a loop of o over the rest; the copies are independent sums for
+ *   Accumulator to keep in locals
+ * - iterations of o must be independent, see parallel_legal, and the
+ *   loops of k must not depend on o
+ */
+class UnrollAndJam : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  explicit UnrollAndJam(const UnrollOptions &options) : options_(options) {}
+
+  Stmt visit(Ref<const LoopNest>) override;
+
+ private:
+  UnrollOptions options_;
+};
+
+
+// full unrolling, then unroll and jam
+Stmt unroll(const Stmt &stmt, const UnrollOptions &options = UnrollOptions());
+
+Group unroll(const Group &group, const UnrollOptions &options = UnrollOptions());
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_UNROLL_H
@@ -165,6 +165,130 @@ class ExprEqualByValue : public ExprFunctor<bool(const Expr&, const Expr&)> {
     return (visit_expr(op->begin, other_op->begin)
           && visit_expr(op->extent, other_op->extent));
   }
+
+  bool visit(Ref<const Let> op, const Expr& other) override {
+    CHECK_TYPE(Let)
+    return (visit_expr(op->var, other_op->var)
+          && visit_expr(op->value, other_op->value)
+          && visit_expr(op->body, other_op->body));
+  }
+};
+
+
+/**
+ * structural hash, consistent with ExprEqualByValue:
+ * exprs equal by value have the same hash
+ */
+class StructuralHash : public ExprFunctor<size_t(const Expr&)> {
+ public:
+  size_t hash(const Expr &expr) {
+    return visit_expr(expr);
+  }
+
+  static size_t combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+  }
+
+ protected:
+  size_t head(const Expr &expr) {
+    size_t ret = std::hash<int>{}((int)expr.node_type());
+    ret = combine(ret, std::hash<int>{}((int)expr.type().code));
+    return combine(ret, std::hash<int>{}((int)expr.type().bits));
+  }
+
+  size_t visit(Ref<const IntImm> op) override {
+    return combine(head(op), std::hash<int64_t>{}(op->value()));
+  }
+
+  size_t visit(Ref<const UIntImm> op) override {
+    return combine(head(op), std::hash<uint64_t>{}(op->value()));
+  }
+
+  size_t visit(Ref<const FloatImm> op) override {
+    return combine(head(op), std::hash<double>{}(op->value()));
+  }
+
+  size_t visit(Ref<const StringImm> op) override {
+    return combine(head(op), std::hash<std::string>{}(op->value()));
+  }
+
+  size_t visit(Ref<const Unary> op) override {
+    return combine(combine(head(op), (size_t)op->op_type), visit_expr(op->a));
+  }
+
+  size_t visit(Ref<const Binary> op) override {
+    size_t ret = combine(head(op), (size_t)op->op_type);
+    return combine(combine(ret, visit_expr(op->a)), visit_expr(op->b));
+  }
+
+  size_t visit(Ref<const Select> op) override {
+    size_t ret = combine(head(op), visit_expr(op->cond));
+    return combine(combine(ret, visit_expr(op->true_value)), visit_expr(op->false_value));
+  }
+
+  size_t visit(Ref<const Compare> op) override {
+    size_t ret = combine(head(op), (size_t)op->op_type);
+    return combine(combine(ret, visit_expr(op->a)), visit_expr(op->b));
+  }
+
+  size_t visit(Ref<const Call> op) override {
+    size_t ret = combine(head(op), std::hash<std::string>{}(op->func_name));
+    for (auto arg : op->args) {
+      ret = combine(ret, visit_expr(arg));
+    }
+    return ret;
+  }
+
+  size_t visit(Ref<const Var> op) override {
+    size_t ret = combine(head(op), std::hash<std::string>{}(op->name));
+    for (auto arg : op->args) {
+      ret = combine(ret, visit_expr(arg));
+    }
+    return ret;
+  }
+
+  size_t visit(Ref<const Cast> op) override {
+    return combine(head(op), visit_expr(op->val));
+  }
+
+  size_t visit(Ref<const Ramp> op) override {
+    size_t ret = combine(head(op), visit_expr(op->base));
+    return combine(combine(ret, op->stride), op->lanes);
+  }
+
+  size_t visit(Ref<const Index> op) override {
+    return combine(head(op), std::hash<std::string>{}(op->name));
+  }
+
+  size_t visit(Ref<const Dom> op) override {
+    return combine(combine(head(op), visit_expr(op->begin)), visit_expr(op->extent));
+  }
+
+  size_t visit(Ref<const Let> op) override {
+    size_t ret = combine(head(op), visit_expr(op->var));
+    return combine(combine(ret, visit_expr(op->value)), visit_expr(op->body));
+  }
+};
+
+
+/**
+ * hash and equality by value, for unordered containers of Expr
+ */
+class ExprHash {
+ public:
+  size_t operator()(const Expr &expr) const {
+    StructuralHash hasher;
+    return hasher.hash(expr);
+  }
+};
+
+
+class ExprEqual {
+ public:
+  bool operator()(const Expr &a, const Expr &b) const {
+    ExprEqualByValue eev;
+    return eev.visit_expr(a, b);
+  }
 };
 
 
@@ -250,6 +374,27 @@ class IndexCollector : public IRVisitor {
 };
 
 
+// integer (or unsigned) constant, booleans excluded
+bool as_const_int(const Expr &expr, int64_t &value);
+
+// index of a Dom with constant begin and extent
+bool constant_dom(const Expr &index, int64_t &begin, int64_t &extent);
+
+// expr uses the index called name
+bool depends_on(const Expr &expr, const std::string &name);
+
+// a and b have structurally equal args
+bool same_element(Ref<const Var> a, Ref<const Var> b);
+
+
+// IR nodes of a tree, shared subtrees counted once per use
+uint64_t count_nodes(const Expr &expr);
+
+uint64_t count_nodes(const Stmt &stmt);
+
+uint64_t count_nodes(const Group &group);
+
+
 template<typename T>
 Expr make_const(Type t, T v) {
   switch (t.code)
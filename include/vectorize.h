@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#ifndef BOOST_VECTORIZE_H
+#define BOOST_VECTORIZE_H
+
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "IR.h"
+#include "IRMutator.h"
+#include "utils.h"
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+/**
+ * vectorize innermost loops
+ * - loops marked Vectorized, and with automatic every innermost loop of
+ *   at least lanes iterations, become a loop over vectors of lanes
+ *   iterations followed by a scalar epilogue of the rest
+ * - an arg of stride 1 in the index becomes a Ramp of stride 1 when it
+ *   is the last arg, loads and stores through it get vector types; values
+ *   invariant in the index stay scalar and are broadcast by Ramps of
+ *   stride 0 where they meet vectors
+ * - dst = dst + e, the only statement, with dst invariant in the index
+ *   is a reduction: dst = dst + vector_reduce_add(e)
+ * - loops stay scalar for gathers, calls or Lets depending on the index,
+ *   guards, or arrays accessed at different elements in one iteration;
+ *   marked ones with a warning
+ */
+class Vectorizer : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  Vectorizer(int lanes, bool automatic) : lanes_(lanes), automatic_(automatic) {}
+
+  Stmt visit(Ref<const LoopNest>) override;
+
+ private:
+  // the vector loop and epilogue of the loop of index, false with the
+  // reason in why if it stays scalar
+  bool vectorize_loop(const Expr &index, const std::vector<Stmt> &body, Stmt &result, std::string &why);
+
+  int lanes_;
+  bool automatic_;
+};
+
+
+Stmt vectorize(const Stmt &stmt, int lanes = 8, bool automatic = true);
+
+Group vectorize(const Group &group, int lanes = 8, bool automatic = true);
+
+}  // namespace Pass
+
+}  // namespace Boost
+
+
+#endif  // BOOST_VECTORIZE_H
@@ -30,6 +30,9 @@ namespace Boost {
 
 namespace Internal {
 
+std::atomic<uint64_t> IRNode::allocations_(0);
+
+
 Expr IntImm::mutate_expr(IRMutator *mutator) const {
     return mutator->visit(Ref<const IntImm>(shared_from_this()));
 }
@@ -100,6 +103,11 @@ Expr Index::mutate_expr(IRMutator *mutator) const {
 }
 
 
+Expr Let::mutate_expr(IRMutator *mutator) const {
+    return mutator->visit(Ref<const Let>(shared_from_this()));
+}
+
+
 Stmt LoopNest::mutate_stmt(IRMutator *mutator) const {
     return mutator->visit(Ref<const LoopNest>(shared_from_this()));
 }
@@ -115,6 +123,11 @@ Stmt Move::mutate_stmt(IRMutator *mutator) const {
 }
 
 
+Stmt LetStmt::mutate_stmt(IRMutator *mutator) const {
+    return mutator->visit(Ref<const LetStmt>(shared_from_this()));
+}
+
+
 Group Kernel::mutate_group(IRMutator *mutator) const {
     return mutator->visit(Ref<const Kernel>(shared_from_this()));
 }
@@ -201,6 +214,11 @@ void Index::visit_node(IRVisitor *visitor) const {
 }
 
 
+void Let::visit_node(IRVisitor *visitor) const {
+    return visitor->visit(Ref<const Let>(shared_from_this()));
+}
+
+
 void LoopNest::visit_node(IRVisitor *visitor) const {
     return visitor->visit(Ref<const LoopNest>(shared_from_this()));
 }
@@ -216,6 +234,11 @@ void Move::visit_node(IRVisitor *visitor) const {
 }
 
 
+void LetStmt::visit_node(IRVisitor *visitor) const {
+    return visitor->visit(Ref<const LetStmt>(shared_from_this()));
+}
+
+
 void Kernel::visit_node(IRVisitor *visitor) const {
     return visitor->visit(Ref<const Kernel>(shared_from_this()));
 }
@@ -135,6 +135,14 @@ Expr IRMutator::visit(Ref<const Index> op) {
 }
 
 
+Expr IRMutator::visit(Ref<const Let> op) {
+    Expr new_var = mutate(op->var);
+    Expr new_value = mutate(op->value);
+    Expr new_body = mutate(op->body);
+    return Let::make(op->type(), new_var, new_value, new_body);
+}
+
+
 Stmt IRMutator::visit(Ref<const LoopNest> op) {
     std::vector<Expr> new_index_list;
     std::vector<Stmt> new_body_list;
@@ -151,7 +159,10 @@ Stmt IRMutator::visit(Ref<const LoopNest> op) {
 Stmt IRMutator::visit(Ref<const IfThenElse> op) {
     Expr new_cond = mutate(op->cond);
     Stmt new_true_case = mutate(op->true_case);
-    Stmt new_false_case = mutate(op->false_case);
+    Stmt new_false_case;
+    if ((op->false_case).defined()) {
+        new_false_case = mutate(op->false_case);
+    }
     return IfThenElse::make(new_cond, new_true_case, new_false_case);
 }
 
@@ -163,6 +174,14 @@ Stmt IRMutator::visit(Ref<const Move> op) {
 }
 
 
+Stmt IRMutator::visit(Ref<const LetStmt> op) {
+    Expr new_var = mutate(op->var);
+    Expr new_value = mutate(op->value);
+    Stmt new_body = mutate(op->body);
+    return LetStmt::make(new_var, new_value, new_body);
+}
+
+
 Group IRMutator::visit(Ref<const Kernel> op) {
     std::vector<Expr> new_inputs;
     for (auto expr : op->inputs) {
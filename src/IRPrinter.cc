@@ -182,7 +182,8 @@ void IRPrinter::visit(Ref<const Var> op) {
         }
         oss << ">";
     } 
-    if (print_index) {
+    // scalar vars (e.g. let bindings) have no index
+    if (print_index && !op->args.empty()) {
         oss << "[";
         for (size_t i = 0; i < op->args.size(); ++i) {
             op->args[i].visit_expr(this);
@@ -204,6 +205,17 @@ void IRPrinter::visit(Ref<const Dom> op) {
 }
 
 
+void IRPrinter::visit(Ref<const Let> op) {
+    oss << "let(";
+    (op->var).visit_expr(this);
+    oss << " = ";
+    (op->value).visit_expr(this);
+    oss << ", ";
+    (op->body).visit_expr(this);
+    oss << ")";
+}
+
+
 void IRPrinter::visit(Ref<const Index> op) {
     oss << op->name;
     if (print_range) {
@@ -256,11 +268,13 @@ void IRPrinter::visit(Ref<const IfThenElse> op) {
     enter();
     (op->true_case).visit_stmt(this);
     exit();
-    print_indent();
-    oss << "} else {\n";
-    enter();
-    (op->false_case).visit_stmt(this);
-    exit();
+    if ((op->false_case).defined()) {
+        print_indent();
+        oss << "} else {\n";
+        enter();
+        (op->false_case).visit_stmt(this);
+        exit();
+    }
     print_indent();
     oss << "}\n";
 }
@@ -297,6 +311,17 @@ void IRPrinter::visit(Ref<const Move> op) {
 }
 
 
+void IRPrinter::visit(Ref<const LetStmt> op) {
+    print_indent();
+    oss << "let ";
+    (op->var).visit_expr(this);
+    oss << " = ";
+    (op->value).visit_expr(this);
+    oss << "\n";
+    (op->body).visit_stmt(this);
+}
+
+
 void IRPrinter::visit(Ref<const Kernel> op) {
     print_indent();
     if (op->kernel_type == KernelType::CPU) {
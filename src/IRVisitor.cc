@@ -118,6 +118,14 @@ void IRVisitor::visit(Ref<const Index> op) {
 }
 
 
+void IRVisitor::visit(Ref<const Let> op) {
+    (op->var).visit_expr(this);
+    (op->value).visit_expr(this);
+    (op->body).visit_expr(this);
+    return;
+}
+
+
 void IRVisitor::visit(Ref<const LoopNest> op) {
     for (auto index : op->index_list) {
         index.visit_expr(this);
@@ -132,7 +140,9 @@ void IRVisitor::visit(Ref<const LoopNest> op) {
 void IRVisitor::visit(Ref<const IfThenElse> op) {
     (op->cond).visit_expr(this);
     (op->true_case).visit_stmt(this);
-    (op->false_case).visit_stmt(this);
+    if ((op->false_case).defined()) {
+        (op->false_case).visit_stmt(this);
+    }
     return;
 }
 
@@ -144,6 +154,14 @@ void IRVisitor::visit(Ref<const Move> op) {
 }
 
 
+void IRVisitor::visit(Ref<const LetStmt> op) {
+    (op->var).visit_expr(this);
+    (op->value).visit_expr(this);
+    (op->body).visit_stmt(this);
+    return;
+}
+
+
 void IRVisitor::visit(Ref<const Kernel> op) {
     for (auto expr : op->inputs) {
         expr.visit_expr(this);
@@ -0,0 +1,284 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+
+#include "debug.h"
+#include "utils.h"
+#include "arith.h"
+#include "cse.h"
+#include "accumulate.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+/**
+ * indices, scalar vars and loaded arrays of an expression
+ */
+class Operands : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const Index> op) override {
+    indices.push_back(op->name);
+  }
+
+  void visit(Ref<const Var> op) override {
+    if (op->args.empty()) {
+      vars.push_back(op->name);
+    } else {
+      loads.push_back(op->name);
+    }
+    IRVisitor::visit(op);
+  }
+
+  bool has(const std::vector<std::string> &names, const std::string &name) const {
+    return std::find(names.begin(), names.end(), name) != names.end();
+  }
+
+  std::vector<std::string> indices;
+  std::vector<std::string> vars;
+  std::vector<std::string> loads;
+};
+
+}  // anonymous namespace
+
+
+Stmt Accumulator::accumulate(const std::vector<Expr> &reduce, const std::vector<Stmt> &body) {
+  std::vector<std::pair<Expr, Expr>> lets;
+  std::vector<Stmt> stmts = body;
+  if (stmts.size() == 1) {
+    for (Ref<const LetStmt> let = stmts[0].as<LetStmt>(); let.defined(); let = stmts[0].as<LetStmt>()) {
+      lets.push_back(std::make_pair(let->var, let->value));
+      stmts[0] = let->body;
+    }
+  }
+  // the reductions, e.g. several output points after unroll and jam
+  std::vector<Sum> sums;
+  Utils::ExprEqual equal;
+  Operands reads;
+  for (auto &stmt : stmts) {
+    Ref<const Move> move = stmt.as<Move>();
+    if (!move.defined()) {
+      return Stmt();
+    }
+    Ref<const Var> dst = move->dst.as<Var>();
+    Ref<const Binary> add = move->src.as<Binary>();
+    if (!dst.defined() || dst->args.empty() || !dst->type().is_scalar()
+        || !add.defined() || add->op_type != BinaryOpType::Add) {
+      return Stmt();
+    }
+    Sum sum;
+    sum.move = move;
+    if (equal(add->a, move->dst)) {
+      sum.value = add->b;
+    } else if (equal(add->b, move->dst)) {
+      sum.value = add->a;
+    } else {
+      return Stmt();
+    }
+    // dst is one element over the reduce loops, bound outside the lets
+    Operands at;
+    move->dst.visit_expr(&at);
+    for (auto &index : reduce) {
+      if (at.has(at.indices, index.as<Index>()->name)) {
+        return Stmt();
+      }
+    }
+    for (auto &let : lets) {
+      if (at.has(at.vars, let.first.as<Var>()->name)) {
+        return Stmt();
+      }
+    }
+    for (auto &other : sums) {
+      if (equal(other.move->dst, move->dst)) {
+        return Stmt();
+      }
+    }
+    sum.value.visit_expr(&reads);
+    sums.push_back(sum);
+  }
+  for (auto &let : lets) {
+    let.second.visit_expr(&reads);
+  }
+  // the sums don't read the elements they write
+  for (auto &sum : sums) {
+    if (reads.has(reads.loads, sum.move->dst.as<Var>()->name)) {
+      return Stmt();
+    }
+  }
+
+  Ref<const Index> last = reduce.back().as<Index>();
+  Ref<const Dom> dom = last->dom.as<Dom>();
+  CHECK(dom.defined(), "Expect Dom");
+  int64_t begin = 0, extent = 0;
+  int count = 1;
+  // copies of the lets would be declared twice in one scope
+  if (accumulators_ > 1 && lets.empty()
+      && Utils::as_const_int(dom->begin, begin) && Utils::as_const_int(dom->extent, extent)) {
+    count = (int)std::max<int64_t>(1, std::min<int64_t>(accumulators_, extent));
+  }
+
+  std::vector<Stmt> result;
+  for (auto &sum : sums) {
+    // a vector term sums into a vector, reduced once at the end
+    Ref<const Call> call = sum.value.as<Call>();
+    sum.vector = call.defined() && call->func_name == "vector_reduce_add";
+    if (sum.vector) {
+      sum.value = call->args[0];
+    }
+    Type type = sum.value.type();
+    Expr zero = Utils::make_const(type.with_lanes(1), 0);
+    if (sum.vector) {
+      zero = Ramp::make(type, zero, 0, type.lanes());
+    }
+    std::string name = sum.move->dst.as<Var>()->name + "_acc" + std::to_string(count_++);
+    for (int u = 0; u < count; ++u) {
+      sum.accs.push_back(Var::make(type, count == 1 ? name : name + "_" + std::to_string(u), {}, {}));
+      result.push_back(Move::make(sum.accs[u], u == 0 && !sum.vector ? sum.move->dst : zero, MoveType::MemToLocal));
+    }
+  }
+  auto sum_into = [&](const Expr &acc, const Expr &v) {
+    return Move::make(acc, Binary::make(acc.type(), BinaryOpType::Add, acc, v), MoveType::LocalToLocal);
+  };
+
+  std::vector<Expr> outer(reduce.begin(), reduce.end() - 1);
+  if (count == 1) {
+    std::vector<Stmt> loop_body;
+    for (auto &sum : sums) {
+      loop_body.push_back(sum_into(sum.accs[0], sum.value));
+    }
+    if (!lets.empty()) {
+      loop_body = {wrap_lets(lets, loop_body[0])};
+    }
+    result.push_back(LoopNest::make(reduce, loop_body));
+  } else {
+    // iteration outer * count + u goes to accumulator u, the rest to the first
+    Type index_type = last->type();
+    int64_t n = extent / count;
+    Expr unrolled = Index::make(index_type, last->name + "_outer",
+      Dom::make(index_type, Utils::make_const(index_type, 0), Utils::make_const(index_type, n)), IndexType::Reduce);
+    std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+    // one key, so each copy reads its own iteration
+    std::shared_ptr<const Index> key = Index::make(index_type, last->name, Expr(), IndexType::Unknown).as<Index>();
+    std::vector<Stmt> chains, rest;
+    for (int u = 0; u < count; ++u) {
+      vmap[key] = Arith::add(Arith::mul(unrolled, Utils::make_const(index_type, count)), Utils::make_const(index_type, begin + u));
+      for (auto &sum : sums) {
+        chains.push_back(sum_into(sum.accs[u], Utils::substitute_index_by_name(sum.value, vmap)));
+      }
+    }
+    for (auto &sum : sums) {
+      rest.push_back(sum_into(sum.accs[0], sum.value));
+    }
+    std::vector<Stmt> loops = {LoopNest::make({unrolled}, chains)};
+    if (extent % count != 0) {
+      Expr index = Index::make(index_type, last->name, Dom::make(index_type,
+        Utils::make_const(index_type, begin + n * count), Utils::make_const(index_type, extent - n * count)),
+        IndexType::Reduce);
+      loops.push_back(LoopNest::make({index}, rest));
+    }
+    result.push_back(LoopNest::make(outer, loops));
+  }
+
+  for (auto &sum : sums) {
+    // pairwise, for the same chains as the accumulators
+    std::vector<Expr> accs = sum.accs;
+    while (accs.size() > 1) {
+      std::vector<Expr> next;
+      for (size_t k = 0; k < accs.size(); k += 2) {
+        next.push_back(k + 1 < accs.size() ? Binary::make(accs[k].type(), BinaryOpType::Add, accs[k], accs[k + 1])
+                                           : accs[k]);
+      }
+      accs = next;
+    }
+    Expr value = accs[0];
+    Expr dst = sum.move->dst;
+    if (sum.vector) {
+      value = Binary::make(dst.type(), BinaryOpType::Add, dst,
+        Call::make(dst.type(), {value}, "vector_reduce_add", CallType::Pure));
+    }
+    result.push_back(Move::make(dst, value, MoveType::LocalToMem));
+  }
+  return LoopNest::make({}, result);
+}
+
+
+Stmt Accumulator::visit(Ref<const LoopNest> op) {
+  if (op->index_list.empty()) {
+    return IRMutator::visit(op);
+  }
+  // the perfectly nested loops down to their body
+  std::vector<Expr> indices = op->index_list;
+  std::vector<Stmt> body = op->body_list;
+  while (body.size() == 1) {
+    Ref<const LoopNest> inner = body[0].as<LoopNest>();
+    if (!inner.defined() || inner->index_list.empty()) {
+      break;
+    }
+    indices.insert(indices.end(), inner->index_list.begin(), inner->index_list.end());
+    body = inner->body_list;
+  }
+  size_t k = indices.size();
+  while (k > 0 && indices[k - 1].as<Index>()->index_type == IndexType::Reduce) {
+    --k;
+  }
+  Stmt result;
+  if (k < indices.size()) {
+    result = accumulate(std::vector<Expr>(indices.begin() + k, indices.end()), body);
+  }
+  if (!result.defined()) {
+    return IRMutator::visit(op);
+  }
+  if (k == 0) {
+    return result;
+  }
+  return LoopNest::make(std::vector<Expr>(indices.begin(), indices.begin() + k), {result});
+}
+
+
+Stmt accumulate(const Stmt &stmt, int accumulators) {
+  Accumulator accumulator(accumulators);
+  return accumulator.mutate(stmt);
+}
+
+
+Group accumulate(const Group &group, int accumulators) {
+  Accumulator accumulator(accumulators);
+  return accumulator.mutate(group);
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
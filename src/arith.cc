@@ -22,112 +22,208 @@
  * SOFTWARE.
 */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
 
 #include "debug.h"
 #include "type.h"
 #include "arith.h"
+#include "utils.h"
 
 namespace Boost {
 
 namespace  Arith {
   
-template<typename T>
-void Matrix<T>::swap_row(int i, int j) {
-  ASSERT(i < height_) << "index out of height range: " << i << " vs. " << height_ << "\n";
-  ASSERT(j < height_) << "index out of height range: " << j << " vs. " << height_ << "\n";
+template<typename T, int InlineCapacity>
+Matrix<T, InlineCapacity> &Matrix<T, InlineCapacity>::operator=(const Matrix &other) {
+  if (this == &other) {
+    return *this;
+  }
+  resize(other.height_, other.width_);
+  for (int i = 0; i < height_; ++i) {
+    const T *src = other[i];
+    T *dst = (*this)[i];
+    for (int l = 0; l < width_; ++l) {
+      dst[l] = src[l];
+    }
+  }
+  return *this;
+}
+
+
+template<typename T, int InlineCapacity>
+Matrix<T, InlineCapacity> &Matrix<T, InlineCapacity>::operator=(Matrix &&other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (other.heap_ == nullptr) {
+    // inline, nothing to steal
+    *this = other;
+  } else {
+    delete []heap_;
+    heap_ = other.heap_;
+    ptr_ = other.ptr_;
+    capacity_ = other.capacity_;
+    height_ = other.height_;
+    width_ = other.width_;
+    stride_ = other.stride_;
+    other.heap_ = nullptr;
+    other.ptr_ = other.inline_;
+    other.capacity_ = InlineCapacity;
+  }
+  other.height_ = 0;
+  other.width_ = 0;
+  other.stride_ = 0;
+  return *this;
+}
+
+
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::resize(int height, int width) {
+  MATRIX_ASSERT(height >= 0 && width >= 0) << "negative matrix shape: (" << height << "x" << width << ")\n";
+  int stride = (width + lanes - 1) / lanes * lanes;
+  size_t size = (size_t)height * stride;
+  if (size > capacity_) {
+    delete []heap_;
+    // over-allocate to round the start up to row_align
+    heap_ = new T[size + lanes];
+    uintptr_t addr = reinterpret_cast<uintptr_t>(heap_);
+    addr = (addr + row_align - 1) / row_align * row_align;
+    ptr_ = reinterpret_cast<T*>(addr);
+    capacity_ = size;
+  }
+  height_ = height;
+  width_ = width;
+  stride_ = stride;
+  for (size_t l = 0; l < size; ++l) {
+    ptr_[l] = 0;
+  }
+}
+
+
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::swap_row(int i, int j) {
+  MATRIX_ASSERT(i < height_) << "index out of height range: " << i << " vs. " << height_ << "\n";
+  MATRIX_ASSERT(j < height_) << "index out of height range: " << j << " vs. " << height_ << "\n";
   if (i == j) {
     return;
   }
-  for (int l = 0; l < width_; ++l) {
-    std::swap(*(ptr + i * width_ + l), *(ptr + j * width_ + l));
+  T *ri = (*this)[i];
+  T *rj = (*this)[j];
+  for (int l = 0; l < stride_; l += lanes) {
+    for (int v = 0; v < lanes; ++v) {
+      std::swap(ri[l + v], rj[l + v]);
+    }
   }
 }
 
 
-template <typename T>
-void Matrix<T>::swap_col(int i, int j) {
-  ASSERT(i < width_) << "index out of width range: " << i << " vs. " << width_ << "\n";
-  ASSERT(j < width_) << "index out of width range: " << j << " vs. " << width_ << "\n";
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::swap_col(int i, int j) {
+  MATRIX_ASSERT(i < width_) << "index out of width range: " << i << " vs. " << width_ << "\n";
+  MATRIX_ASSERT(j < width_) << "index out of width range: " << j << " vs. " << width_ << "\n";
   if (i == j) {
     return;
   }
   for (int l = 0; l < height_; ++l) {
-    std::swap(*(ptr + l * width_ + i), *(ptr + l * width_ + j));
+    T *row = (*this)[l];
+    std::swap(row[i], row[j]);
   }
 }
 
 
-template <typename T>
-void Matrix<T>::scale_row(int i, T factor) {
-  ASSERT(i < height_) << "index out of height range: " << i << " vs. " << height_ << "\n";
-  for (int l = 0; l < width_; ++l) {
-    *(ptr + i * width_ + l) = *(ptr + i * width_ + l) * factor;
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::scale_row(int i, T factor) {
+  MATRIX_ASSERT(i < height_) << "index out of height range: " << i << " vs. " << height_ << "\n";
+  T *ri = (*this)[i];
+  for (int l = 0; l < stride_; l += lanes) {
+    for (int v = 0; v < lanes; ++v) {
+      ri[l + v] *= factor;
+    }
   }
 }
 
 
-template <typename T>
-void Matrix<T>::scale_col(int j, T factor) {
-  ASSERT(j < width_) << "index out of height range: " << j << " vs. " << width_ << "\n";
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::scale_col(int j, T factor) {
+  MATRIX_ASSERT(j < width_) << "index out of width range: " << j << " vs. " << width_ << "\n";
   for (int l = 0; l < height_; ++l) {
-    *(ptr + l * width_ + j) = *(ptr + l * width_ + j) * factor;
+    (*this)[l][j] *= factor;
   }
 }
 
 
-template <typename T>
-void Matrix<T>::add_row(int i, int j, T factor) {
-  ASSERT(i < height_) << "index out of height range: " << i << " vs. " << height_ << "\n";
-  ASSERT(j < height_) << "index out of height range: " << j << " vs. " << height_ << "\n";
-  for (int l = 0; l < width_; ++l) {
-    *(ptr + j * width_ + l) = *(ptr + i * width_ + l) * factor + *(ptr + j * width_ + l);
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::add_row(int i, int j, T factor) {
+  MATRIX_ASSERT(i < height_) << "index out of height range: " << i << " vs. " << height_ << "\n";
+  MATRIX_ASSERT(j < height_) << "index out of height range: " << j << " vs. " << height_ << "\n";
+  if (i == j) {
+    scale_row(i, factor + 1);
+    return;
+  }
+  // distinct rows never overlap, padding stays zero
+  const T * __restrict__ ri = (*this)[i];
+  T * __restrict__ rj = (*this)[j];
+  for (int l = 0; l < stride_; l += lanes) {
+    for (int v = 0; v < lanes; ++v) {
+      rj[l + v] += ri[l + v] * factor;
+    }
   }
 }
 
 
-template <typename T>
-void Matrix<T>::add_col(int i, int j, T factor) {
-  ASSERT(i < width_) << "index out of width range: " << i << " vs. " << width_ << "\n";
-  ASSERT(j < width_) << "index out of width range: " << j << " vs. " << width_ << "\n";
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::add_col(int i, int j, T factor) {
+  MATRIX_ASSERT(i < width_) << "index out of width range: " << i << " vs. " << width_ << "\n";
+  MATRIX_ASSERT(j < width_) << "index out of width range: " << j << " vs. " << width_ << "\n";
   for (int l = 0; l < height_; ++l) {
-    *(ptr + l * width_ + j) =  *(ptr + l * width_ + i) * factor + *(ptr + l * width_ + j);
+    T *row = (*this)[l];
+    row[j] += row[i] * factor;
   }
 }
 
 
-template <typename T>
-void Matrix<T>::row_transform(int i, int j, T s, T t, T g, T h) {
-  ASSERT(i < height_) << "index out of height range: " << i << " vs. " << height_ << "\n";
-  ASSERT(j < height_) << "index out of height range: " << j << " vs. " << height_ << "\n";
-  std::vector<T> row_i(width_), row_j(width_);
-  for (int l = 0; l < width_; ++l) {
-    row_i[l] = (*(ptr + i * width_ + l)) * s + (*(ptr + j * width_ + l)) * t;
-    row_j[l] = (*(ptr + i * width_ + l)) * g + (*(ptr + j * width_ + l)) * h;
-  }
-  for (int l = 0; l < width_; ++l) {
-    *(ptr + i * width_ + l) = row_i[l];
-    *(ptr + j * width_ + l) = row_j[l];
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::row_transform(int i, int j, T s, T t, T g, T h) {
+  MATRIX_ASSERT(i < height_ && j < height_ && i != j) << "bad rows for row_transform: " << i << ", " << j
+                                               << " vs. " << height_ << "\n";
+  T * __restrict__ ri = (*this)[i];
+  T * __restrict__ rj = (*this)[j];
+  for (int l = 0; l < stride_; l += lanes) {
+    for (int v = 0; v < lanes; ++v) {
+      T x = ri[l + v];
+      T y = rj[l + v];
+      ri[l + v] = x * s + y * t;
+      rj[l + v] = x * g + y * h;
+    }
   }
 }
 
 
-template<typename T>
-void Matrix<T>::col_transform(int i, int j, T s, T t, T g, T h) {
-  ASSERT(i < width_) << "index out of width range: " << i << " vs. " << width_ << "\n";
-  ASSERT(j < width_) << "index out of width range: " << j << " vs. " << width_ << "\n";
-  std::vector<T> col_i(height_), col_j(height_);
-  for (int l = 0; l < height_; ++l) {
-    col_i[l] = (*(ptr + l * width_ + i)) * s + (*(ptr + l * width_ + j)) * t;
-    col_j[l] = (*(ptr + l * width_ + i)) * g + (*(ptr + l * width_ + j)) * h;
-  }
+template<typename T, int InlineCapacity>
+void Matrix<T, InlineCapacity>::col_transform(int i, int j, T s, T t, T g, T h) {
+  MATRIX_ASSERT(i < width_ && j < width_ && i != j) << "bad cols for col_transform: " << i << ", " << j
+                                             << " vs. " << width_ << "\n";
   for (int l = 0; l < height_; ++l) {
-    *(ptr + l * width_ + i) = col_i[l];
-    *(ptr + l * width_ + j) = col_j[l];
+    T *row = (*this)[l];
+    T x = row[i];
+    T y = row[j];
+    row[i] = x * s + y * t;
+    row[j] = x * g + y * h;
   }
 }
 
 
+template class Matrix<int>;
+template class Matrix<int64_t>;
+template class Matrix<int64_t, 16 * 16>;
+
+
 int ext_euclidean(int a, int b, int &x, int &y) {
   int r0 = a;
   int r1 = b;
@@ -158,140 +254,397 @@ bool divisible(int a, int b) {
 }
 
 
-int smith_normalize(Matrix<int> &trans, Matrix<int> &U, Matrix<int> &V) {
+
+namespace {
+
+void report_overflow(const char *where) {
+  LOG(ERROR) << "Integer overflow in " << where << ".";
+  throw std::overflow_error(std::string("integer overflow in ") + where);
+}
+
+
+inline int64_t checked_add(int64_t a, int64_t b) {
+  int64_t ret;
+#if defined(__GNUC__) || defined(__clang__)
+  if (__builtin_add_overflow(a, b, &ret)) {
+    report_overflow("add");
+  }
+#else
+  if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+    report_overflow("add");
+  }
+  ret = a + b;
+#endif
+  return ret;
+}
+
+
+inline int64_t checked_sub(int64_t a, int64_t b) {
+  int64_t ret;
+#if defined(__GNUC__) || defined(__clang__)
+  if (__builtin_sub_overflow(a, b, &ret)) {
+    report_overflow("sub");
+  }
+#else
+  if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) {
+    report_overflow("sub");
+  }
+  ret = a - b;
+#endif
+  return ret;
+}
+
+
+inline int64_t checked_mul(int64_t a, int64_t b) {
+  int64_t ret;
+#if defined(__GNUC__) || defined(__clang__)
+  if (__builtin_mul_overflow(a, b, &ret)) {
+    report_overflow("mul");
+  }
+#else
+  uint64_t ua = a < 0 ? 0 - (uint64_t)a : (uint64_t)a;
+  uint64_t ub = b < 0 ? 0 - (uint64_t)b : (uint64_t)b;
+  bool negative = (a < 0) != (b < 0);
+  uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+  if (ua != 0 && ub > limit / ua) {
+    report_overflow("mul");
+  }
+  ret = negative ? (int64_t)(0 - ua * ub) : (int64_t)(ua * ub);
+#endif
+  return ret;
+}
+
+
+// p | x, p != 0
+inline bool divides(int64_t p, int64_t x) {
+  return p == 1 || p == -1 || x % p == 0;
+}
+
+
+inline int64_t floor_div(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  if ((a % b != 0) && ((a < 0) != (b < 0))) {
+    q -= 1;
+  }
+  return q;
+}
+
+
+/**
+ * the non-zero value of least magnitude in trans[row_begin:row_end, col_begin:col_end]
+ */
+bool smallest_nonzero(const SmallMatrix &trans, int row_begin, int col_begin,
+                      int row_end, int col_end, int &pi, int &pj) {
+  uint64_t best = 0;
+  for (int i = row_begin; i < row_end; ++i) {
+    for (int j = col_begin; j < col_end; ++j) {
+      int64_t v = trans[i][j];
+      uint64_t mag = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+      if (mag != 0 && (best == 0 || mag < best)) {
+        best = mag;
+        pi = i;
+        pj = j;
+      }
+    }
+  }
+  return best != 0;
+}
+
+
+/**
+ * at most one non-zero in every row and column
+ */
+bool is_monomial(const SmallMatrix &trans) {
   int height = trans.height();
   int width = trans.width();
- ASSERT(U.height() == height && U.width() == height) << "U matrix wrong shape: ("
-        << U.height() << "x" << U.width() << ")\nExpected: (" << height << "x" << height << ")\n";
- ASSERT(V.height() == width && V.width() == width) << "V matrix wrong shape: ("
-        << V.height() << "x" << V.width() << ")\nExpected: (" << width << "x" << width << ")\n";
-  // initialize U and V
+  bool col_used[SmallMatrix::max_dim] = {false};
   for (int i = 0; i < height; ++i) {
-    for (int j = 0; j < height; ++j) {
-      if (i == j) {
-        U[i][j] = 1;
-      } else {
-        U[i][j] = 0;
+    bool row_used = false;
+    for (int j = 0; j < width; ++j) {
+      if (trans[i][j] != 0) {
+        if (row_used || col_used[j]) {
+          return false;
+        }
+        row_used = true;
+        col_used[j] = true;
       }
     }
   }
-  for (int i = 0; i < width; ++i) {
+  return true;
+}
+
+
+/**
+ * move the non-zeros of a monomial matrix to the diagonal, in the order
+ * the general elimination would pick them, return the number of pivots
+ */
+int place_monomial_pivots(SmallMatrix &trans, SmallMatrix &U, SmallMatrix &V) {
+  int height = trans.height();
+  int width = trans.width();
+  int nz_col[SmallMatrix::max_dim];
+  int nz_row[SmallMatrix::max_dim];
+  for (int i = 0; i < height; ++i) {
+    nz_col[i] = -1;
+  }
+  for (int j = 0; j < width; ++j) {
+    nz_row[j] = -1;
+  }
+  for (int i = 0; i < height; ++i) {
     for (int j = 0; j < width; ++j) {
-      if (i == j) {
-        V[i][j] = 1;
-      } else {
-        V[i][j] = 0;
+      if (trans[i][j] != 0) {
+        nz_col[i] = j;
+        nz_row[j] = i;
       }
     }
   }
-
-  // initialize alpha
   int a = 0;
-  // initialize dimension
-  int dim = 0;
-  // helper functions
-  std::function<bool(int &, int &)> has_next;
-  has_next = [&a, &height, &width, &trans](int &i, int &j) {
-    for (i = a; i < height; ++i) {
-      for (j = a; j < width; ++j) {
-        if (trans[i][j] != 0) {
-          return true;
-        }
-      }
+  int i = 0;
+  while (a < height && a < width) {
+    // the first row below a with a non-zero, which lies right to column a
+    for (i = a; i < height && nz_col[i] < 0; ++i) {}
+    if (i == height) {
+      break;
     }
-    return false;
-  };
-
-  std::function<bool(int &)> col_non_div;
-  col_non_div = [&a, &height, &trans](int &i) {
-    for (i = a + 1; i < height; ++i) {
-      if (!divisible(trans[a][a], trans[i][a])) {
-        return true;
-      }
+    int j = nz_col[i];
+    trans.swap_row(a, i);
+    U.swap_row(a, i);
+    std::swap(nz_col[a], nz_col[i]);
+    if (nz_col[a] >= 0) {
+      nz_row[nz_col[a]] = a;
     }
-    return false;
-  };
-
-  std::function<bool(int &)> col_non_zero;
-  col_non_zero = [&a, &height, &trans](int &i) {
-    for (i = a + 1; i < height; ++i) {
-      if (trans[i][a] != 0) {
-        return true;
-      }
+    if (nz_col[i] >= 0) {
+      nz_row[nz_col[i]] = i;
     }
-    return false;
-  };
+    trans.swap_col(a, j);
+    V.swap_col(a, j);
+    std::swap(nz_row[a], nz_row[j]);
+    if (nz_row[a] >= 0) {
+      nz_col[nz_row[a]] = a;
+    }
+    if (nz_row[j] >= 0) {
+      nz_col[nz_row[j]] = j;
+    }
+    a = a + 1;
+  }
+  return a;
+}
 
-  std::function<bool(int &)> row_non_div;
-  row_non_div = [&a, &width, &trans](int &j) {
-    for (j = a + 1; j < width; ++j) {
-      if (!divisible(trans[a][a], trans[a][j])) {
-        return true;
+
+/**
+ * row-style hermite normal form: trans = U * trans is echelon, pivots are
+ * positive and the entries above a pivot are reduced modulo the pivot
+ */
+void hermite_normalize(SmallMatrix &trans, SmallMatrix &U) {
+  int height = trans.height();
+  int width = trans.width();
+  int r = 0;
+  for (int c = 0; c < width && r < height; ++c) {
+    // euclid on the rows: the smallest value of col c becomes the pivot
+    // and reduces the others, until one non-zero is left
+    int pi = -1;
+    int pj = -1;
+    while (smallest_nonzero(trans, r, c, height, c + 1, pi, pj)) {
+      trans.swap_row(r, pi);
+      U.swap_row(r, pi);
+      bool cleared = true;
+      for (int i = r + 1; i < height; ++i) {
+        int64_t q = trans[i][c] / trans[r][c];
+        if (q != 0) {
+          trans.add_row(r, i, checked_sub(0, q));
+          U.add_row(r, i, checked_sub(0, q));
+        }
+        cleared = cleared && trans[i][c] == 0;
+      }
+      if (cleared) {
+        break;
       }
     }
-    return false;
-  };
-
-  std::function<bool(int &)> row_non_zero;
-  row_non_zero = [&a, &width, &trans](int &j) {
-    for (j = a + 1; j < width; ++j) {
-      if (trans[a][j] != 0) {
-        return true;
+    if (pi < 0) {
+      continue;
+    }
+    if (trans[r][c] < 0) {
+      trans.negate_row(r);
+      U.negate_row(r);
+    }
+    for (int i = 0; i < r; ++i) {
+      int64_t q = floor_div(trans[i][c], trans[r][c]);
+      if (q != 0) {
+        trans.add_row(r, i, checked_sub(0, q));
+        U.add_row(r, i, checked_sub(0, q));
       }
     }
-    return false;
-  };
+    r = r + 1;
+  }
+}
+
+
+void check_small_shape(int height, int width) {
+  if (height < 0 || width < 0 || height > SmallMatrix::max_dim || width > SmallMatrix::max_dim) {
+    LOG(ERROR) << "SmallMatrix shape (" << height << "x" << width << ") exceeds "
+               << SmallMatrix::max_dim << "x" << SmallMatrix::max_dim << ".";
+    throw std::length_error("SmallMatrix shape out of range");
+  }
+}
+
+}  // anonymous namespace
+
+
+SmallMatrix::SmallMatrix(int height, int width) {
+  check_small_shape(height, width);
+  resize(height, width);
+}
+
+
+void SmallMatrix::set_identity(int dim) {
+  check_small_shape(dim, dim);
+  resize(dim, dim);
+  for (int i = 0; i < dim; ++i) {
+    (*this)[i][i] = 1;
+  }
+}
+
+
+void SmallMatrix::negate_row(int i) {
+  int64_t *ri = (*this)[i];
+  for (int l = 0; l < width(); ++l) {
+    ri[l] = checked_sub(0, ri[l]);
+  }
+}
+
+
+void SmallMatrix::negate_col(int j) {
+  for (int l = 0; l < height(); ++l) {
+    (*this)[l][j] = checked_sub(0, (*this)[l][j]);
+  }
+}
+
+
+void SmallMatrix::add_row(int i, int j, int64_t factor) {
+  int64_t *ri = (*this)[i];
+  int64_t *rj = (*this)[j];
+  for (int l = 0; l < width(); ++l) {
+    rj[l] = checked_add(rj[l], checked_mul(ri[l], factor));
+  }
+}
+
+
+void SmallMatrix::add_col(int i, int j, int64_t factor) {
+  for (int l = 0; l < height(); ++l) {
+    int64_t *row = (*this)[l];
+    row[j] = checked_add(row[j], checked_mul(row[i], factor));
+  }
+}
+
+
+void SmallMatrix::row_transform(int i, int j, int64_t s, int64_t t, int64_t g, int64_t h) {
+  int64_t *ri = (*this)[i];
+  int64_t *rj = (*this)[j];
+  for (int l = 0; l < width(); ++l) {
+    int64_t x = ri[l];
+    int64_t y = rj[l];
+    ri[l] = checked_add(checked_mul(x, s), checked_mul(y, t));
+    rj[l] = checked_add(checked_mul(x, g), checked_mul(y, h));
+  }
+}
+
+
+void SmallMatrix::col_transform(int i, int j, int64_t s, int64_t t, int64_t g, int64_t h) {
+  for (int l = 0; l < height(); ++l) {
+    int64_t *row = (*this)[l];
+    int64_t x = row[i];
+    int64_t y = row[j];
+    row[i] = checked_add(checked_mul(x, s), checked_mul(y, t));
+    row[j] = checked_add(checked_mul(x, g), checked_mul(y, h));
+  }
+}
+
+
+int64_t ext_euclidean(int64_t a, int64_t b, int64_t &x, int64_t &y) {
+  int64_t r0 = a;
+  int64_t r1 = b;
+  int64_t s0 = 1;
+  int64_t s1 = 0;
+  int64_t t0 = 0;
+  int64_t t1 = 1;
+  while (r1 != 0) {
+    int64_t q = (r1 == -1) ? checked_sub(0, r0) : r0 / r1;
+    int64_t r = checked_sub(r0, checked_mul(q, r1));
+    int64_t s = checked_sub(s0, checked_mul(q, s1));
+    int64_t t = checked_sub(t0, checked_mul(q, t1));
+    r0 = r1;
+    r1 = r;
+    s0 = s1;
+    s1 = s;
+    t0 = t1;
+    t1 = t;
+  }
+  x = s0;
+  y = t0;
+  return r0;
+}
+
+
+int smith_normalize(SmallMatrix &trans, SmallMatrix &U, SmallMatrix &V) {
+  int height = trans.height();
+  int width = trans.width();
+  U.set_identity(height);
+  V.set_identity(width);
+
+  // initialize alpha
+  int a = 0;
+  // initialize dimension
+  int dim = 0;
+  if (is_monomial(trans)) {
+    a = place_monomial_pivots(trans, U, V);
+  } else {
+    hermite_normalize(trans, U);
+  }
+
   // outer most iteration
   bool stop = false;
   while (!stop) {
     stop = true;
-    // index to non-zero value
-    int pi, pj;
-    // inner iteration
-    while (has_next(pi, pj)) {
+    while (true) {
+      // pivot on the smallest non-zero value
+      int pi = -1;
+      int pj = -1;
+      if (!smallest_nonzero(trans, a, a, height, width, pi, pj)) {
+        break;
+      }
       trans.swap_row(a, pi);
       U.swap_row(a, pi);
       trans.swap_col(a, pj);
       V.swap_col(a, pj);
 
+      // clear row a and col a by division with remainder, a non-zero
+      // remainder is smaller than the pivot and becomes the next pivot
       bool changed = true;
-      // clear row a and col a
       while (changed) {
         changed = false;
-        int ppi, ppj;
-        while (col_non_div(ppi)) {
-          changed = true;
-          // col a, row ppi, non-divisible
-          int s, t;
-          int z = ext_euclidean(trans[a][a], trans[ppi][a], s, t);
-          int g = -trans[ppi][a] / z;
-          int h = trans[a][a] / z;
-          trans.row_transform(a, ppi, s, t, g, h);
-          U.row_transform(a, ppi, s, t, g, h);
+        for (int i = a + 1; i < height; ++i) {
+          int64_t f = trans[i][a] / trans[a][a];
+          if (f != 0) {
+            trans.add_row(a, i, checked_sub(0, f));
+            U.add_row(a, i, checked_sub(0, f));
+          }
         }
-        while (col_non_zero(ppi)) {
-          changed = true;
-          // col a, row ppi, non-zero
-          int f = trans[ppi][a] / trans[a][a];
-          trans.add_row(a, ppi, -f);
-          U.add_row(a, ppi, -f);
+        for (int j = a + 1; j < width; ++j) {
+          int64_t f = trans[a][j] / trans[a][a];
+          if (f != 0) {
+            trans.add_col(a, j, checked_sub(0, f));
+            V.add_col(a, j, checked_sub(0, f));
+          }
         }
-        while (row_non_div(ppj)) {
+        // remainders left in col a
+        if (smallest_nonzero(trans, a + 1, a, height, a + 1, pi, pj)) {
+          trans.swap_row(a, pi);
+          U.swap_row(a, pi);
           changed = true;
-          // col ppj, row a, non-divisible
-          int s, t;
-          int z = ext_euclidean(trans[a][a], trans[a][ppj], s, t);
-          int g = -trans[a][ppj] / z;
-          int h = trans[a][a] / z;
-          trans.col_transform(a, ppj, s, t, g, h);
-          V.col_transform(a, ppj, s, t, g, h);
-        }
-        while (row_non_zero(ppj)) {
+        } else if (smallest_nonzero(trans, a, a + 1, a + 1, width, pi, pj)) {
+          // remainders left in row a
+          trans.swap_col(a, pj);
+          V.swap_col(a, pj);
           changed = true;
-          // col ppj, row a, non-zero
-          int f = trans[a][ppj] / trans[a][a];
-          trans.add_col(a, ppj, -f);
-          V.add_col(a, ppj, -f);
         }
       }
       // move to next row/col
@@ -302,10 +655,10 @@ int smith_normalize(Matrix<int> &trans, Matrix<int> &U, Matrix<int> &V) {
 
     for (a = 0; a < dim; ++a) {
       if (trans[a][a] < 0) {
-        trans.scale_col(a, -1);
-        V.scale_col(a, -1);
+        trans.negate_col(a);
+        V.negate_col(a);
       }
-      if (a < dim - 1 && !divisible(trans[a][a], trans[a+1][a+1])) {
+      if (a < dim - 1 && !divides(trans[a][a], trans[a + 1][a + 1])) {
         trans.add_col(a + 1, a, 1);
         V.add_col(a + 1, a, 1);
         stop = false;
@@ -318,6 +671,81 @@ int smith_normalize(Matrix<int> &trans, Matrix<int> &U, Matrix<int> &V) {
 }
 
 
+int smith_normalize(Matrix<int> &trans, Matrix<int> &U, Matrix<int> &V) {
+  int height = trans.height();
+  int width = trans.width();
+  ASSERT(U.height() == height && U.width() == height) << "U matrix wrong shape: ("
+         << U.height() << "x" << U.width() << ")\nExpected: (" << height << "x" << height << ")\n";
+  ASSERT(V.height() == width && V.width() == width) << "V matrix wrong shape: ("
+         << V.height() << "x" << V.width() << ")\nExpected: (" << width << "x" << width << ")\n";
+  SmallMatrix small_trans(height, width);
+  SmallMatrix small_U;
+  SmallMatrix small_V;
+  for (int i = 0; i < height; ++i) {
+    for (int j = 0; j < width; ++j) {
+      small_trans[i][j] = trans[i][j];
+    }
+  }
+  int dim = smith_normalize(small_trans, small_U, small_V);
+  auto narrow = [](int64_t value) {
+    if (value > INT32_MAX || value < INT32_MIN) {
+      report_overflow("smith_normalize(Matrix<int>)");
+    }
+    return (int)value;
+  };
+  for (int i = 0; i < height; ++i) {
+    for (int j = 0; j < width; ++j) {
+      trans[i][j] = narrow(small_trans[i][j]);
+    }
+    for (int j = 0; j < height; ++j) {
+      U[i][j] = narrow(small_U[i][j]);
+    }
+  }
+  for (int i = 0; i < width; ++i) {
+    for (int j = 0; j < width; ++j) {
+      V[i][j] = narrow(small_V[i][j]);
+    }
+  }
+  return dim;
+}
+
+
+const SmithNormalForm &SmithCache::get(const SmallMatrix &trans) {
+  int height = trans.height();
+  int width = trans.width();
+  std::string key(sizeof(int) * 2 + sizeof(int64_t) * height * width, '\0');
+  char *p = &key[0];
+  std::memcpy(p, &height, sizeof(int));
+  p += sizeof(int);
+  std::memcpy(p, &width, sizeof(int));
+  p += sizeof(int);
+  for (int i = 0; i < height; ++i) {
+    std::memcpy(p, trans[i], sizeof(int64_t) * width);
+    p += sizeof(int64_t) * width;
+  }
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    hits_ += 1;
+    return it->second;
+  }
+  misses_ += 1;
+  SmallMatrix D = trans;
+  SmithNormalForm result;
+  result.rank = smith_normalize(D, result.U, result.V);
+  for (int i = 0; i < result.rank; ++i) {
+    result.diagonal.push_back(D[i][i]);
+  }
+  return entries_.emplace(key, std::move(result)).first->second;
+}
+
+
+void SmithCache::clear() {
+  entries_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+
 std::vector<Expr> relax_matrix_array_product(Matrix<int> &m, std::vector<Expr> &v) {
   std::vector<Expr> res;
   int rows = m.height();
@@ -327,12 +755,7 @@ std::vector<Expr> relax_matrix_array_product(Matrix<int> &m, std::vector<Expr> &
     Expr tmp = 0;
     for (int j = 0; j < cols; ++j) {
       if (m[i][j] != 0) {
-        tmp = Binary::make(
-          tmp.type(),
-          BinaryOpType::Add,
-          tmp,
-          Binary::make(tmp.type(), BinaryOpType::Mul, v[j], m[i][j])
-        );
+        tmp = add(tmp, mul(v[j], m[i][j]));
       }
     }
     res.push_back(tmp);
@@ -341,38 +764,271 @@ std::vector<Expr> relax_matrix_array_product(Matrix<int> &m, std::vector<Expr> &
 }
 
 
-Expr add(const Expr &a, const Expr &b) {
-  return Binary::make(a.type(), BinaryOpType::Add, a, b);
+std::vector<Expr> relax_matrix_array_product(const SmallMatrix &m, std::vector<Expr> &v) {
+  std::vector<Expr> res;
+  int rows = m.height();
+  int cols = m.width();
+  ASSERT(cols <= (int)v.size()) << "Matrix-Array-Mult shape mismatch.\n";
+  for (int i = 0; i < rows; ++i) {
+    Expr tmp = 0;
+    for (int j = 0; j < cols; ++j) {
+      if (m[i][j] != 0) {
+        if (m[i][j] > INT32_MAX || m[i][j] < INT32_MIN) {
+          report_overflow("relax_matrix_array_product");
+        }
+        tmp = add(tmp, mul(v[j], (int)m[i][j]));
+      }
+    }
+    res.push_back(tmp);
+  }
+  return res;
 }
 
 
-Expr operator+(const Expr &a, const Expr &b) {
-  return add(a, b);
+namespace {
+
+// bool, or uint1 as Expr(bool) makes
+bool is_bool_type(const Type &t) {
+  return t.code == TypeCode::Bool || (t.code == TypeCode::UInt && t.bits == 1);
 }
 
 
-Expr sub(const Expr &a, const Expr &b) {
-  return Binary::make(a.type(), BinaryOpType::Sub, a, b);
+bool as_const_float(const Expr &e, double &v) {
+  if (!e.defined()) {
+    return false;
+  }
+  Ref<const FloatImm> as_float = e.as<FloatImm>();
+  if (as_float.defined()) {
+    v = as_float->value();
+    return true;
+  }
+  return false;
 }
 
 
-Expr operator-(const Expr &a, const Expr &b) {
-  return sub(a, b);
+bool as_const_bool(const Expr &e, bool &v) {
+  if (!e.defined() || !is_bool_type(e.type())) {
+    return false;
+  }
+  Ref<const UIntImm> as_uint = e.as<UIntImm>();
+  if (as_uint.defined()) {
+    v = as_uint->value() != 0;
+    return true;
+  }
+  return false;
 }
 
 
-Expr neg(const Expr &a) {
-  return Unary::make(a.type(), UnaryOpType::Neg, a);
+bool is_const(const Expr &e) {
+  int64_t i;
+  double f;
+  return Utils::as_const_int(e, i) || as_const_float(e, f);
 }
 
 
-Expr operator-(const Expr &a) {
-  return neg(a);
+bool is_const_value(const Expr &e, int64_t v) {
+  int64_t i;
+  double f;
+  return (Utils::as_const_int(e, i) && i == v) || (as_const_float(e, f) && f == v);
 }
 
 
-Expr mul(const Expr &a, const Expr &b) {
-  return Binary::make(a.type(), BinaryOpType::Mul, a, b);
+// e = base + offset with an integer constant offset
+bool split_offset(const Expr &e, Expr &base, int64_t &offset) {
+  Ref<const Binary> bin = e.as<Binary>();
+  if (!bin.defined() || !Utils::as_const_int(bin->b, offset)) {
+    return false;
+  }
+  if (bin->op_type == BinaryOpType::Add) {
+    base = bin->a;
+    return true;
+  }
+  if (bin->op_type == BinaryOpType::Sub) {
+    base = bin->a;
+    offset = -offset;
+    return true;
+  }
+  return false;
+}
+
+
+// base + offset, written as base - c for negative offsets
+Expr add_offset(const Expr &base, int64_t offset) {
+  Type t = base.type();
+  if (offset == 0) {
+    return base;
+  }
+  if (offset < 0 && offset != INT64_MIN) {
+    return Binary::make(t, BinaryOpType::Sub, base, Utils::make_const(t, -offset));
+  }
+  return Binary::make(t, BinaryOpType::Add, base, Utils::make_const(t, offset));
+}
+
+
+// e = base * factor with an integer constant factor
+bool split_factor(const Expr &e, Expr &base, int64_t &factor) {
+  Ref<const Binary> bin = e.as<Binary>();
+  if (!bin.defined() || bin->op_type != BinaryOpType::Mul || !Utils::as_const_int(bin->b, factor)) {
+    return false;
+  }
+  base = bin->a;
+  return true;
+}
+
+
+template<typename T>
+int compare_values(T x, T y, CompareOpType op) {
+  switch (op) {
+    case CompareOpType::EQ: return x == y;
+    case CompareOpType::NE: return x != y;
+    case CompareOpType::GT: return x > y;
+    case CompareOpType::GE: return x >= y;
+    case CompareOpType::LT: return x < y;
+    case CompareOpType::LE: return x <= y;
+    default: return -1;
+  }
+}
+
+
+// compare two constants, 1/0 for true/false, -1 if not constant
+int fold_compare(const Expr &a, const Expr &b, CompareOpType op) {
+  int64_t i, j;
+  double x, y;
+  if (Utils::as_const_int(a, i) && Utils::as_const_int(b, j)) {
+    return compare_values(i, j, op);
+  }
+  if (as_const_float(a, x) && as_const_float(b, y)) {
+    return compare_values(x, y, op);
+  }
+  return -1;
+}
+
+
+Expr make_compare(CompareOpType op, const Expr &a, const Expr &b) {
+  int folded = fold_compare(a, b, op);
+  if (folded >= 0) {
+    return Utils::make_const(Type::bool_scalar(), folded);
+  }
+  return Compare::make(Type::bool_scalar(), op, a, b);
+}
+
+}  // anonymous namespace
+
+
+Expr add(const Expr &a, const Expr &b) {
+  int64_t x, y;
+  double fx, fy;
+  if (Utils::as_const_int(a, x) && Utils::as_const_int(b, y)) {
+    return Utils::make_const(a.type(), x + y);
+  }
+  if (as_const_float(a, fx) && as_const_float(b, fy)) {
+    return Utils::make_const(a.type(), fx + fy);
+  }
+  if (is_const(a) && !is_const(b)) {
+    // constants go to the right
+    return add(b, a);
+  }
+  if (is_const_value(b, 0)) {
+    return a;
+  }
+  if (Utils::as_const_int(b, y) && !a.type().is_float()) {
+    // (x + c1) + c2 = x + (c1 + c2)
+    Expr base;
+    int64_t offset;
+    if (split_offset(a, base, offset)) {
+      return add_offset(base, offset + y);
+    }
+    return add_offset(a, y);
+  }
+  return Binary::make(a.type(), BinaryOpType::Add, a, b);
+}
+
+
+Expr operator+(const Expr &a, const Expr &b) {
+  return add(a, b);
+}
+
+
+Expr sub(const Expr &a, const Expr &b) {
+  int64_t x, y;
+  double fx, fy;
+  if (Utils::as_const_int(a, x) && Utils::as_const_int(b, y)) {
+    return Utils::make_const(a.type(), x - y);
+  }
+  if (as_const_float(a, fx) && as_const_float(b, fy)) {
+    return Utils::make_const(a.type(), fx - fy);
+  }
+  if (is_const_value(b, 0)) {
+    return a;
+  }
+  if (Utils::as_const_int(b, y) && y != INT64_MIN && !a.type().is_float()) {
+    // (x + c1) - c2 = x + (c1 - c2)
+    Expr base;
+    int64_t offset;
+    if (split_offset(a, base, offset)) {
+      return add_offset(base, offset - y);
+    }
+    return add_offset(a, -y);
+  }
+  return Binary::make(a.type(), BinaryOpType::Sub, a, b);
+}
+
+
+Expr operator-(const Expr &a, const Expr &b) {
+  return sub(a, b);
+}
+
+
+Expr neg(const Expr &a) {
+  int64_t x;
+  double fx;
+  if (Utils::as_const_int(a, x) && !a.type().is_uint()) {
+    return Utils::make_const(a.type(), -x);
+  }
+  if (as_const_float(a, fx)) {
+    return Utils::make_const(a.type(), -fx);
+  }
+  Ref<const Unary> as_unary = a.as<Unary>();
+  if (as_unary.defined() && as_unary->op_type == UnaryOpType::Neg) {
+    return as_unary->a;
+  }
+  return Unary::make(a.type(), UnaryOpType::Neg, a);
+}
+
+
+Expr operator-(const Expr &a) {
+  return neg(a);
+}
+
+
+Expr mul(const Expr &a, const Expr &b) {
+  int64_t x, y;
+  double fx, fy;
+  if (Utils::as_const_int(a, x) && Utils::as_const_int(b, y)) {
+    return Utils::make_const(a.type(), x * y);
+  }
+  if (as_const_float(a, fx) && as_const_float(b, fy)) {
+    return Utils::make_const(a.type(), fx * fy);
+  }
+  if (is_const(a) && !is_const(b)) {
+    return mul(b, a);
+  }
+  if (is_const_value(b, 1)) {
+    return a;
+  }
+  if (Utils::as_const_int(b, y) && !a.type().is_float()) {
+    // x * 0 is only folded for integers, 0 * inf is nan
+    if (y == 0) {
+      return Utils::make_const(a.type(), 0);
+    }
+    // (x * c1) * c2 = x * (c1 * c2)
+    Expr base;
+    int64_t factor;
+    if (split_factor(a, base, factor)) {
+      return mul(base, Utils::make_const(a.type(), factor * y));
+    }
+  }
+  return Binary::make(a.type(), BinaryOpType::Mul, a, b);
 }
 
 
@@ -382,6 +1038,17 @@ Expr operator*(const Expr &a, const Expr &b) {
 
 
 Expr div(const Expr &a, const Expr &b) {
+  int64_t x, y;
+  double fx, fy;
+  if (Utils::as_const_int(a, x) && Utils::as_const_int(b, y) && y != 0) {
+    return Utils::make_const(a.type(), x / y);
+  }
+  if (as_const_float(a, fx) && as_const_float(b, fy)) {
+    return Utils::make_const(a.type(), fx / fy);
+  }
+  if (is_const_value(b, 1)) {
+    return a;
+  }
   return Binary::make(a.type(), BinaryOpType::Div, a, b);
 }
 
@@ -392,6 +1059,13 @@ Expr operator/(const Expr &a, const Expr &b) {
 
 
 Expr logic_and(const Expr &a, const Expr &b) {
+  bool x;
+  if (as_const_bool(a, x)) {
+    return x ? b : a;
+  }
+  if (as_const_bool(b, x)) {
+    return x ? a : b;
+  }
   return Binary::make(Type::bool_scalar(), BinaryOpType::And, a, b);
 }
 
@@ -402,6 +1076,13 @@ Expr operator&&(const Expr &a, const Expr &b) {
 
 
 Expr logic_or(const Expr &a, const Expr &b) {
+  bool x;
+  if (as_const_bool(a, x)) {
+    return x ? a : b;
+  }
+  if (as_const_bool(b, x)) {
+    return x ? b : a;
+  }
   return Binary::make(Type::bool_scalar(), BinaryOpType::Or, a, b);
 }
 
@@ -412,320 +1093,865 @@ Expr operator||(const Expr &a, const Expr &b) {
 
 
 Expr floordiv(const Expr &a, const Expr &b) {
+  int64_t x, y;
+  if (Utils::as_const_int(b, y) && y != 0) {
+    if (Utils::as_const_int(a, x)) {
+      return Utils::make_const(a.type(), floor_div(x, y));
+    }
+    if (y == 1) {
+      return a;
+    }
+    // (x * c1) // c2 = x * (c1 / c2) when c2 | c1
+    Expr base;
+    int64_t factor;
+    if (split_factor(a, base, factor) && factor % y == 0) {
+      return mul(base, Utils::make_const(a.type(), factor / y));
+    }
+  }
   return Binary::make(a.type(), BinaryOpType::FloorDiv, a, b);
 }
 
 
 Expr mod(const Expr &a, const Expr &b) {
+  int64_t x, y;
+  if (Utils::as_const_int(b, y) && y != 0) {
+    if (Utils::as_const_int(a, x)) {
+      return Utils::make_const(a.type(), x % y);
+    }
+    if (y == 1 || y == -1) {
+      return Utils::make_const(a.type(), 0);
+    }
+  }
   return Binary::make(a.type(), BinaryOpType::Mod, a, b);
 }
 
 
 Expr floormod(const Expr &a, const Expr &b) {
+  int64_t x, y;
+  if (Utils::as_const_int(b, y) && y != 0) {
+    if (Utils::as_const_int(a, x)) {
+      return Utils::make_const(a.type(), x - floor_div(x, y) * y);
+    }
+    // (x * c1) % c2 = 0 when c2 | c1
+    Expr base;
+    int64_t factor;
+    if (y == 1 || y == -1 || (split_factor(a, base, factor) && factor % y == 0)) {
+      return Utils::make_const(a.type(), 0);
+    }
+  }
   return Binary::make(a.type(), BinaryOpType::FloorMod, a, b);
 }
 
 
 Expr eq(const Expr &a, const Expr &b) {
-  return Compare::make(Type::bool_scalar(), CompareOpType::EQ, a, b);
+  return make_compare(CompareOpType::EQ, a, b);
 }
 
 
 Expr ne(const Expr &a, const Expr &b) {
-  return Compare::make(Type::bool_scalar(), CompareOpType::NE, a, b);
+  return make_compare(CompareOpType::NE, a, b);
 }
 
 
 Expr gt(const Expr &a, const Expr &b) {
-  return Compare::make(Type::bool_scalar(), CompareOpType::GT, a, b);
+  return make_compare(CompareOpType::GT, a, b);
 }
 
 
 Expr ge(const Expr &a, const Expr &b) {
-  return Compare::make(Type::bool_scalar(), CompareOpType::GE, a, b);
+  return make_compare(CompareOpType::GE, a, b);
 }
 
 
 Expr lt(const Expr &a, const Expr &b) {
-  return Compare::make(Type::bool_scalar(), CompareOpType::LT, a, b);
+  return make_compare(CompareOpType::LT, a, b);
 }
 
 
 Expr le(const Expr &a, const Expr &b) {
-  return Compare::make(Type::bool_scalar(), CompareOpType::LE, a, b);
+  return make_compare(CompareOpType::LE, a, b);
 }
 
 
-ExtRange ExtRange::floor_div(int factor) {
-  ExtRange ret;
-  if (!this->left_inf) {
-    ret.left = Binary::make(this->left.type(), BinaryOpType::FloorDiv, this->left, factor);
-    ret.left_inf = false;
+bool LinearForm::from_expr(const Expr &expr, LinearForm &form,
+  std::unordered_map<std::string, Expr> *symbols) {
+  switch (expr->node_type()) {
+  case IRNodeType::IntImm:
+    form = LinearForm(expr.as<IntImm>()->value());
+    return true;
+  case IRNodeType::UIntImm:
+    {
+      uint64_t value = expr.as<UIntImm>()->value();
+      if (value > (uint64_t)INT64_MAX) {
+        return false;
+      }
+      form = LinearForm((int64_t)value);
+      return true;
+    }
+  case IRNodeType::Index:
+    {
+      Ref<const Index> index = expr.as<Index>();
+      form = LinearForm(index->name, 1);
+      if (symbols != nullptr) {
+        (*symbols)[index->name] = expr;
+      }
+      return true;
+    }
+  case IRNodeType::Unary:
+    {
+      Ref<const Unary> unary = expr.as<Unary>();
+      if (unary->op_type != UnaryOpType::Neg || !from_expr(unary->a, form, symbols)) {
+        return false;
+      }
+      form *= -1;
+      return true;
+    }
+  case IRNodeType::Binary:
+    {
+      Ref<const Binary> binary = expr.as<Binary>();
+      LinearForm other;
+      if (!from_expr(binary->a, form, symbols) || !from_expr(binary->b, other, symbols)) {
+        return false;
+      }
+      if (binary->op_type == BinaryOpType::Add) {
+        form += other;
+      } else if (binary->op_type == BinaryOpType::Sub) {
+        form -= other;
+      } else if (binary->op_type == BinaryOpType::Mul) {
+        // one side has to be a constant
+        if (other.is_constant()) {
+          form *= other.constant_;
+        } else if (form.is_constant()) {
+          int64_t factor = form.constant_;
+          form = other;
+          form *= factor;
+        } else {
+          return false;
+        }
+      } else {
+        return false;
+      }
+      return true;
+    }
+  default:
+    return false;
   }
-  if (!this->right_inf) {
-    // ceil div
-    ret.right = Binary::make(
-      this->right.type(), BinaryOpType::FloorDiv,
-      Binary::make(this->right.type(), BinaryOpType::Add, this->right, factor - 1), factor);
-    ret.right_inf = false;
+}
+
+
+Expr LinearForm::to_expr(Type type, const std::unordered_map<std::string, Expr> &symbols) const {
+  Expr ret;
+  for (const Term &term : terms_) {
+    auto it = symbols.find(term.first);
+    if (it == symbols.end()) {
+      LOG(ERROR) << "Unknown symbol in linear form: " << term.first << ".";
+      throw std::out_of_range("unknown symbol " + term.first);
+    }
+    if (!ret.defined()) {
+      ret = mul(it->second, Utils::make_const(type, term.second));
+    } else if (term.second > 0) {
+      ret = add(ret, mul(it->second, Utils::make_const(type, term.second)));
+    } else {
+      ret = sub(ret, mul(it->second, Utils::make_const(type, checked_sub(0, term.second))));
+    }
+  }
+  if (!ret.defined()) {
+    return Utils::make_const(type, constant_);
+  }
+  return add(ret, Utils::make_const(type, constant_));
+}
+
+
+int64_t LinearForm::coeff(const std::string &symbol) const {
+  auto it = std::lower_bound(terms_.begin(), terms_.end(), symbol,
+    [](const Term &term, const std::string &name) { return term.first < name; });
+  if (it != terms_.end() && it->first == symbol) {
+    return it->second;
   }
+  return 0;
+}
+
+
+void LinearForm::merge(const std::vector<Term> &other, int64_t factor) {
+  std::vector<Term> merged;
+  merged.reserve(terms_.size() + other.size());
+  size_t i = 0;
+  size_t j = 0;
+  while (i < terms_.size() || j < other.size()) {
+    if (j == other.size() || (i < terms_.size() && terms_[i].first < other[j].first)) {
+      merged.push_back(std::move(terms_[i++]));
+    } else if (i == terms_.size() || other[j].first < terms_[i].first) {
+      merged.emplace_back(other[j].first, checked_mul(other[j].second, factor));
+      ++j;
+    } else {
+      int64_t coeff = checked_add(terms_[i].second, checked_mul(other[j].second, factor));
+      if (coeff != 0) {
+        merged.emplace_back(std::move(terms_[i].first), coeff);
+      }
+      ++i;
+      ++j;
+    }
+  }
+  terms_.swap(merged);
+}
+
+
+LinearForm &LinearForm::operator+=(const LinearForm &other) {
+  merge(other.terms_, 1);
+  constant_ = checked_add(constant_, other.constant_);
+  return *this;
+}
+
+
+LinearForm &LinearForm::operator-=(const LinearForm &other) {
+  merge(other.terms_, -1);
+  constant_ = checked_sub(constant_, other.constant_);
+  return *this;
+}
+
+
+LinearForm &LinearForm::operator*=(int64_t factor) {
+  if (factor == 0) {
+    terms_.clear();
+    constant_ = 0;
+    return *this;
+  }
+  for (Term &term : terms_) {
+    term.second = checked_mul(term.second, factor);
+  }
+  constant_ = checked_mul(constant_, factor);
+  return *this;
+}
+
+
+LinearForm LinearForm::substitute(const std::string &symbol, const LinearForm &value) const {
+  int64_t factor = coeff(symbol);
+  if (factor == 0) {
+    return *this;
+  }
+  LinearForm ret(*this);
+  ret -= LinearForm(symbol, factor);
+  ret.merge(value.terms_, factor);
+  ret.constant_ = checked_add(ret.constant_, checked_mul(value.constant_, factor));
   return ret;
 }
 
 
-ExtRange ExtRange::floor_mod(int factor) {
-  return ExtRange(0, factor, false, false);
+LinearForm operator+(LinearForm a, const LinearForm &b) {
+  a += b;
+  return a;
 }
 
 
-void RangeInference::visit(Ref<const Index> op) {
-  range_map[op->name] = scope_.back();
+LinearForm operator-(LinearForm a, const LinearForm &b) {
+  a -= b;
+  return a;
 }
 
 
-void RangeInference::visit(Ref<const Binary> op) {
-  if (op->op_type == BinaryOpType::Add) {
-    Ref<const IntImm> a_as_int = op->a.as<IntImm>();
-    Ref<const IntImm> b_as_int = op->b.as<IntImm>();
-    ExtRange range = scope_.back();
-    if (a_as_int.defined()) {
-      int bias = (int)a_as_int->value();
-      if (!range.left_inf) {
-        range.left = range.left - bias;
+LinearForm operator*(LinearForm a, int64_t factor) {
+  a *= factor;
+  return a;
+}
+
+
+std::ostream &operator<<(std::ostream &out, const LinearForm &form) {
+  bool first = true;
+  for (const LinearForm::Term &term : form.terms()) {
+    int64_t coeff = term.second;
+    if (!first) {
+      out << (coeff < 0 ? " - " : " + ");
+    } else if (coeff < 0) {
+      out << "-";
+    }
+    uint64_t magnitude = coeff < 0 ? 0 - (uint64_t)coeff : (uint64_t)coeff;
+    if (magnitude != 1) {
+      out << magnitude << "*";
+    }
+    out << term.first;
+    first = false;
+  }
+  if (first) {
+    out << form.constant();
+  } else if (form.constant() != 0) {
+    uint64_t constant = form.constant();
+    out << (form.constant() < 0 ? " - " : " + ")
+        << (form.constant() < 0 ? 0 - constant : constant);
+  }
+  return out;
+}
+
+
+namespace {
+
+int64_t gcd(int64_t a, int64_t b) {
+  a = a < 0 ? -a : a;
+  b = b < 0 ? -b : b;
+  while (b != 0) {
+    int64_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+}  // namespace
+
+
+void IntegerSet::add_ge(const LinearForm &form) {
+  if (form.is_constant()) {
+    if (form.constant() < 0) {
+      empty_ = true;
+    }
+    return;
+  }
+  // sum(a * x) + c >= 0 => sum(a / g * x) + floor(c / g) >= 0
+  int64_t g = 0;
+  for (const LinearForm::Term &term : form.terms()) {
+    g = gcd(g, term.second);
+  }
+  LinearForm normalized(floor_div(form.constant(), g));
+  for (const LinearForm::Term &term : form.terms()) {
+    normalized += LinearForm(term.first, term.second / g);
+  }
+  for (LinearForm &known : constraints_) {
+    if (known.terms() == normalized.terms()) {
+      if (normalized.constant() < known.constant()) {
+        known = normalized;
       }
-      if (!range.right_inf) {
-        range.right = range.right - bias;
+      return;
+    }
+  }
+  constraints_.push_back(normalized);
+}
+
+
+void IntegerSet::add_eq(const LinearForm &form) {
+  add_ge(form);
+  add_ge(form * -1);
+}
+
+
+void IntegerSet::add_range(const std::string &symbol, int64_t lo, int64_t hi) {
+  // x - lo >= 0, hi - 1 - x >= 0
+  add_ge(LinearForm(symbol, 1) - LinearForm(lo));
+  add_ge(LinearForm(checked_sub(hi, 1)) - LinearForm(symbol, 1));
+}
+
+
+IntegerSet IntegerSet::project_out(const std::string &symbol) const {
+  IntegerSet ret;
+  ret.empty_ = empty_;
+  std::vector<const LinearForm*> pos;
+  std::vector<const LinearForm*> neg;
+  for (const LinearForm &form : constraints_) {
+    int64_t a = form.coeff(symbol);
+    if (a > 0) {
+      pos.push_back(&form);
+    } else if (a < 0) {
+      neg.push_back(&form);
+    } else {
+      ret.add_ge(form);
+    }
+  }
+  // a * x + p >= 0 and -b * x + n >= 0 (a, b > 0) => b * p + a * n >= 0
+  for (const LinearForm *p : pos) {
+    for (const LinearForm *n : neg) {
+      ret.add_ge(*p * -n->coeff(symbol) + *n * p->coeff(symbol));
+    }
+  }
+  return ret;
+}
+
+
+bool IntegerSet::loop_bounds(const std::vector<std::string> &order, std::vector<LoopBounds> &bounds) const {
+  bounds.assign(order.size(), LoopBounds());
+  IntegerSet set = *this;
+  for (int k = (int)order.size() - 1; k >= 0; --k) {
+    const std::string &symbol = order[k];
+    bounds[k].symbol = symbol;
+    for (const LinearForm &form : set.constraints_) {
+      int64_t a = form.coeff(symbol);
+      // a * x + rest >= 0
+      LinearForm rest = form - LinearForm(symbol, a);
+      if (a > 0) {
+        // x >= ceil(-rest / a)
+        bounds[k].lower.emplace_back(rest * -1, a);
+      } else if (a < 0) {
+        // x <= floor(rest / -a)
+        bounds[k].upper.emplace_back(rest, -a);
       }
-      scope_.push_back(range);
-      (op->b).visit_expr(this);
-      scope_.pop_back();
-    } else if (b_as_int.defined()) {
-      int bias = (int)b_as_int->value();
+    }
+    if (k > 0) {
+      set = set.project_out(symbol);
+      if (set.constraints_.size() > max_constraints) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+std::ostream &operator<<(std::ostream &out, const IntegerSet &set) {
+  out << "{";
+  bool first = true;
+  for (const LinearForm &form : set.constraints()) {
+    out << (first ? " " : ", ") << form << " >= 0";
+    first = false;
+  }
+  if (set.is_empty()) {
+    out << (first ? " " : ", ") << "false";
+  }
+  out << " }";
+  return out;
+}
+
+
+RangeBound::RangeBound(const Expr &expr) : is_int_(false), value_(0), expr_(expr) {
+  if (!expr.defined()) {
+    return;
+  }
+  if (expr->node_type() == IRNodeType::IntImm) {
+    is_int_ = true;
+    value_ = expr.as<IntImm>()->value();
+  } else if (expr->node_type() == IRNodeType::UIntImm && expr.as<UIntImm>()->value() <= (uint64_t)INT64_MAX) {
+    is_int_ = true;
+    value_ = (int64_t)expr.as<UIntImm>()->value();
+  }
+}
+
+
+const Expr &RangeBound::expr() const {
+  if (is_int_ && !expr_.defined()) {
+    bool fits = value_ >= INT32_MIN && value_ <= INT32_MAX;
+    expr_ = Utils::make_const(Type::int_scalar(fits ? 32 : 64), value_);
+  }
+  return expr_;
+}
+
+
+std::ostream &operator<<(std::ostream &out, const RangeBound &bound) {
+  if (bound.is_int()) {
+    out << bound.value();
+  } else {
+    out << bound.expr();
+  }
+  return out;
+}
+
+
+namespace {
+
+/**
+ * arithmetic on range bounds, integers stay integers,
+ * symbolic bounds go through the folding builders
+ */
+Expr bound_const(const RangeBound &like, int64_t value) {
+  return Utils::make_const(like.expr().type(), value);
+}
+
+
+RangeBound bound_add(const RangeBound &a, int64_t b) {
+  if (a.is_int()) {
+    return checked_add(a.value(), b);
+  }
+  return add(a.expr(), bound_const(a, b));
+}
+
+
+// b - a
+RangeBound bound_rsub(int64_t b, const RangeBound &a) {
+  if (a.is_int()) {
+    return checked_sub(b, a.value());
+  }
+  return sub(bound_const(a, b), a.expr());
+}
+
+
+RangeBound bound_mul(const RangeBound &a, int64_t b) {
+  if (a.is_int()) {
+    return checked_mul(a.value(), b);
+  }
+  return mul(a.expr(), bound_const(a, b));
+}
+
+
+RangeBound bound_floordiv(const RangeBound &a, int64_t b) {
+  if (a.is_int()) {
+    return floor_div(a.value(), b);
+  }
+  return floordiv(a.expr(), bound_const(a, b));
+}
+
+
+// ceil(a / b), b > 0
+RangeBound bound_ceildiv(const RangeBound &a, int64_t b) {
+  return bound_floordiv(bound_add(a, b - 1), b);
+}
+
+
+/**
+ * closed integer interval [lo, hi], either end may be infinite
+ */
+struct Interval {
+  bool lo_inf;
+  bool hi_inf;
+  int64_t lo;
+  int64_t hi;
+
+  Interval() : lo_inf(true), hi_inf(true), lo(0), hi(0) {}
+
+  Interval(int64_t l, int64_t h) : lo_inf(false), hi_inf(false), lo(l), hi(h) {}
+
+  bool is_const() const {
+    return !lo_inf && !hi_inf && lo == hi;
+  }
+
+  bool bounded() const {
+    return !lo_inf && !hi_inf;
+  }
+};
+
+
+Interval negate(const Interval &a) {
+  Interval ret;
+  ret.lo_inf = a.hi_inf;
+  ret.hi_inf = a.lo_inf;
+  ret.lo = a.hi_inf ? 0 : checked_sub(0, a.hi);
+  ret.hi = a.lo_inf ? 0 : checked_sub(0, a.lo);
+  return ret;
+}
+
+
+/**
+ * values of an index expression, indices range over their Dom
+ */
+Interval forward(const Expr &expr) {
+  switch (expr->node_type()) {
+  case IRNodeType::IntImm:
+    return Interval(expr.as<IntImm>()->value(), expr.as<IntImm>()->value());
+  case IRNodeType::Index:
+    {
+      Ref<const Dom> dom = expr.as<Index>()->dom.as<Dom>();
+      if (!dom.defined()) {
+        return Interval();
+      }
+      RangeBound begin(dom->begin);
+      RangeBound extent(dom->extent);
+      // placeholder Doms have negative extents
+      if (!begin.is_int() || !extent.is_int() || extent.value() <= 0) {
+        return Interval();
+      }
+      return Interval(begin.value(), checked_add(begin.value(), extent.value() - 1));
+    }
+  case IRNodeType::Unary:
+    {
+      Ref<const Unary> op = expr.as<Unary>();
+      if (op->op_type != UnaryOpType::Neg) {
+        return Interval();
+      }
+      return negate(forward(op->a));
+    }
+  case IRNodeType::Binary:
+    break;
+  default:
+    return Interval();
+  }
+  Ref<const Binary> op = expr.as<Binary>();
+  Interval a = forward(op->a);
+  Interval b = forward(op->b);
+  Interval ret;
+  switch (op->op_type) {
+  case BinaryOpType::Sub:
+    b = negate(b);
+    // fall through
+  case BinaryOpType::Add:
+    ret.lo_inf = a.lo_inf || b.lo_inf;
+    ret.hi_inf = a.hi_inf || b.hi_inf;
+    ret.lo = ret.lo_inf ? 0 : checked_add(a.lo, b.lo);
+    ret.hi = ret.hi_inf ? 0 : checked_add(a.hi, b.hi);
+    return ret;
+  case BinaryOpType::Mul:
+    if (a.is_const()) {
+      std::swap(a, b);
+    }
+    if (b.is_const()) {
+      if (b.lo == 0) {
+        return Interval(0, 0);
+      }
+      ret = b.lo > 0 ? a : negate(a);
+      int64_t factor = b.lo > 0 ? b.lo : checked_sub(0, b.lo);
+      ret.lo = checked_mul(ret.lo, factor);
+      ret.hi = checked_mul(ret.hi, factor);
+      return ret;
+    }
+    if (a.bounded() && b.bounded()) {
+      int64_t corners[4] = {checked_mul(a.lo, b.lo), checked_mul(a.lo, b.hi),
+                            checked_mul(a.hi, b.lo), checked_mul(a.hi, b.hi)};
+      return Interval(*std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4));
+    }
+    return Interval();
+  case BinaryOpType::FloorDiv:
+    if (!b.is_const() || b.lo == 0) {
+      return Interval();
+    }
+    if (b.lo < 0) {
+      a = negate(a);
+    }
+    ret = a;
+    ret.lo = floor_div(a.lo, b.lo > 0 ? b.lo : -b.lo);
+    ret.hi = floor_div(a.hi, b.lo > 0 ? b.lo : -b.lo);
+    return ret;
+  case BinaryOpType::FloorMod:
+    if (!b.is_const() || b.lo == 0) {
+      return Interval();
+    }
+    if (b.lo > 0 && !a.lo_inf && !a.hi_inf && a.lo >= 0 && a.hi < b.lo) {
+      return a;
+    }
+    return b.lo > 0 ? Interval(0, b.lo - 1) : Interval(b.lo + 1, 0);
+  default:
+    return Interval();
+  }
+}
+
+
+// x + y in range, y in other => x in [left - other.hi, right - other.lo)
+ExtRange add_inverse(const ExtRange &range, const Interval &other) {
+  ExtRange ret;
+  if (!range.left_inf && !other.hi_inf) {
+    ret.left = bound_add(range.left, checked_sub(0, other.hi));
+    ret.left_inf = false;
+  }
+  if (!range.right_inf && !other.lo_inf) {
+    ret.right = bound_add(range.right, checked_sub(0, other.lo));
+    ret.right_inf = false;
+  }
+  return ret;
+}
+
+
+// -x in range => x in [1 - right, 1 - left)
+ExtRange neg_inverse(const ExtRange &range) {
+  ExtRange ret;
+  if (!range.right_inf) {
+    ret.left = bound_rsub(1, range.right);
+    ret.left_inf = false;
+  }
+  if (!range.left_inf) {
+    ret.right = bound_rsub(1, range.left);
+    ret.right_inf = false;
+  }
+  return ret;
+}
+
+
+// x * y in range, y in other
+ExtRange mul_inverse(const ExtRange &range, const Interval &other) {
+  ExtRange ret;
+  if (other.is_const()) {
+    int64_t c = other.lo;
+    if (c > 0) {
+      // [ceil(left / c), ceil(right / c))
       if (!range.left_inf) {
-        range.left = range.left - bias;
+        ret.left = bound_ceildiv(range.left, c);
+        ret.left_inf = false;
       }
       if (!range.right_inf) {
-        range.right = range.right - bias;
-      }
-      scope_.push_back(range);
-      (op->a).visit_expr(this);
-      scope_.pop_back();
-    }
-  } else if (op->op_type == BinaryOpType::Sub) {
-    Ref<const IntImm> a_as_int = op->a.as<IntImm>();
-    Ref<const IntImm> b_as_int = op->b.as<IntImm>();
-    ExtRange range = scope_.back();
-    if (a_as_int.defined()) {
-      int bias = (int)a_as_int->value();
-      ExtRangeType range_type = range.range_type();
-      if (range_type == ExtRangeType::LCRC) {
-        range.left = bias - scope_.back().right;
-        range.right = bias - scope_.back().left;
-      } else if (range_type == ExtRangeType::LCRO) {
-        range.left_inf = true;
-        range.right_inf = false;
-        range.right = bias - range.left;
-      } else if (range_type == ExtRangeType::LORC) {
-        range.left_inf = false;
-        range.right_inf = true;
-        range.left = bias - range.right;
-      } else {
-        // nothing to do
+        ret.right = bound_ceildiv(range.right, c);
+        ret.right_inf = false;
       }
-      scope_.push_back(range);
-      (op->b).visit_expr(this);
-      scope_.pop_back();
-    } else if (b_as_int.defined()) {
-      int bias = (int)b_as_int->value();
+    } else if (c < 0) {
+      // -x * -c in range
+      ret = neg_inverse(mul_inverse(range, Interval(-c, -c)));
+    }
+    return ret;
+  }
+  bool int_range = (range.left_inf || range.left.is_int()) && (range.right_inf || range.right.is_int());
+  if (!int_range || other.lo_inf || other.hi_inf) {
+    return ret;
+  }
+  if (other.hi < 0) {
+    return neg_inverse(mul_inverse(range, negate(other)));
+  }
+  if (other.lo <= 0) {
+    // y may be 0, x is free
+    return ret;
+  }
+  // x * y in [l, r] for y in [other.lo, other.hi], both positive
+  if (!range.left_inf) {
+    int64_t l = range.left.value();
+    ret.left = l >= 0 ? -floor_div(-l, other.hi) : -floor_div(-l, other.lo);
+    ret.left_inf = false;
+  }
+  if (!range.right_inf) {
+    int64_t r = checked_sub(range.right.value(), 1);
+    ret.right = checked_add(r >= 0 ? floor_div(r, other.lo) : floor_div(r, other.hi), 1);
+    ret.right_inf = false;
+  }
+  return ret;
+}
+
+
+// x // y in range, y in other
+ExtRange floordiv_inverse(const ExtRange &range, const Interval &other) {
+  ExtRange ret;
+  if (other.is_const()) {
+    int64_t c = other.lo;
+    if (c > 0) {
+      // [left * c, right * c)
       if (!range.left_inf) {
-        range.left = add(range.left, bias);
+        ret.left = bound_mul(range.left, c);
+        ret.left_inf = false;
       }
       if (!range.right_inf) {
-        range.right = add(range.right, bias);
-      }
-      scope_.push_back(range);
-      (op->a).visit_expr(this);
-      scope_.pop_back();
-    }
-  } else if (op->op_type == BinaryOpType::Mul) {
-    Ref<const IntImm> a_as_int = op->a.as<IntImm>();
-    Ref<const IntImm> b_as_int = op->b.as<IntImm>();
-    ExtRange range = scope_.back();
-    if (a_as_int.defined()) {
-      int bias = (int)a_as_int->value();
-      if (bias == 0) {
-        range.left = 0;
-        range.left_inf = false;
-        range.right = 1;
-        range.right_inf = false;
-      } else if (bias > 0) {
-        ExtRangeType range_type = range.range_type();
-        if (range_type == ExtRangeType::LCRC) {
-          range.left = floordiv(range.left, bias);
-          range.right = floordiv(add(range.right, bias - 1), bias);
-        } else if (range_type == ExtRangeType::LCRO) {
-          range.left = floordiv(range.left, bias);
-        } else if (range_type == ExtRangeType::LORC) {
-          range.right = floordiv(add(range.right, bias - 1), bias);
-        } else {
-          // nothing to do
-        }
-      } else {
-        ExtRangeType range_type = range.range_type();
-        if (range_type == ExtRangeType::LCRC) {
-          range.left = mul(sub(floordiv(add(scope_.back().right, -bias-1), -bias), 1), -1);
-          range.right = mul(sub(floordiv(scope_.back().left, -bias), 1), -1);
-        } else if (range_type == ExtRangeType::LCRO) {
-          range.left_inf = true;
-          range.right_inf = false;
-          range.right = mul(sub(floordiv(range.left, -bias), 1), -1);
-        } else if (range_type == ExtRangeType::LORC) {
-          range.left_inf = false;
-          range.right_inf = true;
-          range.left = mul(sub(floordiv(add(range.right, -bias-1), -bias), 1), -1);
-        } else {
-          // nothing to do
-        }
+        ret.right = bound_mul(range.right, c);
+        ret.right_inf = false;
       }
-      
-      scope_.push_back(range);
-      (op->b).visit_expr(this);
-      scope_.pop_back();
-    } else if (b_as_int.defined()) {
-      int bias = (int)b_as_int->value();
-      if (bias == 0) {
-        range.left = 0;
-        range.left_inf = false;
-        range.right = 1;
-        range.right_inf = false;
-      } else if (bias > 0) {
-        ExtRangeType range_type = range.range_type();
-        if (range_type == ExtRangeType::LCRC) {
-          range.left = floordiv(range.left, bias);
-          range.right = floordiv(add(range.right, bias - 1), bias);
-        } else if (range_type == ExtRangeType::LCRO) {
-          range.left = floordiv(range.left, bias);
-        } else if (range_type == ExtRangeType::LORC) {
-          range.right = floordiv(add(range.right, bias - 1), bias);
-        } else {
-          // nothing to do
-        }
-      } else {
-        ExtRangeType range_type = range.range_type();
-        if (range_type == ExtRangeType::LCRC) {
-          range.left = mul(sub(floordiv(add(scope_.back().right, -bias-1), -bias), 1), -1);
-          range.right = mul(sub(floordiv(scope_.back().left, -bias), 1), -1);
-        } else if (range_type == ExtRangeType::LCRO) {
-          range.left_inf = true;
-          range.right_inf = false;
-          range.right = mul(sub(floordiv(range.left, -bias), 1), -1);
-        } else if (range_type == ExtRangeType::LORC) {
-          range.left_inf = false;
-          range.right_inf = true;
-          range.left = mul(sub(floordiv(add(range.right, -bias-1), -bias), 1), -1);
-        } else {
-          // nothing to do
-        }
+    } else if (c < 0) {
+      // [right * c + 1, left * c + 1)
+      if (!range.right_inf) {
+        ret.left = bound_add(bound_mul(range.right, c), 1);
+        ret.left_inf = false;
       }
-      
-      scope_.push_back(range);
-      (op->a).visit_expr(this);
-      scope_.pop_back();
-    }
-  } else if (op->op_type == BinaryOpType::FloorDiv) {
-    Ref<const IntImm> a_as_int = op->a.as<IntImm>();
-    Ref<const IntImm> b_as_int = op->b.as<IntImm>();
-    ExtRange range = scope_.back();
-    if (a_as_int.defined()) {
-      // int bias = (int)a_as_int->value();
-      // TODO: can't identify zero division problems
-      LOG(WARNING) << "Can't get concrete bound in such case: " << Expr(op) << ".";
-      // if (!range.left_inf && !range.right_inf) {
-      //   Expr new_left = floordiv(add(bias, sub(range.right, 1)), range.right);
-      //   range.right = add(floordiv(bias,range.left), 1);
-      //   range.left = new_left;
-      // } else if (range.left_inf && !range.right_inf) {
-      //   range.left = floordiv(bias, range.right);
-      //   range.right = 0;
-      // } else if (!range.left_inf && range.right_inf) {
-      //   range.right = add(floordiv(bias,range.left), 1);
-      //   range.left = 0;
-      // } else {
-      //   // do nothing
-      // }
-      range.left_inf = true;
-      range.right_inf = true;
-      scope_.push_back(range);
-      (op->b).visit_expr(this);
-      scope_.pop_back();
-    } else if (b_as_int.defined()) {
-      int bias = (int)b_as_int->value();
-      if (bias > 0) {
-        if (!range.left_inf && !range.right_inf) {
-          range.left = mul(range.left, bias);
-          // TODO: can we get a more tight bound?
-          range.right = add(mul(range.right, bias), bias-1);
-        } else if (range.left_inf && !range.right_inf) {
-          range.right = add(mul(range.right, bias), bias-1);
-        } else if (!range.left_inf && range.right_inf) {
-          range.left = mul(range.left, bias);
-        } else {
-          // do nothing
-        }
-      } else if (bias < 0) {
-        if (!range.left_inf && !range.right_inf) {
-          Expr new_left = add(mul(range.right, bias), bias-1);
-          range.right = add(mul(range.left, bias), 1);
-          range.left = new_left;
-        } else if (range.left_inf && !range.right_inf) {
-          range.left = add(mul(range.right, bias), bias-1);
-          range.right_inf = true;
-        } else if (!range.left_inf && range.right_inf) {
-          range.right = add(mul(range.left, bias), 1);
-          range.left_inf = true;
-        } else {
-          // do nothing
-        }
+      if (!range.left_inf) {
+        ret.right = bound_add(bound_mul(range.left, c), 1);
+        ret.right_inf = false;
+      }
+    } else {
+      LOG(ERROR) << "Find floordiv by 0.";
+    }
+    return ret;
+  }
+  bool int_range = (range.left_inf || range.left.is_int()) && (range.right_inf || range.right.is_int());
+  if (!int_range || other.lo_inf || other.hi_inf || other.lo <= 0) {
+    return ret;
+  }
+  // x // y in [l, r] for y in [other.lo, other.hi], both positive
+  // => l * y <= x <= r * y + y - 1
+  if (!range.left_inf) {
+    int64_t l = range.left.value();
+    ret.left = checked_mul(l, l >= 0 ? other.lo : other.hi);
+    ret.left_inf = false;
+  }
+  if (!range.right_inf) {
+    int64_t r = checked_sub(range.right.value(), 1);
+    int64_t y = r >= 0 ? other.hi : other.lo;
+    ret.right = checked_mul(checked_add(r, 1), y);
+    ret.right_inf = false;
+  }
+  return ret;
+}
+
+}  // namespace
+
+
+ExtRange ExtRange::floor_div(int factor) {
+  ExtRange ret;
+  if (!this->left_inf) {
+    ret.left = bound_floordiv(this->left, factor);
+    ret.left_inf = false;
+  }
+  if (!this->right_inf) {
+    ret.right = bound_ceildiv(this->right, factor);
+    ret.right_inf = false;
+  }
+  return ret;
+}
+
+
+ExtRange ExtRange::floor_mod(int factor) {
+  return ExtRange(0, factor, false, false);
+}
+
+
+void RangeInference::do_infer(const Expr &expr) {
+  LinearForm form;
+  if (!LinearForm::from_expr(expr, form) || form.terms().size() != 1) {
+    expr.visit_expr(this);
+    return;
+  }
+  // c * x + b in range => c * x in range - b
+  const LinearForm::Term &term = form.terms()[0];
+  ExtRange shifted = add_inverse(scope_.back(), Interval(form.constant(), form.constant()));
+  range_map[term.first] = mul_inverse(shifted, Interval(term.second, term.second));
+}
+
+
+void RangeInference::infer(const Expr &expr, const ExtRange &range) {
+  scope_.push_back(range);
+  expr.visit_expr(this);
+  scope_.pop_back();
+}
+
+
+void RangeInference::visit(Ref<const Index> op) {
+  const ExtRange &range = scope_.back();
+  auto it = range_map.find(op->name);
+  if (it == range_map.end()) {
+    range_map[op->name] = range;
+    return;
+  }
+  // every occurrence bounds the index, keep the tighter ends
+  ExtRange &known = it->second;
+  if (!range.left_inf && (known.left_inf ||
+      (range.left.is_int() && known.left.is_int() && range.left.value() > known.left.value()))) {
+    known.left = range.left;
+    known.left_inf = false;
+  }
+  if (!range.right_inf && (known.right_inf ||
+      (range.right.is_int() && known.right.is_int() && range.right.value() < known.right.value()))) {
+    known.right = range.right;
+    known.right_inf = false;
+  }
+}
+
+
+void RangeInference::visit(Ref<const Binary> op) {
+  const ExtRange range = scope_.back();
+  switch (op->op_type) {
+  case BinaryOpType::Add:
+    infer(op->a, add_inverse(range, forward(op->b)));
+    infer(op->b, add_inverse(range, forward(op->a)));
+    break;
+  case BinaryOpType::Sub:
+    // a + (-b) in range
+    infer(op->a, add_inverse(range, negate(forward(op->b))));
+    infer(op->b, neg_inverse(add_inverse(range, forward(op->a))));
+    break;
+  case BinaryOpType::Mul:
+    infer(op->a, mul_inverse(range, forward(op->b)));
+    infer(op->b, mul_inverse(range, forward(op->a)));
+    break;
+  case BinaryOpType::FloorDiv:
+    infer(op->a, floordiv_inverse(range, forward(op->b)));
+    // the divisor is not bounded by the quotient
+    infer(op->b, ExtRange());
+    break;
+  case BinaryOpType::FloorMod:
+    {
+      // a % c is a itself if a is within [0, c), otherwise a is free
+      Interval a = forward(op->a);
+      Interval b = forward(op->b);
+      if (b.is_const() && b.lo > 0 && !a.lo_inf && !a.hi_inf && a.lo >= 0 && a.hi < b.lo) {
+        infer(op->a, range);
       } else {
-        LOG(ERROR) << "Find floordiv by 0: " << Expr(op) << ".";
+        infer(op->a, ExtRange());
       }
-      scope_.push_back(range);
-      (op->a).visit_expr(this);
-      scope_.pop_back();
+      infer(op->b, ExtRange());
     }
-  } else if (op->op_type == BinaryOpType::FloorMod) {
-    LOG(WARNING) << "No implement for floormod case: " << Expr(op) << ".";
-  } else {
+    break;
+  default:
     LOG(ERROR) << "Unexpected binary op type in range inference: " << Expr(op) << ".";
+    break;
   }
 }
 
 
 void RangeInference::visit(Ref<const Unary> op) {
   if (op->op_type == UnaryOpType::Neg) {
-    ExtRange range = scope_.back();
-    ExtRangeType range_type = range.range_type();
-    switch (range_type)
-    {
-    case ExtRangeType::LCRC:
-      {Expr tmp = range.left;
-      range.left = neg(range.right);
-      range.right = neg(tmp);}
-      break;
-    case ExtRangeType::LCRO:
-      {range.right = neg(range.left);
-      range.left_inf = true;}
-      break;
-    case ExtRangeType::LORC:
-      {range.left = neg(range.right);
-      range.right_inf = true;}
-      break;
-    default:
-      break;
-    }
-    scope_.push_back(range);
-    (op->a).visit_expr(this);
-    scope_.pop_back();
+    infer(op->a, neg_inverse(scope_.back()));
   }
 }
 
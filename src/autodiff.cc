@@ -23,6 +23,11 @@
 */
 
 #include <vector>
+#include <cstdlib>
+#include <set>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
 
 #include "debug.h"
 #include "type.h"
@@ -31,6 +36,7 @@
 #include "autodiff.h"
 #include "IRMutator.h"
 #include "simplify.h"
+#include "session.h"
 
 
 namespace Boost {
@@ -172,90 +178,23 @@ Expr EliminateIndexFloorDivAndMod::visit(Ref<const Binary> op) {
 }
 
 
-void ExtractIndexCoefficients::visit(Ref<const Index> op) {
-  (*(scope_.back()))[op->name] = (VType)1;
-}
-
-
-void ExtractIndexCoefficients::visit(Ref<const Unary> op) {
-  std::unordered_map<std::string, VType> tmp;
-  scope_.push_back(&tmp);
-  visit_expr(op->a);
-  scope_.pop_back();
-  if (op->op_type == UnaryOpType::Neg) {
-    for (auto kv : tmp) {
-      (*(scope_.back()))[kv.first] = -kv.second;
-    }
-  } else UNEXPECTED
-}
-
-
-void ExtractIndexCoefficients::visit(Ref<const Binary> op) {
-  std::unordered_map<std::string, VType> a;
-  scope_.push_back(&a);
-  visit_expr(op->a);
-  scope_.pop_back();
-  std::unordered_map<std::string, VType> b;
-  scope_.push_back(&b);
-  visit_expr(op->b);
-  scope_.pop_back();
-
-  switch (op->op_type)
-  {
-  case BinaryOpType::Add:
-    {
-      for (auto kv : a) {
-        (*(scope_.back()))[kv.first] = kv.second;
-      }
-      for (auto kv : b) {
-        if ((*(scope_.back())).count(kv.first) != 0) {
-          (*(scope_.back()))[kv.first] += kv.second;
-        } else {
-          (*(scope_.back()))[kv.first] = kv.second;
-        }
-      }
-    }
-    break;
-  case BinaryOpType::Sub:
-    {
-      for (auto kv : a) {
-        (*(scope_.back()))[kv.first] = kv.second;
-      }
-      for (auto kv : b) {
-        if ((*(scope_.back())).count(kv.first) != 0) {
-          (*(scope_.back()))[kv.first] -= kv.second;
-        } else {
-          (*(scope_.back()))[kv.first] = kv.second;
-        }
-      }
-    }
-    break;
-  case BinaryOpType::Mul:
-    {
-      // merge results from two branches
-      for (auto kv1 : a) {
-        for (auto kv2 : b) {
-          if (kv1.first == const_tag_) {
-            if ((*(scope_.back())).count(kv2.first)) {
-              (*(scope_.back()))[kv2.first] += kv1.second * kv2.second;
-            } else {
-              (*(scope_.back()))[kv2.first] = kv1.second * kv2.second;
-            }
-          } else if (kv2.first == const_tag_) {
-            if ((*(scope_.back())).count(kv1.first)) {
-              (*(scope_.back()))[kv1.first] += kv1.second * kv2.second;
-            } else {
-              (*(scope_.back()))[kv1.first] = kv1.second * kv2.second;
-            }
-          } else {
-            LOG(ERROR) << "Find index multiply: " << Expr(op); throw;
-          }
-        }
-      }
+void ExtractIndexCoefficients::get_coefficients(
+  const Expr& expr, std::unordered_map<std::string, VType> &result) {
+  Arith::LinearForm form;
+  if (!Arith::LinearForm::from_expr(expr, form)) {
+    LOG(ERROR) << "Find non-affine index expression: " << expr << ".";
+    throw std::invalid_argument("non-affine index expression");
+  }
+  auto to_vtype = [&](int64_t value) {
+    if (value < std::numeric_limits<VType>::min() || value > std::numeric_limits<VType>::max()) {
+      LOG(ERROR) << "Index coefficient out of range: " << value << " in " << expr << ".";
+      throw std::overflow_error("index coefficient out of range");
     }
-    break;
-  default: UNEXPECTED
-    break;
+    return (VType)value;
+  };
+  result[const_tag_] = to_vtype(form.constant());
+  for (const Arith::LinearForm::Term &term : form.terms()) {
+    result[term.first] = to_vtype(term.second);
   }
 }
 
@@ -426,6 +365,77 @@ void solve_substitutions(SubstituteContext &context,
 }
 
 
+bool is_const_zero(const Expr &expr) {
+  Ref<const IntImm> as_int = expr.as<IntImm>();
+  if (as_int.defined()) {
+    return as_int->value() == 0;
+  }
+  Ref<const FloatImm> as_float = expr.as<FloatImm>();
+  if (as_float.defined()) {
+    return as_float->value() == 0;
+  }
+  return false;
+}
+
+
+DerivativeRegistry &DerivativeRegistry::global() {
+  static DerivativeRegistry registry;
+  return registry;
+}
+
+
+DerivativeRegistry::DerivativeRegistry() {
+  auto one = [](const Expr &e) { return Utils::make_const(e.type(), 1); };
+  auto call = [](const std::string &name, const Expr &e) {
+    return Call::make(e.type(), {e}, name, CallType::Pure);
+  };
+  // y = exp(x), dy/dx = y
+  rules_["exp"] = [](const std::vector<Expr> &args, const Expr &y) {
+    return std::vector<Expr>({y});
+  };
+  // y = log(x), dy/dx = 1 / x
+  rules_["log"] = [one](const std::vector<Expr> &args, const Expr &y) {
+    return std::vector<Expr>({Arith::div(one(y), args[0])});
+  };
+  // y = sqrt(x), dy/dx = 0.5 / y
+  rules_["sqrt"] = [](const std::vector<Expr> &args, const Expr &y) {
+    return std::vector<Expr>({Arith::div(Utils::make_const(y.type(), 0.5), y)});
+  };
+  // y = tanh(x), dy/dx = 1 - y * y
+  rules_["tanh"] = [one](const std::vector<Expr> &args, const Expr &y) {
+    return std::vector<Expr>({Arith::sub(one(y), Arith::mul(y, y))});
+  };
+  // y = sigmoid(x), dy/dx = y * (1 - y)
+  rules_["sigmoid"] = [one](const std::vector<Expr> &args, const Expr &y) {
+    return std::vector<Expr>({Arith::mul(y, Arith::sub(one(y), y))});
+  };
+  // y = sin(x), dy/dx = cos(x)
+  rules_["sin"] = [call](const std::vector<Expr> &args, const Expr &y) {
+    return std::vector<Expr>({call("cos", args[0])});
+  };
+  // y = cos(x), dy/dx = -sin(x)
+  rules_["cos"] = [call](const std::vector<Expr> &args, const Expr &y) {
+    return std::vector<Expr>({Arith::neg(call("sin", args[0]))});
+  };
+}
+
+
+void DerivativeRegistry::register_rule(const std::string &func_name, DerivativeRule rule) {
+  rules_[func_name] = rule;
+}
+
+
+bool DerivativeRegistry::has_rule(const std::string &func_name) const {
+  return rules_.count(func_name) != 0;
+}
+
+
+const DerivativeRule &DerivativeRegistry::get_rule(const std::string &func_name) const {
+  ASSERT(has_rule(func_name)) << "No derivative rule for call: " << func_name << ".\n";
+  return rules_.at(func_name);
+}
+
+
 class GradOp : public IRMutator {
  private:
 
@@ -440,13 +450,19 @@ class GradOp : public IRMutator {
   std::vector<Expr> &call_args_;
   std::vector<Expr> compute_args_;
   std::vector<std::unordered_map<std::shared_ptr<const Index>, Expr>> vmap_scope_;
-  Expr conditions;
+  std::vector<GradIterSpace> iter_spaces_;
+  std::vector<std::pair<Expr, Expr>> &forward_outputs_;
+  // only the active-th access to grad_to contributes, the others are constants
+  int active_;
+  int occurrences_;
   
  public:
   GradOp(Utils::NameGenerator &generator, SubstituteContext &context, Ref<const Var> &grad_to,
-    Ref<const Var> &doutput, std::vector<Expr> &call_args, std::vector<Expr> compute_args) :
+    Ref<const Var> &doutput, std::vector<Expr> &call_args, std::vector<Expr> compute_args,
+    std::vector<std::pair<Expr, Expr>> &forward_outputs, int active = 0) :
     generator_(generator), context_(context), grad_to_(grad_to), doutput_(doutput),
-    call_args_(call_args), compute_args_(compute_args) {
+    call_args_(call_args), compute_args_(compute_args), forward_outputs_(forward_outputs),
+    active_(active), occurrences_(0) {
       const_tag_ = generator_.unique_name("_const");
       sub_hint_ = generator_.unique_name("_s");
       dummy_tag_ = generator_.unique_name("_r");
@@ -457,11 +473,61 @@ class GradOp : public IRMutator {
     return mutate(expr);
   }
 
-  // virtual Expr visit(Ref<const IntImm>);
-  // virtual Expr visit(Ref<const UIntImm>);
-  // virtual Expr visit(Ref<const FloatImm>);
+  const std::vector<GradIterSpace> &iter_spaces() const {
+    return iter_spaces_;
+  }
+
+  // number of accesses to grad_to met so far
+  int occurrences() const {
+    return occurrences_;
+  }
+
+  // constants and piecewise constant exprs, no bindings
+  Expr zero_grad(Type t) {
+    std::unordered_map<std::shared_ptr<const Index>, Expr> empty;
+    vmap_scope_.push_back(empty);
+    return Utils::make_const(t, 0);
+  }
+
+  // the chain rule term d * f of a derivative d, a zero d drops the term
+  // instead of leaving 0 * f, which the simplifier keeps for floats
+  Expr chain(const Expr &d, const Expr &f, bool d_left) {
+    if (is_const_zero(Simplify::simplify(d))) {
+      return Utils::make_const(d.type(), 0);
+    }
+    return d_left ? Arith::mul(d, f) : Arith::mul(f, d);
+  }
+
+  // the saved tensor access of a materialized forward expr, or expr itself
+  Expr forward_output(const Expr &expr) {
+    Utils::ExprEqualByValue eev;
+    for (auto kv : forward_outputs_) {
+      if (eev.visit_expr(expr, kv.first)) {
+        return kv.second;
+      }
+    }
+    return expr;
+  }
+
+  Expr visit(Ref<const IntImm> op) override {
+    return zero_grad(op->type());
+  }
+
+  Expr visit(Ref<const UIntImm> op) override {
+    return zero_grad(op->type());
+  }
+
+  Expr visit(Ref<const FloatImm> op) override {
+    return zero_grad(op->type());
+  }
+
   // virtual Expr visit(Ref<const StringImm>);
-  // Expr visit(Ref<const Unary>) override;
+
+  Expr visit(Ref<const Unary> op) override {
+    if (op->op_type == UnaryOpType::Neg) {
+      return Arith::neg(grad(op->a));
+    } else UNEXPECTED
+  }
 
   Expr visit(Ref<const Binary> op) override {
     // std::cout << "in binay op\n";
@@ -536,7 +602,7 @@ class GradOp : public IRMutator {
       }
       vmap_scope_.pop_back();
       vmap_scope_.push_back(vmap);
-      return Arith::add(Arith::mul(new_a, sub_b), Arith::mul(sub_a, new_b));
+      return Arith::add(chain(new_a, sub_b, true), chain(new_b, sub_a, false));
     } else if (op->op_type == BinaryOpType::Div) {
       std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
       Expr new_a = grad(op->a);
@@ -577,10 +643,14 @@ class GradOp : public IRMutator {
 
       vmap_scope_.pop_back();
       vmap_scope_.push_back(vmap);
+      if (sub_b.as<IntImm>() != nullptr || sub_b.as<FloatImm>() != nullptr) {
+        // (a / c)' = a' / c, the quotient rule would give (a' * c) / (c * c)
+        return Arith::div(new_a, sub_b);
+      }
       return Arith::div(
           Arith::sub(
-              Arith::mul(new_a, sub_b),
-              Arith::mul(sub_a, new_b)),
+              chain(new_a, sub_b, true),
+              chain(new_b, sub_a, false)),
           Arith::mul(sub_b, sub_b));
     } else if (op->op_type == BinaryOpType::FloorDiv) {
       std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
@@ -619,20 +689,88 @@ class GradOp : public IRMutator {
       vmap_scope_.push_back(vmap);
       return Arith::floordiv(
           Arith::sub(
-              Arith::mul(new_a, sub_b),
-              Arith::mul(sub_a, new_b)),
+              chain(new_a, sub_b, true),
+              chain(new_b, sub_a, false)),
           Arith::mul(sub_b, sub_b));
     } else UNEXPECTED
   }
 
-  // virtual Expr visit(Ref<const Select>);
-  // virtual Expr visit(Ref<const Compare>);
-  // virtual Expr visit(Ref<const Call>);
+  Expr visit(Ref<const Select> op) override {
+    // the condition is piecewise constant, only the branches contribute
+    std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+    Expr new_true = grad(op->true_value);
+    for (auto kv : vmap_scope_.back()) {
+      vmap[kv.first] = kv.second;
+    }
+    vmap_scope_.pop_back();
+    Expr new_false = grad(op->false_value);
+    for (auto kv : vmap_scope_.back()) {
+      if (vmap.count(kv.first) != 0) {
+        LOG(WARNING) << "find repeated bindings, but still going ahead"
+                      << "old: " << vmap[kv.first] << "\n"
+                      << "new: " << kv.second << "\n";
+      }
+      vmap[kv.first] = kv.second;
+    }
+    vmap_scope_.pop_back();
+    vmap_scope_.push_back(vmap);
+    // read the saved mask instead of evaluating the condition again
+    Expr cond = forward_output(op->cond);
+    return Select::make(op->type(), Utils::substitute_index(cond, vmap), new_true, new_false);
+  }
+
+  Expr visit(Ref<const Compare> op) override {
+    return zero_grad(op->type());
+  }
+
+  Expr visit(Ref<const Call> op) override {
+    const DerivativeRule &rule = DerivativeRegistry::global().get_rule(op->func_name);
+    std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+    std::vector<Expr> new_args;
+    for (auto arg : op->args) {
+      new_args.push_back(grad(arg));
+      for (auto kv : vmap_scope_.back()) {
+        if (vmap.count(kv.first) != 0) {
+          LOG(WARNING) << "find repeated bindings, but still going ahead"
+                        << "old: " << vmap[kv.first] << "\n"
+                        << "new: " << kv.second << "\n";
+        }
+        vmap[kv.first] = kv.second;
+      }
+      vmap_scope_.pop_back();
+    }
+
+    // reuse the forward output if it is materialized
+    Expr output = forward_output(op);
+    std::vector<Expr> sub_args;
+    for (auto arg : op->args) {
+      sub_args.push_back(Utils::substitute_index(arg, vmap));
+    }
+    output = Utils::substitute_index(output, vmap);
+
+    // chain rule, skip the arguments irrelevant to grad_to
+    std::vector<Expr> partials = rule(sub_args, output);
+    ASSERT(partials.size() == op->args.size()) << "Derivative rule of " << op->func_name
+                                               << " gives wrong number of partials.\n";
+    Expr result;
+    for (size_t i = 0; i < new_args.size(); ++i) {
+      if (is_const_zero(Simplify::simplify(new_args[i]))) {
+        continue;
+      }
+      Expr term = Arith::mul(new_args[i], partials[i]);
+      result = result.defined() ? Arith::add(result, term) : term;
+    }
+    vmap_scope_.push_back(vmap);
+    if (!result.defined()) {
+      return Utils::make_const(op->type(), 0);
+    }
+    return result;
+  }
 
   Expr visit(Ref<const Var> op) override {
     // TODO: for now we can only judge by string
     // change it to judge by pointer
-    if (op->name == grad_to_->name) {
+    if (op->name == grad_to_->name && occurrences_++ == active_) {
       std::vector<std::unordered_map<std::string, int>> coeffs;
       // handle args
       for (const Expr &arg : op->args) {
@@ -653,7 +791,7 @@ class GradOp : public IRMutator {
 
       int cols = (int)context_.index_names.size();
       int rows = (int)coeffs.size();
-      Arith::Matrix<int> trans(rows, cols);
+      Arith::SmallMatrix trans(rows, cols);
       for (int i = 0; i < rows; ++i) {
         for (int j = 0; j < cols; ++j) {
           if (coeffs[i].count(context_.index_names[j]) != 0) {
@@ -678,42 +816,27 @@ class GradOp : public IRMutator {
       }
       // std::cout << "\n";
 
-      // compute simith normal form
-      Arith::Matrix<int> U(rows, rows);
-      Arith::Matrix<int> V(cols, cols);
-      int dims = Arith::smith_normalize(trans, U, V);
-
-      // std::cout << "check dim=" << dims << "\n";
-
-      // std::cout << "check trans after:\n";
-      for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-          // std::cout << trans[i][j] << " ";
-        }
-        // std::cout << "\n";
-      }
-      // std::cout << "\n";
-
-      // std::cout << "check U:\n";
-      for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < rows; ++j) {
-          // std::cout << U[i][j] << " ";
-        }
-        // std::cout << "\n";
-      }
-      // std::cout << "\n";
-
-      // std::cout << "check V:\n";
-      for (int i = 0; i < cols; ++i) {
-        for (int j = 0; j < cols; ++j) {
-          // std::cout << V[i][j] << " ";
-        }
-        // std::cout << "\n";
-      }
-      // std::cout << "\n";
+      // compute simith normal form, shared by kernels with the same access pattern
+      const Arith::SmithNormalForm &snf = Session::global().smith_cache().get(trans);
+      const Arith::SmallMatrix &U = snf.U;
+      const Arith::SmallMatrix &V = snf.V;
+      int dims = snf.rank;
 
       // explain the results:
+      // trans * x = b, U * trans * V = D
+      // => x = V * y, D * y = U * b
       std::vector<Expr> Ub = Arith::relax_matrix_array_product(U, compute_args_);
+      GradIterSpace space;
+      std::vector<Expr> y;
+      for (int i = 0; i < dims; ++i) {
+        if (snf.diagonal[i] != 1) {
+          // y_i = Ub_i / d_i only when Ub_i is divisible by d_i
+          space.divisibility.push_back(std::make_pair(Ub[i], (int)snf.diagonal[i]));
+          y.push_back(Arith::floordiv(Ub[i], (int)snf.diagonal[i]));
+        } else {
+          y.push_back(Ub[i]);
+        }
+      }
       // unbounded bindings
       std::unordered_set<std::string> relaxes;
       // if cols > dims
@@ -722,7 +845,7 @@ class GradOp : public IRMutator {
         relaxes.insert(new_name);
         Expr v = Index::make(
           Type::int_scalar(32), new_name, Dom::make(Type::int_scalar(32), Expr(0), Expr(-1)), IndexType::Reduce);
-        Ub.push_back(v);
+        y.push_back(v);
         context_.index_map[new_name] = v.as<Index>();
         // these vars are unbounded
         context_.range_map[new_name] = Arith::ExtRange();
@@ -738,7 +861,7 @@ class GradOp : public IRMutator {
       // one var may have many bindings
       // for example, i = r0, i = r1 * 4 + s0
       std::unordered_map<std::string, std::vector<Expr>> bindings;
-      std::vector<Expr> VUb = Arith::relax_matrix_array_product(V, Ub);
+      std::vector<Expr> VUb = Arith::relax_matrix_array_product(V, y);
       // std::cout << "check VUb:\n";
       for (auto val : VUb) {
         // std::cout << val << "\n";
@@ -746,9 +869,6 @@ class GradOp : public IRMutator {
       // std::cout << "\n\n";
       for (int i = 0; i < cols; ++i) {
         Expr bind_val = VUb[i];
-        if (i < dims) {
-          bind_val = Arith::floordiv(bind_val, trans[i][i]);
-        }
         if (bindings.count(context_.index_names[i]) > 0) {
           bindings[context_.index_names[i]].push_back(bind_val);
         } else {
@@ -760,7 +880,7 @@ class GradOp : public IRMutator {
       // if rows > dims
       for (int i = dims; i < rows; ++i) {
         // must be zeros
-        conditions.push_back(Arith::eq(Ub[i], 0));
+        space.equalities.push_back(Ub[i]);
       }
 
       // solve the floor_div/mod substitution
@@ -852,9 +972,10 @@ class GradOp : public IRMutator {
           }
         }
 
-        // Put bound checkers
+        // Put bound checkers, a relaxed var took its range from kv.first
         // TODO: do not put unnecessary checkers
-        if (kv.second.as<Index>() == nullptr) {
+        Ref<const Index> as_var = kv.second.as<Index>();
+        if (!as_var.defined() || relaxes.count(as_var->name) == 0) {
           ASSERT(context_.range_map[kv.first].range_type() == Arith::ExtRangeType::LCRC);
           conditions.push_back(Arith::logic_and(
             Arith::ge(kv.second, context_.range_map[kv.first].left),
@@ -908,11 +1029,14 @@ class GradOp : public IRMutator {
         context_.range_map[it] = Arith::ExtRange(0, pos_ext, false, false);
       }
       // prepare condition
-      Expr result_condition = UIntImm::make(Type::bool_scalar(), 1);
       for (auto val : conditions) {
-        result_condition = Arith::logic_and(result_condition, val);
+        val = Utils::substitute_index(val, pos_vmap);
+        space.conditions.push_back(Utils::substitute_index_by_name(val, relax_vmap));
       }
-      result_condition = Utils::substitute_index(result_condition, pos_vmap);
+      for (auto iv : new_axis) {
+        space.reduce_axis.push_back(iv);
+      }
+      iter_spaces_.push_back(space);
       result_expr = Utils::substitute_index(result_expr, relax_vmap);
 
       std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
@@ -921,8 +1045,6 @@ class GradOp : public IRMutator {
       }
       // add new vmap
       vmap_scope_.push_back(vmap);
-      // record condtions
-      // TODO: we didn't record the conditions
       
       result_expr = Utils::substitute_index(result_expr, vmap);
 
@@ -957,7 +1079,7 @@ class GradOp : public IRMutator {
 
 Expr ensure_unique_var(const Expr& body, SubstituteContext &context,
     Utils::NameGenerator &generator, const std::vector<Expr> &call_args,
-    std::vector<Expr> &new_call_args) {
+    std::vector<Expr> &new_call_args, bool check_repeat) {
   std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
 
   for (auto arg : call_args) {
@@ -966,7 +1088,7 @@ Expr ensure_unique_var(const Expr& body, SubstituteContext &context,
     std::string name_hint = index->name;
 
     if (index->index_type != IndexType::Reduce) {
-      if (generator.has_name(name_hint)) {
+      if (check_repeat && generator.has_name(name_hint)) {
         LOG(ERROR) << "Find repeat axis iter_var name: " << name_hint;
         throw;
       }
@@ -1006,14 +1128,18 @@ Expr ensure_unique_var(const Expr& body, SubstituteContext &context,
 }
 
 
-Stmt grad_stmt(Expr expr, std::vector<Expr> all_args, std::vector<int> call_args_index,
-  Ref<const Var> grad_to, Ref<const Var> doutput) {
+/**
+ * gradient of expr to grad_to, one term per access to grad_to
+ * every access is differentiated alone with its own bindings,
+ * so terms like B[i, j] + B[i + 1, j] do not mix their index bindings
+ * spaces[k] is the iteration space of terms[k]
+ */
+std::vector<Expr> grad_body(Expr expr, std::vector<Expr> &all_args, std::vector<int> &call_args_index,
+  Ref<const Var> grad_to, Ref<const Var> doutput, std::vector<std::pair<Expr, Expr>> &forward_outputs,
+  Utils::NameGenerator &gen, std::vector<Expr> &new_args, Expr &new_dst,
+  std::vector<GradIterSpace> &spaces) {
   // std::cout << "check original body:\n" << expr << "\n";
 
-  Utils::NameGenerator gen;
-  SubstituteContext context;
-
-  std::vector<Expr> new_args;
   Type index_type = Type::int_scalar(32);
   for (uint64_t s : grad_to->shape) {
     std::string new_name = gen("_z");
@@ -1021,36 +1147,834 @@ Stmt grad_stmt(Expr expr, std::vector<Expr> all_args, std::vector<int> call_args
       Index::make(
         index_type, new_name, Dom::make(index_type, Expr(0), Expr(s)), IndexType::Spatial)
       );
-    context.range_map[new_name] = Arith::ExtRange(Expr(0), Expr(s), false, false);
   }
-  Expr new_dst = Var::make(grad_to->type(), gen("d" + grad_to->name), new_args, grad_to->shape);
+  new_dst = Var::make(grad_to->type(), gen("d" + grad_to->name), new_args, grad_to->shape);
+
+  std::vector<Expr> terms;
+  int occurrences = 1;
+  for (int active = 0; active < occurrences; ++active) {
+    SubstituteContext context;
+    for (auto arg : new_args) {
+      Ref<const Index> as_index = arg.as<Index>();
+      context.range_map[as_index->name] = Arith::ExtRange(
+        Expr(0), as_index->dom.as<Dom>()->extent, false, false);
+    }
+
+    std::vector<Expr> new_all_args;
+    Expr new_body = ensure_unique_var(expr, context, gen, all_args, new_all_args, active == 0);
 
-  std::vector<Expr> new_all_args;
+    // std::cout << "check initial context:\n";
+    // std::cout << context << "\n";
+    // std::cout << "check new_body:\n" << new_body << "\n"; 
 
-  Expr new_body = ensure_unique_var(expr, context, gen, all_args, new_all_args);
+    std::vector<Expr> new_call_args;
+    for (auto it : call_args_index) {
+      new_call_args.push_back(new_all_args[it]);
+    }
 
-  // std::cout << "check initial context:\n";
-  // std::cout << context << "\n";
-  // std::cout << "check new_body:\n" << new_body << "\n"; 
+    // forward outputs are written in the original indices
+    std::unordered_map<std::shared_ptr<const Index>, Expr> arg_vmap;
+    for (size_t i = 0; i < all_args.size(); ++i) {
+      arg_vmap[all_args[i].as<Index>()] = new_all_args[i];
+    }
+    std::vector<std::pair<Expr, Expr>> new_forward_outputs;
+    for (auto kv : forward_outputs) {
+      new_forward_outputs.push_back(std::make_pair(
+        Utils::substitute_index(kv.first, arg_vmap), Utils::substitute_index(kv.second, arg_vmap)));
+    }
 
-  std::vector<Expr> new_call_args;
-  for (auto it : call_args_index) {
-    new_call_args.push_back(new_all_args[it]);
-  }
+    GradOp grader(gen, context, grad_to, doutput, new_call_args, new_args, new_forward_outputs, active);
+
+    new_body = grader.grad(new_body);
+    occurrences = grader.occurrences();
+    if (grader.iter_spaces().empty()) {
+      // grad_to is not accessed
+      continue;
+    }
+    spaces.push_back(grader.iter_spaces()[0]);
 
-  GradOp grader(gen, context, grad_to, doutput, new_call_args, new_args);
+    // std::cout << "expression after grad:\n" << new_body << "\n";
 
-  new_body = grader.grad(new_body);
+    terms.push_back(Simplify::simplify(new_body));
 
-  // std::cout << "expression after grad:\n" << new_body << "\n";
+    // std::cout << "expression after simplify:\n" << new_body << "\n";
+  }
 
-  new_body = Simplify::simplify_unit_element(new_body);
+  return terms;
+}
 
-  // std::cout << "expression after simplify:\n" << new_body << "\n";
 
+Stmt grad_stmt(Expr expr, std::vector<Expr> all_args, std::vector<int> call_args_index,
+  Ref<const Var> grad_to, Ref<const Var> doutput, std::vector<std::pair<Expr, Expr>> forward_outputs) {
+  Utils::NameGenerator gen;
+  std::vector<Expr> new_args;
+  Expr new_dst;
+  std::vector<GradIterSpace> spaces;
+  std::vector<Expr> terms = grad_body(expr, all_args, call_args_index, grad_to, doutput,
+                                      forward_outputs, gen, new_args, new_dst, spaces);
+  Expr new_body = Utils::make_const(new_dst.type(), 0);
+  for (size_t i = 0; i < terms.size(); ++i) {
+    new_body = i == 0 ? terms[i] : Arith::add(new_body, terms[i]);
+  }
   Stmt stmt = Move::make(new_dst, new_body);
   return stmt;
-};
+}
+
+
+/**
+ * iterate one spatial index with stride to satisfy
+ * constraint % factor == 0 (or constraint == 0 when factor is 0)
+ * constraint = a * v + rest, a = 1 or -1
+ * => v = start + factor * t, start = (-a * rest) mod factor
+ * return false if no such index, the constraint should be kept as guard
+ */
+bool stride_constraint(const Expr &constraint, int factor, const std::string &const_tag,
+  std::vector<Expr> &axis, std::vector<Expr> &strided_axis,
+  std::unordered_map<std::shared_ptr<const Index>, Expr> &vmap,
+  std::vector<Expr> &conditions, Utils::NameGenerator &gen) {
+  std::unordered_map<std::string, int> coeffs;
+  ExtractIndexCoefficients extractor(const_tag);
+  extractor.get_coefficients(constraint, coeffs);
+
+  std::unordered_map<std::string, int> axis_pos;
+  for (int i = 0; i < (int)axis.size(); ++i) {
+    axis_pos[axis[i].as<Index>()->name] = i;
+  }
+  // all the indices should be unit-step spatial indices
+  int pos = -1;
+  for (auto kv : coeffs) {
+    if (kv.first == const_tag || kv.second == 0) {
+      continue;
+    }
+    if (axis_pos.count(kv.first) == 0) {
+      return false;
+    }
+    if ((kv.second == 1 || kv.second == -1) && axis_pos[kv.first] > pos) {
+      // prefer inner index
+      pos = axis_pos[kv.first];
+    }
+  }
+  if (pos < 0) {
+    return false;
+  }
+
+  Ref<const Index> v = axis[pos].as<Index>();
+  int a = coeffs[v->name];
+  // -a * rest
+  int value_const = -a * coeffs[const_tag];
+  Expr value = Expr(0);
+  for (auto index : axis) {
+    Ref<const Index> as_index = index.as<Index>();
+    if (as_index->name == v->name || coeffs.count(as_index->name) == 0
+        || coeffs[as_index->name] == 0) {
+      continue;
+    }
+    value = Arith::add(value, Arith::mul(index, -a * coeffs[as_index->name]));
+  }
+  value = Simplify::simplify(value);
+  Ref<const IntImm> value_as_int = value.as<IntImm>();
+  bool rest_is_const = value_as_int.defined() && value_as_int->value() == 0;
+  Expr extent = v->dom.as<Dom>()->extent;
+
+  if (factor == 0) {
+    // v = -a * rest, still need bound checker
+    value = Simplify::simplify(Arith::add(value, value_const));
+    conditions.push_back(Arith::logic_and(Arith::ge(value, 0), Arith::lt(value, extent)));
+    vmap[v.real_ptr()] = value;
+  } else {
+    Expr start;
+    Expr new_extent;
+    Ref<const IntImm> extent_as_int = extent.as<IntImm>();
+    if (rest_is_const) {
+      int start_value = ((value_const % factor) + factor) % factor;
+      start = Expr(start_value);
+      if (extent_as_int.defined()) {
+        new_extent = Expr(((int)extent_as_int->value() - start_value + factor - 1) / factor);
+      }
+    } else {
+      // C/C++ '%' truncates, so make the start offset non-negative explicitly
+      value = Arith::add(value, value_const);
+      start = Arith::mod(Arith::add(Arith::mod(value, factor), factor), factor);
+    }
+    if (!new_extent.defined()) {
+      new_extent = Arith::floordiv(Arith::sub(Arith::add(extent, factor - 1), start), factor);
+    }
+    start = Simplify::simplify(start);
+    Expr t = Index::make(v->type(), gen.unique_name(v->name + "_t"),
+        Dom::make(v->type(), Expr(0), new_extent), v->index_type);
+    strided_axis.push_back(t);
+    vmap[v.real_ptr()] = Simplify::simplify(Arith::add(start, Arith::mul(t, factor)));
+  }
+  axis.erase(axis.begin() + pos);
+  return true;
+}
+
+
+/**
+ * a bound checker v >= begin && v < begin + extent
+ * on a loop index v of domain [begin, begin + extent)
+ */
+bool is_trivial_bound(const Expr &cond, const std::vector<Expr> &index_list) {
+  Ref<const Binary> as_and = cond.as<Binary>();
+  if (!as_and.defined() || as_and->op_type != BinaryOpType::And) {
+    return false;
+  }
+  Ref<const Compare> ge = as_and->a.as<Compare>();
+  Ref<const Compare> lt = as_and->b.as<Compare>();
+  if (!ge.defined() || !lt.defined()
+      || ge->op_type != CompareOpType::GE || lt->op_type != CompareOpType::LT) {
+    return false;
+  }
+  Ref<const Index> v = ge->a.as<Index>();
+  Ref<const Index> u = lt->a.as<Index>();
+  if (!v.defined() || !u.defined() || v->name != u->name) {
+    return false;
+  }
+  int64_t lower, upper;
+  if (!Utils::as_const_int(ge->b, lower) || !Utils::as_const_int(lt->b, upper)) {
+    return false;
+  }
+  for (auto index : index_list) {
+    Ref<const Index> as_index = index.as<Index>();
+    if (as_index->name != v->name) {
+      continue;
+    }
+    Ref<const Dom> dom = as_index->dom.as<Dom>();
+    int64_t begin, extent;
+    return Utils::as_const_int(dom->begin, begin) && Utils::as_const_int(dom->extent, extent)
+           && lower <= begin && begin + extent <= upper;
+  }
+  return false;
+}
+
+
+/**
+ * linear combination of indices with constant coefficients,
+ * which ExtractIndexCoefficients can handle
+ */
+bool is_affine(const Expr &expr) {
+  int64_t value;
+  if (Utils::as_const_int(expr, value) || expr.as<Index>() != nullptr) {
+    return true;
+  }
+  Ref<const Unary> as_unary = expr.as<Unary>();
+  if (as_unary.defined()) {
+    return as_unary->op_type == UnaryOpType::Neg && is_affine(as_unary->a);
+  }
+  Ref<const Binary> as_binary = expr.as<Binary>();
+  if (!as_binary.defined()) {
+    return false;
+  }
+  if (as_binary->op_type == BinaryOpType::Add || as_binary->op_type == BinaryOpType::Sub) {
+    return is_affine(as_binary->a) && is_affine(as_binary->b);
+  } else if (as_binary->op_type == BinaryOpType::Mul) {
+    return (Utils::as_const_int(as_binary->a, value) && is_affine(as_binary->b))
+           || (Utils::as_const_int(as_binary->b, value) && is_affine(as_binary->a));
+  }
+  return false;
+}
+
+
+/**
+ * a relaxed reduce index v is fixed by a guard lo <= a * v + rest < hi
+ * with |a| >= hi - lo, at most one v satisfies it:
+ * v = ceil((lo - rest) / a) for a > 0, v = floor((rest - lo) / -a) for a < 0
+ * replace the loop of v by this value, the guard is kept together with
+ * the bound of v, so the possible truncation of '/' for negative values
+ * only produces iterations that fail the guards
+ */
+bool solve_tight_bound(Ref<const Index> v, std::vector<Expr> &conditions,
+  const std::string &const_tag, std::unordered_map<std::shared_ptr<const Index>, Expr> &vmap) {
+  for (auto cond : conditions) {
+    Ref<const Binary> as_and = cond.as<Binary>();
+    if (!as_and.defined() || as_and->op_type != BinaryOpType::And) {
+      continue;
+    }
+    Ref<const Compare> ge = as_and->a.as<Compare>();
+    Ref<const Compare> lt = as_and->b.as<Compare>();
+    if (!ge.defined() || !lt.defined() || ge->op_type != CompareOpType::GE
+        || lt->op_type != CompareOpType::LT || !is_affine(ge->a)) {
+      continue;
+    }
+    int64_t lo, hi;
+    if (!Utils::as_const_int(ge->b, lo) || !Utils::as_const_int(lt->b, hi)) {
+      continue;
+    }
+    Utils::ExprEqualByValue eev;
+    if (!eev.visit_expr(ge->a, lt->a)) {
+      continue;
+    }
+    std::unordered_map<std::string, int> coeffs;
+    ExtractIndexCoefficients extractor(const_tag);
+    extractor.get_coefficients(ge->a, coeffs);
+    if (coeffs.count(v->name) == 0) {
+      continue;
+    }
+    int a = coeffs[v->name];
+    if (a == 0 || std::abs(a) < hi - lo) {
+      continue;
+    }
+    // rest = sum of the other terms, collect the indices from the expr
+    std::vector<Ref<const Index>> indices;
+    Utils::IndexCollector collector([](Ref<const Index> index) { return true; });
+    collector.collect(ge->a, indices);
+    Expr rest = Expr(coeffs[const_tag]);
+    std::unordered_set<std::string> visited;
+    for (auto index : indices) {
+      if (index->name == v->name || visited.count(index->name) != 0 || coeffs[index->name] == 0) {
+        continue;
+      }
+      visited.insert(index->name);
+      rest = Arith::add(rest, Arith::mul(index, coeffs[index->name]));
+    }
+    Expr value;
+    if (a > 0) {
+      value = Arith::floordiv(Arith::add(Arith::sub(Expr((int)lo), rest), a - 1), a);
+    } else {
+      value = Arith::floordiv(Arith::sub(rest, Expr((int)lo)), -a);
+    }
+    value = Simplify::simplify(value);
+    Ref<const Dom> dom = v->dom.as<Dom>();
+    conditions.push_back(Arith::logic_and(
+      Arith::ge(value, dom->begin), Arith::lt(value, Arith::add(dom->begin, dom->extent))));
+    std::unordered_map<std::shared_ptr<const Index>, Expr> tmp;
+    tmp[v.real_ptr()] = value;
+    for (auto &val : conditions) {
+      val = Utils::substitute_index_by_name(val, tmp);
+    }
+    for (auto &kv : vmap) {
+      kv.second = Utils::substitute_index_by_name(kv.second, tmp);
+    }
+    vmap[v.real_ptr()] = value;
+    return true;
+  }
+  return false;
+}
+
+
+/**
+ * substitute the eliminated indices of vmap until none is left, the value
+ * of an index can use an index that a later constraint eliminated
+ */
+Expr substitute_eliminated(const Expr &expr, std::unordered_map<std::shared_ptr<const Index>, Expr> &vmap) {
+  Expr ret = expr;
+  // each round resolves one link of a chain, and vmap has no cycles
+  for (size_t round = 0; round <= vmap.size(); ++round) {
+    bool eliminated = false;
+    for (auto &kv : vmap) {
+      eliminated = eliminated || Utils::depends_on(ret, kv.first->name);
+    }
+    if (!eliminated) {
+      break;
+    }
+    ret = Utils::substitute_index_by_name(ret, vmap);
+  }
+  return ret;
+}
+
+
+/**
+ * lower one gradient contribution: dst += src for all index_list under guards
+ * return true if every gradient element is written at most once,
+ * i.e. index_list is new_args and dst is new_dst
+ */
+bool lower_contribution(const Expr &term, const GradIterSpace &space, const std::vector<Expr> &new_args,
+  const Expr &new_dst, bool strided, Utils::NameGenerator &gen,
+  std::vector<Expr> &index_list, Expr &dst, Expr &src, std::vector<Expr> &guards) {
+  std::vector<Expr> axis = new_args;
+  std::vector<Expr> strided_axis;
+  std::vector<Expr> conditions;
+  std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+  std::string const_tag = gen.unique_name("_const");
+  // a constraint sees the indices eliminated before it through their values
+  for (auto val : space.equalities) {
+    val = Simplify::simplify(substitute_eliminated(val, vmap));
+    if (!strided || !is_affine(val)
+        || !stride_constraint(val, 0, const_tag, axis, strided_axis, vmap, conditions, gen)) {
+      conditions.push_back(Arith::eq(val, 0));
+    }
+  }
+  for (auto kv : space.divisibility) {
+    Expr val = Simplify::simplify(substitute_eliminated(kv.first, vmap));
+    if (!strided || !is_affine(val)
+        || !stride_constraint(val, kv.second, const_tag, axis, strided_axis, vmap, conditions, gen)) {
+      conditions.push_back(Arith::eq(Arith::floormod(val, kv.second), 0));
+    }
+  }
+  for (auto val : space.conditions) {
+    conditions.push_back(Simplify::simplify(substitute_eliminated(val, vmap)));
+  }
+  // relaxed indices pinned by their guards need no loop
+  std::vector<Expr> reduce_axis;
+  for (auto index : space.reduce_axis) {
+    if (!solve_tight_bound(index.as<Index>(), conditions, const_tag, vmap)) {
+      reduce_axis.push_back(index);
+    }
+  }
+
+  // outer spatial indices, strided indices, then relaxed indices
+  index_list = axis;
+  for (auto index : strided_axis) {
+    index_list.push_back(index);
+  }
+  for (auto index : reduce_axis) {
+    index_list.push_back(index);
+  }
+
+  // bound checkers the Doms of index_list satisfy fold to true, the others
+  // are kept whole, fuse_pointwise splits regions by them
+  for (auto val : conditions) {
+    val = Simplify::simplify(substitute_eliminated(val, vmap));
+    Expr bounded = Simplify::simplify_bounds(val);
+    Ref<const UIntImm> as_bool = bounded.as<UIntImm>();
+    bool always = as_bool.defined() && bounded.type() == Type::bool_scalar() && as_bool->value() != 0;
+    if (!always && !is_trivial_bound(val, index_list)) {
+      guards.push_back(val);
+    }
+  }
+
+  dst = Simplify::simplify(substitute_eliminated(new_dst, vmap));
+  src = Simplify::simplify(substitute_eliminated(term, vmap));
+  return index_list.size() == new_args.size() && axis.size() == new_args.size();
+}
+
+
+/**
+ * a guard lo <= v + c < hi (or lo <= -v + c < hi) on a single index v,
+ * gives v in [lower, upper)
+ */
+bool as_index_interval(const Expr &cond, const std::string &const_tag,
+  std::string &name, int64_t &lower, int64_t &upper) {
+  Ref<const Binary> as_and = cond.as<Binary>();
+  if (!as_and.defined() || as_and->op_type != BinaryOpType::And) {
+    return false;
+  }
+  Ref<const Compare> ge = as_and->a.as<Compare>();
+  Ref<const Compare> lt = as_and->b.as<Compare>();
+  if (!ge.defined() || !lt.defined() || ge->op_type != CompareOpType::GE
+      || lt->op_type != CompareOpType::LT || !is_affine(ge->a)) {
+    return false;
+  }
+  int64_t lo, hi;
+  Utils::ExprEqualByValue eev;
+  if (!Utils::as_const_int(ge->b, lo) || !Utils::as_const_int(lt->b, hi) || !eev.visit_expr(ge->a, lt->a)) {
+    return false;
+  }
+  std::unordered_map<std::string, int> coeffs;
+  ExtractIndexCoefficients extractor(const_tag);
+  extractor.get_coefficients(ge->a, coeffs);
+  int a = 0;
+  for (auto kv : coeffs) {
+    if (kv.first == const_tag || kv.second == 0) {
+      continue;
+    }
+    if (a != 0 || (kv.second != 1 && kv.second != -1)) {
+      return false;
+    }
+    name = kv.first;
+    a = kv.second;
+  }
+  if (a == 0) {
+    return false;
+  }
+  int64_t c = coeffs.count(const_tag) != 0 ? coeffs[const_tag] : 0;
+  if (a == 1) {
+    lower = lo - c;
+    upper = hi - c;
+  } else {
+    lower = c - hi + 1;
+    upper = c - lo + 1;
+  }
+  return true;
+}
+
+
+/**
+ * write the sum of the pointwise contributions (srcs[k] under guards[k])
+ * to every gradient element
+ * guards bounding single indices, like those of shifted accesses
+ * B[i + 1, j], split the ranges of these indices, so every region sums
+ * its contributions without guards; other guards become selects
+ */
+std::vector<Stmt> fuse_pointwise(const std::vector<Expr> &new_args, const Expr &new_dst,
+  const std::vector<Expr> &srcs, const std::vector<std::vector<Expr>> &guards,
+  const std::string &const_tag) {
+  // regions beyond this count are not worth the code size
+  const int max_regions = 32;
+  typedef std::unordered_map<std::string, std::pair<int64_t, int64_t>> IntervalMap;
+
+  std::vector<IntervalMap> intervals(srcs.size());
+  std::vector<Expr> terms;
+  for (size_t k = 0; k < srcs.size(); ++k) {
+    Expr cond;
+    for (auto val : guards[k]) {
+      std::string name;
+      int64_t lower, upper;
+      if (as_index_interval(val, const_tag, name, lower, upper)) {
+        if (intervals[k].count(name) != 0) {
+          lower = std::max(lower, intervals[k][name].first);
+          upper = std::min(upper, intervals[k][name].second);
+        }
+        intervals[k][name] = std::make_pair(lower, upper);
+      } else {
+        cond = cond.defined() ? Arith::logic_and(cond, val) : val;
+      }
+    }
+    Expr src = srcs[k];
+    if (cond.defined()) {
+      src = Select::make(src.type(), cond, src, Utils::make_const(src.type(), 0));
+    }
+    terms.push_back(src);
+  }
+
+  // break points of every index
+  std::vector<std::vector<int64_t>> points(new_args.size());
+  int num_regions = 1;
+  for (size_t d = 0; d < new_args.size(); ++d) {
+    Ref<const Index> index = new_args[d].as<Index>();
+    int64_t extent;
+    ASSERT(Utils::as_const_int(index->dom.as<Dom>()->extent, extent)) << "Expect constant extent.\n";
+    std::set<int64_t> cut = {0, extent};
+    for (auto &interval : intervals) {
+      if (interval.count(index->name) != 0) {
+        cut.insert(std::min(std::max(interval[index->name].first, (int64_t)0), extent));
+        cut.insert(std::min(std::max(interval[index->name].second, (int64_t)0), extent));
+      }
+    }
+    points[d] = std::vector<int64_t>(cut.begin(), cut.end());
+    num_regions *= (int)points[d].size() - 1;
+  }
+  if (num_regions > max_regions) {
+    // keep all guards as selects, one region
+    for (size_t k = 0; k < srcs.size(); ++k) {
+      intervals[k].clear();
+      terms[k] = srcs[k];
+      Expr cond;
+      for (auto val : guards[k]) {
+        cond = cond.defined() ? Arith::logic_and(cond, val) : val;
+      }
+      if (cond.defined()) {
+        terms[k] = Select::make(srcs[k].type(), cond, srcs[k], Utils::make_const(srcs[k].type(), 0));
+      }
+    }
+    for (size_t d = 0; d < new_args.size(); ++d) {
+      points[d] = {points[d].front(), points[d].back()};
+    }
+    num_regions = 1;
+  }
+
+  std::vector<Stmt> ret;
+  for (int r = 0; r < num_regions; ++r) {
+    // the r-th region in mixed radix, the last index varies fastest
+    std::vector<std::pair<int64_t, int64_t>> segments(new_args.size());
+    int rest = r;
+    for (int d = (int)new_args.size() - 1; d >= 0; --d) {
+      int num_segments = (int)points[d].size() - 1;
+      segments[d] = std::make_pair(points[d][rest % num_segments], points[d][rest % num_segments + 1]);
+      rest /= num_segments;
+    }
+    std::vector<Expr> index_list;
+    std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+    for (size_t d = 0; d < new_args.size(); ++d) {
+      Ref<const Index> index = new_args[d].as<Index>();
+      if (points[d].size() == 2) {
+        index_list.push_back(new_args[d]);
+        continue;
+      }
+      Expr new_index = Index::make(index->type(), index->name,
+        Dom::make(index->type(), Expr((int)segments[d].first),
+                  Expr((int)(segments[d].second - segments[d].first))), index->index_type);
+      index_list.push_back(new_index);
+      vmap[index.real_ptr()] = new_index;
+    }
+    // break points include the interval ends, a segment is inside
+    // an interval or disjoint with it
+    Expr sum;
+    for (size_t k = 0; k < terms.size(); ++k) {
+      bool inside = true;
+      for (size_t d = 0; d < new_args.size(); ++d) {
+        auto it = intervals[k].find(new_args[d].as<Index>()->name);
+        if (it != intervals[k].end() && (segments[d].first < it->second.first
+            || segments[d].second > it->second.second)) {
+          inside = false;
+        }
+      }
+      if (inside) {
+        sum = sum.defined() ? Arith::add(sum, terms[k]) : terms[k];
+      }
+    }
+    if (!sum.defined()) {
+      sum = Utils::make_const(new_dst.type(), 0);
+    }
+    ret.push_back(LoopNest::make(index_list, {Move::make(
+      Utils::substitute_index_by_name(new_dst, vmap), Utils::substitute_index_by_name(sum, vmap))}));
+  }
+  return ret;
+}
+
+
+/**
+ * turn the affine guards of an accumulation loop nest into loop bounds
+ * - the guards and the Doms of index_list form an Arith::IntegerSet, its
+ *   nested bounds in the order of index_list become the new Doms, e.g.
+ *   0 <= h - r < P with r in [0, R) gives r in [max(0, h - P + 1), min(R - 1, h)]
+ * - every constraint holds exactly on the innermost index it involves,
+ *   so the affine guards are dropped, the others are kept
+ * - index_list, guards, dst and src are updated in place
+ */
+void bound_loops_by_guards(std::vector<Expr> &index_list, std::vector<Expr> &guards, Expr &dst, Expr &src) {
+  Arith::IntegerSet set;
+  std::vector<std::string> order;
+  std::unordered_map<std::string, std::pair<int64_t, int64_t>> ranges;
+  for (auto index : index_list) {
+    Ref<const Index> as_index = index.as<Index>();
+    Ref<const Dom> dom = as_index->dom.as<Dom>();
+    int64_t begin, extent;
+    if (!Utils::as_const_int(dom->begin, begin) || !Utils::as_const_int(dom->extent, extent)) {
+      return;
+    }
+    set.add_range(as_index->name, begin, begin + extent);
+    ranges[as_index->name] = std::make_pair(begin, begin + extent - 1);
+    order.push_back(as_index->name);
+  }
+
+  // split the guards into atoms, collect the affine ones as constraints
+  std::vector<Expr> kept;
+  bool absorbed = false;
+  std::vector<Expr> stack(guards.rbegin(), guards.rend());
+  while (!stack.empty()) {
+    Expr cond = stack.back();
+    stack.pop_back();
+    Ref<const Binary> as_and = cond.as<Binary>();
+    if (as_and.defined() && as_and->op_type == BinaryOpType::And) {
+      stack.push_back(as_and->b);
+      stack.push_back(as_and->a);
+      continue;
+    }
+    Ref<const Compare> cmp = cond.as<Compare>();
+    Arith::LinearForm a, b;
+    if (!cmp.defined() || !Arith::LinearForm::from_expr(cmp->a, a) || !Arith::LinearForm::from_expr(cmp->b, b)) {
+      kept.push_back(cond);
+      continue;
+    }
+    Arith::LinearForm diff = a - b;
+    bool known = true;
+    for (auto &term : diff.terms()) {
+      known = known && ranges.count(term.first) != 0;
+    }
+    if (!known || cmp->op_type == CompareOpType::NE) {
+      kept.push_back(cond);
+      continue;
+    }
+    // as form >= 0
+    absorbed = true;
+    if (cmp->op_type == CompareOpType::GE) {
+      set.add_ge(diff);
+    } else if (cmp->op_type == CompareOpType::GT) {
+      set.add_ge(diff - Arith::LinearForm(1));
+    } else if (cmp->op_type == CompareOpType::LE) {
+      set.add_ge(diff * -1);
+    } else if (cmp->op_type == CompareOpType::LT) {
+      set.add_ge(diff * -1 - Arith::LinearForm(1));
+    } else {
+      set.add_eq(diff);
+    }
+  }
+  std::vector<Arith::LoopBounds> bounds;
+  if (!absorbed || !set.loop_bounds(order, bounds)) {
+    return;
+  }
+
+  // floor(form / d) that also holds for the truncating '/' of the generated
+  // code: shift a possibly negative numerator by a multiple of d
+  std::unordered_map<std::string, Expr> symbols;
+  auto floor_expr = [&](const Arith::LinearForm &form, int64_t d, Type type) {
+    if (d == 1) {
+      return form.to_expr(type, symbols);
+    }
+    int64_t lowest = form.constant();
+    for (auto &term : form.terms()) {
+      auto &range = ranges[term.first];
+      lowest += term.second * (term.second > 0 ? range.first : range.second);
+    }
+    int64_t shift = lowest < 0 ? (-lowest + d - 1) / d : 0;
+    Expr ret = Arith::floordiv((form + Arith::LinearForm(shift * d)).to_expr(type, symbols), Utils::make_const(type, d));
+    return Arith::sub(ret, Utils::make_const(type, shift));
+  };
+  // max / min of the bounds, constants folded into one
+  auto combine = [&](const std::vector<std::pair<Arith::LinearForm, int64_t>> &list, bool is_lower, Type type) {
+    Expr ret;
+    bool has_const = false;
+    int64_t value = 0;
+    for (auto &bound : list) {
+      // ceil(n / d) = floor((n + d - 1) / d)
+      Arith::LinearForm num = is_lower ? bound.first + Arith::LinearForm(bound.second - 1) : bound.first;
+      if (num.is_constant()) {
+        int64_t c = num.constant() >= 0 ? num.constant() / bound.second
+                                        : -((-num.constant() + bound.second - 1) / bound.second);
+        value = !has_const ? c : (is_lower ? std::max(value, c) : std::min(value, c));
+        has_const = true;
+        continue;
+      }
+      Expr e = floor_expr(num, bound.second, type);
+      ret = !ret.defined() ? e : Select::make(type, is_lower ? Arith::gt(ret, e) : Arith::lt(ret, e), ret, e);
+    }
+    if (has_const) {
+      Expr e = Utils::make_const(type, value);
+      ret = !ret.defined() ? e : Select::make(type, is_lower ? Arith::gt(ret, e) : Arith::lt(ret, e), ret, e);
+    }
+    return ret;
+  };
+
+  std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+  std::vector<Expr> new_index_list;
+  for (size_t k = 0; k < index_list.size(); ++k) {
+    Ref<const Index> as_index = index_list[k].as<Index>();
+    Type type = as_index->type();
+    Expr begin = combine(bounds[k].lower, true, type);
+    Expr extent = Arith::sub(Arith::add(combine(bounds[k].upper, false, type), Utils::make_const(type, 1)), begin);
+    int64_t new_begin, new_extent;
+    if (Utils::as_const_int(begin, new_begin) && Utils::as_const_int(extent, new_extent)
+        && new_begin == ranges[as_index->name].first && new_begin + new_extent - 1 == ranges[as_index->name].second) {
+      new_index_list.push_back(index_list[k]);
+      symbols[as_index->name] = index_list[k];
+      continue;
+    }
+    Expr new_index = Index::make(type, as_index->name, Dom::make(type, begin, extent), as_index->index_type);
+    new_index_list.push_back(new_index);
+    symbols[as_index->name] = new_index;
+    vmap[as_index.real_ptr()] = new_index;
+  }
+  index_list = new_index_list;
+  guards.clear();
+  for (auto atom : kept) {
+    guards.push_back(Utils::substitute_index_by_name(atom, vmap));
+  }
+  dst = Utils::substitute_index_by_name(dst, vmap);
+  src = Utils::substitute_index_by_name(src, vmap);
+}
+
+
+Stmt grad_loop_nest(Expr expr, std::vector<Expr> all_args, std::vector<int> call_args_index,
+  Ref<const Var> grad_to, Ref<const Var> doutput, bool strided,
+  std::vector<std::pair<Expr, Expr>> forward_outputs) {
+  Utils::NameGenerator gen;
+  std::vector<Expr> new_args;
+  Expr new_dst;
+  std::vector<GradIterSpace> spaces;
+  std::vector<Expr> terms = grad_body(expr, all_args, call_args_index, grad_to, doutput,
+                                      forward_outputs, gen, new_args, new_dst, spaces);
+
+  // contributions writing each gradient element at most once are summed
+  // up in registers and written by one pass, which also initializes the
+  // gradient; the others accumulate to it with their own loop nests
+  std::vector<Expr> srcs;
+  std::vector<std::vector<Expr>> pointwise_guards;
+  std::vector<Stmt> accumulations;
+  for (size_t k = 0; k < terms.size(); ++k) {
+    std::vector<Expr> index_list;
+    Expr dst;
+    Expr src;
+    std::vector<Expr> guards;
+    if (lower_contribution(terms[k], spaces[k], new_args, new_dst, strided, gen,
+                           index_list, dst, src, guards)) {
+      srcs.push_back(src);
+      pointwise_guards.push_back(guards);
+      continue;
+    }
+    bound_loops_by_guards(index_list, guards, dst, src);
+    Stmt body = Move::make(dst, Arith::add(dst, src));
+    if (!guards.empty()) {
+      Expr cond = guards[0];
+      for (int i = 1; i < (int)guards.size(); ++i) {
+        cond = Arith::logic_and(cond, guards[i]);
+      }
+      body = IfThenElse::make(cond, body, Stmt());
+    }
+    accumulations.push_back(LoopNest::make(index_list, {body}));
+  }
+
+  std::vector<Stmt> body_list = fuse_pointwise(
+    new_args, new_dst, srcs, pointwise_guards, gen.unique_name("_const"));
+  for (auto stmt : accumulations) {
+    body_list.push_back(stmt);
+  }
+  return Simplify::simplify_bounds(LoopNest::make({}, body_list));
+}
+
+
+Stmt save_bitmask(Expr cond, std::vector<Expr> index_list, const std::string &name,
+  Expr &mask, std::pair<Expr, Expr> &saved) {
+  ASSERT(!index_list.empty()) << "Empty index list for bitmask " << name << ".\n";
+  Type index_type = Type::int_scalar(32);
+  Type word_type = Type::uint_scalar(32);
+  std::vector<Expr> args;
+  std::vector<Expr> word_axis;
+  std::vector<uint64_t> shape;
+  for (auto index : index_list) {
+    Ref<const Index> as_index = index.as<Index>();
+    ASSERT(as_index.defined()) << "Expect Index for bitmask " << name << ".\n";
+    int64_t extent;
+    ASSERT(Utils::as_const_int(as_index->dom.as<Dom>()->extent, extent))
+      << "Expect constant extent of " << as_index->name << ".\n";
+    shape.push_back((uint64_t)extent);
+    args.push_back(index);
+    word_axis.push_back(index);
+  }
+  // pack the last index into 32-bit words
+  Expr last = index_list.back();
+  shape.back() = (shape.back() + 31) / 32;
+  args.back() = Arith::floordiv(last, 32);
+  word_axis.back() = Index::make(index_type, name + "_w",
+    Dom::make(index_type, 0, Expr((int)shape.back())), IndexType::Spatial);
+  mask = Var::make(word_type, name, args, shape);
+  Expr bit = Arith::floormod(last, 32);
+
+  Expr word = Var::make(word_type, name, word_axis, shape);
+  Stmt init = LoopNest::make(word_axis, {Move::make(word, Utils::make_const(word_type, 0))});
+  Stmt set = LoopNest::make(index_list,
+    {Move::make(mask, Call::make(word_type, {mask, cond, bit}, "bitmask_set", CallType::Pure))});
+  saved = std::make_pair(cond, Call::make(Type::bool_scalar(), {mask, bit}, "bitmask_get", CallType::Pure));
+  return LoopNest::make({}, {init, set});
+}
+
+
+Stmt save_argmax(Expr value, Expr out, std::vector<Expr> reduce_list, const std::string &name,
+  Expr &arg, Expr &routed) {
+  Ref<const Var> out_var = out.as<Var>();
+  ASSERT(out_var.defined()) << "Expect Var for the output of argmax " << name << ".\n";
+  Type index_type = Type::int_scalar(32);
+  // flattened position in the reduce indices
+  // keep the original indices (not simplified copies) so that autodiff can bind them
+  Expr pos;
+  std::unordered_map<std::shared_ptr<const Index>, Expr> first;
+  for (auto index : reduce_list) {
+    Ref<const Index> as_index = index.as<Index>();
+    ASSERT(as_index.defined()) << "Expect Index for argmax " << name << ".\n";
+    Ref<const Dom> dom = as_index->dom.as<Dom>();
+    int64_t begin;
+    Expr offset = index;
+    if (!Utils::as_const_int(dom->begin, begin) || begin != 0) {
+      offset = Arith::sub(index, dom->begin);
+    }
+    pos = pos.defined() ? Arith::add(Arith::mul(pos, dom->extent), offset) : offset;
+    first[as_index.real_ptr()] = dom->begin;
+  }
+  arg = Var::make(index_type, name, out_var->args, out_var->shape);
+
+  // start from the first element, then keep the larger one
+  Stmt init = LoopNest::make(out_var->args, {
+    Move::make(out, Utils::substitute_index(value, first)),
+    Move::make(arg, Expr(0))});
+  Stmt update = IfThenElse::make(Arith::gt(value, out),
+    LoopNest::make({}, {Move::make(out, value), Move::make(arg, pos)}), Stmt());
+  std::vector<Expr> index_list = out_var->args;
+  for (auto index : reduce_list) {
+    index_list.push_back(index);
+  }
+  routed = Select::make(value.type(), Arith::eq(arg, pos), value, Utils::make_const(value.type(), 0));
+  return LoopNest::make({}, {init, LoopNest::make(index_list, {update})});
+}
 
 
 }  // namespace Autodiff
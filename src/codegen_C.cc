@@ -22,9 +22,14 @@
  * SOFTWARE.
 */
 
-#include <sstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_set>
 
 #include "debug.h"
+#include "utils.h"
+#include "parallel.h"
 #include "codegen_C.h"
 
 namespace Boost {
@@ -33,65 +38,275 @@ using namespace Internal;
 
 namespace codegen {
 
+namespace {
+
+int register_bits(VectorISA isa) {
+  switch (isa) {
+    case VectorISA::AVX2:
+      return 256;
+    case VectorISA::AVX512:
+      return 512;
+    default:
+      // SSE4.2, and SSE2, the x86-64 baseline of Native
+      return 128;
+  }
+}
+
+
+const char *isa_suffix(VectorISA isa) {
+  switch (isa) {
+    case VectorISA::SSE:
+      return "sse";
+    case VectorISA::AVX2:
+      return "avx2";
+    case VectorISA::AVX512:
+      return "avx512";
+    default:
+      return "native";
+  }
+}
+
+
+// target attribute of the kernels of isa
+const char *isa_target(VectorISA isa) {
+  switch (isa) {
+    case VectorISA::SSE:
+      return "sse4.2";
+    case VectorISA::AVX2:
+      return "avx2,fma";
+    case VectorISA::AVX512:
+      return "avx512f,fma";
+    default:
+      return "";
+  }
+}
+
+
+// feature checked by the dispatcher, see __builtin_cpu_supports
+const char *isa_feature(VectorISA isa) {
+  switch (isa) {
+    case VectorISA::SSE:
+      return "sse4.2";
+    case VectorISA::AVX2:
+      return "avx2";
+    case VectorISA::AVX512:
+      return "avx512f";
+    default:
+      return "";
+  }
+}
+
+
+// defined by Eigen when it is compiled for isa
+const char *eigen_macro(VectorISA isa) {
+  switch (isa) {
+    case VectorISA::SSE:
+      return "EIGEN_VECTORIZE_SSE4_2";
+    case VectorISA::AVX2:
+      return "EIGEN_VECTORIZE_AVX2";
+    case VectorISA::AVX512:
+      return "EIGEN_VECTORIZE_AVX512";
+    default:
+      return "";
+  }
+}
+
+
+/**
+ * vector types of loads, stores, ramps and casts, in order of appearance;
+ * the other vector values have the type of their operands
+ */
+class VectorTypes : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const Var> op) override {
+    add(op->type());
+    // the ramps of accesses print their base
+    for (auto &arg : op->args) {
+      Ref<const Ramp> as_ramp = arg.as<Ramp>();
+      (as_ramp.defined() ? as_ramp->base : arg).visit_expr(this);
+    }
+  }
+
+  void visit(Ref<const Ramp> op) override {
+    add(op->type());
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Cast> op) override {
+    add(op->new_type);
+    IRVisitor::visit(op);
+  }
+
+  void add(const Type &t) {
+    if (!t.is_scalar() && std::find(types.begin(), types.end(), t) == types.end()) {
+      types.push_back(t);
+    }
+  }
+
+  std::vector<Type> types;
+};
+
+
+bool is_broadcast(const Expr &expr) {
+  Ref<const Ramp> as_ramp = expr.as<Ramp>();
+  return as_ramp.defined() && as_ramp->stride == 0;
+}
+
+}  // anonymous namespace
+
+
+int vector_lanes(VectorISA isa, const Type &t) {
+  CHECK((int)t.bits > 0, "Type without bits\n");
+  return register_bits(isa) / (int)t.bits;
+}
+
 
 std::string CodeGen_C::print_type(const Type &t) {
-  std::ostringstream out;
+  if (!t.is_scalar()) {
+    return print_vector_type(t);
+  }
+  std::string ret;
   switch (t.code)
   {
   case Internal::TypeCode::Bool:
-    out << "bool";
+    ret = "bool";
     break;
   case Internal::TypeCode::Int:
-    out << "int" << t.bits << "_t";
+    ret = "int" + std::to_string(t.bits) + "_t";
     break;
   case Internal::TypeCode::UInt:
-    out << "uint" << t.bits << "_t";
+    ret = "uint" + std::to_string(t.bits) + "_t";
     break;
   case Internal::TypeCode::Float:
     if ((int)t.bits == 32) {
-      out << "float";
+      ret = "float";
     } else if ((int)t.bits == 64) {
-      out << "double";
+      ret = "double";
     } else {
       LOG(ERROR) << "No support for float of bits: " << t.bits << ".";
     }
     break;
   case Internal::TypeCode::String:
-    out << "";
     CHECK((int)t.bits == 1, "Not support string with bits: %ud\n", t.bits);
     break;
   case Internal::TypeCode::Handle:
-    out << "(void*)";
+    ret = "(void*)";
     CHECK((int)t.bits == 1, "Not support handle with bits: %ud\n", t.bits);
     break;
   default: LOG(ERROR) << "Type unknown: " << t;
     break;
   }
-  CHECK((int)t.is_scalar(), "Do not support vector type\n");
-  return out.str();
+  return ret;
+}
+
+
+std::string CodeGen_C::print_vector_type(const Type &t) {
+  CHECK(t.lanes_list.size() == 1, "Do not support vector type of several dimensions\n");
+  CHECK(t.code != TypeCode::Bool, "Do not support vector of bool, use it in Select or Cast\n");
+  int lanes = t.lanes();
+  if (vector_backend == VectorBackend::EigenPacket) {
+    std::string suffix;
+    if (t.code == TypeCode::Float && (int)t.bits == 32) {
+      suffix = "f";
+    } else if (t.code == TypeCode::Float && (int)t.bits == 64) {
+      suffix = "d";
+    } else if (t.code == TypeCode::Int && (int)t.bits == 32) {
+      suffix = "i";
+    }
+    CHECK(suffix != "", "No Eigen packet of the vector type\n");
+    CHECK(vector_isa == VectorISA::Native || lanes * (int)t.bits == register_bits(vector_isa),
+          "Eigen packets fill one register of the ISA, got %d lanes\n", lanes);
+    return "Eigen::internal::Packet" + std::to_string(lanes) + suffix;
+  }
+  std::string ret;
+  if (t.code == TypeCode::Float) {
+    ret = "float";
+  } else if (t.code == TypeCode::Int) {
+    ret = "int";
+  } else if (t.code == TypeCode::UInt) {
+    ret = "uint";
+  } else {
+    LOG(ERROR) << "Vector of type unknown: " << t;
+  }
+  return ret + std::to_string((int)t.bits) + "x" + std::to_string(lanes);
+}
+
+
+void CodeGen_C::print_vector_prelude(const std::string &kernel, const std::vector<Type> &types) {
+  if (types.empty()) {
+    return;
+  }
+  if (vector_backend == VectorBackend::EigenPacket) {
+    oss << "#include <Eigen/Core>\n";
+    if (vector_isa != VectorISA::Native) {
+      oss << "#if !defined(" << eigen_macro(vector_isa) << ")\n";
+      oss << "#error \"" << kernel << " needs Eigen compiled for " << isa_suffix(vector_isa) << "\"\n";
+      oss << "#endif\n";
+    }
+    return;
+  }
+  for (auto &t : types) {
+    std::string name = print_vector_type(t);
+    Type elem = t.with_lanes(1);
+    int bytes = (int)t.bits / 8;
+    // the unaligned, aliasing view loads and stores go through
+    oss << "#ifndef BOOST_VECTOR_" << name << "\n";
+    oss << "#define BOOST_VECTOR_" << name << "\n";
+    oss << "typedef " << print_type(elem) << " " << name
+        << " __attribute__((vector_size(" << bytes * t.lanes() << ")));\n";
+    oss << "typedef " << print_type(elem) << " " << name << "_u"
+        << " __attribute__((vector_size(" << bytes * t.lanes() << "), aligned(" << bytes << "), may_alias));\n";
+    oss << "#endif\n";
+  }
 }
 
 
 std::string CodeGen_C::print(const Expr &expr) {
-  oss.str("");
-  oss.clear();
-  expr.visit_expr(this);
-  return oss.str();
+  ArenaSink sink;
+  sink.reserve(size_hint);
+  emit(expr, sink);
+  size_hint = sink.size();
+  return sink.take();
 }
 
 std::string CodeGen_C::print(const Stmt &stmt) {
-  oss.str("");
-  oss.clear();
-  stmt.visit_stmt(this);
-  return oss.str();
+  ArenaSink sink;
+  sink.reserve(size_hint);
+  emit(stmt, sink);
+  size_hint = sink.size();
+  return sink.take();
 }
 
 
 std::string CodeGen_C::print(const Group &group) {
-  oss.str("");
-  oss.clear();
+  ArenaSink sink;
+  sink.reserve(size_hint);
+  emit(group, sink);
+  size_hint = sink.size();
+  return sink.take();
+}
+
+
+void CodeGen_C::emit(const Expr &expr, Sink &sink) {
+  oss.reset(&sink);
+  expr.visit_expr(this);
+  oss.reset(nullptr);
+}
+
+
+void CodeGen_C::emit(const Stmt &stmt, Sink &sink) {
+  oss.reset(&sink);
+  stmt.visit_stmt(this);
+  oss.reset(nullptr);
+}
+
+
+void CodeGen_C::emit(const Group &group, Sink &sink) {
+  oss.reset(&sink);
   group.visit_group(this);
-  return oss.str();
+  oss.reset(nullptr);
 }
 
 
@@ -116,16 +331,56 @@ void CodeGen_C::visit(Ref<const StringImm> op) {
 
 
 void CodeGen_C::visit(Ref<const Unary> op) {
+  bool vector = !op->type().is_scalar();
+  if (vector && vector_backend == VectorBackend::EigenPacket) {
+    CHECK(op->op_type == UnaryOpType::Neg, "Do not support logic of Eigen packets\n");
+    oss << "Eigen::internal::pnegate(";
+    (op->a).visit_expr(this);
+    oss << ")";
+    return;
+  }
+  // parenthesize to avoid printing '--' for nested negation
+  oss << "(";
   if (op->op_type == UnaryOpType::Neg) {
       oss << "-";
   } else if (op->op_type == UnaryOpType::Not) {
-      oss << "!";
+      // masks of vector compares are 0 or -1
+      oss << (vector ? "~" : "!");
   }
   (op->a).visit_expr(this);
+  oss << ")";
 }
 
 
 void CodeGen_C::visit(Ref<const Binary> op) {
+  bool vector = !op->type().is_scalar();
+  if (vector && vector_backend == VectorBackend::EigenPacket) {
+    static const char *funcs[] = {"padd", "psub", "pmul", "pdiv"};
+    CHECK(op->op_type <= BinaryOpType::Div, "Do not support integer or logic operations of Eigen packets\n");
+    // a * b + c in one fused multiply-add where the ISA has it
+    Ref<const Binary> mul = op->a.as<Binary>();
+    Expr addend = op->b;
+    if (!mul.defined() || mul->op_type != BinaryOpType::Mul) {
+      mul = op->b.as<Binary>();
+      addend = op->a;
+    }
+    if (op->op_type == BinaryOpType::Add && mul.defined() && mul->op_type == BinaryOpType::Mul) {
+      oss << "Eigen::internal::pmadd(";
+      (mul->a).visit_expr(this);
+      oss << ", ";
+      (mul->b).visit_expr(this);
+      oss << ", ";
+      addend.visit_expr(this);
+      oss << ")";
+      return;
+    }
+    oss << "Eigen::internal::" << funcs[(int)op->op_type] << "(";
+    (op->a).visit_expr(this);
+    oss << ", ";
+    (op->b).visit_expr(this);
+    oss << ")";
+    return;
+  }
   oss << "(";
   (op->a).visit_expr(this);
   if (op->op_type == BinaryOpType::Add) {
@@ -143,9 +398,9 @@ void CodeGen_C::visit(Ref<const Binary> op) {
   } else if (op->op_type == BinaryOpType::FloorMod) {
       oss << " % ";
   } else if (op->op_type == BinaryOpType::And) {
-      oss << " && ";
+      oss << (vector ? " & " : " && ");
   } else if (op->op_type == BinaryOpType::Or) {
-      oss << " || ";
+      oss << (vector ? " | " : " || ");
   } else {
     LOG(ERROR) << "Unknown binay OpType.";
   }
@@ -155,6 +410,8 @@ void CodeGen_C::visit(Ref<const Binary> op) {
 
 
 void CodeGen_C::visit(Ref<const Compare> op) {
+  CHECK(op->a.type().is_scalar() || vector_backend != VectorBackend::EigenPacket,
+        "Do not support compare of Eigen packets\n");
   (op->a).visit_expr(this);
   if (op->op_type == CompareOpType::LT) {
       oss << " < ";
@@ -174,28 +431,96 @@ void CodeGen_C::visit(Ref<const Compare> op) {
 
 
 void CodeGen_C::visit(Ref<const Select> op) {
-  LOG(ERROR) << "Find select, should be preprocessed to if_then_else.";
-  // print_indent();
-  // oss << "if (";
-  // (op->cond).visit_expr(this);
-  // oss << ") {\n";
-  // enter();
-  // (op->true_value).visit_expr(this);
-  // exit();
-  // print_indent();
-  // oss << "} else {\n";
-  // enter();
-  // (op->false_value).visit_expr(this);
-  // exit();
-  // print_indent();
-  // oss << "}\n";
+  oss << "(";
+  // a broadcast condition selects whole vectors
+  Ref<const Ramp> as_ramp = op->cond.as<Ramp>();
+  if (is_broadcast(op->cond)) {
+    (as_ramp->base).visit_expr(this);
+  } else {
+    CHECK(op->cond.type().is_scalar() || vector_backend != VectorBackend::EigenPacket,
+          "Do not support select of Eigen packets\n");
+    (op->cond).visit_expr(this);
+  }
+  oss << " ? ";
+  (op->true_value).visit_expr(this);
+  oss << " : ";
+  (op->false_value).visit_expr(this);
+  oss << ")";
 }
 
 
 void CodeGen_C::visit(Ref<const Call> op) {
-  oss << "(" << op->func_name;
+  static const std::unordered_set<std::string> math_funcs = {
+    "exp", "log", "sqrt", "tanh", "sin", "cos", "pow", "fabs"
+  };
+  // bit operations on saved masks and reduced index arithmetic
+  if (op->func_name == "bitmask_get") {
+    oss << "((";
+    op->args[0].visit_expr(this);
+    oss << " >> ";
+    op->args[1].visit_expr(this);
+    oss << ") & 1)";
+    return;
+  } else if (op->func_name == "bitmask_set") {
+    oss << "(";
+    op->args[0].visit_expr(this);
+    oss << " | ((uint32_t)(";
+    op->args[1].visit_expr(this);
+    oss << ") << ";
+    op->args[2].visit_expr(this);
+    oss << "))";
+    return;
+  } else if (op->func_name == "shift_right") {
+    oss << "(";
+    op->args[0].visit_expr(this);
+    oss << " >> ";
+    op->args[1].visit_expr(this);
+    oss << ")";
+    return;
+  } else if (op->func_name == "bitwise_and") {
+    oss << "(";
+    op->args[0].visit_expr(this);
+    oss << " & ";
+    op->args[1].visit_expr(this);
+    oss << ")";
+    return;
+  } else if (op->func_name == "vector_reduce_add") {
+    int lanes = op->args[0].type().lanes();
+    if (vector_backend == VectorBackend::EigenPacket) {
+      oss << "Eigen::internal::predux(";
+      op->args[0].visit_expr(this);
+      oss << ")";
+      return;
+    }
+    // a statement expression rather than a lambda, lambdas don't get
+    // the target attribute of the kernel
+    oss << "({ const " << print_type(op->args[0].type()) << " _vec = ";
+    op->args[0].visit_expr(this);
+    oss << "; ";
+    for (int k = 0; k < lanes; ++k) {
+      oss << (k == 0 ? "" : " + ") << "_vec[" << k << "]";
+    }
+    oss << "; })";
+    return;
+  }
+  bool single = op->type().code == TypeCode::Float && (int)op->type().bits == 32;
+  if (op->func_name == "sigmoid") {
+    // not in libm, 1 / (1 + exp(-x))
+    oss << (single ? "(1.0f / (1.0f + expf(-(" : "(1.0 / (1.0 + exp(-(");
+    op->args[0].visit_expr(this);
+    oss << "))))";
+    return;
+  }
+  oss << op->func_name;
+  // use the single precision version of libm functions, e.g. expf
+  if (single && math_funcs.count(op->func_name) != 0) {
+      oss << "f";
+  }
+  oss << "(";
   for (size_t i = 0; i < op->args.size(); ++i) {
-      oss << ", ";
+      if (i != 0) {
+          oss << ", ";
+      }
       op->args[i].visit_expr(this);
   }
   oss << ")";
@@ -203,6 +528,20 @@ void CodeGen_C::visit(Ref<const Call> op) {
 
 
 void CodeGen_C::visit(Ref<const Cast> op) {
+  if (!op->new_type.is_scalar()) {
+    CHECK(vector_backend != VectorBackend::EigenPacket, "Do not support cast of Eigen packets\n");
+    oss << "__builtin_convertvector(";
+    if (op->val.type().code == TypeCode::Bool) {
+      // masks are 0 or -1, bools 0 or 1
+      oss << "-(";
+      (op->val).visit_expr(this);
+      oss << ")";
+    } else {
+      (op->val).visit_expr(this);
+    }
+    oss << ", " << print_type(op->new_type) << ")";
+    return;
+  }
   oss << "((" << print_type(op->new_type) << ")";
   (op->val).visit_expr(this);
   oss << ")";
@@ -210,7 +549,55 @@ void CodeGen_C::visit(Ref<const Cast> op) {
 
 
 void CodeGen_C::visit(Ref<const Ramp> op) {
-  LOG(ERROR) << "Find ramp, not supported in C/C++ source code.";
+  // the args of vector loads and stores print their base, see print_access
+  Type elem = op->type().with_lanes(1);
+  if (vector_backend == VectorBackend::EigenPacket) {
+    CHECK(op->stride == 0 || (op->stride == 1 && elem.code == TypeCode::Float),
+          "Do not support ramp of Eigen packets other than broadcasts and float ramps\n");
+    oss << "Eigen::internal::" << (op->stride == 0 ? "pset1" : "plset")
+        << "<" << print_type(op->type()) << ">(";
+    (op->base).visit_expr(this);
+    oss << ")";
+    return;
+  }
+  oss << "((" << print_type(op->type()) << "){";
+  if (op->stride != 0) {
+    for (int k = 0; k < (int)op->lanes; ++k) {
+      oss << (k == 0 ? "" : ", ") << k * (int)op->stride;
+    }
+  }
+  oss << "} + (" << print_type(elem) << ")(";
+  (op->base).visit_expr(this);
+  oss << "))";
+}
+
+
+void CodeGen_C::print_access(Ref<const Var> op) {
+  bool vector = !op->type().is_scalar();
+  std::string elem = print_type(op->type().with_lanes(1));
+  auto print_index = [&](const Expr &arg) {
+    Ref<const Ramp> as_ramp = arg.as<Ramp>();
+    if (vector && as_ramp.defined()) {
+      CHECK(as_ramp->stride == 1, "Do not support vector access of stride %d\n", (int)as_ramp->stride);
+      (as_ramp->base).visit_expr(this);
+    } else {
+      CHECK(arg.type().is_scalar(), "Do not support gather or scatter of %s\n", op->name.c_str());
+      arg.visit_expr(this);
+    }
+  };
+  if (op->args.size() == 1 && op->shape.size() > 1) {
+    // offset into the row-major storage, see Pass::StrengthReducer
+    oss << "((" << elem << " *)" << op->name << ")[";
+    print_index(op->args[0]);
+    oss << "]";
+  } else {
+    oss << op->name;
+    for (size_t i = 0; i < op->args.size(); ++i) {
+      oss << "[";
+      print_index(op->args[i]);
+      oss << "]";
+    }
+  }
 }
 
 
@@ -223,13 +610,18 @@ void CodeGen_C::visit(Ref<const Var> op) {
       oss << op->shape[i];
       oss << "]";
     }
-  } else { 
-    oss << op->name;
-    for (size_t i = 0; i < op->args.size(); ++i) {
-      oss << "[";
-      op->args[i].visit_expr(this);
-      oss << "]";
-    }
+  } else if (op->type().is_scalar() || op->args.empty()) {
+    // locals are values, see Pass::Accumulator
+    print_access(op);
+  } else if (vector_backend == VectorBackend::EigenPacket) {
+    oss << "Eigen::internal::ploadu<" << print_type(op->type()) << ">(&";
+    print_access(op);
+    oss << ")";
+  } else {
+    // loads and stores through the unaligned view, an lvalue
+    oss << "(*(" << print_type(op->type()) << "_u *)&";
+    print_access(op);
+    oss << ")";
   }
 }
 
@@ -239,26 +631,108 @@ void CodeGen_C::visit(Ref<const Dom> op) {
 }
 
 
+void CodeGen_C::visit(Ref<const Let> op) {
+  // C has no let expression, use an immediately invoked lambda
+  oss << "[&]() { const " << print_type(op->var.type()) << " ";
+  (op->var).visit_expr(this);
+  oss << " = ";
+  (op->value).visit_expr(this);
+  oss << "; return ";
+  (op->body).visit_expr(this);
+  oss << "; }()";
+}
+
+
 void CodeGen_C::visit(Ref<const Index> op) {
     oss << op->name;
 }
 
 
+int CodeGen_C::parallel_loops(Ref<const LoopNest> op, size_t k) {
+    std::vector<std::string> names;
+    while (true) {
+        for (; k < op->index_list.size(); ++k) {
+            Ref<const Index> index = op->index_list[k].as<Index>();
+            if (index->index_type != IndexType::Thread || (!names.empty() && !omp_collapse)) {
+                return (int)names.size();
+            }
+            // collapsed loops can't depend on each other
+            std::vector<Ref<const Index>> used;
+            Utils::IndexCollector collector([&](Ref<const Index> i) {
+                return std::find(names.begin(), names.end(), i->name) != names.end();
+            });
+            collector.collect(index->dom, used);
+            std::vector<Stmt> body = op->body_list;
+            if (k + 1 < op->index_list.size()) {
+                body = {LoopNest::make(std::vector<Expr>(op->index_list.begin() + k + 1, op->index_list.end()), body)};
+            }
+            std::string why;
+            if (!used.empty()) {
+                return (int)names.size();
+            }
+            if (!Pass::parallel_legal(op->index_list[k], body, why)) {
+                LOG(WARNING) << "Loop of " << index->name << " runs serially: " << why;
+                return (int)names.size();
+            }
+            names.push_back(index->name);
+        }
+        Ref<const LoopNest> inner;
+        if (op->body_list.size() == 1) {
+            inner = op->body_list[0].as<LoopNest>();
+        }
+        if (!inner.defined()) {
+            return (int)names.size();
+        }
+        op = inner;
+        k = 0;
+    }
+}
+
+
 void CodeGen_C::visit(Ref<const LoopNest> op) {
     print_range = true;
-    for (auto index : op->index_list) {
+    bool region = false;
+    for (size_t k = 0; k < op->index_list.size(); ++k) {
+        Expr index = op->index_list[k];
+        int parallel = in_parallel ? 0 : parallel_loops(op, k);
+        if (parallel > 0) {
+            print_indent();
+            oss << "#pragma omp parallel for";
+            if (parallel > 1) {
+                oss << " collapse(" << parallel << ")";
+            }
+            if (omp_schedule != "") {
+                oss << " schedule(" << omp_schedule << ")";
+            }
+            oss << "\n";
+            in_parallel = true;
+            region = true;
+        }
         print_indent();
         oss << "for (";
         oss << print_type(index.type()) << " ";
         index.visit_expr(this);
-        oss << " = 0; ";
-        index.visit_expr(this);
         std::shared_ptr<const Index> as_index = index.as<Index>();
         CHECK(as_index.get() != nullptr, "Expect Index");
         std::shared_ptr<const Dom> dom = as_index->dom.as<Dom>();
         CHECK(dom.get() != nullptr, "Expect Dom");
-        oss << " < ";
-        dom->extent.visit_expr(this);
+        std::shared_ptr<const IntImm> begin = dom->begin.as<IntImm>();
+        if (begin.get() != nullptr && begin->value() == 0) {
+            oss << " = 0; ";
+            index.visit_expr(this);
+            oss << " < ";
+            dom->extent.visit_expr(this);
+        } else {
+            // iterate [begin, begin + extent)
+            oss << " = ";
+            dom->begin.visit_expr(this);
+            oss << "; ";
+            index.visit_expr(this);
+            oss << " < ";
+            dom->begin.visit_expr(this);
+            oss << " + ";
+            dom->extent.visit_expr(this);
+        }
         oss << "; ";
         index.visit_expr(this);
         oss << " = ";
@@ -276,6 +750,9 @@ void CodeGen_C::visit(Ref<const LoopNest> op) {
         print_indent();
         oss << "}\n";
     }
+    if (region) {
+        in_parallel = false;
+    }
 }
 
 
@@ -287,11 +764,13 @@ void CodeGen_C::visit(Ref<const IfThenElse> op) {
     enter();
     (op->true_case).visit_stmt(this);
     exit();
-    print_indent();
-    oss << "} else {\n";
-    enter();
-    (op->false_case).visit_stmt(this);
-    exit();
+    if ((op->false_case).defined()) {
+        print_indent();
+        oss << "} else {\n";
+        enter();
+        (op->false_case).visit_stmt(this);
+        exit();
+    }
     print_indent();
     oss << "}\n";
 }
@@ -299,16 +778,48 @@ void CodeGen_C::visit(Ref<const IfThenElse> op) {
 
 void CodeGen_C::visit(Ref<const Move> op) {
     print_indent();
+    Ref<const Var> dst = op->dst.as<Var>();
+    if (op->move_type == MoveType::MemToLocal && dst.defined() && dst->args.empty()) {
+        // declares the local, see Pass::Accumulator
+        oss << print_type(dst->type()) << " ";
+    } else if (vector_backend == VectorBackend::EigenPacket && dst.defined() && !dst->type().is_scalar()
+               && !dst->args.empty()) {
+        oss << "Eigen::internal::pstoreu(&";
+        print_access(dst);
+        oss << ", ";
+        (op->src).visit_expr(this);
+        oss << ");\n";
+        return;
+    }
     (op->dst).visit_expr(this);
     oss << " = ";
     (op->src).visit_expr(this);
-    oss << "\n";
+    oss << ";\n";
+}
+
+
+void CodeGen_C::visit(Ref<const LetStmt> op) {
+    print_indent();
+    oss << "const " << print_type(op->var.type()) << " ";
+    (op->var).visit_expr(this);
+    oss << " = ";
+    (op->value).visit_expr(this);
+    oss << ";\n";
+    (op->body).visit_stmt(this);
 }
 
 
 void CodeGen_C::visit(Ref<const Kernel> op) {
+    VectorTypes types;
+    for (auto stmt : op->stmt_list) {
+        stmt.visit_stmt(&types);
+    }
+    print_vector_prelude(op->name, types.types);
     print_indent();
     if (op->kernel_type == KernelType::CPU) {
+        if (vector_isa != VectorISA::Native && vector_backend == VectorBackend::GccVector) {
+            oss << "__attribute__((target(\"" << isa_target(vector_isa) << "\"))) ";
+        }
         oss << "void";
     } else if (op->kernel_type == KernelType::GPU) {
         LOG(ERROR) << "Can't generate GPU kernel by C/C++ source code generation.";
@@ -335,6 +846,75 @@ void CodeGen_C::visit(Ref<const Kernel> op) {
     oss << "}\n";
 }
 
+std::string CodeGen_C::print_dispatch(const std::vector<std::pair<VectorISA, Group>> &variants) {
+    CHECK(!variants.empty(), "No variant to dispatch\n");
+    CHECK(vector_backend == VectorBackend::GccVector, "Dispatch needs the target attributes of GccVector\n");
+    for (size_t k = 0; k + 1 < variants.size(); ++k) {
+        CHECK(variants[k].first != VectorISA::Native, "The native variant goes last\n");
+    }
+    // without a native variant, the last one is printed again without a
+    // target attribute, for the baseline ISA of the translation unit
+    std::vector<std::pair<VectorISA, Group>> all = variants;
+    if (all.back().first != VectorISA::Native) {
+        all.push_back({VectorISA::Native, all.back().second});
+    }
+    VectorISA isa = vector_isa;
+    ArenaSink sink;
+    sink.reserve(size_hint);
+    Ref<const Kernel> kernel;
+    for (auto &variant : all) {
+        kernel = variant.second.as<Kernel>();
+        CHECK(kernel.defined(), "Expect kernels to dispatch\n");
+        vector_isa = variant.first;
+        Group renamed = Kernel::make(kernel->name + "_" + isa_suffix(variant.first), kernel->inputs,
+                                     kernel->outputs, kernel->stmt_list, kernel->kernel_type);
+        emit(renamed, sink);
+    }
+    vector_isa = isa;
+
+    // the kernel itself takes the first variant the CPU supports, the
+    // native one if none
+    oss.reset(&sink);
+    oss << "void " << kernel->name << "(";
+    print_arg = true;
+    std::vector<Expr> args = kernel->inputs;
+    args.insert(args.end(), kernel->outputs.begin(), kernel->outputs.end());
+    for (size_t i = 0; i < args.size(); ++i) {
+        oss << (i == 0 ? "" : ", ");
+        args[i].visit_expr(this);
+    }
+    print_arg = false;
+    oss << ") {\n";
+    enter();
+    for (size_t k = 0; k < all.size(); ++k) {
+        bool last = k + 1 == all.size();
+        if (!last) {
+            print_indent();
+            oss << "if (__builtin_cpu_supports(\"" << isa_feature(all[k].first) << "\")) {\n";
+            enter();
+        }
+        print_indent();
+        oss << kernel->name << "_" << isa_suffix(all[k].first) << "(";
+        for (size_t i = 0; i < args.size(); ++i) {
+            oss << (i == 0 ? "" : ", ") << args[i].as<Var>()->name;
+        }
+        oss << ");\n";
+        if (last) {
+            break;
+        }
+        print_indent();
+        oss << "return;\n";
+        exit();
+        print_indent();
+        oss << "}\n";
+    }
+    exit();
+    oss << "}\n";
+    oss.reset(nullptr);
+    size_hint = sink.size();
+    return sink.take();
+}
+
 void CodeGen_C::visit(Ref<const PlaceholderOp> op){
     LOG(ERROR) << "Find placeholder.";
 }
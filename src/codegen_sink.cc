@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "codegen_sink.h"
+
+namespace Boost {
+
+namespace codegen {
+
+
+void FdSink::write(const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd_, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK(written > 0, "Fail to write generated source to fd %d\n", fd_);
+    data += written;
+    size -= (size_t)written;
+  }
+}
+
+
+MmapSink::MmapSink(const std::string &path, size_t capacity) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  CHECK(fd_ >= 0, "Fail to open %s\n", path.c_str());
+  map(capacity < 4096 ? 4096 : capacity);
+}
+
+
+void MmapSink::map(size_t capacity) {
+  if (data_ != nullptr) {
+    ::munmap(data_, capacity_);
+  }
+  CHECK(::ftruncate(fd_, (off_t)capacity) == 0, "Fail to grow mapped output to %zu bytes\n", capacity);
+  void *data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  CHECK(data != MAP_FAILED, "Fail to map output of %zu bytes\n", capacity);
+  data_ = static_cast<char*>(data);
+  capacity_ = capacity;
+}
+
+
+void MmapSink::write(const char *data, size_t size) {
+  CHECK(data_ != nullptr, "Write to a closed MmapSink\n");
+  if (size_ + size > capacity_) {
+    size_t capacity = capacity_;
+    while (size_ + size > capacity) {
+      capacity *= 2;
+    }
+    map(capacity);
+  }
+  std::memcpy(data_ + size_, data, size);
+  size_ += size;
+}
+
+
+void MmapSink::flush() {
+  if (data_ != nullptr) {
+    ::msync(data_, capacity_, MS_ASYNC);
+  }
+}
+
+
+void MmapSink::close() {
+  if (fd_ < 0) {
+    return;
+  }
+  ::munmap(data_, capacity_);
+  if (::ftruncate(fd_, (off_t)size_) != 0) {
+    LOG(ERROR) << "Fail to truncate mapped output to " << size_ << " bytes.";
+  }
+  ::close(fd_);
+  data_ = nullptr;
+  fd_ = -1;
+}
+
+
+void Emitter::write_uint(uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  if (size_ + n > kBufferSize) {
+    flush();
+  }
+  while (n > 0) {
+    buffer_[size_++] = digits[--n];
+  }
+}
+
+
+void Emitter::write_int(int64_t value) {
+  if (value < 0) {
+    *this << '-';
+    // -INT64_MIN overflows, negate in unsigned
+    write_uint(~(uint64_t)value + 1);
+  } else {
+    write_uint((uint64_t)value);
+  }
+}
+
+
+Emitter &Emitter::operator<<(double value) {
+  // %g prints integers below 10^6 exactly, the common case of constants
+  if (std::fabs(value) < 1e6 && value == std::floor(value)) {
+    if (value == 0 && std::signbit(value)) {
+      return *this << "-0";
+    }
+    write_int((int64_t)value);
+    return *this;
+  }
+  char str[32];
+  int n = std::snprintf(str, sizeof(str), "%g", value);
+  write(str, (size_t)n);
+  return *this;
+}
+
+}  // namespace codegen
+
+}  // namespace Boost
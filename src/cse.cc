@@ -0,0 +1,423 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include <vector>
+#include <unordered_set>
+
+#include "debug.h"
+#include "IRVisitor.h"
+#include "utils.h"
+#include "cse.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+bool is_const(const Expr &expr) {
+  return expr.node_type() == IRNodeType::IntImm
+      || expr.node_type() == IRNodeType::UIntImm
+      || expr.node_type() == IRNodeType::FloatImm;
+}
+
+
+/**
+ * replace values by the vars bound to them
+ * - only the first limit bindings are visible, so the value of a binding
+ *   never refers to itself or to a later one
+ */
+class ValueReplacer : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  int size() const {
+    return (int)vars_.size();
+  }
+
+  void add(const Expr &value, const Expr &var) {
+    ids_[value] = (int)vars_.size();
+    vars_.push_back(var);
+  }
+
+  Expr replace(const Expr &expr, int limit) {
+    limit_ = limit;
+    return mutate(expr);
+  }
+
+  Stmt replace(const Stmt &stmt) {
+    limit_ = size();
+    return mutate(stmt);
+  }
+
+ protected:
+  #define REPLACE_OR_MUTATE(T)                            \
+    Expr visit(Ref<const T> op) override {                \
+      auto it = ids_.find(op);                            \
+      if (it != ids_.end() && it->second < limit_) {      \
+        return vars_[it->second];                         \
+      }                                                   \
+      return IRMutator::visit(op);                        \
+    }
+  REPLACE_OR_MUTATE(Unary)
+  REPLACE_OR_MUTATE(Binary)
+  REPLACE_OR_MUTATE(Select)
+  REPLACE_OR_MUTATE(Compare)
+  REPLACE_OR_MUTATE(Call)
+  REPLACE_OR_MUTATE(Var)
+  REPLACE_OR_MUTATE(Cast)
+  #undef REPLACE_OR_MUTATE
+
+  // keep the index nodes, other passes match them by pointer
+  Expr visit(Ref<const Index> op) override {
+    return op;
+  }
+
+  // the dst stays the array stored to, only its args are replaced
+  Stmt visit(Ref<const Move> op) override {
+    Expr dst = op->dst;
+    Ref<const Var> as_var = dst.as<Var>();
+    if (as_var.defined()) {
+      std::vector<Expr> args;
+      for (auto arg : as_var->args) {
+        args.push_back(mutate(arg));
+      }
+      dst = Var::make(as_var->type(), as_var->name, args, as_var->shape);
+    }
+    return Move::make(dst, mutate(op->src), op->move_type);
+  }
+
+ private:
+  std::unordered_map<Expr, int, Utils::ExprHash, Utils::ExprEqual> ids_;
+  std::vector<Expr> vars_;
+  int limit_ = 0;
+};
+
+
+/**
+ * names of the vars read by an expression, or written by the Moves of a
+ * statement
+ */
+class VarNames : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const Var> op) override {
+    if (!writes_only_) {
+      names.insert(op->name);
+    }
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Move> op) override {
+    Ref<const Var> dst = op->dst.as<Var>();
+    if (dst.defined()) {
+      names.insert(dst->name);
+    }
+    IRVisitor::visit(op);
+  }
+
+  void reads(const Expr &expr) {
+    writes_only_ = false;
+    expr.visit_expr(this);
+  }
+
+  void writes(const Stmt &stmt) {
+    writes_only_ = true;
+    stmt.visit_stmt(this);
+  }
+
+  std::unordered_set<std::string> names;
+
+ private:
+  bool writes_only_ = false;
+};
+
+
+/**
+ * bind the shared values of numbering, replace them in exprs and stmt
+ * return the bindings in dependence order
+ */
+std::vector<std::pair<Expr, Expr>> bind_shared(const ExprNumbering &numbering, bool safe_only,
+  Utils::NameGenerator &gen, std::vector<Expr> &exprs, Stmt &stmt,
+  const std::unordered_set<std::string> &written = std::unordered_set<std::string>(),
+  std::vector<Expr> *values = nullptr) {
+  ValueReplacer replacer;
+  std::vector<std::pair<Expr, Expr>> lets;
+  for (auto &entry : numbering.entries) {
+    if (entry.uses < 2 || (safe_only && !entry.safe)) {
+      continue;
+    }
+    if (!written.empty()) {
+      VarNames reads;
+      reads.reads(entry.expr);
+      bool stale = false;
+      for (auto &name : reads.names) {
+        stale = stale || written.count(name) != 0;
+      }
+      if (stale) {
+        continue;
+      }
+    }
+    Expr var = Var::make(entry.expr.type(), gen("_cse"), {}, {1});
+    if (values != nullptr) {
+      values->push_back(entry.expr);
+    }
+    lets.push_back(std::make_pair(var, replacer.replace(entry.expr, replacer.size())));
+    replacer.add(entry.expr, var);
+  }
+  if (lets.empty()) {
+    return lets;
+  }
+  for (auto &expr : exprs) {
+    expr = replacer.replace(expr, replacer.size());
+  }
+  stmt = replacer.replace(stmt);
+  return lets;
+}
+
+
+void number_move(ExprNumbering &numbering, Ref<const Move> op) {
+  Ref<const Var> dst = op->dst.as<Var>();
+  if (dst.defined()) {
+    for (auto arg : dst->args) {
+      numbering.number(arg);
+    }
+  }
+  numbering.number(op->src);
+}
+
+}  // anonymous namespace
+
+
+bool is_leaf(const Expr &expr) {
+  switch (expr.node_type()) {
+    case IRNodeType::IntImm:
+    case IRNodeType::UIntImm:
+    case IRNodeType::FloatImm:
+    case IRNodeType::StringImm:
+    case IRNodeType::Index:
+    case IRNodeType::Dom:
+    case IRNodeType::Ramp:
+    case IRNodeType::Let:
+      return true;
+    case IRNodeType::Var:
+      return expr.as<Var>()->args.empty();
+    default:
+      return false;
+  }
+}
+
+
+Stmt wrap_lets(const std::vector<std::pair<Expr, Expr>> &lets, Stmt stmt) {
+  for (int i = (int)lets.size() - 1; i >= 0; --i) {
+    stmt = LetStmt::make(lets[i].first, lets[i].second, stmt);
+  }
+  return stmt;
+}
+
+
+int ExprNumbering::number(const Expr &expr) {
+  if (is_leaf(expr)) {
+    return -1;
+  }
+  auto it = table_.find(expr);
+  if (it != table_.end()) {
+    entries[it->second].uses += 1;
+    return it->second;
+  }
+
+  // children are numbered first, so they get smaller ids
+  bool safe = true;
+  auto child = [&](const Expr &e) {
+    int id = number(e);
+    if (id >= 0) {
+      safe = safe && entries[id].safe;
+    } else if (e.node_type() == IRNodeType::Let) {
+      safe = false;
+    }
+  };
+  switch (expr.node_type()) {
+    case IRNodeType::Unary:
+      child(expr.as<Unary>()->a);
+      break;
+    case IRNodeType::Binary: {
+      Ref<const Binary> op = expr.as<Binary>();
+      child(op->a);
+      child(op->b);
+      if ((op->op_type == BinaryOpType::Div || op->op_type == BinaryOpType::Mod
+           || op->op_type == BinaryOpType::FloorDiv || op->op_type == BinaryOpType::FloorMod)
+          && !is_const(op->b)) {
+        safe = false;
+      }
+      break;
+    }
+    case IRNodeType::Compare:
+      child(expr.as<Compare>()->a);
+      child(expr.as<Compare>()->b);
+      break;
+    case IRNodeType::Cast:
+      child(expr.as<Cast>()->val);
+      break;
+    case IRNodeType::Select:
+      // the branches are evaluated lazily
+      child(expr.as<Select>()->cond);
+      safe = false;
+      break;
+    case IRNodeType::Call:
+      for (auto arg : expr.as<Call>()->args) {
+        child(arg);
+      }
+      safe = false;
+      break;
+    case IRNodeType::Var:
+      for (auto arg : expr.as<Var>()->args) {
+        child(arg);
+      }
+      safe = false;
+      break;
+    default:
+      LOG(ERROR) << "Unexpected node in value numbering: " << expr;
+  }
+
+  int id = (int)entries.size();
+  entries.push_back(Entry{expr, 1, safe});
+  table_[expr] = id;
+  return id;
+}
+
+
+int ExprNumbering::lookup(const Expr &expr) const {
+  auto it = table_.find(expr);
+  if (it == table_.end()) {
+    return -1;
+  }
+  return it->second;
+}
+
+
+Stmt CommonSubexprEliminator::visit(Ref<const Move> op) {
+  ExprNumbering numbering;
+  number_move(numbering, op);
+  std::vector<Expr> exprs;
+  Stmt ret = Move::make(op->dst, op->src, op->move_type);
+  auto lets = bind_shared(numbering, false, name_generator_, exprs, ret);
+  return wrap_lets(lets, ret);
+}
+
+
+Stmt CommonSubexprEliminator::visit(Ref<const LoopNest> op) {
+  // values shared by the Moves of the body, numbered together
+  std::vector<Stmt> body = op->body_list;
+  std::vector<ExprNumbering> used(body.size());
+  ExprNumbering numbering;
+  int moves = 0;
+  for (size_t k = 0; k < body.size(); ++k) {
+    Ref<const Move> move = body[k].as<Move>();
+    if (move.defined()) {
+      number_move(numbering, move);
+      number_move(used[k], move);
+      moves += 1;
+    }
+  }
+  std::vector<std::pair<Expr, Expr>> lets;
+  std::vector<Expr> values;
+  if (moves > 1) {
+    // a value reading what the body writes can't move before the writes
+    VarNames written;
+    for (auto &stmt : body) {
+      written.writes(stmt);
+    }
+    std::vector<Expr> exprs;
+    Stmt block = LoopNest::make({}, body);
+    lets = bind_shared(numbering, false, name_generator_, exprs, block, written.names, &values);
+    if (!lets.empty()) {
+      body = block.as<LoopNest>()->body_list;
+    }
+  }
+  if (lets.empty()) {
+    return IRMutator::visit(op);
+  }
+
+  // the bindings go right before the first statement that may use them
+  size_t first = 0;
+  for (; first < body.size(); ++first) {
+    Ref<const Move> move = body[first].as<Move>();
+    bool uses = !move.defined();
+    for (auto &value : values) {
+      uses = uses || used[first].lookup(value) >= 0;
+    }
+    if (uses) {
+      break;
+    }
+  }
+  std::vector<Stmt> head;
+  std::vector<Stmt> tail;
+  for (size_t k = 0; k < body.size(); ++k) {
+    (k < first ? head : tail).push_back(mutate(body[k]));
+  }
+  head.push_back(wrap_lets(lets, LoopNest::make({}, tail)));
+  return LoopNest::make(op->index_list, head);
+}
+
+
+Stmt CommonSubexprEliminator::visit(Ref<const IfThenElse> op) {
+  // safe values shared by the guard and a guarded Move go before the guard
+  ExprNumbering numbering;
+  numbering.number(op->cond);
+  Ref<const Move> move = op->true_case.as<Move>();
+  if (move.defined()) {
+    number_move(numbering, move);
+  }
+  std::vector<Expr> exprs = {op->cond};
+  Stmt true_case = op->true_case;
+  auto lets = bind_shared(numbering, true, name_generator_, exprs, true_case);
+
+  Stmt false_case;
+  if (op->false_case.defined()) {
+    false_case = mutate(op->false_case);
+  }
+  return wrap_lets(lets, IfThenElse::make(exprs[0], mutate(true_case), false_case));
+}
+
+
+Stmt common_subexpr_elimination(const Stmt &stmt) {
+  CommonSubexprEliminator cse;
+  return cse.mutate(stmt);
+}
+
+
+Group common_subexpr_elimination(const Group &group) {
+  CommonSubexprEliminator cse;
+  return cse.mutate(group);
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
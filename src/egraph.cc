@@ -0,0 +1,788 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "arith.h"
+#include "debug.h"
+#include "simplify.h"
+#include "utils.h"
+#include "egraph.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+using Domain = Simplify::Rule::Domain;
+
+
+struct ERule {
+  Expr lhs;
+  Expr rhs;
+  Domain domain;
+};
+
+
+/**
+ * rewrites applied in both directions where that makes sense, the cost
+ * model picks the result; division rules hold over the reals only
+ */
+const std::vector<ERule> &rules() {
+  static std::vector<ERule> ret;
+  if (!ret.empty()) {
+    return ret;
+  }
+  Expr x = Simplify::Rule::wildcard("x");
+  Expr y = Simplify::Rule::wildcard("y");
+  Expr z = Simplify::Rule::wildcard("z");
+  Type t = x.type();
+  auto mk = [&](BinaryOpType op, Expr a, Expr b) { return Binary::make(t, op, a, b); };
+  auto add = [&](Expr a, Expr b) { return mk(BinaryOpType::Add, a, b); };
+  auto sub = [&](Expr a, Expr b) { return mk(BinaryOpType::Sub, a, b); };
+  auto mul = [&](Expr a, Expr b) { return mk(BinaryOpType::Mul, a, b); };
+  auto div = [&](Expr a, Expr b) { return mk(BinaryOpType::Div, a, b); };
+  auto neg = [&](Expr a) { return Unary::make(t, UnaryOpType::Neg, a); };
+  Expr zero = IntImm::make(t, 0), one = IntImm::make(t, 1), two = IntImm::make(t, 2);
+
+  ret = {
+    // commutativity, associativity
+    {add(x, y), add(y, x), Domain::Any},
+    {mul(x, y), mul(y, x), Domain::Any},
+    {add(add(x, y), z), add(x, add(y, z)), Domain::Any},
+    {add(x, add(y, z)), add(add(x, y), z), Domain::Any},
+    {mul(mul(x, y), z), mul(x, mul(y, z)), Domain::Any},
+    {mul(x, mul(y, z)), mul(mul(x, y), z), Domain::Any},
+    // subtraction and negation
+    {sub(x, y), add(x, neg(y)), Domain::Any},
+    {add(x, neg(y)), sub(x, y), Domain::Any},
+    {mul(neg(x), y), neg(mul(x, y)), Domain::Any},
+    {neg(mul(x, y)), mul(neg(x), y), Domain::Any},
+    {neg(neg(x)), x, Domain::Any},
+    // distributivity
+    {add(mul(x, y), mul(x, z)), mul(x, add(y, z)), Domain::Any},
+    {mul(x, add(y, z)), add(mul(x, y), mul(x, z)), Domain::Any},
+    {add(x, x), mul(x, two), Domain::Any},
+    // identities
+    {sub(x, x), zero, Domain::Any},
+    {add(x, zero), x, Domain::Any},
+    {mul(x, one), x, Domain::Any},
+    {mul(x, zero), zero, Domain::Any},
+    // quotients
+    {div(mul(x, y), z), mul(x, div(y, z)), Domain::Float},
+    {mul(x, div(y, z)), div(mul(x, y), z), Domain::Float},
+    {add(div(x, y), div(z, y)), div(add(x, z), y), Domain::Float},
+    {div(div(x, y), z), div(x, mul(y, z)), Domain::Float},
+    {div(x, div(y, z)), div(mul(x, z), y), Domain::Float},
+    {div(mul(x, y), mul(x, z)), div(y, z), Domain::Float},
+    {div(x, mul(x, y)), div(one, y), Domain::Float},
+    {div(mul(x, y), y), x, Domain::Float},
+    {mul(div(x, y), y), x, Domain::Float},
+    {div(neg(x), y), neg(div(x, y)), Domain::Float},
+    {neg(div(x, y)), div(neg(x), y), Domain::Float},
+    {div(x, one), x, Domain::Float}
+  };
+  return ret;
+}
+
+
+bool in_domain(Domain domain, const Type &type) {
+  switch (domain) {
+    case Domain::Int:
+      return type.is_int() || type.is_uint();
+    case Domain::Float:
+      return type.is_float();
+    default:
+      return type.is_int() || type.is_uint() || type.is_float();
+  }
+}
+
+
+bool is_operation(IRNodeType kind) {
+  switch (kind) {
+    case IRNodeType::Unary:
+    case IRNodeType::Binary:
+    case IRNodeType::Compare:
+    case IRNodeType::Select:
+    case IRNodeType::Var:
+    case IRNodeType::Call:
+    case IRNodeType::Cast:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+bool is_const(const Expr &expr) {
+  return expr.node_type() == IRNodeType::IntImm
+      || expr.node_type() == IRNodeType::UIntImm
+      || expr.node_type() == IRNodeType::FloatImm;
+}
+
+
+double const_value(const Expr &expr) {
+  switch (expr.node_type()) {
+    case IRNodeType::IntImm:
+      return (double)expr.as<IntImm>()->value();
+    case IRNodeType::UIntImm:
+      return (double)expr.as<UIntImm>()->value();
+    default:
+      return expr.as<FloatImm>()->value();
+  }
+}
+
+
+/**
+ * cost of the operation itself, operations cost at least 1 so that
+ * extraction never picks a cycle
+ */
+int op_cost(const CostModel &model, IRNodeType kind, int op) {
+  int ret = 0;
+  switch (kind) {
+    case IRNodeType::Unary:
+    case IRNodeType::Compare:
+      ret = model.add;
+      break;
+    case IRNodeType::Binary:
+      switch ((BinaryOpType)op) {
+        case BinaryOpType::Mul:
+          ret = model.mul;
+          break;
+        case BinaryOpType::Div:
+        case BinaryOpType::Mod:
+        case BinaryOpType::FloorDiv:
+        case BinaryOpType::FloorMod:
+          ret = model.div;
+          break;
+        default:
+          ret = model.add;
+      }
+      break;
+    case IRNodeType::Select:
+      ret = model.select;
+      break;
+    case IRNodeType::Var:
+      ret = model.load;
+      break;
+    case IRNodeType::Call:
+      ret = model.call;
+      break;
+    case IRNodeType::Cast:
+      ret = model.cast;
+      break;
+    default:
+      return 0;
+  }
+  return std::max(ret, 1);
+}
+
+
+/**
+ * value of a node over constant children, undefined if it does not fold
+ */
+Expr fold_value(const EGraph::ENode &node, const std::vector<Expr> &args) {
+  if (node.kind == IRNodeType::Unary) {
+    return (UnaryOpType)node.op == UnaryOpType::Neg ? Arith::neg(args[0]) : Expr();
+  }
+  if (node.kind == IRNodeType::Select) {
+    return Expr();
+  }
+  const Expr &a = args[0], &b = args[1];
+  if (node.kind == IRNodeType::Compare) {
+    switch ((CompareOpType)node.op) {
+      case CompareOpType::LT: return Arith::lt(a, b);
+      case CompareOpType::LE: return Arith::le(a, b);
+      case CompareOpType::EQ: return Arith::eq(a, b);
+      case CompareOpType::NE: return Arith::ne(a, b);
+      case CompareOpType::GE: return Arith::ge(a, b);
+      default: return Arith::gt(a, b);
+    }
+  }
+  switch ((BinaryOpType)node.op) {
+    case BinaryOpType::Add: return Arith::add(a, b);
+    case BinaryOpType::Sub: return Arith::sub(a, b);
+    case BinaryOpType::Mul: return Arith::mul(a, b);
+    default:
+      break;
+  }
+  if (const_value(b) == 0) {
+    return Expr();
+  }
+  switch ((BinaryOpType)node.op) {
+    case BinaryOpType::Div: return Arith::div(a, b);
+    case BinaryOpType::Mod: return Arith::mod(a, b);
+    case BinaryOpType::FloorDiv: return Arith::floordiv(a, b);
+    case BinaryOpType::FloorMod: return Arith::floormod(a, b);
+    default: return Expr();
+  }
+}
+
+}  // namespace
+
+
+int CostModel::cost(const Expr &expr) const {
+  int ret = 0;
+  switch (expr.node_type()) {
+    case IRNodeType::Unary:
+      ret = cost(expr.as<Unary>()->a);
+      return ret + op_cost(*this, IRNodeType::Unary, (int)expr.as<Unary>()->op_type);
+    case IRNodeType::Binary: {
+      auto op = expr.as<Binary>();
+      return cost(op->a) + cost(op->b) + op_cost(*this, IRNodeType::Binary, (int)op->op_type);
+    }
+    case IRNodeType::Compare: {
+      auto op = expr.as<Compare>();
+      return cost(op->a) + cost(op->b) + op_cost(*this, IRNodeType::Compare, (int)op->op_type);
+    }
+    case IRNodeType::Select: {
+      auto op = expr.as<Select>();
+      ret = cost(op->cond) + cost(op->true_value) + cost(op->false_value);
+      return ret + op_cost(*this, IRNodeType::Select, 0);
+    }
+    case IRNodeType::Var:
+      for (auto &arg : expr.as<Var>()->args) {
+        ret += cost(arg);
+      }
+      return ret + op_cost(*this, IRNodeType::Var, 0);
+    case IRNodeType::Call:
+      for (auto &arg : expr.as<Call>()->args) {
+        ret += cost(arg);
+      }
+      return ret + op_cost(*this, IRNodeType::Call, 0);
+    case IRNodeType::Cast:
+      return cost(expr.as<Cast>()->val) + op_cost(*this, IRNodeType::Cast, 0);
+    default:
+      return 0;
+  }
+}
+
+
+std::ostream &operator<<(std::ostream &out, const EGraphStats &stats) {
+  out << "exprs: " << stats.exprs << ", improved: " << stats.improved
+      << ", cost: " << stats.cost_before << " -> " << stats.cost_after
+      << ", iterations: " << stats.iterations << ", saturated: " << stats.saturated
+      << ", max nodes: " << stats.max_nodes << ", millis: " << stats.millis;
+  return out;
+}
+
+
+size_t EGraph::ENodeHash::operator()(const ENode &node) const {
+  using Utils::StructuralHash;
+  size_t ret = std::hash<int>{}((int)node.kind);
+  ret = StructuralHash::combine(ret, std::hash<int>{}(node.op));
+  ret = StructuralHash::combine(ret, std::hash<int>{}((int)node.type.code));
+  ret = StructuralHash::combine(ret, std::hash<int>{}((int)node.type.bits));
+  for (int child : node.children) {
+    ret = StructuralHash::combine(ret, std::hash<int>{}(child));
+  }
+  switch (node.kind) {
+    case IRNodeType::Var:
+      return StructuralHash::combine(ret, std::hash<std::string>{}(node.payload.as<Var>()->name));
+    case IRNodeType::Call:
+      return StructuralHash::combine(ret, std::hash<std::string>{}(node.payload.as<Call>()->func_name));
+    case IRNodeType::Cast:
+      return StructuralHash::combine(ret, std::hash<int>{}((int)node.payload.as<Cast>()->new_type.code));
+    default:
+      break;
+  }
+  if (!is_operation(node.kind)) {
+    ret = StructuralHash::combine(ret, Utils::ExprHash()(node.payload));
+  }
+  return ret;
+}
+
+
+bool EGraph::ENodeEqual::operator()(const ENode &a, const ENode &b) const {
+  if (a.kind != b.kind || a.op != b.op || !(a.type == b.type) || a.children != b.children) {
+    return false;
+  }
+  switch (a.kind) {
+    case IRNodeType::Var:
+      return a.payload.as<Var>()->name == b.payload.as<Var>()->name;
+    case IRNodeType::Call:
+      return a.payload.as<Call>()->func_name == b.payload.as<Call>()->func_name
+          && a.payload.as<Call>()->call_type == b.payload.as<Call>()->call_type;
+    case IRNodeType::Cast:
+      return a.payload.as<Cast>()->new_type == b.payload.as<Cast>()->new_type;
+    default:
+      break;
+  }
+  return is_operation(a.kind) || Utils::ExprEqual()(a.payload, b.payload);
+}
+
+
+int EGraph::add(const Expr &expr) {
+  ENode node;
+  node.kind = expr.node_type();
+  node.op = 0;
+  node.type = expr.type();
+  switch (node.kind) {
+    case IRNodeType::Unary: {
+      auto op = expr.as<Unary>();
+      node.op = (int)op->op_type;
+      node.children = {add(op->a)};
+      break;
+    }
+    case IRNodeType::Binary: {
+      auto op = expr.as<Binary>();
+      node.op = (int)op->op_type;
+      node.children = {add(op->a), add(op->b)};
+      break;
+    }
+    case IRNodeType::Compare: {
+      auto op = expr.as<Compare>();
+      node.op = (int)op->op_type;
+      node.children = {add(op->a), add(op->b)};
+      break;
+    }
+    case IRNodeType::Select: {
+      auto op = expr.as<Select>();
+      node.children = {add(op->cond), add(op->true_value), add(op->false_value)};
+      break;
+    }
+    case IRNodeType::Var:
+      for (auto &arg : expr.as<Var>()->args) {
+        node.children.push_back(add(arg));
+      }
+      node.payload = expr;
+      break;
+    case IRNodeType::Call:
+      for (auto &arg : expr.as<Call>()->args) {
+        node.children.push_back(add(arg));
+      }
+      node.payload = expr;
+      break;
+    case IRNodeType::Cast:
+      node.children = {add(expr.as<Cast>()->val)};
+      node.payload = expr;
+      break;
+    default:
+      node.payload = expr;
+  }
+  return add_node(node);
+}
+
+
+int EGraph::find(int id) const {
+  int root = id;
+  while (parent_[root] != root) {
+    root = parent_[root];
+  }
+  while (parent_[id] != root) {
+    int next = parent_[id];
+    parent_[id] = root;
+    id = next;
+  }
+  return root;
+}
+
+
+bool EGraph::merge(int a, int b) {
+  a = find(a);
+  b = find(b);
+  if (a == b) {
+    return false;
+  }
+  if (b < a) {
+    std::swap(a, b);
+  }
+  parent_[b] = a;
+  auto it = consts_.find(b);
+  if (it != consts_.end()) {
+    if (!consts_.count(a)) {
+      consts_[a] = it->second;
+    }
+    consts_.erase(it);
+  }
+  return true;
+}
+
+
+EGraph::ENode EGraph::canonical(const ENode &node) const {
+  ENode ret = node;
+  for (auto &child : ret.children) {
+    child = find(child);
+  }
+  return ret;
+}
+
+
+int EGraph::add_node(ENode node) {
+  node = canonical(node);
+  auto it = memo_.find(node);
+  if (it != memo_.end()) {
+    return find(it->second);
+  }
+  int id = (int)parent_.size();
+  parent_.push_back(id);
+  types_.push_back(node.type);
+  memo_.emplace(node, id);
+  if (!is_operation(node.kind) && is_const(node.payload)) {
+    consts_[id] = node.payload;
+    return id;
+  }
+
+  fold(node, id);
+  return find(id);
+}
+
+
+void EGraph::fold(const ENode &node, int id) {
+  // a constant condition selects its branch
+  if (node.kind == IRNodeType::Select) {
+    auto cond = consts_.find(find(node.children[0]));
+    if (cond != consts_.end()) {
+      merge(id, node.children[const_value(cond->second) != 0 ? 1 : 2]);
+    }
+    return;
+  }
+  if (node.kind != IRNodeType::Unary && node.kind != IRNodeType::Binary
+      && node.kind != IRNodeType::Compare) {
+    return;
+  }
+  std::vector<Expr> args;
+  for (int child : node.children) {
+    auto value = consts_.find(find(child));
+    if (value == consts_.end()) {
+      return;
+    }
+    args.push_back(value->second);
+  }
+  Expr value = fold_value(node, args);
+  if (value.defined() && is_const(value) && value.type() == node.type) {
+    merge(id, add(value));
+  }
+}
+
+
+void EGraph::rebuild() {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::unordered_map<ENode, int, ENodeHash, ENodeEqual> memo;
+    std::vector<std::pair<ENode, int>> pending;
+    for (auto &kv : memo_) {
+      ENode node = canonical(kv.first);
+      auto it = memo.find(node);
+      if (it != memo.end()) {
+        changed = merge(it->second, kv.second) || changed;
+      } else {
+        memo.emplace(node, find(kv.second));
+        if (!consts_.count(find(kv.second)) && is_operation(node.kind)) {
+          pending.push_back(std::make_pair(node, kv.second));
+        }
+      }
+    }
+    memo_.swap(memo);
+    // merges may have made the children of a node constant
+    size_t classes = num_classes();
+    for (auto &entry : pending) {
+      if (!consts_.count(find(entry.second))) {
+        fold(entry.first, entry.second);
+      }
+    }
+    changed = changed || num_classes() != classes;
+  }
+}
+
+
+std::vector<std::vector<EGraph::ENode>> EGraph::class_members() const {
+  std::vector<std::vector<ENode>> ret(parent_.size());
+  for (auto &kv : memo_) {
+    ret[find(kv.second)].push_back(canonical(kv.first));
+  }
+  return ret;
+}
+
+
+size_t EGraph::num_classes() const {
+  size_t ret = 0;
+  for (size_t i = 0; i < parent_.size(); ++i) {
+    ret += find((int)i) == (int)i;
+  }
+  return ret;
+}
+
+
+void EGraph::match(const Expr &pattern, int id, const std::vector<std::vector<ENode>> &members,
+                   const Subst &subst, std::vector<Subst> &results) const {
+  id = find(id);
+  if (pattern.node_type() == IRNodeType::Index) {
+    const std::string &name = pattern.as<Index>()->name;
+    auto it = subst.find(name);
+    if (it != subst.end()) {
+      if (find(it->second) == id) {
+        results.push_back(subst);
+      }
+      return;
+    }
+    Subst ret = subst;
+    ret[name] = id;
+    results.push_back(ret);
+    return;
+  }
+  if (is_const(pattern)) {
+    auto it = consts_.find(id);
+    if (it != consts_.end() && const_value(it->second) == const_value(pattern)) {
+      results.push_back(subst);
+    }
+    return;
+  }
+
+  int op = 0;
+  std::vector<Expr> children;
+  if (pattern.node_type() == IRNodeType::Unary) {
+    op = (int)pattern.as<Unary>()->op_type;
+    children = {pattern.as<Unary>()->a};
+  } else if (pattern.node_type() == IRNodeType::Binary) {
+    op = (int)pattern.as<Binary>()->op_type;
+    children = {pattern.as<Binary>()->a, pattern.as<Binary>()->b};
+  } else {
+    LOG(ERROR) << "Unsupported e-graph pattern " << pattern << "\n";
+    throw;
+  }
+  for (auto &node : members[id]) {
+    if (node.kind != pattern.node_type() || node.op != op) {
+      continue;
+    }
+    std::vector<Subst> partial = {subst};
+    for (size_t i = 0; i < children.size() && !partial.empty(); ++i) {
+      std::vector<Subst> next;
+      for (auto &s : partial) {
+        match(children[i], node.children[i], members, s, next);
+      }
+      partial.swap(next);
+    }
+    results.insert(results.end(), partial.begin(), partial.end());
+  }
+}
+
+
+int EGraph::instantiate(const Expr &pattern, const Subst &subst, Type type) {
+  if (pattern.node_type() == IRNodeType::Index) {
+    return find(subst.at(pattern.as<Index>()->name));
+  }
+  if (is_const(pattern)) {
+    return add(Utils::make_const(type, const_value(pattern)));
+  }
+  ENode node;
+  node.kind = pattern.node_type();
+  node.type = type;
+  if (pattern.node_type() == IRNodeType::Unary) {
+    node.op = (int)pattern.as<Unary>()->op_type;
+    node.children = {instantiate(pattern.as<Unary>()->a, subst, type)};
+  } else {
+    auto op = pattern.as<Binary>();
+    node.op = (int)op->op_type;
+    node.children = {instantiate(op->a, subst, type), instantiate(op->b, subst, type)};
+  }
+  return add_node(node);
+}
+
+
+bool EGraph::apply_rules(const EGraphOptions &options, Deadline deadline) {
+  // match everything first, the graph does not change while matching
+  auto members = class_members();
+  std::vector<std::pair<size_t, std::pair<int, Subst>>> matches;
+  const auto &all = rules();
+  for (size_t r = 0; r < all.size(); ++r) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      break;
+    }
+    for (size_t id = 0; id < members.size(); ++id) {
+      if (members[id].empty() || !in_domain(all[r].domain, types_[id])) {
+        continue;
+      }
+      std::vector<Subst> found;
+      match(all[r].lhs, (int)id, members, Subst(), found);
+      for (auto &subst : found) {
+        matches.push_back(std::make_pair(r, std::make_pair((int)id, subst)));
+      }
+    }
+  }
+
+  size_t nodes = memo_.size();
+  bool changed = false;
+  for (auto &m : matches) {
+    if (memo_.size() >= options.max_nodes) {
+      break;
+    }
+    int id = m.second.first;
+    int rhs = instantiate(all[m.first].rhs, m.second.second, types_[id]);
+    changed = merge(id, rhs) || changed;
+  }
+  rebuild();
+  return changed || memo_.size() != nodes;
+}
+
+
+void EGraph::saturate(const EGraphOptions &options, EGraphStats &stats) {
+  auto start = std::chrono::steady_clock::now();
+  Deadline deadline = start + std::chrono::microseconds((long long)(options.max_millis * 1000));
+  bool saturated = false;
+  for (int iter = 0; iter < options.max_iterations; ++iter) {
+    ++stats.iterations;
+    if (!apply_rules(options, deadline)) {
+      saturated = true;
+      break;
+    }
+    if (memo_.size() >= options.max_nodes || std::chrono::steady_clock::now() > deadline) {
+      break;
+    }
+  }
+  stats.saturated += saturated;
+  stats.max_nodes = std::max(stats.max_nodes, memo_.size());
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  stats.millis += elapsed.count();
+}
+
+
+Expr EGraph::extract(int id, const CostModel &model) const {
+  // cheapest node of every class, to a fixpoint
+  auto members = class_members();
+  const long long inf = std::numeric_limits<long long>::max();
+  std::vector<long long> best(members.size(), inf);
+  std::vector<const ENode*> choice(members.size(), nullptr);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t c = 0; c < members.size(); ++c) {
+      for (auto &node : members[c]) {
+        long long cost = op_cost(model, node.kind, node.op);
+        for (int child : node.children) {
+          if (best[child] == inf) {
+            cost = inf;
+            break;
+          }
+          cost += best[child];
+        }
+        if (cost < best[c]) {
+          best[c] = cost;
+          choice[c] = &node;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  std::function<Expr(int)> build = [&](int c) -> Expr {
+    const ENode &node = *choice[find(c)];
+    std::vector<Expr> args;
+    for (int child : node.children) {
+      args.push_back(build(child));
+    }
+    switch (node.kind) {
+      case IRNodeType::Unary:
+        return Unary::make(node.type, (UnaryOpType)node.op, args[0]);
+      case IRNodeType::Binary:
+        return Binary::make(node.type, (BinaryOpType)node.op, args[0], args[1]);
+      case IRNodeType::Compare:
+        return Compare::make(node.type, (CompareOpType)node.op, args[0], args[1]);
+      case IRNodeType::Select:
+        return Select::make(node.type, args[0], args[1], args[2]);
+      case IRNodeType::Var: {
+        auto op = node.payload.as<Var>();
+        return Var::make(node.type, op->name, args, op->shape);
+      }
+      case IRNodeType::Call: {
+        auto op = node.payload.as<Call>();
+        return Call::make(node.type, args, op->func_name, op->call_type);
+      }
+      case IRNodeType::Cast:
+        return Cast::make(node.type, node.payload.as<Cast>()->new_type, args[0]);
+      default:
+        return node.payload;
+    }
+  };
+  return build(id);
+}
+
+
+Expr EGraphOptimizer::optimize(const Expr &expr) {
+  int before = options_.cost.cost(expr);
+  if (before == 0) {
+    return expr;
+  }
+  ++stats_.exprs;
+  EGraph graph;
+  int root = graph.add(expr);
+  graph.saturate(options_, stats_);
+  Expr ret = graph.extract(root, options_.cost);
+  int after = options_.cost.cost(ret);
+  stats_.cost_before += before;
+  if (after < before) {
+    ++stats_.improved;
+    stats_.cost_after += after;
+    return ret;
+  }
+  stats_.cost_after += before;
+  return expr;
+}
+
+
+Stmt EGraphOptimizer::visit(Ref<const Move> op) {
+  return Move::make(op->dst, optimize(op->src), op->move_type);
+}
+
+
+Stmt EGraphOptimizer::visit(Ref<const IfThenElse> op) {
+  Stmt false_case;
+  if (op->false_case.defined()) {
+    false_case = mutate(op->false_case);
+  }
+  return IfThenElse::make(optimize(op->cond), mutate(op->true_case), false_case);
+}
+
+
+Stmt egraph_optimize(const Stmt &stmt, const EGraphOptions &options, EGraphStats *stats) {
+  EGraphOptimizer optimizer(options);
+  Stmt ret = optimizer.mutate(stmt);
+  if (stats != nullptr) {
+    *stats = optimizer.stats();
+  }
+  return ret;
+}
+
+
+Group egraph_optimize(const Group &group, const EGraphOptions &options, EGraphStats *stats) {
+  EGraphOptimizer optimizer(options);
+  Group ret = optimizer.mutate(group);
+  if (stats != nullptr) {
+    *stats = optimizer.stats();
+  }
+  return ret;
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
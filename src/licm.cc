@@ -0,0 +1,345 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <vector>
+
+#include "debug.h"
+#include "utils.h"
+#include "cse.h"
+#include "licm.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+bool positive_extent(Ref<const Index> index) {
+  Ref<const Dom> dom = index->dom.as<Dom>();
+  CHECK(dom.defined(), "Expect Dom");
+  Ref<const IntImm> as_int = dom->extent.as<IntImm>();
+  if (as_int.defined()) {
+    return as_int->value() > 0;
+  }
+  Ref<const UIntImm> as_uint = dom->extent.as<UIntImm>();
+  return as_uint.defined() && as_uint->value() > 0;
+}
+
+
+/**
+ * the outermost loop of a multi-index LoopNest
+ */
+Stmt split(Ref<const LoopNest> op) {
+  Stmt ret = LoopNest::make({op->index_list.back()}, op->body_list);
+  for (int i = (int)op->index_list.size() - 2; i >= 0; --i) {
+    ret = LoopNest::make({op->index_list[i]}, {ret});
+  }
+  return ret;
+}
+
+
+class LoopSplitter : public IRMutator {
+ public:
+  using IRMutator::visit;
+  Stmt visit(Ref<const LoopNest> op) override {
+    if (op->index_list.size() > 1) {
+      return IRMutator::visit(split(op).as<LoopNest>());
+    }
+    return IRMutator::visit(op);
+  }
+};
+
+
+/**
+ * indices, scalar vars, loaded arrays and calls of an expression
+ */
+class Operands : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const Index> op) override {
+    indices.push_back(op->name);
+  }
+
+  void visit(Ref<const Var> op) override {
+    if (op->args.empty()) {
+      vars.push_back(op->name);
+    } else {
+      loads.push_back(op->name);
+    }
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Call> op) override {
+    impure = impure || op->call_type == CallType::SideEffect;
+    IRVisitor::visit(op);
+  }
+
+  std::vector<std::string> indices;
+  std::vector<std::string> vars;
+  std::vector<std::string> loads;
+  bool impure = false;
+};
+
+
+class WriteCollector : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const Move> op) override {
+    Ref<const Var> dst = op->dst.as<Var>();
+    if (dst.defined()) {
+      names.push_back(dst->name);
+    }
+    IRVisitor::visit(op);
+  }
+
+  std::vector<std::string> names;
+};
+
+}  // anonymous namespace
+
+
+int LoopInvariantCodeMotion::target_level(const Expr &expr, int depth) const {
+  Operands operands;
+  expr.visit_expr(&operands);
+  if (operands.impure) {
+    return depth;
+  }
+  for (auto &name : operands.loads) {
+    if (std::find(written_.begin(), written_.end(), name) != written_.end()) {
+      return depth;
+    }
+  }
+  // locals of Accumulator change in the loops
+  for (auto &name : operands.vars) {
+    if (std::find(written_.begin(), written_.end(), name) != written_.end()) {
+      return depth;
+    }
+  }
+
+  int level = 0;
+  for (auto &name : operands.indices) {
+    int k = depth;
+    while (k > 0 && levels_[k].index != name) {
+      --k;
+    }
+    if (k == 0) {
+      // not an index of the enclosing loops
+      return depth;
+    }
+    level = std::max(level, k);
+  }
+  for (auto &name : operands.vars) {
+    auto it = bound_.find(name);
+    if (it != bound_.end()) {
+      level = std::max(level, it->second);
+    }
+  }
+
+  ExprNumbering numbering;
+  if (numbering.entries[numbering.number(expr)].safe) {
+    return level;
+  }
+  // unsafe values stay inside loops that may not run and inside guards
+  for (int k = depth; k > level; --k) {
+    if (!levels_[k].runs) {
+      level = k;
+      break;
+    }
+  }
+  if (!guards_.empty()) {
+    level = std::max(level, guards_.back());
+  }
+  return level;
+}
+
+
+Expr LoopInvariantCodeMotion::hoist(const Expr &expr, int depth) {
+  if (is_leaf(expr)) {
+    return expr;
+  }
+  int level = target_level(expr, depth);
+  if (level == depth) {
+    return hoist_operands(expr, depth);
+  }
+  Expr value = hoist_operands(expr, level);
+  Utils::ExprEqual equal;
+  auto &lets = levels_[level].lets;
+  for (auto &let : lets) {
+    if (equal(let.second, value)) {
+      return let.first;
+    }
+  }
+  Expr var = Var::make(expr.type(), name_generator_("_licm"), {}, {1});
+  lets.push_back(std::make_pair(var, value));
+  return var;
+}
+
+
+Expr LoopInvariantCodeMotion::hoist_operands(const Expr &expr, int depth) {
+  switch (expr.node_type()) {
+    case IRNodeType::Unary: {
+      Ref<const Unary> op = expr.as<Unary>();
+      return Unary::make(op->type(), op->op_type, hoist(op->a, depth));
+    }
+    case IRNodeType::Binary: {
+      Ref<const Binary> op = expr.as<Binary>();
+      return Binary::make(op->type(), op->op_type, hoist(op->a, depth), hoist(op->b, depth));
+    }
+    case IRNodeType::Compare: {
+      Ref<const Compare> op = expr.as<Compare>();
+      return Compare::make(op->type(), op->op_type, hoist(op->a, depth), hoist(op->b, depth));
+    }
+    case IRNodeType::Select: {
+      // the branches are evaluated lazily
+      Ref<const Select> op = expr.as<Select>();
+      return Select::make(op->type(), hoist(op->cond, depth), op->true_value, op->false_value);
+    }
+    case IRNodeType::Cast: {
+      Ref<const Cast> op = expr.as<Cast>();
+      return Cast::make(op->type(), op->new_type, hoist(op->val, depth));
+    }
+    case IRNodeType::Call: {
+      Ref<const Call> op = expr.as<Call>();
+      std::vector<Expr> args;
+      for (auto arg : op->args) {
+        args.push_back(hoist(arg, depth));
+      }
+      return Call::make(op->type(), args, op->func_name, op->call_type);
+    }
+    case IRNodeType::Var: {
+      Ref<const Var> op = expr.as<Var>();
+      std::vector<Expr> args;
+      for (auto arg : op->args) {
+        args.push_back(hoist(arg, depth));
+      }
+      return Var::make(op->type(), op->name, args, op->shape);
+    }
+    default:
+      return expr;
+  }
+}
+
+
+Stmt LoopInvariantCodeMotion::visit(Ref<const LoopNest> op) {
+  if (op->index_list.empty()) {
+    return IRMutator::visit(op);
+  }
+  if (op->index_list.size() > 1) {
+    return mutate(split(op));
+  }
+  Ref<const Index> index = op->index_list[0].as<Index>();
+  CHECK(index.defined(), "Expect Index");
+  if (depth() == 0) {
+    WriteCollector collector;
+    op->visit_node(&collector);
+    written_ = collector.names;
+  }
+
+  levels_.push_back(Level{index->name, positive_extent(index), {}});
+  std::vector<Stmt> body_list;
+  for (auto body : op->body_list) {
+    body_list.push_back(mutate(body));
+  }
+  levels_.pop_back();
+
+  // values that only depend on the enclosing loops go right before this one
+  Stmt ret = wrap_lets(levels_.back().lets, LoopNest::make(op->index_list, body_list));
+  levels_.back().lets.clear();
+  return ret;
+}
+
+
+Stmt LoopInvariantCodeMotion::visit(Ref<const IfThenElse> op) {
+  Expr cond = hoist(op->cond, depth());
+  guards_.push_back(depth());
+  Stmt true_case = mutate(op->true_case);
+  Stmt false_case;
+  if (op->false_case.defined()) {
+    false_case = mutate(op->false_case);
+  }
+  guards_.pop_back();
+  return IfThenElse::make(cond, true_case, false_case);
+}
+
+
+Stmt LoopInvariantCodeMotion::visit(Ref<const Move> op) {
+  Expr dst = op->dst;
+  Ref<const Var> var = dst.as<Var>();
+  if (var.defined()) {
+    std::vector<Expr> args;
+    for (auto arg : var->args) {
+      args.push_back(hoist(arg, depth()));
+    }
+    dst = Var::make(var->type(), var->name, args, var->shape);
+  }
+  return Move::make(dst, hoist(op->src, depth()), op->move_type);
+}
+
+
+Stmt LoopInvariantCodeMotion::visit(Ref<const LetStmt> op) {
+  Expr value = hoist(op->value, depth());
+  Ref<const Var> var = op->var.as<Var>();
+  CHECK(var.defined(), "Expect Var");
+  auto it = bound_.find(var->name);
+  bool shadows = it != bound_.end();
+  int outer = shadows ? it->second : 0;
+  bound_[var->name] = depth();
+  Stmt body = mutate(op->body);
+  if (shadows) {
+    bound_[var->name] = outer;
+  } else {
+    bound_.erase(var->name);
+  }
+  return LetStmt::make(op->var, value, body);
+}
+
+
+Stmt split_loop_nest(const Stmt &stmt) {
+  LoopSplitter splitter;
+  return splitter.mutate(stmt);
+}
+
+
+Stmt loop_invariant_code_motion(const Stmt &stmt) {
+  LoopInvariantCodeMotion licm;
+  return licm.mutate(stmt);
+}
+
+
+Group loop_invariant_code_motion(const Group &group) {
+  LoopInvariantCodeMotion licm;
+  return licm.mutate(group);
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
@@ -0,0 +1,271 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+#include "debug.h"
+#include "utils.h"
+#include "arith.h"
+#include "simplify.h"
+#include "parallel.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+/**
+ * arrays written and read, and the loops of a statement
+ */
+class Accesses : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const Move> op) override {
+    writes.push_back(op->dst);
+    Ref<const Var> dst = op->dst.as<Var>();
+    if (dst.defined() && dst->args.empty() && op->move_type == MoveType::MemToLocal) {
+      locals.push_back(dst->name);
+    }
+    if (dst.defined()) {
+      for (auto &arg : dst->args) {
+        arg.visit_expr(this);
+      }
+    }
+    op->src.visit_expr(this);
+  }
+
+  void visit(Ref<const Var> op) override {
+    reads.push_back(op);
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Call> op) override {
+    impure = impure || op->call_type == CallType::SideEffect;
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const LoopNest> op) override {
+    for (auto &index : op->index_list) {
+      loops[index.as<Index>()->name] = index;
+    }
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const LetStmt> op) override {
+    lets[op->var.as<Var>()->name] = op->value;
+    IRVisitor::visit(op);
+  }
+
+  std::vector<Expr> writes;
+  std::vector<Ref<const Var>> reads;
+  // declared in the statement, one per iteration
+  std::vector<std::string> locals;
+  std::unordered_map<std::string, Expr> loops;
+  // bound in the statement, e.g. the index arithmetic of LICM and CSE
+  std::unordered_map<std::string, Expr> lets;
+  bool impure = false;
+};
+
+
+/**
+ * replace the vars bound in a statement by their values, so args are
+ * seen in terms of the loop indices
+ */
+class LetInliner : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  explicit LetInliner(const std::unordered_map<std::string, Expr> &lets) : lets_(lets) {}
+
+  Expr visit(Ref<const Var> op) override {
+    auto it = lets_.find(op->name);
+    if (op->args.empty() && it != lets_.end()) {
+      return mutate(it->second);
+    }
+    return IRMutator::visit(op);
+  }
+
+ private:
+  const std::unordered_map<std::string, Expr> &lets_;
+};
+
+
+/**
+ * arg takes different values in different iterations of the loop of
+ * name, whatever the loops of body do
+ */
+bool separates(const Expr &arg, const std::string &name, const std::unordered_map<std::string, Expr> &loops) {
+  Arith::LinearForm form;
+  std::unordered_map<std::string, Expr> symbols;
+  if (!Arith::LinearForm::from_expr(arg, form, &symbols)) {
+    return false;
+  }
+  int64_t coeff = std::llabs(form.coeff(name));
+  if (coeff == 0) {
+    return false;
+  }
+  int64_t span = 0;
+  for (auto &term : form.terms()) {
+    auto it = loops.find(term.first);
+    if (term.first == name || it == loops.end()) {
+      // the enclosing loops stay fixed
+      continue;
+    }
+    // both Doms hold the values of the index, e.g. split loops have
+    // a tail in the loop and the full range in the args
+    int64_t lo, hi, arg_lo, arg_hi;
+    bool in_loop = Simplify::const_bounds(it->second, lo, hi);
+    if (Simplify::const_bounds(symbols[term.first], arg_lo, arg_hi)) {
+      lo = in_loop ? std::max(lo, arg_lo) : arg_lo;
+      hi = in_loop ? std::min(hi, arg_hi) : arg_hi;
+    } else if (!in_loop) {
+      return false;
+    }
+    span += std::llabs(term.second) * (hi - lo);
+  }
+  return span < coeff;
+}
+
+
+}  // anonymous namespace
+
+
+bool parallel_legal(const Expr &index, const std::vector<Stmt> &body, std::string &why) {
+  Ref<const Index> as_index = index.as<Index>();
+  CHECK(as_index.defined(), "Expect Index");
+  const std::string &name = as_index->name;
+  if (as_index->index_type == IndexType::Reduce) {
+    why = name + " is a reduce index";
+    return false;
+  }
+  Accesses accesses;
+  for (auto &stmt : body) {
+    stmt.visit_stmt(&accesses);
+  }
+  if (accesses.impure) {
+    why = "calls with side effects in the loop of " + name;
+    return false;
+  }
+  LetInliner inliner(accesses.lets);
+  for (auto &dst : accesses.writes) {
+    Ref<const Var> var = dst.as<Var>();
+    if (var.defined() && var->args.empty()
+        && std::find(accesses.locals.begin(), accesses.locals.end(), var->name) != accesses.locals.end()) {
+      continue;
+    }
+    if (!var.defined() || var->args.empty()) {
+      why = "scalar written in the loop of " + name;
+      return false;
+    }
+    bool disjoint = false;
+    for (auto &arg : var->args) {
+      disjoint = disjoint || separates(inliner.mutate(arg), name, accesses.loops);
+    }
+    if (!disjoint) {
+      why = var->name + " is not indexed by " + name;
+      return false;
+    }
+  }
+  for (auto &load : accesses.reads) {
+    for (auto &dst : accesses.writes) {
+      if (dst.as<Var>()->name == load->name
+          && !Utils::same_element(inliner.mutate(dst).as<Var>(), inliner.mutate(load).as<Var>())) {
+        why = load->name + " is read at elements written by other iterations of " + name;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+Stmt Parallelizer::visit(Ref<const LoopNest> op) {
+  if (op->index_list.empty()) {
+    return IRMutator::visit(op);
+  }
+  int count = max_loops_;
+  Ref<const LoopNest> nest = op;
+  std::vector<std::vector<Expr>> index_lists;
+  // the perfectly nested loops, marked from the outermost one
+  while (true) {
+    std::vector<Expr> index_list = nest->index_list;
+    for (size_t k = 0; k < index_list.size() && count > 0; ++k) {
+      Ref<const Index> index = index_list[k].as<Index>();
+      std::vector<Stmt> body = nest->body_list;
+      if (k + 1 < index_list.size()) {
+        body = {LoopNest::make(std::vector<Expr>(index_list.begin() + k + 1, index_list.end()), body)};
+      }
+      std::string why;
+      int64_t begin, extent;
+      if (index->index_type != IndexType::Spatial || !Utils::constant_dom(index_list[k], begin, extent)
+          || !parallel_legal(index_list[k], body, why)) {
+        count = 0;
+        break;
+      }
+      index_list[k] = Index::make(index->type(), index->name, index->dom, IndexType::Thread);
+      --count;
+    }
+    index_lists.push_back(index_list);
+    Ref<const LoopNest> inner;
+    if (count > 0 && nest->body_list.size() == 1) {
+      inner = nest->body_list[0].as<LoopNest>();
+    }
+    if (!inner.defined() || inner->index_list.empty()) {
+      break;
+    }
+    nest = inner;
+  }
+  Stmt ret;
+  for (int k = (int)index_lists.size() - 1; k >= 0; --k) {
+    ret = LoopNest::make(index_lists[k], k + 1 < (int)index_lists.size() ? std::vector<Stmt>{ret} : nest->body_list);
+  }
+  return ret;
+}
+
+
+Stmt parallelize(const Stmt &stmt, int max_loops) {
+  Parallelizer parallelizer(max_loops);
+  return parallelizer.mutate(stmt);
+}
+
+
+Group parallelize(const Group &group, int max_loops) {
+  Parallelizer parallelizer(max_loops);
+  return parallelizer.mutate(group);
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
@@ -0,0 +1,309 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+
+#include "debug.h"
+#include "IRPrinter.h"
+#include "IRVisitor.h"
+#include "simplify.h"
+#include "cse.h"
+#include "egraph.h"
+#include "licm.h"
+#include "strength_reduce.h"
+#include "parallel.h"
+#include "vectorize.h"
+#include "accumulate.h"
+#include "unroll.h"
+#include "pass_manager.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+template <typename T>
+std::string print(const T &node) {
+  IRPrinter printer;
+  return printer.print(node);
+}
+
+
+std::string json_string(const std::string &str) {
+  std::string ret = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+    }
+    ret += c;
+  }
+  return ret + "\"";
+}
+
+}  // anonymous namespace
+
+
+Pipeline Pipeline::preset(int level) {
+  Pipeline ret;
+  ret.name = "-O" + std::to_string(level);
+  if (level >= 3) {
+    ret.then("simplify_bounds").then("cse").then("strength_reduce").then("unroll").then("accumulate");
+  } else if (level == 2) {
+    ret.then("simplify_bounds").then("cse").then("licm");
+  } else if (level == 1) {
+    ret.then("simplify");
+  }
+  return ret;
+}
+
+
+Pipeline Pipeline::preset_fast() {
+  Pipeline ret;
+  ret.name = "-Ofast";
+  ret.fixpoint({"simplify_bounds", "egraph"});
+  Pipeline o3 = preset(3);
+  ret.steps.insert(ret.steps.end(), o3.steps.begin() + 1, o3.steps.end());
+  return ret;
+}
+
+
+bool Pipeline::parse(const std::string &spec, Pipeline &pipeline) {
+  size_t pos = 0;
+  auto skip = [&]() {
+    while (pos < spec.size() && std::isspace((unsigned char)spec[pos])) {
+      ++pos;
+    }
+  };
+  auto name = [&](std::string &out) {
+    skip();
+    size_t beg = pos;
+    while (pos < spec.size() && (std::isalnum((unsigned char)spec[pos]) || spec[pos] == '_')) {
+      ++pos;
+    }
+    out = spec.substr(beg, pos - beg);
+    skip();
+    return !out.empty();
+  };
+
+  skip();
+  if (spec.compare(pos, 2, "-O") == 0) {
+    std::string level;
+    pos += 2;
+    if (!name(level) || pos != spec.size()) {
+      return false;
+    }
+    if (level == "fast") {
+      pipeline = preset_fast();
+      return true;
+    }
+    if (level.size() != 1 || level[0] < '0' || level[0] > '3') {
+      return false;
+    }
+    pipeline = preset(level[0] - '0');
+    return true;
+  }
+
+  Pipeline ret;
+  ret.name = spec;
+  while (true) {
+    skip();
+    std::vector<std::string> passes;
+    bool group = pos < spec.size() && spec[pos] == '[';
+    pos += group;
+    while (true) {
+      std::string pass;
+      if (!name(pass)) {
+        return false;
+      }
+      passes.push_back(pass);
+      if (!group || pos == spec.size() || spec[pos] != ',') {
+        break;
+      }
+      ++pos;
+    }
+    if (group) {
+      if (pos == spec.size() || spec[pos] != ']') {
+        return false;
+      }
+      ++pos;
+      ret.fixpoint(passes);
+    } else {
+      ret.then(passes[0]);
+    }
+    skip();
+    if (pos == spec.size()) {
+      break;
+    }
+    if (spec[pos] != ',') {
+      return false;
+    }
+    ++pos;
+  }
+  pipeline = ret;
+  return true;
+}
+
+
+PassManager::PassManager() {
+  add_expr_pass("simplify", [](const Expr &e) { return Simplify::simplify(e); });
+  add_stmt_pass("simplify", [](const Stmt &s) { return Simplify::simplify(s); });
+  add_group_pass("simplify", [](const Group &g) { return Simplify::simplify(g); });
+  add_expr_pass("simplify_bounds", [](const Expr &e) { return Simplify::simplify_bounds(e); });
+  add_stmt_pass("simplify_bounds", [](const Stmt &s) { return Simplify::simplify_bounds(s); });
+  add_group_pass("simplify_bounds", [](const Group &g) { return Simplify::simplify_bounds(g); });
+  add_stmt_pass("cse", [](const Stmt &s) { return common_subexpr_elimination(s); });
+  add_group_pass("cse", [](const Group &g) { return common_subexpr_elimination(g); });
+  add_stmt_pass("egraph", [](const Stmt &s) { return egraph_optimize(s); });
+  add_group_pass("egraph", [](const Group &g) { return egraph_optimize(g); });
+  add_stmt_pass("licm", [](const Stmt &s) { return loop_invariant_code_motion(s); });
+  add_group_pass("licm", [](const Group &g) { return loop_invariant_code_motion(g); });
+  add_stmt_pass("strength_reduce", [](const Stmt &s) { return strength_reduce(s); });
+  add_group_pass("strength_reduce", [](const Group &g) { return strength_reduce(g); });
+  add_stmt_pass("parallelize", [](const Stmt &s) { return parallelize(s); });
+  add_group_pass("parallelize", [](const Group &g) { return parallelize(g); });
+  add_stmt_pass("vectorize", [](const Stmt &s) { return vectorize(s); });
+  add_group_pass("vectorize", [](const Group &g) { return vectorize(g); });
+  add_stmt_pass("accumulate", [](const Stmt &s) { return accumulate(s); });
+  add_group_pass("accumulate", [](const Group &g) { return accumulate(g); });
+  add_stmt_pass("unroll", [](const Stmt &s) { return unroll(s); });
+  add_group_pass("unroll", [](const Group &g) { return unroll(g); });
+}
+
+
+void PassManager::add_expr_pass(const std::string &name, ExprPass pass) {
+  passes_[name].expr = pass;
+}
+
+
+void PassManager::add_stmt_pass(const std::string &name, StmtPass pass) {
+  passes_[name].stmt = pass;
+}
+
+
+void PassManager::add_group_pass(const std::string &name, GroupPass pass) {
+  passes_[name].group = pass;
+}
+
+
+bool PassManager::has_pass(const std::string &name) const {
+  return passes_.count(name) != 0;
+}
+
+
+PassStats &PassManager::stats_of(const std::string &name) {
+  auto it = stat_ids_.find(name);
+  if (it != stat_ids_.end()) {
+    return stats_[it->second];
+  }
+  stat_ids_[name] = stats_.size();
+  stats_.push_back(PassStats());
+  stats_.back().name = name;
+  return stats_.back();
+}
+
+
+template <typename T, typename F>
+T PassManager::run_impl(const Pipeline &pipeline, const T &node, F get) {
+  T ret = node;
+  uint64_t nodes = Utils::count_nodes(ret);
+  for (auto &step : pipeline.steps) {
+    for (int iter = 0; iter < step.max_iterations; ++iter) {
+      std::string before = step.max_iterations > 1 ? print(ret) : "";
+      for (auto &name : step.passes) {
+        auto it = passes_.find(name);
+        if (it == passes_.end() || !get(it->second)) {
+          LOG(ERROR) << "No pass " << name << " for this level of IR, skipped.";
+          continue;
+        }
+        uint64_t allocations = IRNode::allocations();
+        auto beg = std::chrono::steady_clock::now();
+        T next = get(it->second)(ret);
+        auto end = std::chrono::steady_clock::now();
+
+        PassStats &stats = stats_of(name);
+        stats.runs += 1;
+        stats.millis += std::chrono::duration<double, std::milli>(end - beg).count();
+        stats.allocations += IRNode::allocations() - allocations;
+        stats.nodes_before += nodes;
+        nodes = Utils::count_nodes(next);
+        stats.nodes_after += nodes;
+        ret = next;
+      }
+      if (step.max_iterations <= 1 || print(ret) == before) {
+        break;
+      }
+    }
+  }
+  return ret;
+}
+
+
+Expr PassManager::run(const Pipeline &pipeline, const Expr &expr) {
+  return run_impl(pipeline, expr, [](const Entry &e) -> const ExprPass & { return e.expr; });
+}
+
+
+Stmt PassManager::run(const Pipeline &pipeline, const Stmt &stmt) {
+  return run_impl(pipeline, stmt, [](const Entry &e) -> const StmtPass & { return e.stmt; });
+}
+
+
+Group PassManager::run(const Pipeline &pipeline, const Group &group) {
+  return run_impl(pipeline, group, [](const Entry &e) -> const GroupPass & { return e.group; });
+}
+
+
+void PassManager::write_json(std::ostream &out) const {
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  double total = 0;
+  out << "{\"passes\": [";
+  for (size_t i = 0; i < stats_.size(); ++i) {
+    const PassStats &stats = stats_[i];
+    total += stats.millis;
+    out << (i == 0 ? "\n  " : ",\n  ")
+        << "{\"name\": " << json_string(stats.name)
+        << ", \"runs\": " << stats.runs
+        << ", \"millis\": " << std::fixed << std::setprecision(3) << stats.millis
+        << ", \"nodes_before\": " << stats.nodes_before
+        << ", \"nodes_after\": " << stats.nodes_after
+        << ", \"allocations\": " << stats.allocations << "}";
+  }
+  out << (stats_.empty() ? "" : "\n") << "], \"millis\": " << std::fixed << std::setprecision(3)
+      << total << "}\n";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
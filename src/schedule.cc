@@ -0,0 +1,320 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <vector>
+
+#include "debug.h"
+#include "utils.h"
+#include "arith.h"
+#include "schedule.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+void const_dom(const Expr &index, int64_t &begin, int64_t &extent) {
+  CHECK(Utils::constant_dom(index, begin, extent), "Expect constant Dom of index %s",
+    index.as<Index>()->name.c_str());
+}
+
+
+Expr make_index(const Expr &like, const std::string &name, const Expr &extent, IndexType index_type) {
+  Type type = like.type();
+  return Index::make(type, name, Dom::make(type, Utils::make_const(type, 0), extent), index_type);
+}
+
+
+std::vector<std::string> index_names(const Expr &expr) {
+  std::vector<Ref<const Index>> indices;
+  Utils::IndexCollector collector([](Ref<const Index>) { return true; });
+  collector.collect(expr, indices);
+  std::vector<std::string> ret;
+  for (auto index : indices) {
+    ret.push_back(index->name);
+  }
+  return ret;
+}
+
+}  // anonymous namespace
+
+
+Schedule::Schedule(const Operation &op) {
+  Ref<const ComputeOp> compute = op.as<ComputeOp>();
+  CHECK(compute.defined(), "Expect ComputeOp");
+  init(compute->index_list, compute->body_list);
+}
+
+
+Schedule::Schedule(const Stmt &loop_nest) {
+  std::vector<Expr> index_list;
+  Ref<const LoopNest> nest = loop_nest.as<LoopNest>();
+  CHECK(nest.defined(), "Expect LoopNest");
+  while (true) {
+    index_list.insert(index_list.end(), nest->index_list.begin(), nest->index_list.end());
+    Ref<const LoopNest> inner;
+    if (nest->body_list.size() == 1) {
+      inner = nest->body_list[0].as<LoopNest>();
+    }
+    if (!inner.defined()) {
+      break;
+    }
+    nest = inner;
+  }
+  init(index_list, nest->body_list);
+}
+
+
+void Schedule::init(const std::vector<Expr> &index_list, const std::vector<Stmt> &body_list) {
+  for (auto index : index_list) {
+    CHECK(index.as<Index>() != nullptr, "Expect Index");
+    loops_.push_back(index);
+    indices_.push_back(index);
+    values_.push_back(index);
+  }
+  body_list_ = body_list;
+  for (auto &stmt : body_list) {
+    std::vector<Ref<const Index>> indices;
+    Utils::IndexCollector collector([](Ref<const Index>) { return true; });
+    collector.collect(stmt, indices);
+    for (auto index : indices) {
+      names_.insert(index->name);
+    }
+  }
+  for (auto index : index_list) {
+    names_.insert(index.as<Index>()->name);
+  }
+}
+
+
+std::string Schedule::fresh_name(const std::string &name) {
+  std::string ret = name;
+  for (int k = 1; names_.count(ret) != 0; ++k) {
+    ret = name + std::to_string(k);
+  }
+  names_.insert(ret);
+  return ret;
+}
+
+
+int Schedule::position(const Expr &index) const {
+  Ref<const Index> as_index = index.as<Index>();
+  CHECK(as_index.defined(), "Expect Index");
+  return position(as_index->name);
+}
+
+
+int Schedule::position(const std::string &name) const {
+  for (size_t k = 0; k < loops_.size(); ++k) {
+    if (loops_[k].as<Index>()->name == name) {
+      return (int)k;
+    }
+  }
+  CHECK(false, "Index %s is not a loop of the schedule", name.c_str());
+  return -1;
+}
+
+
+void Schedule::substitute(const Expr &index, const Expr &value) {
+  std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+  vmap[index.as<Index>()] = value;
+  for (auto &v : values_) {
+    v = Utils::substitute_index_by_name(v, vmap);
+  }
+  for (auto &tail : tails_) {
+    tail.base = Utils::substitute_index_by_name(tail.base, vmap);
+    tail.inner = Utils::substitute_index_by_name(tail.inner, vmap);
+  }
+}
+
+
+void Schedule::split(const Expr &index, int64_t factor, Expr &outer, Expr &inner) {
+  CHECK(factor > 0, "Expect positive split factor, get %lld", (long long)factor);
+  int pos = position(index);
+  Expr loop = loops_[pos];
+  Ref<const Index> as_index = loop.as<Index>();
+  int64_t begin, extent;
+  const_dom(loop, begin, extent);
+  Type type = loop.type();
+  outer = make_index(loop, fresh_name(as_index->name + "_outer"),
+    Utils::make_const(type, (extent + factor - 1) / factor), as_index->index_type);
+  inner = make_index(loop, fresh_name(as_index->name + "_inner"),
+    Utils::make_const(type, factor), as_index->index_type);
+  loops_[pos] = inner;
+  loops_.insert(loops_.begin() + pos, outer);
+
+  Expr offset = Arith::add(Arith::mul(outer, Utils::make_const(type, factor)), inner);
+  if (extent % factor != 0) {
+    tails_.push_back(Tail{outer, inner, factor, extent});
+  }
+  substitute(loop, Arith::add(offset, Utils::make_const(type, begin)));
+}
+
+
+void Schedule::fuse(const Expr &outer, const Expr &inner, Expr &fused) {
+  int pos = position(outer);
+  CHECK(pos + 1 < (int)loops_.size() && position(inner) == pos + 1,
+    "Expect the loop of %s right around the loop of %s", outer.as<Index>()->name.c_str(),
+    inner.as<Index>()->name.c_str());
+  Expr a = loops_[pos];
+  Expr b = loops_[pos + 1];
+  Ref<const Index> index_a = a.as<Index>();
+  Ref<const Index> index_b = b.as<Index>();
+  CHECK(index_a->index_type == index_b->index_type, "Can't fuse %s and %s of different IndexTypes",
+    index_a->name.c_str(), index_b->name.c_str());
+  int64_t begin_a, extent_a, begin_b, extent_b;
+  const_dom(a, begin_a, extent_a);
+  const_dom(b, begin_b, extent_b);
+  Type type = a.type();
+  fused = make_index(a, fresh_name(index_a->name + "_" + index_b->name + "_fused"),
+    Utils::make_const(type, extent_a * extent_b), index_a->index_type);
+  loops_.erase(loops_.begin() + pos + 1);
+  loops_[pos] = fused;
+
+  Expr stride = Utils::make_const(type, extent_b);
+  substitute(a, Arith::add(Arith::div(fused, stride), Utils::make_const(type, begin_a)));
+  substitute(b, Arith::add(Arith::mod(fused, stride), Utils::make_const(type, begin_b)));
+}
+
+
+void Schedule::reorder(const std::vector<Expr> &indices) {
+  std::vector<int> positions;
+  for (auto &index : indices) {
+    int pos = position(index);
+    CHECK(std::find(positions.begin(), positions.end(), pos) == positions.end(),
+      "Index %s reordered twice", index.as<Index>()->name.c_str());
+    positions.push_back(pos);
+  }
+  std::vector<Expr> loops;
+  for (int pos : positions) {
+    loops.push_back(loops_[pos]);
+  }
+  std::sort(positions.begin(), positions.end());
+  for (size_t k = 0; k < positions.size(); ++k) {
+    loops_[positions[k]] = loops[k];
+  }
+}
+
+
+void Schedule::tile(const Expr &x, const Expr &y, int64_t x_factor, int64_t y_factor,
+                    Expr &x_outer, Expr &y_outer, Expr &x_inner, Expr &y_inner) {
+  split(x, x_factor, x_outer, x_inner);
+  split(y, y_factor, y_outer, y_inner);
+  reorder({x_outer, y_outer, x_inner, y_inner});
+}
+
+
+void Schedule::parallel(const Expr &index) {
+  int pos = position(index);
+  Ref<const Index> as_index = loops_[pos].as<Index>();
+  CHECK(as_index->index_type != IndexType::Reduce, "Can't run the loop of reduce index %s in parallel",
+    as_index->name.c_str());
+  loops_[pos] = Index::make(as_index->type(), as_index->name, as_index->dom, IndexType::Thread);
+}
+
+
+void Schedule::vectorize(const Expr &index) {
+  int pos = position(index);
+  Ref<const Index> as_index = loops_[pos].as<Index>();
+  loops_[pos] = Index::make(as_index->type(), as_index->name, as_index->dom, IndexType::Vectorized);
+}
+
+
+void Schedule::unroll(const Expr &index) {
+  int pos = position(index);
+  Ref<const Index> as_index = loops_[pos].as<Index>();
+  loops_[pos] = Index::make(as_index->type(), as_index->name, as_index->dom, IndexType::Unrolled);
+}
+
+
+Stmt Schedule::lower() const {
+  std::vector<Expr> loops = loops_;
+  std::vector<std::vector<Expr>> guards(loops_.size());
+  std::vector<bool> bounded(loops_.size(), false);
+  for (auto &tail : tails_) {
+    Type type = tail.inner.type();
+    Expr factor = Utils::make_const(type, tail.factor);
+    Expr extent = Utils::make_const(type, tail.extent);
+    Expr start = Arith::mul(tail.base, factor);
+    int depth = -1;
+    for (auto &name : index_names(tail.base)) {
+      depth = std::max(depth, position(name));
+    }
+    int inner = tail.inner.as<Index>() != nullptr ? position(tail.inner) : -1;
+    if (inner > depth && !bounded[inner]) {
+      // the inner loop stops at the end of the split index
+      Ref<const Index> as_index = loops[inner].as<Index>();
+      Expr rest = Arith::sub(extent, start);
+      Expr bound = Select::make(type, Arith::le(Arith::add(start, factor), extent), factor, rest);
+      loops[inner] = make_index(loops[inner], as_index->name, bound, as_index->index_type);
+      bounded[inner] = true;
+      continue;
+    }
+    for (auto &name : index_names(tail.inner)) {
+      depth = std::max(depth, position(name));
+    }
+    guards[depth].push_back(Arith::lt(Arith::add(start, tail.inner), extent));
+  }
+
+  for (size_t k = 0; k < loops.size(); ++k) {
+    Ref<const Dom> dom = loops[k].as<Index>()->dom.as<Dom>();
+    for (auto &name : index_names(Arith::add(dom->begin, dom->extent))) {
+      CHECK(position(name) < (int)k, "Expect the loop of %s around the loop of %s", name.c_str(),
+        loops[k].as<Index>()->name.c_str());
+    }
+  }
+
+  std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+  for (size_t k = 0; k < indices_.size(); ++k) {
+    vmap[indices_[k].as<Index>()] = values_[k];
+  }
+  Utils::SubstituteIndexByName substituter(vmap);
+  std::vector<Stmt> body_list;
+  for (auto &stmt : body_list_) {
+    body_list.push_back(substituter.mutate(stmt));
+  }
+  for (int k = (int)loops.size() - 1; k >= 0; --k) {
+    if (!guards[k].empty()) {
+      Expr cond = guards[k][0];
+      for (size_t i = 1; i < guards[k].size(); ++i) {
+        cond = Arith::logic_and(cond, guards[k][i]);
+      }
+      Stmt body = body_list.size() == 1 ? body_list[0] : LoopNest::make({}, body_list);
+      body_list = {IfThenElse::make(cond, body, Stmt())};
+    }
+    body_list = {LoopNest::make({loops[k]}, body_list)};
+  }
+  return body_list.size() == 1 ? body_list[0] : LoopNest::make({}, body_list);
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
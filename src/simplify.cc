@@ -1,6 +1,7 @@
-#include <cmath>
+#include <algorithm>
 
 #include "simplify.h"
+#include "arith.h"
 #include "utils.h"
 
 namespace Boost {
@@ -9,222 +10,1084 @@ using namespace Internal;
 
 namespace Simplify {
 
-Expr SimplifyUnitElement::visit(Ref<const Unary> op) {
-  Expr new_value = mutate(op->a);
-  if (op->op_type == UnaryOpType::Neg) {
-    Ref<const IntImm> as_int = new_value.as<IntImm>();
-    if (as_int.defined()) {
-      return Expr(-as_int->value());
-    }
-    Ref<const FloatImm> as_float = new_value.as<FloatImm>();
-    if (as_float.defined()) {
-      return Expr(-as_float->value());
-    }
-    Ref<const Unary> as_unary = new_value.as<Unary>();
-    if (as_unary.defined() && as_unary->op_type == UnaryOpType::Neg) {
-      return as_unary->a;
-    }
-  } else if (op->op_type == UnaryOpType::Not) {
-    Ref<const IntImm> as_int = new_value.as<IntImm>();
-    if (as_int.defined()) {
-      if (as_int->value() != 0) {
-        return Utils::make_const(op->type(), 0);
-      } else {
-        return Utils::make_const(op->type(), 1);
+namespace {
+
+// bool, or uint1 as Expr(bool) makes
+bool is_bool_type(const Type &t) {
+  return t.code == TypeCode::Bool || (t.code == TypeCode::UInt && t.bits == 1);
+}
+
+
+bool as_const_float(const Expr &e, double &v) {
+  Ref<const FloatImm> as_float = e.as<FloatImm>();
+  if (e.defined() && as_float.defined()) {
+    v = as_float->value();
+    return true;
+  }
+  return false;
+}
+
+
+bool as_const_bool(const Expr &e, bool &v) {
+  if (!e.defined() || !is_bool_type(e.type())) {
+    return false;
+  }
+  Ref<const UIntImm> as_uint = e.as<UIntImm>();
+  if (as_uint.defined()) {
+    v = as_uint->value() != 0;
+    return true;
+  }
+  return false;
+}
+
+
+bool is_const(const Expr &e) {
+  int64_t i;
+  double f;
+  return Utils::as_const_int(e, i) || as_const_float(e, f);
+}
+
+
+bool is_const_value(const Expr &e, double v) {
+  int64_t i;
+  double f;
+  return (Utils::as_const_int(e, i) && i == v) || (as_const_float(e, f) && f == v);
+}
+
+
+bool is_integer(const Type &t) {
+  return (t.is_int() || t.is_uint()) && !is_bool_type(t);
+}
+
+
+bool equal(const Expr &a, const Expr &b) {
+  Utils::ExprEqualByValue eev;
+  return eev.visit_expr(a, b);
+}
+
+
+template<typename T>
+int compare_values(const T &x, const T &y) {
+  return x < y ? -1 : (y < x ? 1 : 0);
+}
+
+
+/**
+ * total order of expressions for canonical operands:
+ * node type, then name or value, then children
+ */
+int compare_exprs(const Expr &a, const Expr &b) {
+  if (a.get() == b.get()) {
+    return 0;
+  }
+  int ret = compare_values((int)a->node_type(), (int)b->node_type());
+  if (ret != 0) {
+    return ret;
+  }
+  auto compare_lists = [](const std::vector<Expr> &x, const std::vector<Expr> &y) {
+    for (size_t i = 0; i < x.size() && i < y.size(); ++i) {
+      int ret = compare_exprs(x[i], y[i]);
+      if (ret != 0) {
+        return ret;
       }
     }
-    Ref<const Unary> as_unary = new_value.as<Unary>();
-    if (as_unary.defined() && as_unary->op_type == UnaryOpType::Not) {
-      return as_unary->a;
+    return compare_values(x.size(), y.size());
+  };
+  switch (a->node_type()) {
+  case IRNodeType::IntImm:
+    return compare_values(a.as<IntImm>()->value(), b.as<IntImm>()->value());
+  case IRNodeType::UIntImm:
+    return compare_values(a.as<UIntImm>()->value(), b.as<UIntImm>()->value());
+  case IRNodeType::FloatImm:
+    return compare_values(a.as<FloatImm>()->value(), b.as<FloatImm>()->value());
+  case IRNodeType::Index:
+    return compare_values(a.as<Index>()->name, b.as<Index>()->name);
+  case IRNodeType::Var: {
+    ret = compare_values(a.as<Var>()->name, b.as<Var>()->name);
+    return ret != 0 ? ret : compare_lists(a.as<Var>()->args, b.as<Var>()->args);
+  }
+  case IRNodeType::Call: {
+    ret = compare_values(a.as<Call>()->func_name, b.as<Call>()->func_name);
+    return ret != 0 ? ret : compare_lists(a.as<Call>()->args, b.as<Call>()->args);
+  }
+  case IRNodeType::Unary: {
+    Ref<const Unary> x = a.as<Unary>(), y = b.as<Unary>();
+    ret = compare_values((int)x->op_type, (int)y->op_type);
+    return ret != 0 ? ret : compare_exprs(x->a, y->a);
+  }
+  case IRNodeType::Binary: {
+    Ref<const Binary> x = a.as<Binary>(), y = b.as<Binary>();
+    ret = compare_values((int)x->op_type, (int)y->op_type);
+    return ret != 0 ? ret : compare_lists({x->a, x->b}, {y->a, y->b});
+  }
+  case IRNodeType::Compare: {
+    Ref<const Compare> x = a.as<Compare>(), y = b.as<Compare>();
+    ret = compare_values((int)x->op_type, (int)y->op_type);
+    return ret != 0 ? ret : compare_lists({x->a, x->b}, {y->a, y->b});
+  }
+  case IRNodeType::Select: {
+    Ref<const Select> x = a.as<Select>(), y = b.as<Select>();
+    return compare_lists({x->cond, x->true_value, x->false_value},
+                         {y->cond, y->true_value, y->false_value});
+  }
+  case IRNodeType::Cast:
+    return compare_exprs(a.as<Cast>()->val, b.as<Cast>()->val);
+  default:
+    return 0;
+  }
+}
+
+
+// && and || are not reordered, the generated code short-circuits
+bool is_commutative(BinaryOpType op) {
+  return op == BinaryOpType::Add || op == BinaryOpType::Mul;
+}
+
+
+// canonical operand order: constants last, integer operands by
+// compare_exprs, floating point ones keep dst = dst + src readable
+bool should_swap(const Expr &a, const Expr &b) {
+  if (is_const(a) != is_const(b)) {
+    return is_const(a);
+  }
+  return is_integer(a.type()) && compare_exprs(a, b) > 0;
+}
+
+
+int64_t floor_div(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+
+/**
+ * fold a binary operation of two constants into a constant of type
+ */
+bool fold_binary(BinaryOpType op, Type type, const Expr &a, const Expr &b, Expr &ret) {
+  int64_t x, y;
+  double fx, fy;
+  bool bx, by;
+  if (as_const_bool(a, bx) && as_const_bool(b, by)) {
+    if (op == BinaryOpType::And || op == BinaryOpType::Or) {
+      ret = Utils::make_const(type, op == BinaryOpType::And ? (bx && by) : (bx || by));
+      return true;
+    }
+    return false;
+  }
+  if (Utils::as_const_int(a, x) && Utils::as_const_int(b, y) && is_integer(type)) {
+    bool by_zero = y == 0 && op != BinaryOpType::Add && op != BinaryOpType::Sub && op != BinaryOpType::Mul;
+    if (by_zero) {
+      return false;
+    }
+    switch (op) {
+    case BinaryOpType::Add: ret = Utils::make_const(type, x + y); return true;
+    case BinaryOpType::Sub: ret = Utils::make_const(type, x - y); return true;
+    case BinaryOpType::Mul: ret = Utils::make_const(type, x * y); return true;
+    case BinaryOpType::Div: ret = Utils::make_const(type, x / y); return true;
+    case BinaryOpType::Mod: ret = Utils::make_const(type, x % y); return true;
+    case BinaryOpType::FloorDiv: ret = Utils::make_const(type, floor_div(x, y)); return true;
+    case BinaryOpType::FloorMod: ret = Utils::make_const(type, x - floor_div(x, y) * y); return true;
+    default: return false;
+    }
+  }
+  if (as_const_float(a, fx) && as_const_float(b, fy) && type.is_float()) {
+    switch (op) {
+    case BinaryOpType::Add: ret = Utils::make_const(type, fx + fy); return true;
+    case BinaryOpType::Sub: ret = Utils::make_const(type, fx - fy); return true;
+    case BinaryOpType::Mul: ret = Utils::make_const(type, fx * fy); return true;
+    case BinaryOpType::Div: ret = Utils::make_const(type, fx / fy); return true;
+    default: return false;
     }
   }
-  return Unary::make(op->type(), op->op_type, new_value);
+  return false;
 }
 
 
-Expr SimplifyUnitElement::visit(Ref<const Binary> op) {
-  Expr new_a = mutate(op->a);
-  Expr new_b = mutate(op->b);
-  Ref<const IntImm> a_as_int = new_a.as<IntImm>();
-  Ref<const FloatImm> a_as_float = new_a.as<FloatImm>();
-  Ref<const IntImm> b_as_int = new_b.as<IntImm>();
-  Ref<const FloatImm> b_as_float = new_b.as<FloatImm>();
+Expr make_binary(BinaryOpType op, const Expr &a, const Expr &b) {
+  switch (op) {
+  case BinaryOpType::Add: return Arith::add(a, b);
+  case BinaryOpType::Sub: return Arith::sub(a, b);
+  case BinaryOpType::Mul: return Arith::mul(a, b);
+  case BinaryOpType::Div: return Arith::div(a, b);
+  case BinaryOpType::Mod: return Arith::mod(a, b);
+  case BinaryOpType::FloorDiv: return Arith::floordiv(a, b);
+  case BinaryOpType::FloorMod: return Arith::floormod(a, b);
+  case BinaryOpType::And: return Arith::logic_and(a, b);
+  case BinaryOpType::Or: return Arith::logic_or(a, b);
+  default: return Binary::make(a.type(), op, a, b);
+  }
+}
 
-  if (op->op_type == BinaryOpType::Add) {
-    if (a_as_int.defined() && b_as_int.defined()) {
-      return Expr(a_as_int->value() + b_as_int->value());
-    } else if (a_as_float.defined() && b_as_float.defined()) {
-      return Expr(a_as_float->value() + b_as_float->value());
-    } else if (a_as_int.defined()) {
-      if (a_as_int->value() == 0) {
-        return new_b;
-      }
-    } else if (b_as_int.defined()) {
-      if (b_as_int->value() == 0) {
-        return new_a;
-      }
-    } else if (a_as_float.defined()) {
-      if (std::abs(a_as_float->value()) < 1e-20) {
-        return new_b;
-      }
-    } else if (b_as_float.defined()) {
-      if (std::abs(b_as_float->value() < 1e-20)) {
-        return new_a;
-      }
+
+Expr make_compare(CompareOpType op, const Expr &a, const Expr &b) {
+  switch (op) {
+  case CompareOpType::EQ: return Arith::eq(a, b);
+  case CompareOpType::NE: return Arith::ne(a, b);
+  case CompareOpType::GT: return Arith::gt(a, b);
+  case CompareOpType::GE: return Arith::ge(a, b);
+  case CompareOpType::LT: return Arith::lt(a, b);
+  case CompareOpType::LE: return Arith::le(a, b);
+  default: return Compare::make(Type::bool_scalar(), op, a, b);
+  }
+}
+
+
+Expr make_not(const Expr &a) {
+  bool x;
+  if (as_const_bool(a, x)) {
+    return Utils::make_const(a.type(), !x);
+  }
+  Ref<const Unary> as_unary = a.as<Unary>();
+  if (as_unary.defined() && as_unary->op_type == UnaryOpType::Not) {
+    return as_unary->a;
+  }
+  return Unary::make(a.type(), UnaryOpType::Not, a);
+}
+
+
+bool match(const Expr &pattern, const Expr &expr, Bindings &bindings) {
+  switch (pattern->node_type()) {
+  case IRNodeType::Index: {
+    const std::string &name = pattern.as<Index>()->name;
+    if (name[0] == 'c' && !is_const(expr)) {
+      return false;
     }
-  } else if (op->op_type == BinaryOpType::Sub) {
-    if (a_as_int.defined() && b_as_int.defined()) {
-      return Expr(a_as_int->value() - b_as_int->value());
-    } else if (a_as_float.defined() && b_as_float.defined()) {
-      return Expr(a_as_float->value() - b_as_float->value());
-    } else if (a_as_int.defined()) {
-      if (a_as_int->value() == 0) {
-        return Unary::make(new_b->type(), UnaryOpType::Neg, new_b);
-      }
-    } else if (b_as_int.defined()) {
-      if (b_as_int->value() == 0) {
-        return new_a;
-      }
-    } else if (a_as_float.defined()) {
-      if (std::abs(a_as_float->value()) < 1e-20) {
-        return Unary::make(new_b->type(), UnaryOpType::Neg, new_b);
-      }
-    } else if (b_as_float.defined()) {
-      if (std::abs(b_as_float->value() < 1e-20)) {
-        return new_a;
-      }
+    auto it = bindings.find(name);
+    if (it != bindings.end()) {
+      return equal(it->second, expr);
     }
-  } else if (op->op_type == BinaryOpType::Mul) {
-    if (a_as_int.defined() && b_as_int.defined()) {
-      return Expr(a_as_int->value() * b_as_int->value());
-    } else if (a_as_float.defined() && b_as_float.defined()) {
-      return Expr(a_as_float->value() * b_as_float->value());
-    } else if (a_as_int.defined()) {
-      if (a_as_int->value() == 0) {
-        return Utils::make_const(new_b->type(), 0);
-      } else if (a_as_int->value() == 1) {
-        return new_b;
-      } else if (a_as_int->value() == -1) {
-        return Unary::make(new_b->type(), UnaryOpType::Neg, new_b);
-      }
-    } else if (b_as_int.defined()) {
-      if (b_as_int->value() == 0) {
-        return Utils::make_const(new_a->type(), 0);
-      } else if (b_as_int->value() == 1) {
-        return new_a;
-      } else if (b_as_int->value() == -1) {
-        return Unary::make(new_a->type(), UnaryOpType::Neg, new_a);
-      }
-    } else if (a_as_float.defined()) {
-      if (std::abs(a_as_float->value()) < 1e-20) {
-        return Utils::make_const(new_b->type(), 0.0);
-      } else if (std::abs(a_as_float->value() - 1) < 1e-20) {
-        return new_b;
-      } else if (std::abs(a_as_float->value() + 1) < 1e-20) {
-        return Unary::make(new_b->type(), UnaryOpType::Neg, new_b);
-      }
-    } else if (b_as_float.defined()) {
-      if (std::abs(b_as_float->value()) < 1e-20) {
-        new_a->type();
-        auto tmp = Utils::make_const(new_a->type(), 0.0);
-        return tmp;
-      } else if (std::abs(b_as_float->value() - 1) < 1e-20) {
-        return new_a;
-      } else if (std::abs(b_as_float->value() + 1) < 1e-20) {
-        return Unary::make(new_a->type(), UnaryOpType::Neg, new_a);
-      }
+    bindings[name] = expr;
+    return true;
+  }
+  case IRNodeType::IntImm:
+    return is_const_value(expr, (double)pattern.as<IntImm>()->value());
+  case IRNodeType::FloatImm:
+    return is_const_value(expr, pattern.as<FloatImm>()->value());
+  case IRNodeType::Unary: {
+    Ref<const Unary> p = pattern.as<Unary>(), e = expr.as<Unary>();
+    return e.defined() && p->op_type == e->op_type && match(p->a, e->a, bindings);
+  }
+  case IRNodeType::Binary: {
+    Ref<const Binary> p = pattern.as<Binary>(), e = expr.as<Binary>();
+    return e.defined() && p->op_type == e->op_type
+        && match(p->a, e->a, bindings) && match(p->b, e->b, bindings);
+  }
+  case IRNodeType::Compare: {
+    Ref<const Compare> p = pattern.as<Compare>(), e = expr.as<Compare>();
+    return e.defined() && p->op_type == e->op_type
+        && match(p->a, e->a, bindings) && match(p->b, e->b, bindings);
+  }
+  case IRNodeType::Select: {
+    Ref<const Select> p = pattern.as<Select>(), e = expr.as<Select>();
+    return e.defined() && match(p->cond, e->cond, bindings)
+        && match(p->true_value, e->true_value, bindings)
+        && match(p->false_value, e->false_value, bindings);
+  }
+  default:
+    return false;
+  }
+}
+
+
+// constants of the rhs take the type of the rewritten expression
+Expr instantiate(const Expr &pattern, const Bindings &bindings, Type type) {
+  switch (pattern->node_type()) {
+  case IRNodeType::Index:
+    return bindings.at(pattern.as<Index>()->name);
+  case IRNodeType::IntImm:
+    return Utils::make_const(type, pattern.as<IntImm>()->value());
+  case IRNodeType::FloatImm:
+    return Utils::make_const(type, pattern.as<FloatImm>()->value());
+  case IRNodeType::Unary: {
+    Ref<const Unary> p = pattern.as<Unary>();
+    Expr a = instantiate(p->a, bindings, type);
+    return p->op_type == UnaryOpType::Neg ? Arith::neg(a) : make_not(a);
+  }
+  case IRNodeType::Binary: {
+    Ref<const Binary> p = pattern.as<Binary>();
+    return make_binary(p->op_type, instantiate(p->a, bindings, type), instantiate(p->b, bindings, type));
+  }
+  case IRNodeType::Compare: {
+    Ref<const Compare> p = pattern.as<Compare>();
+    Type operand = bindings.count("x") ? bindings.at("x").type() : type;
+    return make_compare(p->op_type, instantiate(p->a, bindings, operand), instantiate(p->b, bindings, operand));
+  }
+  case IRNodeType::Select: {
+    Ref<const Select> p = pattern.as<Select>();
+    Expr t = instantiate(p->true_value, bindings, type);
+    return Select::make(t.type(), instantiate(p->cond, bindings, type), t,
+                        instantiate(p->false_value, bindings, type));
+  }
+  default:
+    LOG(ERROR) << "Unsupported node in a rewrite rule: " << pattern << ".";
+    throw;
+  }
+}
+
+
+/**
+ * the rule tables, one per node kind
+ */
+struct Rules {
+  std::vector<Rule> neg, logic_not, add, sub, mul, div, floordiv, mod, logic_and, logic_or, select;
+
+  Rules() {
+    using Domain = Rule::Domain;
+    Expr x = Rule::wildcard("x"), y = Rule::wildcard("y"), z = Rule::wildcard("z");
+    Expr c0 = Rule::wildcard("c0"), c1 = Rule::wildcard("c1");
+    Type t = x.type();
+    auto mk = [&](BinaryOpType op, Expr a, Expr b) { return Binary::make(t, op, a, b); };
+    auto negate = [&](Expr a) { return Unary::make(t, UnaryOpType::Neg, a); };
+    auto cmp = [&](CompareOpType op, Expr a, Expr b) { return Compare::make(Type::bool_scalar(), op, a, b); };
+    auto lnot = [&](Expr a) { return Unary::make(Type::bool_scalar(), UnaryOpType::Not, a); };
+    // nan compares false both ways, negated compares only flip for integers
+    auto int_operands = [](const Bindings &b) { return is_integer(b.at("x").type()); };
+    auto nonzero = [](const Bindings &b) { return !is_const_value(b.at("c0"), 0); };
+    auto divides = [](const Bindings &b) {
+      int64_t x, y;
+      return Utils::as_const_int(b.at("c0"), x) && Utils::as_const_int(b.at("c1"), y) && y != 0 && x % y == 0;
+    };
+
+    neg = {
+      // -(x - y) has the same rounding as y - x
+      Rule(negate(mk(BinaryOpType::Sub, x, y)), mk(BinaryOpType::Sub, y, x)),
+      Rule(negate(mk(BinaryOpType::Mul, x, c0)), mk(BinaryOpType::Mul, x, negate(c0))),
+    };
+    logic_not = {
+      Rule(lnot(cmp(CompareOpType::LT, x, y)), cmp(CompareOpType::GE, x, y), Domain::Any, int_operands),
+      Rule(lnot(cmp(CompareOpType::LE, x, y)), cmp(CompareOpType::GT, x, y), Domain::Any, int_operands),
+      Rule(lnot(cmp(CompareOpType::GT, x, y)), cmp(CompareOpType::LE, x, y), Domain::Any, int_operands),
+      Rule(lnot(cmp(CompareOpType::GE, x, y)), cmp(CompareOpType::LT, x, y), Domain::Any, int_operands),
+      Rule(lnot(cmp(CompareOpType::EQ, x, y)), cmp(CompareOpType::NE, x, y)),
+      Rule(lnot(cmp(CompareOpType::NE, x, y)), cmp(CompareOpType::EQ, x, y)),
+    };
+    add = {
+      Rule(mk(BinaryOpType::Add, x, negate(y)), mk(BinaryOpType::Sub, x, y)),
+      Rule(mk(BinaryOpType::Add, negate(x), y), mk(BinaryOpType::Sub, y, x)),
+      Rule(mk(BinaryOpType::Add, x, Expr(0)), x),
+    };
+    sub = {
+      Rule(mk(BinaryOpType::Sub, x, negate(y)), mk(BinaryOpType::Add, x, y)),
+      Rule(mk(BinaryOpType::Sub, Expr(0), x), negate(x)),
+      Rule(mk(BinaryOpType::Sub, x, x), Expr(0), Domain::Int),
+    };
+    mul = {
+      // 0 * inf is nan, floating point products stay
+      Rule(mk(BinaryOpType::Mul, x, Expr(0)), Expr(0), Domain::Int),
+      Rule(mk(BinaryOpType::Mul, x, Expr(-1)), negate(x)),
+      Rule(mk(BinaryOpType::Mul, negate(x), negate(y)), mk(BinaryOpType::Mul, x, y)),
+      Rule(mk(BinaryOpType::Mul, negate(x), c0), mk(BinaryOpType::Mul, x, negate(c0))),
+    };
+    div = {
+      Rule(mk(BinaryOpType::Div, Expr(0), x), Expr(0)),
+      Rule(mk(BinaryOpType::Div, x, Expr(-1)), negate(x)),
+      Rule(mk(BinaryOpType::Div, mk(BinaryOpType::Mul, x, y), y), x, Domain::Int),
+      Rule(mk(BinaryOpType::Div, mk(BinaryOpType::Mul, y, x), y), x, Domain::Int),
+      Rule(mk(BinaryOpType::Div, mk(BinaryOpType::Mul, x, c0), c1),
+           mk(BinaryOpType::Mul, x, mk(BinaryOpType::Div, c0, c1)), Domain::Int, divides),
+      Rule(mk(BinaryOpType::Div, negate(x), c0), mk(BinaryOpType::Div, x, negate(c0)), Domain::Any, nonzero),
+    };
+    floordiv = {
+      Rule(mk(BinaryOpType::FloorDiv, x, Expr(-1)), negate(x), Domain::Int),
+      Rule(mk(BinaryOpType::FloorDiv, mk(BinaryOpType::Mul, x, y), y), x, Domain::Int),
+      Rule(mk(BinaryOpType::FloorDiv, mk(BinaryOpType::Mul, y, x), y), x, Domain::Int),
+    };
+    for (auto op : {BinaryOpType::Mod, BinaryOpType::FloorMod}) {
+      mod.push_back(Rule(mk(op, mk(BinaryOpType::Mul, x, y), y), Expr(0), Domain::Int));
+      mod.push_back(Rule(mk(op, mk(BinaryOpType::Mul, y, x), y), Expr(0), Domain::Int));
+      mod.push_back(Rule(mk(op, mk(BinaryOpType::Mul, x, c0), c1), Expr(0), Domain::Int, divides));
     }
-  } else if (op->op_type == BinaryOpType::Div) {
-    if (a_as_int.defined() && b_as_int.defined()) {
-      return Expr(a_as_int->value() / b_as_int->value());
-    } else if (a_as_float.defined() && b_as_float.defined()) {
-      return Expr(a_as_float->value() / b_as_float->value());
-    } else if (a_as_int.defined()) {
-      if (a_as_int->value() == 0) {
-        return Utils::make_const(new_b->type(), 0);
-      }
-    } else if (b_as_int.defined()) {
-      if (b_as_int->value() == 1) {
-        return new_a;
-      } else if (b_as_int->value() == -1) {
-        return Unary::make(new_a->type(), UnaryOpType::Neg, new_a);
-      }
-    } else if (a_as_float.defined()) {
-      if (std::abs(a_as_float->value()) < 1e-20) {
-        return Utils::make_const(new_b->type(), 0.0);
-      }
-    } else if (b_as_float.defined()) {
-      if (std::abs(b_as_float->value() - 1) < 1e-20) {
-        return new_a;
-      } else if (std::abs(b_as_float->value() + 1) < 1e-20) {
-        return Unary::make(new_a->type(), UnaryOpType::Neg, new_a);
+    logic_and = {
+      Rule(mk(BinaryOpType::And, x, x), x),
+    };
+    logic_or = {
+      Rule(mk(BinaryOpType::Or, x, x), x),
+    };
+    select = {
+      Rule(Select::make(t, z, x, x), x),
+      Rule(Select::make(t, lnot(z), x, y), Select::make(t, z, y, x)),
+    };
+  }
+};
+
+
+const std::vector<Rule> *rules_of(const Expr &expr) {
+  static const Rules rules;
+  static const std::vector<Rule> none;
+  Ref<const Unary> as_unary = expr.as<Unary>();
+  if (as_unary.defined()) {
+    return as_unary->op_type == UnaryOpType::Neg ? &rules.neg : &rules.logic_not;
+  }
+  if (expr.as<Select>() != nullptr) {
+    return &rules.select;
+  }
+  Ref<const Binary> as_binary = expr.as<Binary>();
+  if (!as_binary.defined()) {
+    return &none;
+  }
+  switch (as_binary->op_type) {
+  case BinaryOpType::Add: return &rules.add;
+  case BinaryOpType::Sub: return &rules.sub;
+  case BinaryOpType::Mul: return &rules.mul;
+  case BinaryOpType::Div: return &rules.div;
+  case BinaryOpType::FloorDiv: return &rules.floordiv;
+  case BinaryOpType::Mod: return &rules.mod;
+  case BinaryOpType::FloorMod: return &rules.mod;
+  case BinaryOpType::And: return &rules.logic_and;
+  case BinaryOpType::Or: return &rules.logic_or;
+  default: return &none;
+  }
+}
+
+
+/**
+ * integer sum of coeff * term plus a constant, terms are not sums
+ */
+struct Sum {
+  std::vector<std::pair<Expr, int64_t>> terms;
+  int64_t constant = 0;
+
+  void add(const Expr &term, int64_t coeff) {
+    for (auto &t : terms) {
+      if (equal(t.first, term)) {
+        t.second += coeff;
+        return;
       }
     }
-  } else if (op->op_type == BinaryOpType::Mod) {
-    if (a_as_int.defined() && b_as_int.defined()) {
-      return Expr(a_as_int->value() % b_as_int->value());
-    // } else if (a_as_float.defined() && b_as_float.defined()) {
-    //   return Expr((a_as_float->value()) % (b_as_float->value()));
-    } else if (a_as_int.defined()) {
-      if (a_as_int->value() == 0) {
-        return Utils::make_const(new_b->type(), 0);
-      }
-    } else if (b_as_int.defined()) {
-      if (b_as_int->value() == 1) {
-        return Utils::make_const(new_a->type(), 0);
-      } else if (b_as_int->value() == -1) {
-        return Utils::make_const(new_a->type(), 0);
-      }
-    } else if (a_as_float.defined()) {
-      if (std::abs(a_as_float->value()) < 1e-20) {
-        return Utils::make_const(new_b->type(), 0.0);
+    terms.push_back(std::make_pair(term, coeff));
+  }
+};
+
+
+bool is_sum(const Expr &expr) {
+  Ref<const Binary> as_binary = expr.as<Binary>();
+  return as_binary.defined()
+      && (as_binary->op_type == BinaryOpType::Add || as_binary->op_type == BinaryOpType::Sub);
+}
+
+
+void flatten(const Expr &expr, int64_t coeff, Sum &sum) {
+  int64_t v;
+  if (Utils::as_const_int(expr, v)) {
+    sum.constant += coeff * v;
+    return;
+  }
+  Ref<const Binary> as_binary = expr.as<Binary>();
+  if (as_binary.defined() && is_integer(expr.type())) {
+    if (as_binary->op_type == BinaryOpType::Add || as_binary->op_type == BinaryOpType::Sub) {
+      flatten(as_binary->a, coeff, sum);
+      flatten(as_binary->b, as_binary->op_type == BinaryOpType::Add ? coeff : -coeff, sum);
+      return;
+    }
+    // (x + y) * c stays a product: distributing it adds operations
+    if (as_binary->op_type == BinaryOpType::Mul && Utils::as_const_int(as_binary->b, v) && !is_sum(as_binary->a)) {
+      flatten(as_binary->a, coeff * v, sum);
+      return;
+    }
+  }
+  Ref<const Unary> as_unary = expr.as<Unary>();
+  if (as_unary.defined() && as_unary->op_type == UnaryOpType::Neg) {
+    flatten(as_unary->a, -coeff, sum);
+    return;
+  }
+  sum.add(expr, coeff);
+}
+
+
+Expr scaled(const Expr &term, int64_t coeff, Type type) {
+  return coeff == 1 ? term : Arith::mul(term, Utils::make_const(type, coeff));
+}
+
+
+/**
+ * positive terms in canonical order, then the negative ones subtracted,
+ * the constant last: 2 * x - y + 3
+ */
+Expr build_sum(Sum sum, Type type) {
+  std::stable_sort(sum.terms.begin(), sum.terms.end(),
+    [](const std::pair<Expr, int64_t> &a, const std::pair<Expr, int64_t> &b) {
+      return compare_exprs(a.first, b.first) < 0;
+    });
+  Expr ret;
+  for (auto &term : sum.terms) {
+    if (term.second > 0) {
+      Expr e = scaled(term.first, term.second, type);
+      ret = ret.defined() ? Arith::add(ret, e) : e;
+    }
+  }
+  for (auto &term : sum.terms) {
+    if (term.second < 0) {
+      Expr e = scaled(term.first, -term.second, type);
+      if (ret.defined()) {
+        ret = Arith::sub(ret, e);
+      } else if (sum.constant != 0) {
+        // c - x instead of -x + c
+        ret = Arith::sub(Utils::make_const(type, sum.constant), e);
+        sum.constant = 0;
+      } else {
+        ret = Arith::neg(e);
       }
-    } else if (b_as_float.defined()) {
-      if (std::abs(b_as_float->value() - 1) < 1e-20) {
-        return Utils::make_const(new_a->type(), 0.0);
-      } else if (std::abs(b_as_float->value() + 1) < 1e-20) {
-        return Utils::make_const(new_a->type(), 0.0);
+    }
+  }
+  if (!ret.defined()) {
+    return Utils::make_const(type, sum.constant);
+  }
+  return Arith::add(ret, Utils::make_const(type, sum.constant));
+}
+
+
+// ranges beyond this are not tracked, products of two bounds stay exact
+const int64_t bound_limit = (int64_t)1 << 30;
+
+bool bounds_of(const Expr &expr, int64_t &lo, int64_t &hi, int depth);
+
+
+bool sum_bounds(const Sum &sum, int64_t &lo, int64_t &hi, int depth) {
+  lo = hi = sum.constant;
+  for (auto &term : sum.terms) {
+    int64_t l, h;
+    if (term.second == 0) {
+      continue;
+    }
+    if (!bounds_of(term.first, l, h, depth + 1)) {
+      return false;
+    }
+    lo += term.second * (term.second > 0 ? l : h);
+    hi += term.second * (term.second > 0 ? h : l);
+  }
+  return true;
+}
+
+
+/**
+ * interval arithmetic, sums are flattened first so that common terms
+ * cancel, e.g. the begin of a Dom in begin + extent - 1
+ */
+bool bounds_of(const Expr &expr, int64_t &lo, int64_t &hi, int depth) {
+  // Dom ends nest as deep as the loops, the limit is a guard
+  if (depth > 64 || !expr.defined()) {
+    return false;
+  }
+  if (Utils::as_const_int(expr, lo)) {
+    hi = lo;
+    return true;
+  }
+  if (!is_integer(expr.type())) {
+    return false;
+  }
+  bool ret = false;
+  Ref<const Index> as_index = expr.as<Index>();
+  Ref<const Binary> as_binary = expr.as<Binary>();
+  Ref<const Select> as_select = expr.as<Select>();
+  if (as_index.defined()) {
+    Ref<const Dom> dom = as_index->dom.as<Dom>();
+    if (!dom.defined()) {
+      return false;
+    }
+    Sum last;
+    flatten(dom->begin, 1, last);
+    flatten(dom->extent, 1, last);
+    last.constant -= 1;
+    int64_t l, h;
+    // empty or placeholder domains have no range
+    ret = bounds_of(dom->begin, lo, h, depth + 1) && sum_bounds(last, l, hi, depth) && lo <= hi;
+  } else if (as_binary.defined() && (as_binary->op_type == BinaryOpType::Add
+             || as_binary->op_type == BinaryOpType::Sub || as_binary->op_type == BinaryOpType::Mul)) {
+    Sum sum;
+    flatten(expr, 1, sum);
+    if (sum.terms.size() != 1 || sum.terms[0].second != 1 || !equal(sum.terms[0].first, expr)) {
+      ret = sum_bounds(sum, lo, hi, depth);
+    } else if (as_binary->op_type == BinaryOpType::Mul) {
+      int64_t al, ah, bl, bh;
+      if (bounds_of(as_binary->a, al, ah, depth + 1) && bounds_of(as_binary->b, bl, bh, depth + 1)) {
+        int64_t corners[] = {al * bl, al * bh, ah * bl, ah * bh};
+        lo = *std::min_element(corners, corners + 4);
+        hi = *std::max_element(corners, corners + 4);
+        ret = true;
       }
     }
-  } else if (op->op_type == BinaryOpType::FloorDiv) {
-    if (a_as_int.defined() && b_as_int.defined()) {
-      return Expr(a_as_int->value() / b_as_int->value());
-    } else if (a_as_int.defined()) {
-      if (a_as_int->value() == 0) {
-        return Utils::make_const(new_b->type(), 0);
+  } else if (as_binary.defined()) {
+    int64_t c, al, ah;
+    if (!Utils::as_const_int(as_binary->b, c) || c <= 0 || !bounds_of(as_binary->a, al, ah, depth + 1)) {
+      return false;
+    }
+    ret = true;
+    switch (as_binary->op_type) {
+      case BinaryOpType::FloorDiv:
+        lo = floor_div(al, c);
+        hi = floor_div(ah, c);
+        break;
+      case BinaryOpType::Div:
+        // truncation is monotonic too
+        lo = al / c;
+        hi = ah / c;
+        break;
+      case BinaryOpType::FloorMod:
+        lo = floor_div(al, c) == floor_div(ah, c) ? al - floor_div(al, c) * c : 0;
+        hi = floor_div(al, c) == floor_div(ah, c) ? ah - floor_div(al, c) * c : c - 1;
+        break;
+      case BinaryOpType::Mod:
+        if (al / c == ah / c && (al >= 0 || ah <= 0)) {
+          lo = al - al / c * c;
+          hi = ah - al / c * c;
+        } else {
+          lo = al >= 0 ? 0 : -(c - 1);
+          hi = ah <= 0 ? 0 : c - 1;
+        }
+        break;
+      default:
+        ret = false;
+    }
+  } else if (as_select.defined()) {
+    int64_t tl, th, fl, fh;
+    if (bounds_of(as_select->true_value, tl, th, depth + 1)
+        && bounds_of(as_select->false_value, fl, fh, depth + 1)) {
+      lo = std::min(tl, fl);
+      hi = std::max(th, fh);
+      ret = true;
+    }
+  } else if (expr.as<Unary>() != nullptr && expr.as<Unary>()->op_type == UnaryOpType::Neg) {
+    int64_t l, h;
+    ret = bounds_of(expr.as<Unary>()->a, l, h, depth + 1);
+    lo = -h;
+    hi = -l;
+  }
+  return ret && lo >= -bound_limit && hi <= bound_limit;
+}
+
+
+/**
+ * range of a - b, common terms of the sides cancel
+ */
+bool difference_bounds(const Expr &a, const Expr &b, int64_t &lo, int64_t &hi) {
+  if (!is_integer(a.type()) || !is_integer(b.type())) {
+    return false;
+  }
+  Sum diff;
+  flatten(a, 1, diff);
+  flatten(b, -1, diff);
+  return sum_bounds(diff, lo, hi, 0);
+}
+
+
+class OpCounter : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+  int ops = 0;
+
+  // innermost_only: count inside the innermost loops only
+  explicit OpCounter(bool innermost_only) : counting_(!innermost_only) {}
+
+  void visit(Ref<const Unary> op) override {
+    ops += counting_;
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Binary> op) override {
+    ops += counting_;
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Compare> op) override {
+    ops += counting_;
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Select> op) override {
+    ops += counting_;
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Call> op) override {
+    ops += counting_;
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Index> op) override {}
+
+  void visit(Ref<const LoopNest> op) override {
+    bool innermost = !op->index_list.empty();
+    for (auto body : op->body_list) {
+      innermost = innermost && !has_loop(body);
+    }
+    bool old = counting_;
+    counting_ = counting_ || innermost;
+    for (auto body : op->body_list) {
+      body.visit_stmt(this);
+    }
+    counting_ = old;
+  }
+
+ private:
+  static bool has_loop(const Stmt &stmt) {
+    class LoopFinder : public IRVisitor {
+     public:
+      using IRVisitor::visit;
+      bool found = false;
+      void visit(Ref<const LoopNest> op) override {
+        found = found || !op->index_list.empty();
+        IRVisitor::visit(op);
       }
-    } else if (b_as_int.defined()) {
-      if (b_as_int->value() == 1) {
-        return new_a;
-      } else if (b_as_int->value() == -1) {
-        return Unary::make(new_a->type(), UnaryOpType::Neg, new_a);
+    } finder;
+    stmt.visit_stmt(&finder);
+    return finder.found;
+  }
+
+  bool counting_;
+};
+
+
+int count_nodes(const Expr &expr) {
+  OpCounter counter(false);
+  expr.visit_expr(&counter);
+  return counter.ops;
+}
+
+
+/**
+ * run simplifier until no rule applies, at most max_passes passes
+ */
+template <typename T>
+T fixpoint(Simplifier &simplifier, const T &node) {
+  T ret = node;
+  for (int pass = 0; pass < max_passes; ++pass) {
+    simplifier.reset();
+    ret = simplifier.mutate(ret);
+    if (!simplifier.changed()) {
+      break;
+    }
+  }
+  return ret;
+}
+
+}  // anonymous namespace
+
+
+bool Rule::apply(const Expr &expr, Expr &result) const {
+  Type type = expr.type();
+  if ((domain_ == Domain::Int && !is_integer(type)) || (domain_ == Domain::Float && !type.is_float())) {
+    return false;
+  }
+  Bindings bindings;
+  if (!match(lhs_, expr, bindings) || (cond_ && !cond_(bindings))) {
+    return false;
+  }
+  result = instantiate(rhs_, bindings, type);
+  return true;
+}
+
+
+Expr Rule::wildcard(const std::string &name) {
+  Type type = Type::int_scalar(32);
+  return Index::make(type, name, Dom::make(type, 0, 0), IndexType::Unknown);
+}
+
+
+Expr Simplifier::rewrite(const Expr &expr) {
+  Expr ret = expr;
+  // every rule shrinks the expression or orders it, the bound is a guard
+  for (int round = 0; round < 16; ++round) {
+    bool applied = false;
+    for (auto &rule : *rules_of(ret)) {
+      Expr result;
+      if (rule.apply(ret, result)) {
+        ret = result;
+        applied = changed_ = true;
+        break;
       }
     }
-  } else if (op->op_type == BinaryOpType::FloorMod) {
-    if (a_as_int.defined() && b_as_int.defined()) {
-      return Expr(a_as_int->value() % b_as_int->value());
-    } else if (a_as_int.defined()) {
-      if (a_as_int->value() == 0) {
-        return Utils::make_const(new_b->type(), 0);
+    if (!applied) {
+      break;
+    }
+  }
+  return ret;
+}
+
+
+Expr Simplifier::visit(Ref<const Unary> op) {
+  Expr a = mutate(op->a);
+  Expr ret = op->op_type == UnaryOpType::Neg ? Arith::neg(a) : make_not(a);
+  Ref<const Unary> as_unary = ret.as<Unary>();
+  if (!as_unary.defined() || as_unary->op_type != op->op_type || as_unary->a.get() != a.get()) {
+    // a constant, or a double negation
+    changed_ = true;
+    return ret;
+  }
+  ret = rewrite(Unary::make(op->type(), op->op_type, a));
+  if (ret->node_type() == IRNodeType::Unary && ret.as<Unary>()->op_type == UnaryOpType::Neg
+      && ret.type().is_int()) {
+    // -(x + 1) = -1 - x
+    Sum sum;
+    flatten(ret, 1, sum);
+    Expr canonical = build_sum(sum, ret.type());
+    if (count_nodes(canonical) < count_nodes(ret)) {
+      changed_ = true;
+      ret = canonical;
+    }
+  }
+  return ret;
+}
+
+
+Expr Simplifier::visit(Ref<const Binary> op) {
+  Expr a = mutate(op->a);
+  Expr b = mutate(op->b);
+  Expr ret;
+  if (fold_binary(op->op_type, op->type(), a, b, ret)) {
+    changed_ = true;
+    return ret;
+  }
+  if (is_commutative(op->op_type) && should_swap(a, b)) {
+    std::swap(a, b);
+    changed_ = true;
+  }
+  // identities of the Arith builders: x + 0, x * 1, (x + c0) + c1, ...
+  ret = make_binary(op->op_type, a, b);
+  Ref<const Binary> as_binary = ret.as<Binary>();
+  if (as_binary.defined() && as_binary->op_type == op->op_type
+      && as_binary->a.get() == a.get() && as_binary->b.get() == b.get()) {
+    // keep the original type, the builders take the type of a
+    ret = Binary::make(op->type(), op->op_type, a, b);
+  } else {
+    changed_ = true;
+  }
+  ret = rewrite(ret);
+
+  // integer sums: combine like terms
+  if (ret.type().is_int() && ret->node_type() == IRNodeType::Binary) {
+    BinaryOpType ret_op = ret.as<Binary>()->op_type;
+    if (ret_op == BinaryOpType::Add || ret_op == BinaryOpType::Sub || ret_op == BinaryOpType::Mul) {
+      Sum sum;
+      flatten(ret, 1, sum);
+      Expr canonical = build_sum(sum, ret.type());
+      if (count_nodes(canonical) <= count_nodes(ret) && !equal(canonical, ret)) {
+        changed_ = true;
+        ret = canonical;
       }
-    } else if (b_as_int.defined()) {
-      if (b_as_int->value() == 1) {
-        return Utils::make_const(new_a->type(), 0);
-      } else if (b_as_int->value() == -1) {
-        return Utils::make_const(new_a->type(), 0);
+    }
+  }
+  return ret;
+}
+
+
+Expr Simplifier::visit(Ref<const Compare> op) {
+  Expr a = mutate(op->a);
+  Expr b = mutate(op->b);
+  Expr ret = make_compare(op->op_type, a, b);
+  if (is_const(ret) || ret.as<UIntImm>() != nullptr) {
+    changed_ = true;
+    return ret;
+  }
+  // integers: a op b as (a - b) op 0, constants fold, common terms cancel
+  if (a.type().is_int() && b.type().is_int()) {
+    Sum diff;
+    flatten(a, 1, diff);
+    flatten(b, -1, diff);
+    Sum lhs, rhs;
+    for (auto &term : diff.terms) {
+      if (term.second > 0) {
+        lhs.add(term.first, term.second);
+      } else if (term.second < 0) {
+        rhs.add(term.first, -term.second);
       }
     }
+    if (lhs.terms.empty() && rhs.terms.empty()) {
+      changed_ = true;
+      return make_compare(op->op_type, Utils::make_const(a.type(), diff.constant), Utils::make_const(a.type(), 0));
+    }
+    // the constant goes to the side without terms, or to the right
+    if (rhs.terms.empty() || !lhs.terms.empty()) {
+      rhs.constant = -diff.constant;
+    } else {
+      lhs.constant = diff.constant;
+    }
+    Expr canonical = make_compare(op->op_type, build_sum(lhs, a.type()), build_sum(rhs, a.type()));
+    if (count_nodes(canonical) < count_nodes(ret)) {
+      changed_ = true;
+      ret = canonical;
+    }
   }
-  return Binary::make(op->type(), op->op_type, new_a, new_b);
+  return rewrite(ret);
+}
+
+
+Expr Simplifier::visit(Ref<const Select> op) {
+  Expr cond = mutate(op->cond);
+  bool value;
+  if (as_const_bool(cond, value)) {
+    changed_ = true;
+    return mutate(value ? op->true_value : op->false_value);
+  }
+  Expr true_value = mutate(op->true_value);
+  Expr false_value = mutate(op->false_value);
+  return rewrite(Select::make(op->type(), cond, true_value, false_value));
+}
+
+
+Stmt Simplifier::visit(Ref<const IfThenElse> op) {
+  Expr cond = mutate(op->cond);
+  bool value;
+  if (as_const_bool(cond, value)) {
+    changed_ = true;
+    if (value) {
+      return mutate(op->true_case);
+    }
+    return op->false_case.defined() ? mutate(op->false_case) : LoopNest::make({}, {});
+  }
+  Stmt true_case = mutate(op->true_case);
+  Stmt false_case;
+  if (op->false_case.defined()) {
+    false_case = mutate(op->false_case);
+  }
+  return IfThenElse::make(cond, true_case, false_case);
+}
+
+
+Expr BoundsSimplifier::visit(Ref<const Binary> op) {
+  Expr ret = Simplifier::visit(op);
+  Ref<const Binary> as_binary = ret.as<Binary>();
+  int64_t c, lo, hi;
+  if (!as_binary.defined() || !is_integer(ret.type()) || !Utils::as_const_int(as_binary->b, c) || c <= 0
+      || !bounds_of(as_binary->a, lo, hi, 0)) {
+    return ret;
+  }
+  // x within one period of c: the quotient is constant, the remainder x - k * c
+  bool floor = as_binary->op_type == BinaryOpType::FloorDiv || as_binary->op_type == BinaryOpType::FloorMod;
+  int64_t k = floor ? floor_div(lo, c) : lo / c;
+  if (k != (floor ? floor_div(hi, c) : hi / c) || (!floor && lo < 0 && hi > 0)) {
+    return ret;
+  }
+  switch (as_binary->op_type) {
+    case BinaryOpType::Div:
+    case BinaryOpType::FloorDiv:
+      changed_ = true;
+      return Utils::make_const(ret.type(), k);
+    case BinaryOpType::Mod:
+    case BinaryOpType::FloorMod:
+      changed_ = true;
+      return Arith::sub(as_binary->a, Utils::make_const(ret.type(), k * c));
+    default:
+      return ret;
+  }
+}
+
+
+Expr BoundsSimplifier::visit(Ref<const Compare> op) {
+  Expr ret = Simplifier::visit(op);
+  Ref<const Compare> as_compare = ret.as<Compare>();
+  int64_t lo, hi;
+  if (!as_compare.defined() || !difference_bounds(as_compare->a, as_compare->b, lo, hi)) {
+    return ret;
+  }
+  // -1: false, 1: true, 0: unknown
+  int value = 0;
+  switch (as_compare->op_type) {
+    case CompareOpType::LT:
+      value = hi < 0 ? 1 : (lo >= 0 ? -1 : 0);
+      break;
+    case CompareOpType::LE:
+      value = hi <= 0 ? 1 : (lo > 0 ? -1 : 0);
+      break;
+    case CompareOpType::GT:
+      value = lo > 0 ? 1 : (hi <= 0 ? -1 : 0);
+      break;
+    case CompareOpType::GE:
+      value = lo >= 0 ? 1 : (hi < 0 ? -1 : 0);
+      break;
+    case CompareOpType::EQ:
+      value = lo == 0 && hi == 0 ? 1 : (lo > 0 || hi < 0 ? -1 : 0);
+      break;
+    case CompareOpType::NE:
+      value = lo == 0 && hi == 0 ? -1 : (lo > 0 || hi < 0 ? 1 : 0);
+      break;
+  }
+  if (value == 0) {
+    return ret;
+  }
+  changed_ = true;
+  return Utils::make_const(Type::bool_scalar(), value > 0);
+}
+
+
+Expr BoundsSimplifier::visit(Ref<const Select> op) {
+  Expr ret = Simplifier::visit(op);
+  Ref<const Select> as_select = ret.as<Select>();
+  if (!as_select.defined()) {
+    return ret;
+  }
+  // min / max: select(a op b, a, b) or select(a op b, b, a)
+  Ref<const Compare> cond = as_select->cond.as<Compare>();
+  int64_t lo, hi;
+  if (!cond.defined() || cond->op_type == CompareOpType::EQ || cond->op_type == CompareOpType::NE
+      || !difference_bounds(cond->a, cond->b, lo, hi)) {
+    return ret;
+  }
+  bool same = equal(as_select->true_value, cond->a) && equal(as_select->false_value, cond->b);
+  bool swapped = equal(as_select->true_value, cond->b) && equal(as_select->false_value, cond->a);
+  if ((!same && !swapped) || (lo < 0 && hi > 0)) {
+    return ret;
+  }
+  // where a == b both branches agree, so a >= b everywhere acts as a > b
+  bool greater = lo >= 0;
+  bool holds = (cond->op_type == CompareOpType::GT || cond->op_type == CompareOpType::GE) == greater;
+  changed_ = true;
+  return holds ? as_select->true_value : as_select->false_value;
+}
+
+
+Expr simplify(const Expr &expr) {
+  Simplifier simplifier;
+  return fixpoint(simplifier, expr);
+}
+
+
+Stmt simplify(const Stmt &stmt) {
+  Simplifier simplifier;
+  return fixpoint(simplifier, stmt);
+}
+
+
+Group simplify(const Group &group) {
+  Simplifier simplifier;
+  return fixpoint(simplifier, group);
+}
+
+
+bool const_bounds(const Expr &expr, int64_t &lo, int64_t &hi) {
+  return bounds_of(expr, lo, hi, 0);
+}
+
+
+Expr simplify_bounds(const Expr &expr) {
+  BoundsSimplifier simplifier;
+  return fixpoint(simplifier, expr);
+}
+
+
+Stmt simplify_bounds(const Stmt &stmt) {
+  BoundsSimplifier simplifier;
+  return fixpoint(simplifier, stmt);
+}
+
+
+Group simplify_bounds(const Group &group) {
+  BoundsSimplifier simplifier;
+  return fixpoint(simplifier, group);
+}
+
+
+int count_ops(const Expr &expr) {
+  return count_nodes(expr);
 }
 
 
-Expr simplify_unit_element(const Expr &expr) {
-  SimplifyUnitElement sue;
-  return sue.mutate(expr);
+int inner_loop_ops(const Stmt &stmt) {
+  OpCounter counter(true);
+  stmt.visit_stmt(&counter);
+  return counter.ops;
 }
 
 
 }  // namespace Simplify
 
-}  // namespace Boost
\ No newline at end of file
+}  // namespace Boost
@@ -0,0 +1,200 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "debug.h"
+#include "utils.h"
+#include "arith.h"
+#include "simplify.h"
+#include "licm.h"
+#include "strength_reduce.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+bool is_integer(const Type &t) {
+  return t.is_int() || (t.is_uint() && t.bits > 1);
+}
+
+
+int log2_of(int64_t v) {
+  int ret = 0;
+  while (v > 1) {
+    v >>= 1;
+    ++ret;
+  }
+  return ret;
+}
+
+}  // anonymous namespace
+
+
+int StrengthReducer::level(const Expr &expr) const {
+  std::vector<Ref<const Index>> indices;
+  Utils::IndexCollector collector([](Ref<const Index>) { return true; });
+  collector.collect(expr, indices);
+  int ret = 0;
+  for (auto index : indices) {
+    auto it = std::find(loops_.begin(), loops_.end(), index->name);
+    // indices of no enclosing loop go last
+    int k = it == loops_.end() ? (int)loops_.size() + 1 : (int)(it - loops_.begin()) + 1;
+    ret = std::max(ret, k);
+  }
+  return ret;
+}
+
+
+Expr StrengthReducer::linearize(Ref<const Var> op, const std::vector<Expr> &args) const {
+  uint64_t size = 1;
+  for (auto s : op->shape) {
+    size *= s;
+  }
+  Type type = args.back().type();
+  if (size > (uint64_t)INT32_MAX || !is_integer(type)) {
+    return Var::make(op->type(), op->name, args, op->shape);
+  }
+
+  struct Term {
+    int level;
+    Expr expr;
+    int64_t coeff;
+  };
+  std::vector<Term> terms;
+  Arith::LinearForm affine;
+  std::unordered_map<std::string, Expr> symbols;
+  int64_t stride = 1;
+  for (int k = (int)args.size() - 1; k >= 0; --k) {
+    Arith::LinearForm form;
+    if (Arith::LinearForm::from_expr(args[k], form, &symbols)) {
+      affine += form * stride;
+    } else {
+      terms.push_back(Term{level(args[k]), args[k], stride});
+    }
+    stride *= (int64_t)op->shape[k];
+  }
+  for (auto &term : affine.terms()) {
+    Expr index = symbols.at(term.first);
+    terms.push_back(Term{level(index), index, term.second});
+  }
+  std::stable_sort(terms.begin(), terms.end(), [](const Term &a, const Term &b) {
+    return a.level < b.level;
+  });
+
+  // (constant + outer terms) + inner terms, left to right
+  Expr offset;
+  if (affine.constant() != 0) {
+    offset = Utils::make_const(type, affine.constant());
+  }
+  for (auto &term : terms) {
+    int64_t coeff = term.coeff < 0 ? -term.coeff : term.coeff;
+    Expr value = term.expr;
+    if (coeff != 1) {
+      value = Binary::make(type, BinaryOpType::Mul, value, Utils::make_const(type, coeff));
+    }
+    if (!offset.defined()) {
+      offset = term.coeff < 0 ? Unary::make(type, UnaryOpType::Neg, value) : value;
+    } else {
+      offset = Binary::make(type, term.coeff < 0 ? BinaryOpType::Sub : BinaryOpType::Add, offset, value);
+    }
+  }
+  if (!offset.defined()) {
+    offset = Utils::make_const(type, 0);
+  }
+  return Var::make(op->type(), op->name, {offset}, op->shape);
+}
+
+
+Expr StrengthReducer::visit(Ref<const Binary> op) {
+  Expr a = mutate(op->a);
+  Expr b = mutate(op->b);
+  int64_t c = 0;
+  if (is_integer(op->type()) && Utils::as_const_int(b, c) && c > 1 && (c & (c - 1)) == 0) {
+    bool floor = op->op_type == BinaryOpType::FloorDiv || op->op_type == BinaryOpType::FloorMod;
+    bool trunc = op->op_type == BinaryOpType::Div || op->op_type == BinaryOpType::Mod;
+    int64_t lo = 0, hi = 0;
+    if (trunc) {
+      trunc = Simplify::const_bounds(op->a, lo, hi) && lo >= 0;
+    }
+    if (floor || trunc) {
+      if (op->op_type == BinaryOpType::FloorDiv || op->op_type == BinaryOpType::Div) {
+        return Call::make(op->type(), {a, Utils::make_const(op->type(), log2_of(c))},
+          "shift_right", CallType::Pure);
+      }
+      return Call::make(op->type(), {a, Utils::make_const(op->type(), c - 1)},
+        "bitwise_and", CallType::Pure);
+    }
+  }
+  return Binary::make(op->type(), op->op_type, a, b);
+}
+
+
+Expr StrengthReducer::visit(Ref<const Var> op) {
+  std::vector<Expr> args;
+  for (auto arg : op->args) {
+    args.push_back(mutate(arg));
+  }
+  if (args.size() > 1 && args.size() == op->shape.size()) {
+    return linearize(op, args);
+  }
+  return Var::make(op->type(), op->name, args, op->shape);
+}
+
+
+Stmt StrengthReducer::visit(Ref<const LoopNest> op) {
+  for (auto index : op->index_list) {
+    Ref<const Index> as_index = index.as<Index>();
+    CHECK(as_index.defined(), "Expect Index");
+    loops_.push_back(as_index->name);
+  }
+  Stmt ret = IRMutator::visit(op);
+  loops_.resize(loops_.size() - op->index_list.size());
+  return ret;
+}
+
+
+Stmt strength_reduce(const Stmt &stmt) {
+  StrengthReducer reducer;
+  return loop_invariant_code_motion(reducer.mutate(stmt));
+}
+
+
+Group strength_reduce(const Group &group) {
+  StrengthReducer reducer;
+  return loop_invariant_code_motion(reducer.mutate(group));
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
@@ -196,58 +196,39 @@ namespace Boost
       auto ic = IndexConstraint();
       for (auto it = op->args.begin(); it != op->args.end(); ++it)
       {
-        auto arg_visitor = ArgVisitor(op->shape[arg_pos]);
-        it->visit_expr(&arg_visitor);
-        ic = ic.merge(arg_visitor.retrieve());
+        ic = ic.merge(arg_constraint(*it, op->shape[arg_pos]));
         ++arg_pos;
       }
       type_stack.push(TSType(base_type, ic, is_tensor));
     }
 
-    /* ArgVisitor */
-    void ArgVisitor::visit(Ref<const Index> op)
+    IndexConstraint arg_constraint(const Expr &arg, int shape)
     {
-      index_weight[op->name] = 1;
-    }
-
-    void ArgVisitor::visit(Ref<const Unary> op)
-    {
-      // only support things like -i, not something like -(i+j)
-      (op->a).visit_expr(this);
-      auto i_ptr = dynamic_cast<const Index*>(op->a.get());
-      if (!i_ptr) {
-        LOG(ERROR) << "unsupport index forms";
-      }
-      index_weight[i_ptr->name] = -index_weight[i_ptr->name];
-      shape -= 2;
-    }
-
-    void ArgVisitor::visit(Ref<const Binary> op)
-    {
-      (op->a).visit_expr(this);
-      (op->b).visit_expr(this);
-
-      if (op->op_type == BinaryOpType::Add)
+      Arith::LinearForm form;
+      if (!Arith::LinearForm::from_expr(arg, form))
       {
-        shape += 1;
+        throw TypecheckException("Index operations unsupported yet.");
       }
-      else if (op->op_type == BinaryOpType::Sub)
+      if (form.is_constant())
       {
-        // TODO
+        // constant accesses do not constrain any index
+        return IndexConstraint();
       }
-      else if (op->op_type == BinaryOpType::Mul)
-      {
-        // TODO
-      }
-      else if (op->op_type == BinaryOpType::FloorDiv)
-      {
-        // TODO
-      }
-      else
+
+      auto names = std::vector<std::string>();
+      auto mat = Eigen::MatrixXd(1, form.terms().size());
+      auto shapes = Eigen::VectorXd(1);
+
+      int i = 0;
+      double bound = (double)shape - 1 - (double)form.constant();
+      for (auto it = form.terms().begin(); it != form.terms().end(); ++it)
       {
-        LOG(ERROR) << int(op->op_type) << "Index operations unsupported yet.";
+        names.push_back(it->first);
+        mat(0, i++) = (double)it->second;
+        bound += (double)it->second;
       }
-      return;
+      shapes(0) = bound;
+      return IndexConstraint(names, mat, shapes);
     }
 
   } // namespace Typechecker
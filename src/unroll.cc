@@ -0,0 +1,284 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <vector>
+
+#include "debug.h"
+#include "utils.h"
+#include "arith.h"
+#include "simplify.h"
+#include "parallel.h"
+#include "unroll.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+uint64_t count_nodes(const std::vector<Stmt> &stmts) {
+  uint64_t ret = 0;
+  for (auto &stmt : stmts) {
+    ret += Utils::count_nodes(stmt);
+  }
+  return ret;
+}
+
+
+class LoopFinder : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const LoopNest> op) override {
+    found = found || !op->index_list.empty();
+    IRVisitor::visit(op);
+  }
+
+  bool found = false;
+};
+
+
+bool has_loops(const std::vector<Stmt> &stmts) {
+  LoopFinder finder;
+  for (auto &stmt : stmts) {
+    stmt.visit_stmt(&finder);
+  }
+  return finder.found;
+}
+
+
+/**
+ * names declared by statements: let bindings and locals
+ */
+class Declarations : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const LetStmt> op) override {
+    names.push_back(op->var.as<Var>()->name);
+    IRVisitor::visit(op);
+  }
+
+  void visit(Ref<const Move> op) override {
+    Ref<const Var> dst = op->dst.as<Var>();
+    if (dst.defined() && dst->args.empty() && op->move_type == MoveType::MemToLocal) {
+      names.push_back(dst->name);
+    }
+    IRVisitor::visit(op);
+  }
+
+  std::vector<std::string> names;
+};
+
+
+/**
+ * a copy of statements for one value of an index, with the declared
+ * names suffixed so copies can share a scope
+ */
+class Copier : public IRMutator {
+ public:
+  using IRMutator::mutate;
+  using IRMutator::visit;
+
+  Copier(const std::string &name, const Expr &value, const std::vector<std::string> &declared,
+         const std::string &suffix) : name_(name), value_(value), declared_(declared), suffix_(suffix) {}
+
+  Expr visit(Ref<const Index> op) override {
+    if (op->name == name_) {
+      return value_;
+    }
+    return IRMutator::visit(op);
+  }
+
+  Expr visit(Ref<const Var> op) override {
+    if (op->args.empty() && std::find(declared_.begin(), declared_.end(), op->name) != declared_.end()) {
+      return Var::make(op->type(), op->name + suffix_, {}, op->shape);
+    }
+    return IRMutator::visit(op);
+  }
+
+ private:
+  std::string name_;
+  Expr value_;
+  const std::vector<std::string> &declared_;
+  std::string suffix_;
+};
+
+
+std::vector<Stmt> copy_body(const std::string &name, const std::vector<Expr> &values,
+                            const std::vector<Stmt> &body) {
+  Declarations declarations;
+  for (auto &stmt : body) {
+    stmt.visit_stmt(&declarations);
+  }
+  std::vector<Stmt> ret;
+  for (size_t u = 0; u < values.size(); ++u) {
+    Copier copier(name, values[u], declarations.names, "_" + std::to_string(u));
+    for (auto &stmt : body) {
+      ret.push_back(Simplify::simplify(copier.mutate(stmt)));
+    }
+  }
+  return ret;
+}
+
+}  // anonymous namespace
+
+
+Stmt Unroller::visit(Ref<const LoopNest> op) {
+  if (op->index_list.empty()) {
+    return IRMutator::visit(op);
+  }
+  std::vector<Stmt> stmts;
+  for (auto &body : op->body_list) {
+    stmts.push_back(mutate(body));
+  }
+  // the loops left between the unrolled ones, innermost last
+  std::vector<Expr> kept;
+  for (int k = (int)op->index_list.size() - 1; k >= 0; --k) {
+    Ref<const Index> index = op->index_list[k].as<Index>();
+    CHECK(index.defined(), "Expect Index");
+    bool marked = index->index_type == IndexType::Unrolled;
+    bool small = index->index_type == IndexType::Spatial || index->index_type == IndexType::Reduce;
+    int64_t begin, extent;
+    if (!Utils::constant_dom(index, begin, extent) || (!marked && !(small && extent <= options_.max_extent))) {
+      if (marked) {
+        LOG(WARNING) << "Loop of " << index->name << " stays rolled: Dom not constant";
+      }
+      kept.insert(kept.begin(), op->index_list[k]);
+      continue;
+    }
+    std::vector<Stmt> body = stmts;
+    if (!kept.empty()) {
+      body = {LoopNest::make(kept, stmts)};
+    }
+    if (!marked && has_loops(body)) {
+      // copies of whole loops only grow the code
+      kept.insert(kept.begin(), op->index_list[k]);
+      continue;
+    }
+    uint64_t nodes = count_nodes(body) * (uint64_t)extent;
+    if (nodes > options_.max_nodes) {
+      if (marked) {
+        LOG(WARNING) << "Loop of " << index->name << " stays rolled: " << nodes
+                     << " nodes over the budget of " << options_.max_nodes;
+      }
+      kept.insert(kept.begin(), op->index_list[k]);
+      continue;
+    }
+    std::vector<Expr> values;
+    for (int64_t u = 0; u < extent; ++u) {
+      values.push_back(Utils::make_const(index->type(), begin + u));
+    }
+    stmts = copy_body(index->name, values, body);
+    kept.clear();
+  }
+  return LoopNest::make(kept, stmts);
+}
+
+
+Stmt UnrollAndJam::visit(Ref<const LoopNest> op) {
+  if (op->index_list.empty() || options_.jam < 2) {
+    return IRMutator::visit(op);
+  }
+  // the perfectly nested loops down to their body
+  std::vector<Expr> indices = op->index_list;
+  std::vector<Stmt> body = op->body_list;
+  while (body.size() == 1) {
+    Ref<const LoopNest> inner = body[0].as<LoopNest>();
+    if (!inner.defined() || inner->index_list.empty()) {
+      break;
+    }
+    indices.insert(indices.end(), inner->index_list.begin(), inner->index_list.end());
+    body = inner->body_list;
+  }
+  size_t k = indices.size();
+  while (k > 0 && indices[k - 1].as<Index>()->index_type == IndexType::Reduce) {
+    --k;
+  }
+  if (k == 0 || k == indices.size()) {
+    return IRMutator::visit(op);
+  }
+  Ref<const Index> outer = indices[k - 1].as<Index>();
+  int64_t begin, extent;
+  if (outer->index_type != IndexType::Spatial || !Utils::constant_dom(outer, begin, extent)) {
+    return IRMutator::visit(op);
+  }
+  int64_t factor = std::min<int64_t>(options_.jam, extent);
+  std::vector<Expr> reduce(indices.begin() + k, indices.end());
+  for (auto &index : reduce) {
+    if (Utils::depends_on(index.as<Index>()->dom, outer->name)) {
+      return IRMutator::visit(op);
+    }
+  }
+  Stmt inner = LoopNest::make(reduce, body);
+  std::string why;
+  if (factor < 2 || count_nodes(body) * (uint64_t)factor > options_.max_nodes
+      || !parallel_legal(indices[k - 1], {inner}, why)) {
+    return IRMutator::visit(op);
+  }
+
+  Type type = outer->type();
+  int64_t n = extent / factor;
+  Expr jammed = Index::make(type, outer->name + "_outer",
+    Dom::make(type, Utils::make_const(type, 0), Utils::make_const(type, n)), IndexType::Spatial);
+  std::vector<Expr> values;
+  for (int64_t u = 0; u < factor; ++u) {
+    values.push_back(Arith::add(Arith::mul(jammed, Utils::make_const(type, factor)),
+                                Utils::make_const(type, begin + u)));
+  }
+  Stmt result = LoopNest::make({jammed}, {LoopNest::make(reduce, copy_body(outer->name, values, body))});
+  if (extent % factor != 0) {
+    Expr rest = Index::make(type, outer->name, Dom::make(type, Utils::make_const(type, begin + n * factor),
+      Utils::make_const(type, extent - n * factor)), IndexType::Spatial);
+    result = LoopNest::make({}, {result, LoopNest::make({rest}, {inner})});
+  }
+  if (k == 1) {
+    return result;
+  }
+  return LoopNest::make(std::vector<Expr>(indices.begin(), indices.begin() + k - 1), {result});
+}
+
+
+Stmt unroll(const Stmt &stmt, const UnrollOptions &options) {
+  Unroller unroller(options);
+  UnrollAndJam jam(options);
+  return jam.mutate(unroller.mutate(stmt));
+}
+
+
+Group unroll(const Group &group, const UnrollOptions &options) {
+  Unroller unroller(options);
+  UnrollAndJam jam(options);
+  return jam.mutate(unroller.mutate(group));
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
@@ -36,6 +36,48 @@ using namespace Internal;
 
 namespace Utils {
 
+namespace {
+
+/**
+ * IR nodes of a tree, shared subtrees counted once per use
+ */
+class NodeCounter : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+  uint64_t nodes = 0;
+
+#define COUNT_NODE(T)                          \
+  void visit(Ref<const T> op) override {       \
+    ++nodes;                                   \
+    IRVisitor::visit(op);                      \
+  }
+
+  COUNT_NODE(IntImm)
+  COUNT_NODE(UIntImm)
+  COUNT_NODE(FloatImm)
+  COUNT_NODE(StringImm)
+  COUNT_NODE(Unary)
+  COUNT_NODE(Binary)
+  COUNT_NODE(Select)
+  COUNT_NODE(Compare)
+  COUNT_NODE(Call)
+  COUNT_NODE(Var)
+  COUNT_NODE(Cast)
+  COUNT_NODE(Ramp)
+  COUNT_NODE(Index)
+  COUNT_NODE(Dom)
+  COUNT_NODE(Let)
+  COUNT_NODE(LoopNest)
+  COUNT_NODE(IfThenElse)
+  COUNT_NODE(Move)
+  COUNT_NODE(LetStmt)
+  COUNT_NODE(Kernel)
+
+#undef COUNT_NODE
+};
+
+}  // anonymous namespace
+
 
 std::string NameGenerator::unique_name(const std::string &name_hint) {
   std::ostringstream oss;
@@ -73,6 +115,76 @@ Expr substitute_index_by_name(const Expr &expr,
     return suber.substitute(expr);
 }
 
+
+bool as_const_int(const Expr &expr, int64_t &value) {
+  if (!expr.defined() || expr.type().code == TypeCode::Bool
+      || (expr.type().code == TypeCode::UInt && expr.type().bits == 1)) {
+    return false;
+  }
+  Ref<const IntImm> as_int = expr.as<IntImm>();
+  if (as_int.defined()) {
+    value = as_int->value();
+    return true;
+  }
+  Ref<const UIntImm> as_uint = expr.as<UIntImm>();
+  if (as_uint.defined() && as_uint->value() <= (uint64_t)INT64_MAX) {
+    value = (int64_t)as_uint->value();
+    return true;
+  }
+  return false;
+}
+
+
+bool constant_dom(const Expr &index, int64_t &begin, int64_t &extent) {
+  Ref<const Index> as_index = index.as<Index>();
+  CHECK(as_index.defined(), "Expect Index");
+  Ref<const Dom> dom = as_index->dom.as<Dom>();
+  return dom.defined() && as_const_int(dom->begin, begin) && as_const_int(dom->extent, extent);
+}
+
+
+bool depends_on(const Expr &expr, const std::string &name) {
+  std::vector<Ref<const Index>> used;
+  IndexCollector collector([&](Ref<const Index> index) { return index->name == name; });
+  collector.collect(expr, used);
+  return !used.empty();
+}
+
+
+bool same_element(Ref<const Var> a, Ref<const Var> b) {
+  if (a->args.size() != b->args.size()) {
+    return false;
+  }
+  ExprEqual equal;
+  for (size_t k = 0; k < a->args.size(); ++k) {
+    if (!equal(a->args[k], b->args[k])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+uint64_t count_nodes(const Expr &expr) {
+  NodeCounter counter;
+  expr.visit_expr(&counter);
+  return counter.nodes;
+}
+
+
+uint64_t count_nodes(const Stmt &stmt) {
+  NodeCounter counter;
+  stmt.visit_stmt(&counter);
+  return counter.nodes;
+}
+
+
+uint64_t count_nodes(const Group &group) {
+  NodeCounter counter;
+  group.visit_group(&counter);
+  return counter.nodes;
+}
+
 }  // namespace Utils
 
 }  // namespace Boost
\ No newline at end of file
@@ -0,0 +1,407 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2020 Size Zheng
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+#include <vector>
+
+#include "debug.h"
+#include "utils.h"
+#include "arith.h"
+#include "vectorize.h"
+
+
+namespace Boost {
+
+using namespace Internal;
+
+
+namespace Pass {
+
+namespace {
+
+/**
+ * expr = stride * index + (terms invariant in index), false if not
+ * - unlike LinearForm, the invariant terms may be anything, e.g. the
+ *   offsets bound by LICM
+ */
+bool stride_of(const Expr &expr, const std::string &name, int64_t &stride) {
+  if (!Utils::depends_on(expr, name)) {
+    stride = 0;
+    return true;
+  }
+  if (expr.as<Index>() != nullptr) {
+    stride = 1;
+    return true;
+  }
+  Ref<const Unary> as_unary = expr.as<Unary>();
+  if (as_unary.defined() && as_unary->op_type == UnaryOpType::Neg) {
+    bool ret = stride_of(as_unary->a, name, stride);
+    stride = -stride;
+    return ret;
+  }
+  Ref<const Binary> as_binary = expr.as<Binary>();
+  if (!as_binary.defined()) {
+    return false;
+  }
+  int64_t a, b, c;
+  switch (as_binary->op_type) {
+    case BinaryOpType::Add:
+    case BinaryOpType::Sub:
+      if (!stride_of(as_binary->a, name, a) || !stride_of(as_binary->b, name, b)) {
+        return false;
+      }
+      stride = as_binary->op_type == BinaryOpType::Add ? a + b : a - b;
+      return true;
+    case BinaryOpType::Mul:
+      if (Utils::as_const_int(as_binary->b, c) && stride_of(as_binary->a, name, a)) {
+        stride = a * c;
+        return true;
+      }
+      if (Utils::as_const_int(as_binary->a, c) && stride_of(as_binary->b, name, b)) {
+        stride = b * c;
+        return true;
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+
+/**
+ * array elements written and read
+ */
+class Accesses : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const Move> op) override {
+    Ref<const Var> dst = op->dst.as<Var>();
+    if (dst.defined()) {
+      writes.push_back(dst);
+      for (auto &arg : dst->args) {
+        arg.visit_expr(this);
+      }
+    }
+    op->src.visit_expr(this);
+  }
+
+  void visit(Ref<const Var> op) override {
+    if (!op->args.empty()) {
+      loads.push_back(op);
+    }
+    IRVisitor::visit(op);
+  }
+
+  std::vector<Ref<const Var>> writes;
+  std::vector<Ref<const Var>> loads;
+};
+
+
+class HasLoop : public IRVisitor {
+ public:
+  using IRVisitor::visit;
+
+  void visit(Ref<const LoopNest> op) override {
+    found = true;
+  }
+
+  bool found = false;
+};
+
+
+/**
+ * the values of the iterations base, ..., base + lanes - 1 of the loop
+ * of an index
+ */
+class Widener {
+ public:
+  Widener(const std::string &name, const Expr &base, int lanes) : name_(name), base_(base), lanes_(lanes) {}
+
+  // a vector, or expr itself if invariant; undefined if not vectorizable
+  Expr widen(const Expr &expr);
+
+  Stmt widen(const Stmt &stmt, bool only);
+
+  Expr broadcast(const Expr &expr) const {
+    if (expr.type().lanes() == lanes_) {
+      return expr;
+    }
+    return Ramp::make(expr.type().with_lanes(lanes_), expr, 0, lanes_);
+  }
+
+  std::string why;
+
+ private:
+  Expr fail(const std::string &reason) {
+    why = reason;
+    return Expr();
+  }
+
+  Expr ramp(const Expr &expr) const {
+    std::unordered_map<std::shared_ptr<const Index>, Expr> vmap;
+    vmap[Index::make(expr.type(), name_, Expr(), IndexType::Unknown).as<Index>()] = base_;
+    return Ramp::make(expr.type().with_lanes(lanes_), Utils::substitute_index_by_name(expr, vmap), 1, lanes_);
+  }
+
+  std::string name_;
+  Expr base_;
+  int lanes_;
+};
+
+
+Expr Widener::widen(const Expr &expr) {
+  if (!Utils::depends_on(expr, name_)) {
+    return expr;
+  }
+  Type type = expr.type().with_lanes(lanes_);
+  switch (expr.node_type()) {
+    case IRNodeType::Index:
+      return ramp(expr);
+    case IRNodeType::Var: {
+      Ref<const Var> var = expr.as<Var>();
+      std::vector<Expr> args = var->args;
+      for (size_t k = 0; k + 1 < args.size(); ++k) {
+        if (Utils::depends_on(args[k], name_)) {
+          return fail("gather from " + var->name);
+        }
+      }
+      int64_t stride;
+      if (!stride_of(args.back(), name_, stride) || stride != 1) {
+        return fail("access of " + var->name + " not of stride 1");
+      }
+      args.back() = ramp(args.back());
+      return Var::make(type, var->name, args, var->shape);
+    }
+    case IRNodeType::Unary: {
+      Ref<const Unary> op = expr.as<Unary>();
+      Expr a = widen(op->a);
+      return a.defined() ? Unary::make(type, op->op_type, a) : a;
+    }
+    case IRNodeType::Binary: {
+      Ref<const Binary> op = expr.as<Binary>();
+      Expr a = widen(op->a);
+      Expr b = widen(op->b);
+      if (!a.defined() || !b.defined()) {
+        return Expr();
+      }
+      return Binary::make(type, op->op_type, broadcast(a), broadcast(b));
+    }
+    case IRNodeType::Compare: {
+      Ref<const Compare> op = expr.as<Compare>();
+      Expr a = widen(op->a);
+      Expr b = widen(op->b);
+      if (!a.defined() || !b.defined()) {
+        return Expr();
+      }
+      return Compare::make(type, op->op_type, broadcast(a), broadcast(b));
+    }
+    case IRNodeType::Select: {
+      Ref<const Select> op = expr.as<Select>();
+      Expr cond = widen(op->cond);
+      Expr t = widen(op->true_value);
+      Expr f = widen(op->false_value);
+      if (!cond.defined() || !t.defined() || !f.defined()) {
+        return Expr();
+      }
+      return Select::make(type, broadcast(cond), broadcast(t), broadcast(f));
+    }
+    case IRNodeType::Cast: {
+      Ref<const Cast> op = expr.as<Cast>();
+      Expr val = widen(op->val);
+      return val.defined() ? Cast::make(type, op->new_type.with_lanes(lanes_), val) : val;
+    }
+    default:
+      return fail("call or Let depending on " + name_);
+  }
+}
+
+
+Stmt Widener::widen(const Stmt &stmt, bool only) {
+  Ref<const LetStmt> let = stmt.as<LetStmt>();
+  if (let.defined()) {
+    if (Utils::depends_on(let->value, name_)) {
+      why = "binding depending on " + name_;
+      return Stmt();
+    }
+    Stmt body = widen(let->body, only);
+    return body.defined() ? LetStmt::make(let->var, let->value, body) : body;
+  }
+  Ref<const Move> move = stmt.as<Move>();
+  if (!move.defined()) {
+    why = "guard or statement other than Move";
+    return Stmt();
+  }
+  if (Utils::depends_on(move->dst, name_)) {
+    Expr dst = widen(move->dst);
+    Expr src = widen(move->src);
+    if (!dst.defined() || !src.defined()) {
+      return Stmt();
+    }
+    return Move::make(dst, broadcast(src), move->move_type);
+  }
+
+  // reduction to an element invariant in the index
+  Ref<const Binary> add = move->src.as<Binary>();
+  Utils::ExprEqual equal;
+  if (!only || !add.defined() || add->op_type != BinaryOpType::Add
+      || (!equal(add->a, move->dst) && !equal(add->b, move->dst))) {
+    why = "write of an element invariant in " + name_ + " other than a sum";
+    return Stmt();
+  }
+  Expr term = equal(add->a, move->dst) ? add->b : add->a;
+  Ref<const Var> dst = move->dst.as<Var>();
+  Accesses accesses;
+  term.visit_expr(&accesses);
+  for (auto &load : accesses.loads) {
+    if (load->name == dst->name) {
+      why = "sum reading its own result";
+      return Stmt();
+    }
+  }
+  Expr vec = widen(term);
+  if (!vec.defined()) {
+    return Stmt();
+  }
+  if (vec.type().lanes() != lanes_) {
+    why = "sum of a term invariant in " + name_;
+    return Stmt();
+  }
+  Expr sum = Call::make(move->dst.type(), {vec}, "vector_reduce_add", CallType::Pure);
+  return Move::make(move->dst, Binary::make(add->type(), BinaryOpType::Add, move->dst, sum), move->move_type);
+}
+
+}  // anonymous namespace
+
+
+bool Vectorizer::vectorize_loop(const Expr &index, const std::vector<Stmt> &body, Stmt &result, std::string &why) {
+  Ref<const Index> as_index = index.as<Index>();
+  Ref<const Dom> dom = as_index->dom.as<Dom>();
+  CHECK(dom.defined(), "Expect Dom");
+  const std::string &name = as_index->name;
+  int64_t extent = 0;
+  bool const_extent = Utils::as_const_int(dom->extent, extent);
+  if (const_extent && extent < lanes_) {
+    why = "fewer than " + std::to_string(lanes_) + " iterations";
+    return false;
+  }
+
+  // vector iterations access each array at one element
+  Accesses accesses;
+  for (auto &stmt : body) {
+    stmt.visit_stmt(&accesses);
+  }
+  for (auto &dst : accesses.writes) {
+    if (dst->args.empty()) {
+      why = "scalar " + dst->name + " written";
+      return false;
+    }
+    for (auto &other : accesses.writes) {
+      if (other->name == dst->name && !Utils::same_element(dst, other)) {
+        why = dst->name + " written at different elements";
+        return false;
+      }
+    }
+    for (auto &load : accesses.loads) {
+      if (load->name == dst->name && !Utils::same_element(dst, load)) {
+        why = dst->name + " read at elements other than written";
+        return false;
+      }
+    }
+  }
+
+  Type type = index.type();
+  Expr lanes = Utils::make_const(type, lanes_);
+  IndexType index_type = as_index->index_type == IndexType::Vectorized ? IndexType::Spatial : as_index->index_type;
+  Expr vectors = Arith::div(dom->extent, lanes);
+  Expr vec_index = Index::make(type, name + "_vec", Dom::make(type, Utils::make_const(type, 0), vectors), index_type);
+  Widener widener(name, Arith::add(Arith::mul(vec_index, lanes), dom->begin), lanes_);
+  std::vector<Stmt> vec_body;
+  for (auto &stmt : body) {
+    Stmt vec = widener.widen(stmt, body.size() == 1);
+    if (!vec.defined()) {
+      why = widener.why;
+      return false;
+    }
+    vec_body.push_back(vec);
+  }
+  result = LoopNest::make({vec_index}, vec_body);
+  if (const_extent && extent % lanes_ == 0) {
+    return true;
+  }
+  // the scalar rest
+  Expr done = Arith::mul(vectors, lanes);
+  Expr tail = Index::make(type, name, Dom::make(type, Arith::add(dom->begin, done), Arith::sub(dom->extent, done)),
+    index_type);
+  result = LoopNest::make({}, {result, LoopNest::make({tail}, body)});
+  return true;
+}
+
+
+Stmt Vectorizer::visit(Ref<const LoopNest> op) {
+  HasLoop has_loop;
+  for (auto &stmt : op->body_list) {
+    stmt.visit_stmt(&has_loop);
+  }
+  if (op->index_list.empty() || has_loop.found) {
+    return IRMutator::visit(op);
+  }
+  Expr index = op->index_list.back();
+  Ref<const Index> as_index = index.as<Index>();
+  CHECK(as_index.defined(), "Expect Index");
+  bool marked = as_index->index_type == IndexType::Vectorized;
+  bool candidate = automatic_ && (as_index->index_type == IndexType::Spatial
+                                  || as_index->index_type == IndexType::Reduce);
+  if (!marked && !candidate) {
+    return op;
+  }
+  Stmt result;
+  std::string why;
+  if (!vectorize_loop(index, op->body_list, result, why)) {
+    if (marked) {
+      LOG(WARNING) << "Loop of " << as_index->name << " stays scalar: " << why;
+    }
+    return op;
+  }
+  if (op->index_list.size() == 1) {
+    return result;
+  }
+  return LoopNest::make(std::vector<Expr>(op->index_list.begin(), op->index_list.end() - 1), {result});
+}
+
+
+Stmt vectorize(const Stmt &stmt, int lanes, bool automatic) {
+  Vectorizer vectorizer(lanes, automatic);
+  return vectorizer.mutate(stmt);
+}
+
+
+Group vectorize(const Group &group, int lanes, bool automatic) {
+  Vectorizer vectorizer(lanes, automatic);
+  return vectorizer.mutate(group);
+}
+
+}  // namespace Pass
+
+}  // namespace Boost
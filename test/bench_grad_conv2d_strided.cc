@@ -0,0 +1,159 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "autodiff.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+
+
+/**
+ * backward of conv2d (to the input) with stride and dilation:
+ * O[n, k, p, q] += I[n, c, p * stride + r * dilation, q * stride + s * dilation] * W[k, c, r, s]
+ * compare the guarded gradient kernel against the strided one
+ */
+int bench_case(int stride, int dilation) {
+    const int N = 4;
+    const int C = 16;
+    const int K = 16;
+    const int P = 14;
+    const int Q = 14;
+    const int R = 3;
+    const int S = 3;
+    const uint64_t H = (P - 1) * stride + (R - 1) * dilation + 1;
+    const uint64_t W = (Q - 1) * stride + (S - 1) * dilation + 1;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr n = Index::make(index_type, "n", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Spatial);
+    Expr p = Index::make(index_type, "p", Dom::make(index_type, 0, P), IndexType::Spatial);
+    Expr q = Index::make(index_type, "q", Dom::make(index_type, 0, Q), IndexType::Spatial);
+    Expr c = Index::make(index_type, "c", Dom::make(index_type, 0, C), IndexType::Reduce);
+    Expr r = Index::make(index_type, "r", Dom::make(index_type, 0, R), IndexType::Reduce);
+    Expr s = Index::make(index_type, "s", Dom::make(index_type, 0, S), IndexType::Reduce);
+
+    Expr h_arg = Binary::make(index_type, BinaryOpType::Add,
+        Binary::make(index_type, BinaryOpType::Mul, p, stride),
+        Binary::make(index_type, BinaryOpType::Mul, r, dilation));
+    Expr w_arg = Binary::make(index_type, BinaryOpType::Add,
+        Binary::make(index_type, BinaryOpType::Mul, q, stride),
+        Binary::make(index_type, BinaryOpType::Mul, s, dilation));
+    Expr expr_I = Var::make(data_type, "I", {n, c, h_arg, w_arg}, {N, C, H, W});
+    Expr expr_W = Var::make(data_type, "W", {k, c, r, s}, {K, C, R, S});
+    Expr expr_dO = Var::make(data_type, "dO", {n, k, p, q}, {N, K, P, Q});
+    Expr src = Binary::make(data_type, BinaryOpType::Mul, expr_I, expr_W);
+
+    std::ostringstream oss;
+    oss << Bench::driver_prelude();
+    Boost::codegen::CodeGen_C gen;
+    Expr dst;
+    for (bool strided : {false, true}) {
+        Stmt stmt = Boost::Autodiff::grad_loop_nest(
+            src, {n, k, p, q, c, r, s}, {0, 1, 2, 3}, expr_I.as<Var>(), expr_dO.as<Var>(), strided);
+        Ref<const LoopNest> init = stmt.as<LoopNest>()->body_list[0].as<LoopNest>();
+        dst = init->body_list[0].as<Move>()->dst;
+        Group kernel = Kernel::make(strided ? "strided" : "guarded",
+            {expr_dO, expr_W}, {dst}, {stmt}, KernelType::CPU);
+        oss << gen.print(kernel) << "\n";
+    }
+
+    oss << Bench::declare(expr_dO) << Bench::declare(expr_W)
+        << Bench::declare(dst, "guarded_out") << Bench::declare(dst, "strided_out")
+        << Bench::declare(dst, "ref_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)dO, sizeof(dO) / sizeof(float), 1);\n"
+        << "    fill((float*)W, sizeof(W) / sizeof(float), 2);\n"
+        << "    for (int n = 0; n < " << N << "; ++n)\n"
+        << "    for (int k = 0; k < " << K << "; ++k)\n"
+        << "    for (int p = 0; p < " << P << "; ++p)\n"
+        << "    for (int q = 0; q < " << Q << "; ++q)\n"
+        << "    for (int c = 0; c < " << C << "; ++c)\n"
+        << "    for (int r = 0; r < " << R << "; ++r)\n"
+        << "    for (int s = 0; s < " << S << "; ++s)\n"
+        << "        ref_out[n][c][p * " << stride << " + r * " << dilation << "][q * "
+        << stride << " + s * " << dilation << "] += dO[n][k][p][q] * W[k][c][r][s];\n"
+        << "    double t0 = timeit([]() { guarded(dO, W, guarded_out); }, 10);\n"
+        << "    double t1 = timeit([]() { strided(dO, W, strided_out); }, 10);\n"
+        << "    size_t size = sizeof(ref_out) / sizeof(float);\n"
+        << "    float e0 = max_diff((float*)guarded_out, (float*)ref_out, size);\n"
+        << "    float e1 = max_diff((float*)strided_out, (float*)ref_out, size);\n"
+        << "    printf(\"stride=" << stride << " dilation=" << dilation
+        << ": guarded %.3f ms (err %g), strided %.3f ms (err %g), speedup %.2fx\\n\",\n"
+        << "           t0, e0, t1, e1, t0 / t1);\n"
+        << "    return (e0 < 1e-3 && e1 < 1e-3) ? 0 : 1;\n"
+        << "}\n";
+
+    std::ostringstream name;
+    name << "bench_grad_conv2d_s" << stride << "_d" << dilation;
+    return Bench::compile_and_run(name.str(), oss.str());
+}
+
+
+/**
+ * O<N>[i] = A<2N, 2N>[2 * i, 2 * i] * B<N>[i], both args of A strided by
+ * the same index
+ */
+int diagonal_case() {
+    const int N = 16;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr two_i = Binary::make(index_type, BinaryOpType::Mul, i, 2);
+    Expr expr_A = Var::make(data_type, "A", {two_i, two_i}, {2 * N, 2 * N});
+    Expr expr_B = Var::make(data_type, "B", {i}, {N});
+    Expr expr_dO = Var::make(data_type, "dO", {i}, {N});
+    Expr src = Binary::make(data_type, BinaryOpType::Mul, expr_A, expr_B);
+
+    std::ostringstream oss;
+    oss << Bench::driver_prelude();
+    Boost::codegen::CodeGen_C gen;
+    Expr dst;
+    for (bool strided : {false, true}) {
+        Stmt stmt = Boost::Autodiff::grad_loop_nest(src, {i}, {0}, expr_A.as<Var>(), expr_dO.as<Var>(), strided);
+        Ref<const LoopNest> init = stmt.as<LoopNest>()->body_list[0].as<LoopNest>();
+        dst = init->body_list[0].as<Move>()->dst;
+        std::string code = gen.print(Kernel::make(strided ? "strided" : "guarded",
+            {expr_dO, expr_B}, {dst}, {stmt}, KernelType::CPU));
+        std::cout << code;
+        oss << code << "\n";
+    }
+
+    oss << Bench::declare(expr_dO) << Bench::declare(expr_B)
+        << Bench::declare(dst, "guarded_out") << Bench::declare(dst, "strided_out")
+        << Bench::declare(dst, "ref_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)dO, sizeof(dO) / sizeof(float), 1);\n"
+        << "    fill((float*)B, sizeof(B) / sizeof(float), 2);\n"
+        << "    for (int i = 0; i < " << N << "; ++i)\n"
+        << "        ref_out[2 * i][2 * i] += dO[i] * B[i];\n"
+        << "    guarded(dO, B, guarded_out);\n"
+        << "    strided(dO, B, strided_out);\n"
+        << "    size_t size = sizeof(ref_out) / sizeof(float);\n"
+        << "    float e0 = max_diff((float*)guarded_out, (float*)ref_out, size);\n"
+        << "    float e1 = max_diff((float*)strided_out, (float*)ref_out, size);\n"
+        << "    printf(\"A[2i, 2i]: guarded err %g, strided err %g\\n\", e0, e1);\n"
+        << "    return (e0 < 1e-3 && e1 < 1e-3) ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("bench_grad_diagonal", oss.str());
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= bench_case(2, 1);
+    ret |= bench_case(1, 2);
+    ret |= bench_case(2, 2);
+    ret |= diagonal_case();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "arith.h"
+#include "autodiff.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+
+
+Expr get_dst(const Stmt &stmt) {
+    Ref<const LoopNest> nest = stmt.as<LoopNest>()->body_list[0].as<LoopNest>();
+    return nest->body_list[0].as<Move>()->dst;
+}
+
+
+/**
+ * relu: Y[i, j] = select(X[i, j] > 0, X[i, j], 0)
+ * the backward either compares X again or reads a saved bitmask
+ */
+int bench_relu() {
+    const int M = 2048;
+    const int N = 2048;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr expr_X = Var::make(data_type, "X", {i, j}, {M, N});
+    Expr expr_dY = Var::make(data_type, "dY", {i, j}, {M, N});
+    Expr cond = Boost::Arith::gt(expr_X, Expr(0.0f));
+    Expr src = Select::make(data_type, cond, expr_X, Expr(0.0f));
+
+    Expr mask;
+    std::pair<Expr, Expr> saved;
+    Stmt forward = Boost::Autodiff::save_bitmask(cond, {i, j}, "mask", mask, saved);
+    Stmt compare = Boost::Autodiff::grad_loop_nest(src, {i, j}, {0, 1}, expr_X.as<Var>(), expr_dY.as<Var>());
+    Stmt masked = Boost::Autodiff::grad_loop_nest(
+        src, {i, j}, {0, 1}, expr_X.as<Var>(), expr_dY.as<Var>(), true, {saved});
+
+    IRPrinter printer;
+    std::cout << printer.print(forward) << "\n" << printer.print(masked) << "\n";
+
+    Expr dst = get_dst(compare);
+    Ref<const Var> mask_var = mask.as<Var>();
+    Expr mask_arg = Var::make(mask.type(), "mask", {}, mask_var->shape);
+    Boost::codegen::CodeGen_C gen;
+    std::ostringstream oss;
+    oss << Bench::driver_prelude();
+    oss << gen.print(Kernel::make("save_mask", {expr_X}, {mask_arg}, {forward}, KernelType::CPU)) << "\n";
+    oss << gen.print(Kernel::make("compare", {expr_dY, expr_X}, {dst}, {compare}, KernelType::CPU)) << "\n";
+    oss << gen.print(Kernel::make("masked", {expr_dY, mask_arg}, {dst}, {masked}, KernelType::CPU)) << "\n";
+    oss << Bench::declare(expr_X) << Bench::declare(expr_dY)
+        << "static uint32_t mask[" << M << "][" << (N + 31) / 32 << "];\n"
+        << Bench::declare(dst, "compare_out") << Bench::declare(dst, "masked_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)X, sizeof(X) / sizeof(float), 1);\n"
+        << "    fill((float*)dY, sizeof(dY) / sizeof(float), 2);\n"
+        << "    save_mask(X, mask);\n"
+        << "    double t0 = timeit([]() { compare(dY, X, compare_out); }, 10);\n"
+        << "    double t1 = timeit([]() { masked(dY, mask, masked_out); }, 10);\n"
+        << "    float err = 0;\n"
+        << "    for (int i = 0; i < " << M << "; ++i)\n"
+        << "    for (int j = 0; j < " << N << "; ++j) {\n"
+        << "        float ref = X[i][j] > 0 ? dY[i][j] : 0;\n"
+        << "        err = fmaxf(err, fabsf(ref - compare_out[i][j]));\n"
+        << "        err = fmaxf(err, fabsf(ref - masked_out[i][j]));\n"
+        << "    }\n"
+        << "    printf(\"relu: compare %.3f ms, bitmask %.3f ms (err %g), speedup %.2fx\\n\",\n"
+        << "           t0, t1, err, t0 / t1);\n"
+        << "    return err == 0 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("bench_grad_relu", oss.str());
+}
+
+
+/**
+ * 2x2 max-pooling with stride 2:
+ * Y[n, c, p, q] = max(X[n, c, p * 2 + r, q * 2 + s])
+ * the backward either compares X against Y or reads the saved argmax
+ */
+int bench_maxpool() {
+    const int N = 8;
+    const int C = 64;
+    const int P = 56;
+    const int Q = 56;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr n = Index::make(index_type, "n", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr c = Index::make(index_type, "c", Dom::make(index_type, 0, C), IndexType::Spatial);
+    Expr p = Index::make(index_type, "p", Dom::make(index_type, 0, P), IndexType::Spatial);
+    Expr q = Index::make(index_type, "q", Dom::make(index_type, 0, Q), IndexType::Spatial);
+    Expr r = Index::make(index_type, "r", Dom::make(index_type, 0, 2), IndexType::Reduce);
+    Expr s = Index::make(index_type, "s", Dom::make(index_type, 0, 2), IndexType::Reduce);
+    Expr expr_X = Var::make(data_type, "X",
+        {n, c, Boost::Arith::add(Boost::Arith::mul(p, 2), r), Boost::Arith::add(Boost::Arith::mul(q, 2), s)},
+        {N, C, 2 * P, 2 * Q});
+    Expr expr_Y = Var::make(data_type, "Y", {n, c, p, q}, {N, C, P, Q});
+    Expr expr_dY = Var::make(data_type, "dY", {n, c, p, q}, {N, C, P, Q});
+
+    Expr arg;
+    Expr routed;
+    Stmt forward = Boost::Autodiff::save_argmax(expr_X, expr_Y, {r, s}, "arg", arg, routed);
+    Expr src = Select::make(data_type, Boost::Arith::eq(expr_X, expr_Y), expr_X, Expr(0.0f));
+    Stmt compare = Boost::Autodiff::grad_loop_nest(
+        src, {n, c, p, q, r, s}, {0, 1, 2, 3}, expr_X.as<Var>(), expr_dY.as<Var>());
+    Stmt argmax = Boost::Autodiff::grad_loop_nest(
+        routed, {n, c, p, q, r, s}, {0, 1, 2, 3}, expr_X.as<Var>(), expr_dY.as<Var>());
+
+    IRPrinter printer;
+    std::cout << printer.print(forward) << "\n" << printer.print(argmax) << "\n";
+
+    Expr dst = get_dst(compare);
+    Boost::codegen::CodeGen_C gen;
+    std::ostringstream oss;
+    oss << Bench::driver_prelude();
+    oss << gen.print(Kernel::make("forward", {expr_X}, {expr_Y, arg}, {forward}, KernelType::CPU)) << "\n";
+    oss << gen.print(Kernel::make("compare", {expr_dY, expr_X, expr_Y}, {dst}, {compare}, KernelType::CPU)) << "\n";
+    oss << gen.print(Kernel::make("argmax", {expr_dY, arg}, {dst}, {argmax}, KernelType::CPU)) << "\n";
+    oss << Bench::declare(dst, "X") << Bench::declare(expr_Y) << Bench::declare(expr_dY)
+        << "static int32_t arg[" << N << "][" << C << "][" << P << "][" << Q << "];\n"
+        << Bench::declare(dst, "compare_out") << Bench::declare(dst, "argmax_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)X, sizeof(X) / sizeof(float), 1);\n"
+        << "    fill((float*)dY, sizeof(dY) / sizeof(float), 2);\n"
+        << "    forward(X, Y, arg);\n"
+        << "    double t0 = timeit([]() { compare(dY, X, Y, compare_out); }, 10);\n"
+        << "    double t1 = timeit([]() { argmax(dY, arg, argmax_out); }, 10);\n"
+        << "    float err = 0;\n"
+        << "    for (int n = 0; n < " << N << "; ++n)\n"
+        << "    for (int c = 0; c < " << C << "; ++c)\n"
+        << "    for (int h = 0; h < " << 2 * P << "; ++h)\n"
+        << "    for (int w = 0; w < " << 2 * Q << "; ++w) {\n"
+        << "        float ref = X[n][c][h][w] == Y[n][c][h / 2][w / 2] ? dY[n][c][h / 2][w / 2] : 0;\n"
+        << "        err = fmaxf(err, fabsf(ref - compare_out[n][c][h][w]));\n"
+        << "        err = fmaxf(err, fabsf(ref - argmax_out[n][c][h][w]));\n"
+        << "    }\n"
+        << "    printf(\"max-pool: compare %.3f ms, argmax %.3f ms (err %g), speedup %.2fx\\n\",\n"
+        << "           t0, t1, err, t0 / t1);\n"
+        << "    return err == 0 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("bench_grad_maxpool", oss.str());
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= bench_relu();
+    ret |= bench_maxpool();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
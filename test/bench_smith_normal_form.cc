@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "arith.h"
+
+using namespace Boost::Arith;
+
+
+/**
+ * the previous implementation, kept as the baseline:
+ * heap matrices, std::function helpers and temporary vectors per transform
+ */
+namespace Legacy {
+
+class Matrix {
+ public:
+    Matrix(int height, int width) : width_(width), height_(height) {
+        ptr = new int[width * height];
+    }
+    ~Matrix() {
+        delete []ptr;
+    }
+
+    int *operator[](int id) {
+        return ptr + id * width_;
+    }
+
+    void swap_row(int i, int j) {
+        for (int l = 0; l < width_; ++l) {
+            std::swap(ptr[i * width_ + l], ptr[j * width_ + l]);
+        }
+    }
+
+    void swap_col(int i, int j) {
+        for (int l = 0; l < height_; ++l) {
+            std::swap(ptr[l * width_ + i], ptr[l * width_ + j]);
+        }
+    }
+
+    void scale_col(int j, int factor) {
+        for (int l = 0; l < height_; ++l) {
+            ptr[l * width_ + j] *= factor;
+        }
+    }
+
+    void add_row(int i, int j, int factor) {
+        for (int l = 0; l < width_; ++l) {
+            ptr[j * width_ + l] += ptr[i * width_ + l] * factor;
+        }
+    }
+
+    void add_col(int i, int j, int factor) {
+        for (int l = 0; l < height_; ++l) {
+            ptr[l * width_ + j] += ptr[l * width_ + i] * factor;
+        }
+    }
+
+    void row_transform(int i, int j, int s, int t, int g, int h) {
+        std::vector<int> row_i(width_), row_j(width_);
+        for (int l = 0; l < width_; ++l) {
+            row_i[l] = ptr[i * width_ + l] * s + ptr[j * width_ + l] * t;
+            row_j[l] = ptr[i * width_ + l] * g + ptr[j * width_ + l] * h;
+        }
+        for (int l = 0; l < width_; ++l) {
+            ptr[i * width_ + l] = row_i[l];
+            ptr[j * width_ + l] = row_j[l];
+        }
+    }
+
+    void col_transform(int i, int j, int s, int t, int g, int h) {
+        std::vector<int> col_i(height_), col_j(height_);
+        for (int l = 0; l < height_; ++l) {
+            col_i[l] = ptr[l * width_ + i] * s + ptr[l * width_ + j] * t;
+            col_j[l] = ptr[l * width_ + i] * g + ptr[l * width_ + j] * h;
+        }
+        for (int l = 0; l < height_; ++l) {
+            ptr[l * width_ + i] = col_i[l];
+            ptr[l * width_ + j] = col_j[l];
+        }
+    }
+
+ private:
+    int *ptr;
+    int width_, height_;
+};
+
+
+int smith_normalize(Matrix &trans, Matrix &U, Matrix &V, int height, int width) {
+    for (int i = 0; i < height; ++i) {
+        for (int j = 0; j < height; ++j) {
+            U[i][j] = i == j ? 1 : 0;
+        }
+    }
+    for (int i = 0; i < width; ++i) {
+        for (int j = 0; j < width; ++j) {
+            V[i][j] = i == j ? 1 : 0;
+        }
+    }
+    int a = 0;
+    int dim = 0;
+    std::function<bool(int &, int &)> has_next = [&](int &i, int &j) {
+        for (i = a; i < height; ++i) {
+            for (j = a; j < width; ++j) {
+                if (trans[i][j] != 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    std::function<bool(int &)> col_non_div = [&](int &i) {
+        for (i = a + 1; i < height; ++i) {
+            if (!divisible(trans[a][a], trans[i][a])) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::function<bool(int &)> col_non_zero = [&](int &i) {
+        for (i = a + 1; i < height; ++i) {
+            if (trans[i][a] != 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::function<bool(int &)> row_non_div = [&](int &j) {
+        for (j = a + 1; j < width; ++j) {
+            if (!divisible(trans[a][a], trans[a][j])) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::function<bool(int &)> row_non_zero = [&](int &j) {
+        for (j = a + 1; j < width; ++j) {
+            if (trans[a][j] != 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    bool stop = false;
+    while (!stop) {
+        stop = true;
+        int pi, pj;
+        while (has_next(pi, pj)) {
+            trans.swap_row(a, pi);
+            U.swap_row(a, pi);
+            trans.swap_col(a, pj);
+            V.swap_col(a, pj);
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                int ppi, ppj;
+                while (col_non_div(ppi)) {
+                    changed = true;
+                    int s, t;
+                    int z = ext_euclidean(trans[a][a], trans[ppi][a], s, t);
+                    int g = -trans[ppi][a] / z;
+                    int h = trans[a][a] / z;
+                    trans.row_transform(a, ppi, s, t, g, h);
+                    U.row_transform(a, ppi, s, t, g, h);
+                }
+                while (col_non_zero(ppi)) {
+                    changed = true;
+                    int f = trans[ppi][a] / trans[a][a];
+                    trans.add_row(a, ppi, -f);
+                    U.add_row(a, ppi, -f);
+                }
+                while (row_non_div(ppj)) {
+                    changed = true;
+                    int s, t;
+                    int z = ext_euclidean(trans[a][a], trans[a][ppj], s, t);
+                    int g = -trans[a][ppj] / z;
+                    int h = trans[a][a] / z;
+                    trans.col_transform(a, ppj, s, t, g, h);
+                    V.col_transform(a, ppj, s, t, g, h);
+                }
+                while (row_non_zero(ppj)) {
+                    changed = true;
+                    int f = trans[a][ppj] / trans[a][a];
+                    trans.add_col(a, ppj, -f);
+                    V.add_col(a, ppj, -f);
+                }
+            }
+            a = a + 1;
+        }
+        dim = a;
+        for (a = 0; a < dim; ++a) {
+            if (trans[a][a] < 0) {
+                trans.scale_col(a, -1);
+                V.scale_col(a, -1);
+            }
+            if (a < dim - 1 && !divisible(trans[a][a], trans[a + 1][a + 1])) {
+                trans.add_col(a + 1, a, 1);
+                V.add_col(a + 1, a, 1);
+                stop = false;
+                break;
+            }
+        }
+    }
+    return dim;
+}
+
+}  // namespace Legacy
+
+
+/**
+ * access matrices as the autodiff builds them, rows are array dimensions
+ * and columns are loop indices
+ */
+std::vector<SmallMatrix> make_cases(std::mt19937 &rng, int kind, int count) {
+    std::vector<SmallMatrix> cases;
+    for (int iter = 0; iter < count; ++iter) {
+        if (kind == 0) {
+            // transposed / permuted access, A[j, i, k]
+            int n = 2 + rng() % 5;
+            std::vector<int> perm(n);
+            for (int j = 0; j < n; ++j) {
+                perm[j] = j;
+            }
+            std::shuffle(perm.begin(), perm.end(), rng);
+            SmallMatrix m(n, n);
+            for (int i = 0; i < n; ++i) {
+                m[i][perm[i]] = 1;
+            }
+            cases.push_back(m);
+        } else if (kind == 1) {
+            // strided conv2d input, I[n, c, p * s + r * d, q * s + t * d]
+            // over loops (n, k, p, q, c, r, t)
+            int stride = 1 + rng() % 3;
+            int dilation = 1 + rng() % 3;
+            SmallMatrix m(4, 7);
+            m[0][0] = 1;
+            m[1][4] = 1;
+            m[2][2] = stride;
+            m[2][5] = dilation;
+            m[3][3] = stride;
+            m[3][6] = dilation;
+            cases.push_back(m);
+        } else {
+            // dense with small coefficients
+            int rows = 2 + rng() % 5;
+            int cols = 2 + rng() % 5;
+            SmallMatrix m(rows, cols);
+            for (int i = 0; i < rows; ++i) {
+                for (int j = 0; j < cols; ++j) {
+                    m[i][j] = (int)(rng() % 5) - 2;
+                }
+            }
+            cases.push_back(m);
+        }
+    }
+    return cases;
+}
+
+
+template <typename F>
+double time_ns(F f, int repeat, int count) {
+    f();
+    auto beg = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) {
+        f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - beg).count() / repeat / count;
+}
+
+
+int main() {
+    std::mt19937 rng(2020);
+    const char *names[] = {"permutation", "strided conv2d", "dense"};
+    const int count = 1000;
+    const int repeat = 20;
+    int failed = 0;
+    for (int kind = 0; kind < 3; ++kind) {
+        std::vector<SmallMatrix> cases = make_cases(rng, kind, count);
+        // both give a smith normal form, compare the diagonals
+        for (const SmallMatrix &m : cases) {
+            int rows = m.height();
+            int cols = m.width();
+            SmallMatrix D = m;
+            SmallMatrix U, V;
+            int dim = smith_normalize(D, U, V);
+            Legacy::Matrix trans(rows, cols), old_U(rows, rows), old_V(cols, cols);
+            for (int i = 0; i < rows; ++i) {
+                for (int j = 0; j < cols; ++j) {
+                    trans[i][j] = (int)m[i][j];
+                }
+            }
+            int old_dim = Legacy::smith_normalize(trans, old_U, old_V, rows, cols);
+            bool same = dim == old_dim;
+            for (int i = 0; i < dim && same; ++i) {
+                same = D[i][i] == trans[i][i];
+            }
+            if (!same) {
+                failed += 1;
+            }
+        }
+
+        int64_t sink = 0;
+        double t0 = time_ns([&]() {
+            for (const SmallMatrix &m : cases) {
+                int rows = m.height();
+                int cols = m.width();
+                Legacy::Matrix trans(rows, cols), U(rows, rows), V(cols, cols);
+                for (int i = 0; i < rows; ++i) {
+                    for (int j = 0; j < cols; ++j) {
+                        trans[i][j] = (int)m[i][j];
+                    }
+                }
+                sink += Legacy::smith_normalize(trans, U, V, rows, cols);
+            }
+        }, repeat, count);
+        double t1 = time_ns([&]() {
+            for (const SmallMatrix &m : cases) {
+                SmallMatrix D = m;
+                SmallMatrix U, V;
+                sink += smith_normalize(D, U, V);
+            }
+        }, repeat, count);
+        std::cout << names[kind] << ": legacy " << t0 << " ns, new " << t1
+                  << " ns, speedup " << t0 / t1 << "x (" << sink % 2 << ")\n";
+    }
+    if (failed != 0) {
+        std::cout << "Fail! " << failed << " different diagonals.\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,259 @@
+#ifndef BOOST_TEST_BENCH_UTILS_H
+#define BOOST_TEST_BENCH_UTILS_H
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "IR.h"
+#include "autodiff.h"
+#include "codegen_C.h"
+
+// the compiler used to build generated kernels, set by test/CMakeLists.txt
+#ifndef BOOST_BENCH_CXX
+#define BOOST_BENCH_CXX "c++"
+#endif
+
+// the include directory of the repository, set by test/CMakeLists.txt
+#ifndef BOOST_BENCH_INCLUDE
+#define BOOST_BENCH_INCLUDE "include"
+#endif
+
+using namespace Boost::Internal;
+
+namespace Bench {
+
+/**
+ * common helpers of the generated benchmark driver
+ */
+inline std::string driver_prelude() {
+    return
+"#include <cstdint>\n\
+#include <cstdio>\n\
+#include <cstdlib>\n\
+#include <cmath>\n\
+#include <chrono>\n\
+\n\
+static void fill(float *p, size_t n, unsigned seed) {\n\
+    srand(seed);\n\
+    for (size_t i = 0; i < n; ++i) p[i] = (float)rand() / RAND_MAX - 0.5f;\n\
+}\n\
+\n\
+static float max_diff(const float *a, const float *b, size_t n) {\n\
+    float ret = 0;\n\
+    for (size_t i = 0; i < n; ++i) ret = fmaxf(ret, fabsf(a[i] - b[i]));\n\
+    return ret;\n\
+}\n\
+\n\
+template <typename F>\n\
+static double timeit(F f, int repeat) {\n\
+    f();\n\
+    auto beg = std::chrono::steady_clock::now();\n\
+    for (int i = 0; i < repeat; ++i) f();\n\
+    auto end = std::chrono::steady_clock::now();\n\
+    return std::chrono::duration<double, std::milli>(end - beg).count() / repeat;\n\
+}\n\
+\n";
+}
+
+
+/**
+ * print what failed, return 1 on failure and 0 otherwise
+ */
+inline int check(bool cond, const std::string &what) {
+    if (!cond) {
+        std::cout << "Fail! " << what << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * occurrences of pattern in str, overlapping ones included
+ */
+inline int count(const std::string &str, const std::string &pattern) {
+    int ret = 0;
+    for (size_t pos = str.find(pattern); pos != std::string::npos; pos = str.find(pattern, pos + 1)) {
+        ret += 1;
+    }
+    return ret;
+}
+
+
+/**
+ * global array declaration for a tensor, e.g. static float A[4][8];
+ */
+inline std::string declare(const Expr &expr, const std::string &name = "") {
+    Ref<const Var> var = expr.as<Var>();
+    std::ostringstream oss;
+    oss << "static float " << (name == "" ? var->name : name);
+    for (auto s : var->shape) {
+        oss << "[" << s << "]";
+    }
+    oss << ";\n";
+    return oss.str();
+}
+
+
+/**
+ * write the generated source, compile it with the host compiler and run it
+ */
+inline int compile_and_run(const std::string &name, const std::string &source,
+    const std::string &flags = "-O2") {
+    std::string src_file = name + ".cc";
+    std::ofstream ofile(src_file, std::ios::out);
+    ofile << source;
+    ofile.close();
+    std::string cmd = std::string(BOOST_BENCH_CXX) + " -std=c++11 " + flags
+                    + " -I" + BOOST_BENCH_INCLUDE + " " + src_file + " -o " + name;
+    std::cout << std::flush;
+    if (std::system(cmd.c_str()) != 0) {
+        std::cerr << "Fail to compile generated source " << src_file << "\n";
+        return -1;
+    }
+    return std::system(("./" + name).c_str());
+}
+
+
+/**
+ * O<N, K, P, Q>[n, k, p, q] += I<N, C, H, W>[n, c, p * stride + r, q * stride + s] * W<K, C, R, S>[k, c, r, s]
+ * the conv2d of the pass tests, with I, W and O named by the test
+ */
+struct Conv2d {
+    Expr n, k, p, q, c, r, s;
+    Expr input, weight, output;
+
+    Conv2d(const std::string &input_name, const std::string &weight_name, const std::string &output_name,
+           int N, int C, int K, int P, int Q, int R, int S, int stride = 1) {
+        Type index_type = Type::int_scalar(32);
+        Type data_type = Type::float_scalar(32);
+        auto index = [&](const std::string &name, int extent, IndexType t) {
+            return Index::make(index_type, name, Dom::make(index_type, 0, extent), t);
+        };
+        auto at = [&](Expr a, Expr b) {
+            if (stride != 1) {
+                a = Binary::make(index_type, BinaryOpType::Mul, a, stride);
+            }
+            return Binary::make(index_type, BinaryOpType::Add, a, b);
+        };
+        n = index("n", N, IndexType::Spatial);
+        k = index("k", K, IndexType::Spatial);
+        p = index("p", P, IndexType::Spatial);
+        q = index("q", Q, IndexType::Spatial);
+        c = index("c", C, IndexType::Reduce);
+        r = index("r", R, IndexType::Reduce);
+        s = index("s", S, IndexType::Reduce);
+        uint64_t H = (P - 1) * stride + R, W = (Q - 1) * stride + S;
+        input = Var::make(data_type, input_name, {n, c, at(p, r), at(q, s)}, {(uint64_t)N, (uint64_t)C, H, W});
+        weight = Var::make(data_type, weight_name, {k, c, r, s}, {(uint64_t)K, (uint64_t)C, (uint64_t)R, (uint64_t)S});
+        output = Var::make(data_type, output_name, {n, k, p, q}, {(uint64_t)N, (uint64_t)K, (uint64_t)P, (uint64_t)Q});
+    }
+
+    std::vector<Expr> loops() const {
+        return {n, k, p, q, c, r, s};
+    }
+
+    // output = output + input * weight
+    Stmt update() const {
+        return Move::make(output, Binary::make(output.type(), BinaryOpType::Add, output,
+            Binary::make(output.type(), BinaryOpType::Mul, input, weight)), MoveType::MemToMem);
+    }
+
+    // backward to the input, output holds the gradient of the output
+    Stmt grad() const {
+        Expr src = Binary::make(output.type(), BinaryOpType::Mul, input, weight);
+        return Boost::Autodiff::grad_loop_nest(src, loops(), {0, 1, 2, 3}, input.as<Var>(), output.as<Var>());
+    }
+
+    // the gradient of the input written by grad
+    static Expr grad_dst(const Stmt &grad) {
+        return grad.as<LoopNest>()->body_list[0].as<LoopNest>()->body_list[0].as<Move>()->dst;
+    }
+};
+
+
+/**
+ * kernels of the same inputs and output, timed by a generated driver
+ * that compares the output of each one to the one of the first
+ */
+class Benchmark {
+ public:
+    Benchmark(const std::string &title, const std::vector<Expr> &inputs, const Expr &output)
+        : title_(title), inputs_(inputs), output_(output) {}
+
+    void add(const std::string &label, const Stmt &stmt) {
+        labels_.push_back(label);
+        stmts_.push_back(stmt);
+    }
+
+    // the driver fills the inputs with seeds 1, 2, ... and fails if an output differs by tolerance or more;
+    // a repeat of 0 runs each kernel once and prints the error only
+    int run(const std::string &name, int repeat, float tolerance, const std::string &flags = "-O2") const {
+        Boost::codegen::CodeGen_C gen;
+        std::ostringstream oss;
+        oss << driver_prelude();
+        for (size_t k = 0; k < stmts_.size(); ++k) {
+            oss << gen.print(Kernel::make("kernel" + std::to_string(k), inputs_, {output_}, {stmts_[k]},
+                                          KernelType::CPU)) << "\n";
+        }
+        std::string args;
+        for (auto &input : inputs_) {
+            oss << declare(input);
+            args += input.as<Var>()->name + ", ";
+        }
+        for (size_t k = 0; k < stmts_.size(); ++k) {
+            oss << declare(output_, "out" + std::to_string(k));
+        }
+        oss << "\nint main() {\n";
+        for (size_t k = 0; k < inputs_.size(); ++k) {
+            std::string input = inputs_[k].as<Var>()->name;
+            oss << "    fill((float*)" << input << ", sizeof(" << input << ") / sizeof(float), " << k + 1 << ");\n";
+        }
+        if (repeat == 0) {
+            for (size_t k = 0; k < stmts_.size(); ++k) {
+                oss << "    kernel" << k << "(" << args << "out" << k << ");\n";
+            }
+        } else {
+            oss << "    double t[" << stmts_.size() << "] = {\n";
+            for (size_t k = 0; k < stmts_.size(); ++k) {
+                oss << "        timeit([]() { kernel" << k << "(" << args << "out" << k << "); }, " << repeat << "),\n";
+            }
+            oss << "    };\n";
+        }
+        oss << "    float err = 0;\n";
+        for (size_t k = 1; k < stmts_.size(); ++k) {
+            oss << "    err = fmaxf(err, max_diff((float*)out0, (float*)out" << k << ", sizeof(out0) / sizeof(float)));\n";
+        }
+        oss << "    printf(\"" << title_ << ":";
+        for (size_t k = 0; k < stmts_.size(); ++k) {
+            oss << (k == 0 ? " " : ", ") << labels_[k] << (repeat == 0 ? "" : " %.3f ms");
+        }
+        if (repeat == 0) {
+            oss << " (err %g)\\n\", err);\n";
+        } else {
+            oss << " (err %g), speedup %.2fx\\n\",\n           ";
+            for (size_t k = 0; k < stmts_.size(); ++k) {
+                oss << "t[" << k << "], ";
+            }
+            oss << "err, t[0] / t[" << stmts_.size() - 1 << "]);\n";
+        }
+        oss << "    return err < " << tolerance << " ? 0 : 1;\n"
+            << "}\n";
+        return compile_and_run(name, oss.str(), flags);
+    }
+
+ private:
+    std::string title_;
+    std::vector<Expr> inputs_;
+    Expr output_;
+    std::vector<std::string> labels_;
+    std::vector<Stmt> stmts_;
+};
+
+}  // namespace Bench
+
+#endif  // BOOST_TEST_BENCH_UTILS_H
@@ -0,0 +1,166 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "type.h"
+#include "parallel.h"
+#include "vectorize.h"
+#include "accumulate.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Bench::check;
+
+
+std::string print(const Stmt &stmt) {
+    Boost::codegen::CodeGen_C gen;
+    return gen.print(Kernel::make("kernel", {}, {}, {stmt}, KernelType::CPU));
+}
+
+
+/**
+ * C<M, N>[i, j] = C[i, j] + A<M, K>[i, k] * B<N, K>[j, k]
+ */
+struct Gemm {
+    Expr i, j, k, A, B, C;
+    Stmt stmt;
+
+    Gemm(int M, int N, int K, bool dst_last = false) {
+        Type index_type = Type::int_scalar(32);
+        Type data_type = Type::float_scalar(32);
+        i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+        j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+        k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Reduce);
+        A = Var::make(data_type, "A", {i, k}, {(uint64_t)M, (uint64_t)K});
+        B = Var::make(data_type, "B", {j, k}, {(uint64_t)N, (uint64_t)K});
+        C = Var::make(data_type, "C", {i, j}, {(uint64_t)M, (uint64_t)N});
+        Expr mul = Binary::make(data_type, BinaryOpType::Mul, A, B);
+        Expr src = dst_last ? Binary::make(data_type, BinaryOpType::Add, mul, C)
+                            : Binary::make(data_type, BinaryOpType::Add, C, mul);
+        stmt = LoopNest::make({i, j, k}, {Move::make(C, src, MoveType::MemToMem)});
+    }
+};
+
+
+int test_lowering() {
+    int ret = 0;
+    for (bool dst_last : {false, true}) {
+        Gemm gemm(8, 8, 8, dst_last);
+        std::string str = print(Boost::Pass::accumulate(gemm.stmt));
+        std::cout << str;
+        ret |= check(str.find("      float C_acc0 = C[i][j];\n"
+                              "      for (int32_t k = 0; k < 8; k = k + 1) {\n"
+                              "        C_acc0 = (C_acc0 + (A[i][k] * B[j][k]));\n"
+                              "      }\n"
+                              "      C[i][j] = C_acc0;\n") != std::string::npos,
+            "expect one load and store of C[i][j]\n" + str);
+    }
+
+    // four chains over k, and the rest of 10 in the first
+    Gemm odd(8, 8, 10);
+    std::string str = print(Boost::Pass::accumulate(odd.stmt, 4));
+    std::cout << str;
+    ret |= check(str.find("float C_acc0_3 = 0;") != std::string::npos
+        && str.find("C_acc0_1 = (C_acc0_1 + (A[i][((k_outer * 4) + 1)] * B[j][((k_outer * 4) + 1)]));")
+        != std::string::npos
+        && str.find("for (int32_t k = 8; k < 8 + 2; k = k + 1) {\n        C_acc0_0 = (C_acc0_0 + ") != std::string::npos
+        && str.find("C[i][j] = ((C_acc0_0 + C_acc0_1) + (C_acc0_2 + C_acc0_3));") != std::string::npos,
+        "expect four accumulators\n" + str);
+
+    // every chain reads its own iteration
+    for (int n : {2, 3, 5, 8}) {
+        Gemm gemm(8, 8, 16);
+        std::string chains = print(Boost::Pass::accumulate(gemm.stmt, n));
+        for (int u = 1; u < n; ++u) {
+            std::string k = "((k_outer * " + std::to_string(n) + ") + " + std::to_string(u) + ")";
+            std::string acc = "C_acc0_" + std::to_string(u);
+            ret |= check(chains.find(acc + " = (" + acc + " + (A[i][" + k + "] * B[j][" + k + "]));") != std::string::npos,
+                "expect " + acc + " to read " + k + "\n" + chains);
+        }
+    }
+
+    // the locals are private to the iterations of i
+    str = print(Boost::Pass::accumulate(Boost::Pass::parallelize(odd.stmt)));
+    ret |= check(str.find("#pragma omp parallel for\n  for (int32_t i") != std::string::npos,
+        "expect i in parallel\n" + str);
+
+    // untouched: spatial innermost loop, dst read by the term
+    Type data_type = Type::float_scalar(32);
+    Stmt reordered = LoopNest::make({odd.i, odd.k, odd.j}, {odd.stmt.as<LoopNest>()->body_list});
+    Expr Ct = Var::make(data_type, "C", {odd.j, odd.i}, {8, 8});
+    Stmt self = LoopNest::make({odd.i, odd.j, odd.k}, {Move::make(odd.C,
+        Binary::make(data_type, BinaryOpType::Add, odd.C, Ct), MoveType::MemToMem)});
+    for (auto &stmt : {reordered, self}) {
+        str = print(Boost::Pass::accumulate(stmt));
+        ret |= check(str.find("_acc") == std::string::npos, "unexpected accumulator\n" + str);
+    }
+
+    // a vector accumulator, reduced once
+    str = print(Boost::Pass::accumulate(Boost::Pass::vectorize(odd.stmt, 4)));
+    std::cout << str;
+    ret |= check(str.find("float32x4 C_acc0 = ((float32x4){} + (float)(0));") != std::string::npos
+        && str.find("C[i][j] = (C[i][j] + ({ const float32x4 _vec = C_acc0;") != std::string::npos
+        && str.find("float C_acc1 = C[i][j];") != std::string::npos,
+        "expect a vector accumulator and a scalar one for the epilogue\n" + str);
+    return ret;
+}
+
+
+/**
+ * gemm with C[i, j] in memory, in one local, in 4 locals, and vectorized
+ * over k with 4 vector locals
+ */
+int test_gemm() {
+    const int M = 256, N = 256, K = 256;
+    Gemm gemm(M, N, K);
+    Boost::codegen::CodeGen_C gen;
+    std::ostringstream oss;
+    std::vector<std::string> names = {"plain", "acc1", "acc4", "vec4"};
+    std::vector<Stmt> stmts = {
+        gemm.stmt,
+        Boost::Pass::accumulate(gemm.stmt),
+        Boost::Pass::accumulate(gemm.stmt, 4),
+        Boost::Pass::accumulate(Boost::Pass::vectorize(gemm.stmt, 8), 4)
+    };
+    oss << Bench::driver_prelude();
+    for (size_t k = 0; k < names.size(); ++k) {
+        gen.vector_isa = k == 3 ? Boost::codegen::VectorISA::AVX2 : Boost::codegen::VectorISA::Native;
+        oss << gen.print(Kernel::make(names[k], {gemm.A, gemm.B}, {gemm.C}, {stmts[k]}, KernelType::CPU)) << "\n";
+    }
+    oss << Bench::declare(gemm.A) << Bench::declare(gemm.B);
+    for (auto &name : names) {
+        oss << Bench::declare(gemm.C, name + "_out");
+    }
+    oss << "\nint main() {\n"
+        << "    fill((float*)A, sizeof(A) / sizeof(float), 1);\n"
+        << "    fill((float*)B, sizeof(B) / sizeof(float), 2);\n"
+        << "    double t[4] = {\n";
+    for (auto &name : names) {
+        oss << "        timeit([]() { " << name << "(A, B, " << name << "_out); }, 5),\n";
+    }
+    oss << "    };\n"
+        << "    float err = fmaxf(max_diff((float*)plain_out, (float*)acc1_out, " << M * N << "),\n"
+        << "        fmaxf(max_diff((float*)plain_out, (float*)acc4_out, " << M * N << "),\n"
+        << "              max_diff((float*)plain_out, (float*)vec4_out, " << M * N << ")));\n"
+        << "    printf(\"gemm 256: memory %.3f ms, 1 local %.3f ms (%.2fx), 4 locals %.3f ms (%.2fx), \"\n"
+        << "           \"4 vector locals %.3f ms (%.2fx), err %g\\n\",\n"
+        << "           t[0], t[1], t[0] / t[1], t[2], t[0] / t[2], t[3], t[0] / t[3], err);\n"
+        << "    return err < 1e-2 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_accumulate_gemm", oss.str());
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_lowering();
+    ret |= test_gemm();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <string>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "arith.h"
+
+using namespace Boost::Internal;
+using namespace Boost::Arith;
+
+
+int check(const Expr &expr, const std::string &expected) {
+    IRPrinter printer;
+    std::string got = printer.print(expr);
+    if (got != expected) {
+        std::cout << "Fail! expect " << expected << ", got " << got << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+int main() {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr x = Index::make(index_type, "x", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr y = Index::make(index_type, "y", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr f = Var::make(data_type, "F", {x}, {16});
+    IRPrinter printer;
+    std::string px = printer.print(x);
+    std::string pf = printer.print(f);
+
+    int ret = 0;
+    // constants fold, keeping the type
+    ret |= check(add(Expr(2), Expr(3)), "((int32_t <1>) 5)");
+    ret |= check(mul(Expr(2.0f), Expr(3.0f)), "((float32_t <1>) 6)");
+    ret |= check(floordiv(Expr(-7), Expr(2)), "((int32_t <1>) -4)");
+    ret |= check(floormod(Expr(-7), Expr(2)), "((int32_t <1>) 1)");
+    ret |= check(lt(Expr(1), Expr(2)), "((bool1_t <1>) 1)");
+    // identities
+    ret |= check(sub(mul(add(x, 0), 1), 0), px);
+    ret |= check(add(Expr(0.0f), f), pf);
+    ret |= check(floordiv(x, 1), px);
+    ret |= check(logic_and(Expr(true), lt(x, y)), printer.print(lt(x, y)));
+    // x * 0 only folds for integers
+    ret |= check(mul(x, 0), "((int32_t <1>) 0)");
+    if (printer.print(mul(f, Expr(0.0f))) == "((float32_t <1>) 0)") {
+        std::cout << "Fail! F * 0.0 is not 0 for inf and nan\n";
+        ret = 1;
+    }
+    // constants go to the right, offsets and factors merge
+    ret |= check(add(3, x), "(" + px + " + ((int32_t <1>) 3))");
+    ret |= check(add(add(x, 3), 2), "(" + px + " + ((int32_t <1>) 5))");
+    ret |= check(sub(add(x, 3), 5), "(" + px + " - ((int32_t <1>) 2))");
+    ret |= check(add(sub(x, 3), 3), px);
+    ret |= check(mul(2, mul(x, 3)), "(" + px + " * ((int32_t <1>) 6))");
+    ret |= check(floordiv(mul(x, 6), 3), "(" + px + " * ((int32_t <1>) 2))");
+    ret |= check(floormod(mul(x, 6), 3), "((int32_t <1>) 0)");
+    // ceil div of a range bound: (15 + 3) // 4
+    ExtRange range(0, 15, false, false);
+    ret |= check(range.floor_div(4).right, "((int32_t <1>) 4)");
+
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "IR.h"
+#include "type.h"
+#include "autodiff.h"
+#include "codegen_C.h"
+#include "codegen_sink.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using namespace Boost::codegen;
+using Bench::check;
+
+
+std::string read_file(const std::string &path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+
+/**
+ * numbers print like the std::ostream defaults
+ */
+int test_format() {
+    ArenaSink sink;
+    Emitter out;
+    out.reset(&sink);
+    std::ostringstream oss;
+    std::vector<int64_t> ints = {0, 7, -7, 1234567890123LL, std::numeric_limits<int64_t>::max(),
+                                 std::numeric_limits<int64_t>::min()};
+    std::vector<double> floats = {0.0, -0.0, 3.0, -2.0, 0.5, 1.0 / 3, 1e-05, 999999.0, 1e6, -2.5e10, 0.1f};
+    for (auto v : ints) {
+        out << v << ' ';
+        oss << v << ' ';
+    }
+    uint64_t big = std::numeric_limits<uint64_t>::max();
+    out << big << ' ' << (uint16_t)32 << ' ';
+    oss << big << ' ' << (uint16_t)32 << ' ';
+    for (auto v : floats) {
+        out << v << ' ';
+        oss << v << ' ';
+    }
+    out.reset(nullptr);
+    return check(sink.str() == oss.str(), "expect " + oss.str() + "\ngot " + sink.str());
+}
+
+
+/**
+ * A<2, 8, 5, 5>[n, k, p, q] = A[n, k, p, q] + B<2, 16, 7, 7>[n, c, p + r, q + s] * C<8, 16, 3, 3>[k, c, r, s]
+ */
+Group conv2d_grad(const std::string &name) {
+    Bench::Conv2d conv("B", "C", "dA", 2, 16, 8, 5, 5, 3, 3);
+    Stmt stmt = conv.grad();
+    return Kernel::make(name, {conv.output, conv.weight}, {Bench::Conv2d::grad_dst(stmt)}, {stmt}, KernelType::CPU);
+}
+
+
+/**
+ * all sinks get the text of print
+ */
+int test_sinks() {
+    Group kernel = conv2d_grad("conv2d_grad");
+    CodeGen_C gen;
+    std::string expect = gen.print(kernel);
+
+    ArenaSink arena;
+    gen.emit(kernel, arena);
+    int ret = check(arena.str() == expect, "arena output differs");
+
+    int fd = ::open("test_codegen_sink_fd.cc", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    FdSink fd_sink(fd);
+    gen.emit(kernel, fd_sink);
+    ::close(fd);
+    ret |= check(read_file("test_codegen_sink_fd.cc") == expect, "fd output differs");
+
+    {
+        // a tiny mapping grows while writing
+        MmapSink mapped("test_codegen_sink_mmap.cc", 16);
+        gen.emit(kernel, mapped);
+        gen.emit(kernel, mapped);
+    }
+    return ret | check(read_file("test_codegen_sink_mmap.cc") == expect + expect, "mapped output differs");
+}
+
+
+/**
+ * many kernels into one translation unit
+ */
+int test_throughput() {
+    const int count = 500;
+    std::vector<Group> kernels;
+    for (int i = 0; i < count; ++i) {
+        kernels.push_back(conv2d_grad("conv2d_grad_" + std::to_string(i)));
+    }
+    CodeGen_C gen;
+    auto beg = std::chrono::steady_clock::now();
+    size_t size = 0;
+    {
+        MmapSink mapped("test_codegen_sink_unit.cc");
+        for (auto &kernel : kernels) {
+            gen.emit(kernel, mapped);
+        }
+        size = mapped.size();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double millis = std::chrono::duration<double, std::milli>(end - beg).count();
+    std::cout << "emit " << count << " kernels (" << size / 1024 << " KiB): " << millis << " ms, "
+              << (int)(count / millis * 1000) << " kernels/s\n";
+    return check(count / millis * 1000 > 100, "fewer than 100 kernels per second");
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_format();
+    ret |= test_sinks();
+    ret |= test_throughput();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
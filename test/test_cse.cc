@@ -0,0 +1,250 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "autodiff.h"
+#include "cse.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Bench::count;
+
+
+/**
+ * Y[i, j] = sin(exp(A[i, j]))
+ * the gradient cos(exp(A[i, j])) * exp(A[i, j]) repeats exp(A[i, j]),
+ * after CSE it is computed once
+ */
+int test_repeated_call() {
+    const int M = 1024;
+    const int N = 1024;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr expr_A = Var::make(data_type, "A", {i, j}, {M, N});
+    Expr expr_dY = Var::make(data_type, "dY", {i, j}, {M, N});
+    Expr exp_A = Call::make(data_type, {expr_A}, "exp", CallType::Pure);
+    Expr src = Call::make(data_type, {exp_A}, "sin", CallType::Pure);
+
+    Stmt stmt = Boost::Autodiff::grad_loop_nest(src, {i, j}, {0, 1}, expr_A.as<Var>(), expr_dY.as<Var>());
+    Stmt cse = Boost::Pass::common_subexpr_elimination(stmt);
+
+    IRPrinter printer;
+    std::cout << printer.print(cse) << "\n";
+
+    Expr dst = stmt.as<LoopNest>()->body_list[0].as<LoopNest>()->body_list[0].as<Move>()->dst;
+    Boost::codegen::CodeGen_C gen;
+    std::string plain = gen.print(Kernel::make("plain", {expr_dY, expr_A}, {dst}, {stmt}, KernelType::CPU));
+    std::string shared = gen.print(Kernel::make("shared", {expr_dY, expr_A}, {dst}, {cse}, KernelType::CPU));
+    if (count(plain, "expf(") < 2 || count(shared, "expf(") != 1) {
+        std::cout << "Fail! expect exp to be computed once.\n" << shared << "\n";
+        return 1;
+    }
+
+    std::ostringstream oss;
+    oss << Bench::driver_prelude() << plain << "\n" << shared << "\n";
+    oss << Bench::declare(expr_A) << Bench::declare(expr_dY)
+        << Bench::declare(dst, "plain_out") << Bench::declare(dst, "shared_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)A, sizeof(A) / sizeof(float), 1);\n"
+        << "    fill((float*)dY, sizeof(dY) / sizeof(float), 2);\n"
+        << "    double t0 = timeit([]() { plain(dY, A, plain_out); }, 10);\n"
+        << "    double t1 = timeit([]() { shared(dY, A, shared_out); }, 10);\n"
+        << "    float err = 0;\n"
+        << "    for (int i = 0; i < " << M << "; ++i)\n"
+        << "    for (int j = 0; j < " << N << "; ++j)\n"
+        << "        err = fmaxf(err, fabsf(dY[i][j] * cosf(expf(A[i][j])) * expf(A[i][j]) - shared_out[i][j]));\n"
+        << "    err = fmaxf(err, max_diff((float*)plain_out, (float*)shared_out, " << M * N << "));\n"
+        << "    printf(\"sin(exp(A)): plain %.3f ms, cse %.3f ms (err %g), speedup %.2fx\\n\",\n"
+        << "           t0, t1, err, t0 / t1);\n"
+        << "    return err < 1e-4 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_cse_call", oss.str());
+}
+
+
+/**
+ * guarded conv2d backward with stride 2:
+ * the index arithmetic shared by the guards and the loads is bound
+ * before the guard
+ */
+int test_guarded_conv2d() {
+    const int N = 2;
+    const int C = 8;
+    const int K = 8;
+    const int P = 7;
+    const int Q = 7;
+    const int R = 3;
+    const int S = 3;
+    const uint64_t H = (P - 1) * 2 + R;
+    const uint64_t W = (Q - 1) * 2 + S;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr n = Index::make(index_type, "n", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Spatial);
+    Expr p = Index::make(index_type, "p", Dom::make(index_type, 0, P), IndexType::Spatial);
+    Expr q = Index::make(index_type, "q", Dom::make(index_type, 0, Q), IndexType::Spatial);
+    Expr c = Index::make(index_type, "c", Dom::make(index_type, 0, C), IndexType::Reduce);
+    Expr r = Index::make(index_type, "r", Dom::make(index_type, 0, R), IndexType::Reduce);
+    Expr s = Index::make(index_type, "s", Dom::make(index_type, 0, S), IndexType::Reduce);
+    Expr h_arg = Binary::make(index_type, BinaryOpType::Add,
+        Binary::make(index_type, BinaryOpType::Mul, p, 2), r);
+    Expr w_arg = Binary::make(index_type, BinaryOpType::Add,
+        Binary::make(index_type, BinaryOpType::Mul, q, 2), s);
+    Expr expr_I = Var::make(data_type, "I", {n, c, h_arg, w_arg}, {N, C, H, W});
+    Expr expr_W = Var::make(data_type, "W", {k, c, r, s}, {K, C, R, S});
+    Expr expr_dO = Var::make(data_type, "dO", {n, k, p, q}, {N, K, P, Q});
+    Expr src = Binary::make(data_type, BinaryOpType::Mul, expr_I, expr_W);
+
+    Stmt stmt = Boost::Autodiff::grad_loop_nest(
+        src, {n, k, p, q, c, r, s}, {0, 1, 2, 3}, expr_I.as<Var>(), expr_dO.as<Var>(), false);
+    Stmt cse = Boost::Pass::common_subexpr_elimination(stmt);
+
+    IRPrinter printer;
+    std::cout << printer.print(cse) << "\n";
+
+    Expr dst = stmt.as<LoopNest>()->body_list[0].as<LoopNest>()->body_list[0].as<Move>()->dst;
+    Boost::codegen::CodeGen_C gen;
+    std::ostringstream oss;
+    oss << Bench::driver_prelude();
+    oss << gen.print(Kernel::make("plain", {expr_dO, expr_W}, {dst}, {stmt}, KernelType::CPU)) << "\n";
+    oss << gen.print(Kernel::make("shared", {expr_dO, expr_W}, {dst}, {cse}, KernelType::CPU)) << "\n";
+    oss << Bench::declare(expr_dO) << Bench::declare(expr_W)
+        << Bench::declare(dst, "plain_out") << Bench::declare(dst, "shared_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)dO, sizeof(dO) / sizeof(float), 1);\n"
+        << "    fill((float*)W, sizeof(W) / sizeof(float), 2);\n"
+        << "    double t0 = timeit([]() { plain(dO, W, plain_out); }, 10);\n"
+        << "    double t1 = timeit([]() { shared(dO, W, shared_out); }, 10);\n"
+        << "    float err = max_diff((float*)plain_out, (float*)shared_out, sizeof(plain_out) / sizeof(float));\n"
+        << "    printf(\"guarded conv2d: plain %.3f ms, cse %.3f ms (err %g), speedup %.2fx\\n\",\n"
+        << "           t0, t1, err, t0 / t1);\n"
+        << "    return err < 1e-4 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_cse_conv2d", oss.str());
+}
+
+
+/**
+ * A[i] = A[i] * A[i] + B[i] reads its dst, the store stays to A[i]
+ */
+int test_update() {
+    const int N = 1024;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr expr_A = Var::make(data_type, "A", {i}, {N});
+    Expr expr_B = Var::make(data_type, "B", {i}, {N});
+    Expr src = Binary::make(data_type, BinaryOpType::Add,
+        Binary::make(data_type, BinaryOpType::Mul, expr_A, expr_A), expr_B);
+    Stmt stmt = LoopNest::make({i}, {Move::make(expr_A, src, MoveType::MemToMem)});
+    Stmt cse = Boost::Pass::common_subexpr_elimination(stmt);
+
+    Boost::codegen::CodeGen_C gen;
+    std::string plain = gen.print(Kernel::make("plain", {expr_B}, {expr_A}, {stmt}, KernelType::CPU));
+    std::string shared = gen.print(Kernel::make("shared", {expr_B}, {expr_A}, {cse}, KernelType::CPU));
+    std::cout << shared;
+    if (shared.find("A[i] = ((_cse0 * _cse0) + B[i]);") == std::string::npos) {
+        std::cout << "Fail! expect the store to A[i].\n" << shared << "\n";
+        return 1;
+    }
+
+    std::ostringstream oss;
+    oss << Bench::driver_prelude() << plain << "\n" << shared << "\n";
+    oss << Bench::declare(expr_B) << Bench::declare(expr_A, "A0") << Bench::declare(expr_A, "A1") << "\n";
+    oss << "int main() {\n"
+        << "    fill(A0, " << N << ", 1);\n"
+        << "    fill(A1, " << N << ", 1);\n"
+        << "    fill(B, " << N << ", 2);\n"
+        << "    plain(B, A0);\n"
+        << "    shared(B, A1);\n"
+        << "    return max_diff(A0, A1, " << N << ") == 0 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_cse_update", oss.str());
+}
+
+
+/**
+ * Y[i] = exp(A[i] * X[i]) + B[i]; Z[i] = exp(A[i] * X[i]) * B[i]
+ * the sibling Moves share exp(A[i] * X[i]), bound once before the first
+ */
+int test_siblings() {
+    const int N = 1024;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr expr_A = Var::make(data_type, "A", {i}, {N});
+    Expr expr_X = Var::make(data_type, "X", {i}, {N});
+    Expr expr_B = Var::make(data_type, "B", {i}, {N});
+    Expr expr_Y = Var::make(data_type, "Y", {i}, {N});
+    Expr expr_Z = Var::make(data_type, "Z", {i}, {N});
+    auto exp_AX = [&]() {
+        return Call::make(data_type, {Binary::make(data_type, BinaryOpType::Mul, expr_A, expr_X)}, "exp",
+                          CallType::Pure);
+    };
+    Stmt stmt = LoopNest::make({i}, {
+        Move::make(expr_Y, Binary::make(data_type, BinaryOpType::Add, exp_AX(), expr_B), MoveType::MemToMem),
+        Move::make(expr_Z, Binary::make(data_type, BinaryOpType::Mul, exp_AX(), expr_B), MoveType::MemToMem)});
+    Stmt cse = Boost::Pass::common_subexpr_elimination(stmt);
+
+    Boost::codegen::CodeGen_C gen;
+    std::string plain = gen.print(Kernel::make("plain", {expr_A, expr_X, expr_B}, {expr_Y, expr_Z}, {stmt},
+                                               KernelType::CPU));
+    std::string shared = gen.print(Kernel::make("shared", {expr_A, expr_X, expr_B}, {expr_Y, expr_Z}, {cse},
+                                                KernelType::CPU));
+    std::cout << shared;
+    if (count(shared, "expf(") != 1 || shared.find("const float _cse0 = expf((A[i] * X[i]));") == std::string::npos) {
+        std::cout << "Fail! expect exp(A[i] * X[i]) bound once for both statements.\n" << shared << "\n";
+        return 1;
+    }
+
+    // Y[i] is written before Z[i] reads it, so Y[i] + B[i] stays in the loads
+    Stmt reads = LoopNest::make({i}, {
+        Move::make(expr_Y, Binary::make(data_type, BinaryOpType::Add, expr_Y, expr_B), MoveType::MemToMem),
+        Move::make(expr_Z, Binary::make(data_type, BinaryOpType::Add, expr_Y, expr_B), MoveType::MemToMem)});
+    std::string kept = gen.print(Kernel::make("kept", {expr_B}, {expr_Y, expr_Z},
+                                              {Boost::Pass::common_subexpr_elimination(reads)}, KernelType::CPU));
+    if (kept.find("_cse") != std::string::npos) {
+        std::cout << "Fail! unexpected binding of a value the body writes.\n" << kept << "\n";
+        return 1;
+    }
+
+    std::ostringstream oss;
+    oss << Bench::driver_prelude() << plain << "\n" << shared << "\n";
+    oss << Bench::declare(expr_A) << Bench::declare(expr_X) << Bench::declare(expr_B)
+        << Bench::declare(expr_Y, "Y0") << Bench::declare(expr_Z, "Z0")
+        << Bench::declare(expr_Y, "Y1") << Bench::declare(expr_Z, "Z1") << "\n";
+    oss << "int main() {\n"
+        << "    fill(A, " << N << ", 1);\n"
+        << "    fill(X, " << N << ", 2);\n"
+        << "    fill(B, " << N << ", 3);\n"
+        << "    plain(A, X, B, Y0, Z0);\n"
+        << "    shared(A, X, B, Y1, Z1);\n"
+        << "    return fmaxf(max_diff(Y0, Y1, " << N << "), max_diff(Z0, Z1, " << N << ")) == 0 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_cse_siblings", oss.str());
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_repeated_call();
+    ret |= test_guarded_conv2d();
+    ret |= test_update();
+    ret |= test_siblings();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "autodiff.h"
+#include "egraph.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Bench::check;
+using Bench::count;
+
+
+Expr move_src(const Stmt &stmt) {
+    return stmt.as<LoopNest>()->body_list[0].as<LoopNest>()->body_list[0].as<Move>()->src;
+}
+
+
+/**
+ * rules on small expressions, cheapest form by the default cost model
+ */
+int test_rules() {
+    Type data_type = Type::float_scalar(32);
+    Type index_type = Type::int_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr a = Var::make(data_type, "a", {i}, {16});
+    Expr b = Var::make(data_type, "b", {i}, {16});
+    Expr c = Var::make(data_type, "c", {i}, {16});
+    auto mk = [&](BinaryOpType op, Expr x, Expr y) { return Binary::make(data_type, op, x, y); };
+    Boost::Pass::CostModel model;
+    int ret = 0;
+
+    struct Case {
+        Expr expr;
+        int cost;
+    };
+    std::vector<Case> cases = {
+        // factoring: a * b + a * c = a * (b + c)
+        {mk(BinaryOpType::Add, mk(BinaryOpType::Mul, a, b), mk(BinaryOpType::Mul, a, c)), 8},
+        // a / b + c / b = (a + c) / b
+        {mk(BinaryOpType::Add, mk(BinaryOpType::Div, a, b), mk(BinaryOpType::Div, c, b)), 17},
+        // (a * b) / (b * b) = a / b
+        {mk(BinaryOpType::Div, mk(BinaryOpType::Mul, a, b), mk(BinaryOpType::Mul, b, b)), 14},
+        // (a / b) / c = a / (b * c)
+        {mk(BinaryOpType::Div, mk(BinaryOpType::Div, a, b), c), 17},
+        // a - a * 1 = 0
+        {mk(BinaryOpType::Sub, a, mk(BinaryOpType::Mul, a, Boost::Utils::make_const(data_type, 1))), 0}
+    };
+    for (auto &item : cases) {
+        Boost::Pass::EGraph graph;
+        Boost::Pass::EGraphStats stats;
+        int root = graph.add(item.expr);
+        graph.saturate(Boost::Pass::EGraphOptions(), stats);
+        Expr best = graph.extract(root, model);
+        std::ostringstream oss;
+        oss << item.expr << " => " << best << " (" << model.cost(best) << ")";
+        std::cout << oss.str() << "\n";
+        ret |= check(model.cost(best) == item.cost, "unexpected cost of " + oss.str());
+    }
+    return ret;
+}
+
+
+/**
+ * a tiny budget stops early and still gives an equivalent expression
+ */
+int test_budget() {
+    Type data_type = Type::float_scalar(32);
+    Type index_type = Type::int_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr sum = Var::make(data_type, "x0", {i}, {16});
+    for (int k = 1; k < 12; ++k) {
+        Expr term = Binary::make(data_type, BinaryOpType::Mul,
+            Var::make(data_type, "x" + std::to_string(k), {i}, {16}), Var::make(data_type, "y", {i}, {16}));
+        sum = Binary::make(data_type, BinaryOpType::Add, sum, term);
+    }
+    Boost::Pass::EGraphOptions options;
+    options.max_nodes = 64;
+    Boost::Pass::EGraph graph;
+    Boost::Pass::EGraphStats stats;
+    int root = graph.add(sum);
+    graph.saturate(options, stats);
+    Expr best = graph.extract(root, options.cost);
+    std::cout << "budget: " << stats << "\n";
+    int ret = check(stats.saturated == 0 && graph.num_nodes() < 256, "budget not respected");
+    ret |= check(options.cost.cost(best) <= options.cost.cost(sum), "extraction worse than the input");
+    return ret;
+}
+
+
+/**
+ * Y[i] = A[i] * B[i] / (A[i] + B[i])
+ * dB = dY * A / (A + B) - dY * A * B / ((A + B) * (A + B)) has two
+ * divisions, the optimized gradient one
+ */
+int test_quotient_grad() {
+    const int N = 1 << 20;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr expr_A = Var::make(data_type, "A", {i}, {N});
+    Expr expr_B = Var::make(data_type, "B", {i}, {N});
+    Expr expr_dY = Var::make(data_type, "dY", {i}, {N});
+    Expr src = Binary::make(data_type, BinaryOpType::Div,
+        Binary::make(data_type, BinaryOpType::Mul, expr_A, expr_B),
+        Binary::make(data_type, BinaryOpType::Add, expr_A, expr_B));
+    int ret = 0;
+
+    // dA of A / B is dY * B / (B * B) = dY / B
+    Expr quot = Binary::make(data_type, BinaryOpType::Div, expr_A, expr_B);
+    Stmt stmt_A = Boost::Autodiff::grad_loop_nest(quot, {i}, {0}, expr_A.as<Var>(), expr_dY.as<Var>());
+    Boost::Pass::EGraphStats stats_A;
+    Stmt opt_A = Boost::Pass::egraph_optimize(stmt_A, Boost::Pass::EGraphOptions(), &stats_A);
+    std::cout << "A / B, dA: " << move_src(stmt_A) << " => " << move_src(opt_A) << "\n";
+    ret |= check(stats_A.improved == 1 && stats_A.cost_after < stats_A.cost_before, "dA of A / B not improved");
+
+    Stmt stmt = Boost::Autodiff::grad_loop_nest(src, {i}, {0}, expr_B.as<Var>(), expr_dY.as<Var>());
+    Boost::Pass::EGraphStats stats;
+    Stmt opt = Boost::Pass::egraph_optimize(stmt, Boost::Pass::EGraphOptions(), &stats);
+    std::cout << "A * B / (A + B), dB: " << move_src(stmt) << " => " << move_src(opt) << "\n";
+    std::cout << stats << "\n";
+    ret |= check(stats.cost_after < stats.cost_before, "dB of A * B / (A + B) not improved");
+
+    Expr dst = stmt.as<LoopNest>()->body_list[0].as<LoopNest>()->body_list[0].as<Move>()->dst;
+    Boost::codegen::CodeGen_C gen;
+    std::string plain = gen.print(Kernel::make("plain", {expr_dY, expr_A, expr_B}, {dst}, {stmt}, KernelType::CPU));
+    std::string fast = gen.print(Kernel::make("fast", {expr_dY, expr_A, expr_B}, {dst}, {opt}, KernelType::CPU));
+    ret |= check(count(plain, " / ") == 2 && count(fast, " / ") == 1, "expect one division\n" + fast);
+    if (ret != 0) {
+        return ret;
+    }
+
+    std::ostringstream oss;
+    oss << Bench::driver_prelude() << plain << "\n" << fast << "\n";
+    oss << Bench::declare(expr_A) << Bench::declare(expr_B) << Bench::declare(expr_dY)
+        << Bench::declare(dst, "plain_out") << Bench::declare(dst, "fast_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill(A, " << N << ", 1);\n"
+        << "    fill(B, " << N << ", 2);\n"
+        << "    fill(dY, " << N << ", 3);\n"
+        << "    double t0 = timeit([]() { plain(dY, A, B, plain_out); }, 10);\n"
+        << "    double t1 = timeit([]() { fast(dY, A, B, fast_out); }, 10);\n"
+        << "    float err = 0;\n"
+        << "    for (int i = 0; i < " << N << "; ++i)\n"
+        << "        err = fmaxf(err, fabsf(plain_out[i] - fast_out[i]) / (fabsf(plain_out[i]) + 1));\n"
+        << "    printf(\"A * B / (A + B): plain %.3f ms, egraph %.3f ms (err %g), speedup %.2fx\\n\",\n"
+        << "           t0, t1, err, t0 / t1);\n"
+        << "    return err < 1e-4 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_egraph_quotient", oss.str());
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_rules();
+    ret |= test_budget();
+    ret |= test_quotient_grad();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include "arith.h"
+#include "bench_utils.h"
+
+using namespace Boost::Arith;
+using Bench::check;
+
+
+std::string str(const IntegerSet &set) {
+    std::ostringstream oss;
+    oss << set;
+    return oss.str();
+}
+
+
+int64_t eval(const LinearForm &form, const std::unordered_map<std::string, int64_t> &values) {
+    int64_t ret = form.constant();
+    for (auto &term : form.terms()) {
+        ret += term.second * values.at(term.first);
+    }
+    return ret;
+}
+
+
+int64_t floor_div(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+
+/**
+ * the loop nest from bounds visits exactly the points of set in the box
+ * [-16, 16) of every symbol, each once
+ */
+int check_enumeration(const IntegerSet &set, const std::vector<std::string> &order) {
+    std::vector<LoopBounds> bounds;
+    if (!set.loop_bounds(order, bounds)) {
+        return check(false, "no loop bounds for " + str(set));
+    }
+    std::unordered_map<std::string, int64_t> values;
+    int64_t visited = 0;
+    bool outside = false;
+    std::function<void(size_t)> walk = [&](size_t level) {
+        if (level == order.size()) {
+            ++visited;
+            for (auto &c : set.constraints()) {
+                outside = outside || eval(c, values) < 0;
+            }
+            return;
+        }
+        int64_t lo = -16, hi = 15;
+        for (auto &b : bounds[level].lower) {
+            lo = std::max(lo, -floor_div(-eval(b.first, values), b.second));
+        }
+        for (auto &b : bounds[level].upper) {
+            hi = std::min(hi, floor_div(eval(b.first, values), b.second));
+        }
+        for (int64_t v = lo; v <= hi; ++v) {
+            values[order[level]] = v;
+            walk(level + 1);
+        }
+    };
+    walk(0);
+
+    int64_t expected = 0;
+    std::function<void(size_t)> brute = [&](size_t level) {
+        if (level == order.size()) {
+            bool inside = true;
+            for (auto &c : set.constraints()) {
+                inside = inside && eval(c, values) >= 0;
+            }
+            expected += inside;
+            return;
+        }
+        for (int64_t v = -16; v < 16; ++v) {
+            values[order[level]] = v;
+            brute(level + 1);
+        }
+    };
+    brute(0);
+    return check(!outside && visited == expected, "wrong loop nest for " + str(set));
+}
+
+
+int main() {
+    LinearForm h("h", 1), r("r", 1), s("s", 1);
+    int ret = 0;
+
+    // integer tightening: 2h - 3 >= 0 => h - 2 >= 0
+    IntegerSet tight;
+    tight.add_ge(h * 2 - LinearForm(3));
+    ret |= check(tight.constraints().size() == 1 && tight.constraints()[0] == h - LinearForm(2),
+        "no tightening in " + str(tight));
+    // parallel constraints keep the tightest
+    tight.add_ge(h - LinearForm(5));
+    ret |= check(tight.constraints().size() == 1 && tight.constraints()[0] == h - LinearForm(5),
+        "parallel constraints kept in " + str(tight));
+
+    // emptiness by projection: h >= r + 1, r >= h
+    IntegerSet empty;
+    empty.add_ge(h - r - LinearForm(1));
+    empty.add_ge(r - h);
+    ret |= check(!empty.is_empty() && empty.project_out("r").is_empty(), "empty set not detected");
+    // tightening finds integer emptiness: 3 <= 2h <= 3 is h >= 2, h <= 1
+    IntegerSet odd;
+    odd.add_ge(h * 2 - LinearForm(3));
+    odd.add_ge(LinearForm(3) - h * 2);
+    ret |= check(odd.project_out("h").is_empty(), "2h == 3 not empty");
+
+    // projection: 0 <= h - r < 8, 0 <= r < 3 => 0 <= h < 10
+    IntegerSet conv;
+    conv.add_range("r", 0, 3);
+    conv.add_ge(h - r);
+    conv.add_ge(LinearForm(7) - h + r);
+    IntegerSet projected = conv.project_out("r");
+    ret |= check(projected.constraints().size() == 2, "wrong projection " + str(projected));
+    for (auto &c : projected.constraints()) {
+        ret |= check(c == h || c == LinearForm(9) - h, "wrong projected constraint in " + str(projected));
+    }
+
+    // loop bounds: r in [max(0, h - 7), min(2, h)] under h in [0, 10)
+    std::vector<LoopBounds> bounds;
+    ret |= check(conv.loop_bounds({"h", "r"}, bounds) && bounds.size() == 2, "no loop bounds");
+    ret |= check(bounds[1].symbol == "r" && bounds[1].lower.size() == 2 && bounds[1].upper.size() == 2,
+        "wrong bounds of r");
+    ret |= check_enumeration(conv, {"h", "r"});
+    ret |= check_enumeration(conv, {"r", "h"});
+
+    // strided: 0 <= h - 2r < 8, 0 <= r < 4, r in [ceil((h - 7) / 2), floor(h / 2)]
+    IntegerSet strided;
+    strided.add_range("r", 0, 4);
+    strided.add_range("s", 0, 3);
+    strided.add_ge(h - r * 2 - s);
+    strided.add_ge(LinearForm(7) - h + r * 2 + s);
+    ret |= check_enumeration(strided, {"h", "r", "s"});
+    ret |= check_enumeration(strided, {"h", "s", "r"});
+    ret |= check_enumeration(strided, {"s", "r", "h"});
+
+    // equalities: h == 3r + 1
+    IntegerSet equal;
+    equal.add_range("r", 0, 5);
+    equal.add_eq(h - r * 3 - LinearForm(1));
+    ret |= check_enumeration(equal, {"h", "r"});
+
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
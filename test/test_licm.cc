@@ -0,0 +1,144 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "autodiff.h"
+#include "licm.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Bench::check;
+
+
+std::string print(const Stmt &stmt) {
+    Boost::codegen::CodeGen_C gen;
+    return gen.print(Kernel::make("kernel", {}, {}, {stmt}, KernelType::CPU));
+}
+
+
+/**
+ * the line of str holding pattern
+ */
+std::string line_of(const std::string &str, const std::string &pattern) {
+    size_t pos = str.find(pattern);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    size_t beg = str.rfind('\n', pos);
+    size_t end = str.find('\n', pos);
+    return str.substr(beg == std::string::npos ? 0 : beg + 1, end - beg);
+}
+
+
+Expr last_dst(const Stmt &stmt) {
+    Ref<const LoopNest> nest = stmt.as<LoopNest>();
+    while (nest.defined()) {
+        Stmt body = nest->body_list.back();
+        Ref<const Move> move = body.as<Move>();
+        if (move.defined()) {
+            return move->dst;
+        }
+        nest = body.as<LoopNest>();
+    }
+    return Expr();
+}
+
+
+/**
+ * A<M, N>[i, j] = A[i, j] + alpha<1> * (B<M, K>[i, k] * C<K, N>[k, j])
+ * alpha[0] may alias the gradient, only the pass moves it out of the loops
+ */
+int test_gemm_grad() {
+    const int M = 256, N = 256, K = 256;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Reduce);
+    Expr alpha = Var::make(data_type, "alpha", {Expr(0)}, {1});
+    Expr B = Var::make(data_type, "B", {i, k}, {M, K});
+    Expr C = Var::make(data_type, "C", {k, j}, {K, N});
+    Expr dA = Var::make(data_type, "dA", {i, j}, {M, N});
+    Expr src = Binary::make(data_type, BinaryOpType::Mul, alpha,
+        Binary::make(data_type, BinaryOpType::Mul, B, C));
+
+    Stmt stmt = Boost::Autodiff::grad_loop_nest(src, {i, j, k}, {0, 1}, B.as<Var>(), dA.as<Var>());
+    Stmt hoisted = Boost::Pass::loop_invariant_code_motion(stmt);
+    std::string str = print(hoisted);
+    std::cout << str;
+    int ret = check(line_of(str, "alpha[0]").find("  const float _licm0") == 0, "alpha[0] not hoisted out of the loops");
+    ret |= check(line_of(str, " = (dB0").find("alpha") == std::string::npos, "alpha[0] left in the loop body");
+    if (ret != 0) {
+        return ret;
+    }
+
+    Bench::Benchmark bench("gemm grad", {dA, alpha, C}, last_dst(stmt.as<LoopNest>()->body_list.back()));
+    bench.add("plain", stmt);
+    bench.add("licm", hoisted);
+    return bench.run("test_licm_gemm", 5, 1e-4);
+}
+
+
+/**
+ * A<2, 8, 5, 5>[n, k, p, q] = A[n, k, p, q] + B<2, 16, 7, 7>[n, c, p + r, q + s] * C<8, 16, 3, 3>[k, c, r, s]
+ * the input indices of dB only change in the loops of r and s
+ */
+int test_conv2d_grad() {
+    Bench::Conv2d conv("B", "C", "dA", 2, 16, 8, 5, 5, 3, 3);
+    Stmt stmt = conv.grad();
+    std::string str = print(Boost::Pass::loop_invariant_code_motion(stmt));
+    std::cout << str;
+    std::string body = line_of(str, " = (dB0");
+    int ret = check(body != "" && body.find(" - ") == std::string::npos, "index arithmetic left in " + body);
+    return ret | check(str.find("_licm1") != std::string::npos, "expect two hoisted indices");
+}
+
+
+/**
+ * for i in [0, 16), j in [0, i): if (i < 8) Y[i, j] = Y[i, 0] + A[0] * B[2 * i, j]
+ * - 2 * i leaves the guard and the loop of j
+ * - A[0] can't leave the guard, nor the loop of j that may not run
+ * - Y[i, 0] is written in the nest
+ */
+int test_legality() {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, i), IndexType::Spatial);
+    Expr twice = Binary::make(index_type, BinaryOpType::Mul, Expr(2), i);
+    Expr A = Var::make(data_type, "A", {Expr(0)}, {1});
+    Expr B = Var::make(data_type, "B", {twice, j}, {32, 16});
+    Expr Y = Var::make(data_type, "Y", {i, j}, {16, 16});
+    Expr Y0 = Var::make(data_type, "Y", {i, Expr(0)}, {16, 16});
+    Expr src = Binary::make(data_type, BinaryOpType::Add, Y0,
+        Binary::make(data_type, BinaryOpType::Mul, A, B));
+    Expr cond = Compare::make(Type::bool_scalar(), CompareOpType::LT, i, Expr(8));
+    Stmt stmt = LoopNest::make({i, j}, {IfThenElse::make(cond, Move::make(Y, src, MoveType::MemToMem), Stmt())});
+
+    std::string str = print(Boost::Pass::loop_invariant_code_motion(stmt));
+    std::cout << str;
+    std::string body = line_of(str, "Y[i][j] =");
+    int ret = check(body.find("A[0]") != std::string::npos && body.find("Y[i][0]") != std::string::npos,
+        "unsafe value hoisted " + str);
+    ret |= check(body.find("2 * i") == std::string::npos, "2 * i left in " + body);
+    return ret | check(str.find("2 * i") < str.find("for (int32_t j"), "2 * i not hoisted out of the loop of j");
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_legality();
+    ret |= test_conv2d_grad();
+    ret |= test_gemm_grad();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
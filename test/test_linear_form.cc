@@ -0,0 +1,107 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <unordered_map>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "arith.h"
+#include "autodiff.h"
+#include "typechecker.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using namespace Boost::Arith;
+using Bench::check;
+
+
+std::string str(const LinearForm &form) {
+    std::ostringstream oss;
+    oss << form;
+    return oss.str();
+}
+
+
+int main() {
+    Type index_type = Type::int_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, 16), IndexType::Reduce);
+    auto make = [&](BinaryOpType op, Expr a, Expr b) {
+        return Binary::make(index_type, op, a, b);
+    };
+
+    int ret = 0;
+    // 2 * (i + 3) - j * 3 + i
+    Expr expr = make(BinaryOpType::Add,
+        make(BinaryOpType::Sub,
+            make(BinaryOpType::Mul, Expr(2), make(BinaryOpType::Add, i, Expr(3))),
+            make(BinaryOpType::Mul, j, Expr(3))),
+        i);
+    LinearForm form;
+    std::unordered_map<std::string, Expr> symbols;
+    ret |= check(LinearForm::from_expr(expr, form, &symbols), "affine expression rejected");
+    ret |= check(str(form) == "3*i - 3*j + 6", "wrong form " + str(form));
+    ret |= check(form.coeff("i") == 3 && form.coeff("j") == -3 && form.coeff("k") == 0, "wrong coefficients");
+    ret |= check(symbols.size() == 2 && symbols.count("i") && symbols.count("j"), "wrong symbols");
+
+    // canonical: the order of terms does not matter, zeros vanish
+    LinearForm a, b;
+    LinearForm::from_expr(make(BinaryOpType::Add, i, j), a);
+    LinearForm::from_expr(make(BinaryOpType::Add, j, i), b);
+    ret |= check(a == b, "i + j != j + i");
+    LinearForm::from_expr(make(BinaryOpType::Sub, i, i), a);
+    ret |= check(a.is_constant() && a.constant() == 0, "i - i is not 0");
+    LinearForm::from_expr(Unary::make(index_type, UnaryOpType::Neg, make(BinaryOpType::Mul, k, Expr(0))), a);
+    ret |= check(a.is_constant(), "-(k * 0) keeps k");
+
+    // not affine
+    ret |= check(!LinearForm::from_expr(make(BinaryOpType::Mul, i, j), a), "i * j accepted");
+    ret |= check(!LinearForm::from_expr(make(BinaryOpType::FloorDiv, i, Expr(2)), a), "i // 2 accepted");
+
+    // arithmetic and substitution
+    LinearForm x("i", 2);
+    x += LinearForm("k", 1) * 3;
+    x -= LinearForm(4);
+    ret |= check(str(x) == "2*i + 3*k - 4", "wrong arithmetic " + str(x));
+    // i = j - k + 1
+    LinearForm y = x.substitute("i", LinearForm("j", 1) - LinearForm("k", 1) + LinearForm(1));
+    ret |= check(str(y) == "2*j + k - 2", "wrong substitution " + str(y));
+    ret |= check(x.substitute("j", LinearForm(7)) == x, "substitute of an absent symbol");
+
+    // round trip through Expr
+    Expr rebuilt = form.to_expr(index_type, symbols);
+    ret |= check(LinearForm::from_expr(rebuilt, a) && a == form, "round trip changes the form");
+
+    // autodiff coefficients
+    std::unordered_map<std::string, int> coeffs;
+    Boost::Autodiff::ExtractIndexCoefficients extractor("_const");
+    extractor.get_coefficients(expr, coeffs);
+    ret |= check(coeffs["i"] == 3 && coeffs["j"] == -3 && coeffs["_const"] == 6, "wrong extracted coefficients");
+
+    // closed form ranges: 2 * i + 1 in [0, 10) => i in [0, 5)
+    IRPrinter printer;
+    RangeInference infer(ExtRange(0, 10, false, false));
+    infer.do_infer(make(BinaryOpType::Add, make(BinaryOpType::Mul, i, Expr(2)), Expr(1)));
+    ret |= check(infer.range_map.count("i") != 0, "no range for i");
+    ret |= check(printer.print(infer.range_map["i"].left) == "((int32_t <1>) 0)" &&
+                 printer.print(infer.range_map["i"].right) == "((int32_t <1>) 5)", "wrong range of 2 * i + 1");
+    // 9 - i in [0, 10) => i in [0, 10)
+    RangeInference infer_neg(ExtRange(0, 10, false, false));
+    infer_neg.do_infer(make(BinaryOpType::Sub, Expr(9), i));
+    ret |= check(printer.print(infer_neg.range_map["i"].left) == "((int32_t <1>) 0)" &&
+                 printer.print(infer_neg.range_map["i"].right) == "((int32_t <1>) 10)", "wrong range of 9 - i");
+
+    // typechecker: i + 1 in a dimension of 8 => extent of i is 7
+    Boost::Typechecker::IndexConstraint ic = Boost::Typechecker::arg_constraint(
+        make(BinaryOpType::Add, i, Expr(1)), 8);
+    ret |= check(ic.index_constraints_b(0) == 7, "wrong index constraint");
+
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "arith.h"
+
+using namespace Boost::Arith;
+
+
+/**
+ * reference: plain row-major vector
+ */
+class Reference {
+ public:
+    Reference(int height, int width) : height(height), width(width), data(height * width, 0) {}
+
+    int64_t &at(int i, int j) {
+        return data[i * width + j];
+    }
+
+    int height, width;
+    std::vector<int64_t> data;
+};
+
+
+template <typename M>
+bool same(M &m, Reference &ref) {
+    if (m.height() != ref.height || m.width() != ref.width) {
+        return false;
+    }
+    for (int i = 0; i < ref.height; ++i) {
+        for (int j = 0; j < ref.width; ++j) {
+            if (m[i][j] != ref.at(i, j)) {
+                return false;
+            }
+        }
+        // padding stays zero
+        for (int j = ref.width; j < m.stride(); ++j) {
+            if (m[i][j] != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+template <typename T, int Capacity>
+int check_ops(std::mt19937 &rng, int height, int width) {
+    Matrix<T, Capacity> m(height, width);
+    Reference ref(height, width);
+    for (int i = 0; i < height; ++i) {
+        if (reinterpret_cast<uintptr_t>(m[i]) % Matrix<T, Capacity>::row_align != 0) {
+            std::cout << "Fail: row " << i << " is not aligned\n";
+            return 1;
+        }
+        for (int j = 0; j < width; ++j) {
+            T v = (T)(rng() % 11) - 5;
+            m[i][j] = v;
+            ref.at(i, j) = v;
+        }
+    }
+    for (int iter = 0; iter < 200; ++iter) {
+        int op = rng() % 8;
+        bool by_row = op % 2 == 0;
+        int n = by_row ? height : width;
+        int a = rng() % n;
+        int b = rng() % n;
+        T f = (T)(rng() % 5) - 2;
+        if (op < 2) {
+            if (by_row) {
+                m.swap_row(a, b);
+                for (int l = 0; l < width; ++l) {
+                    std::swap(ref.at(a, l), ref.at(b, l));
+                }
+            } else {
+                m.swap_col(a, b);
+                for (int l = 0; l < height; ++l) {
+                    std::swap(ref.at(l, a), ref.at(l, b));
+                }
+            }
+        } else if (op < 4) {
+            if (by_row) {
+                m.add_row(a, b, f);
+                for (int l = 0; l < width; ++l) {
+                    ref.at(b, l) += ref.at(a, l) * f;
+                }
+            } else {
+                m.add_col(a, b, f);
+                for (int l = 0; l < height; ++l) {
+                    ref.at(l, b) += ref.at(l, a) * f;
+                }
+            }
+        } else if (op < 6) {
+            // keep values small, only scale by -1
+            if (by_row) {
+                m.scale_row(a, -1);
+                for (int l = 0; l < width; ++l) {
+                    ref.at(a, l) = -ref.at(a, l);
+                }
+            } else {
+                m.scale_col(a, -1);
+                for (int l = 0; l < height; ++l) {
+                    ref.at(l, a) = -ref.at(l, a);
+                }
+            }
+        } else if (a != b) {
+            // [[2, 1], [1, 1]] is unimodular
+            if (by_row) {
+                m.row_transform(a, b, 2, 1, 1, 1);
+                for (int l = 0; l < width; ++l) {
+                    int64_t x = ref.at(a, l);
+                    int64_t y = ref.at(b, l);
+                    ref.at(a, l) = 2 * x + y;
+                    ref.at(b, l) = x + y;
+                }
+            } else {
+                m.col_transform(a, b, 2, 1, 1, 1);
+                for (int l = 0; l < height; ++l) {
+                    int64_t x = ref.at(l, a);
+                    int64_t y = ref.at(l, b);
+                    ref.at(l, a) = 2 * x + y;
+                    ref.at(l, b) = x + y;
+                }
+            }
+        }
+        if (!same(m, ref)) {
+            std::cout << "Fail: op " << op << " on " << height << "x" << width << "\n";
+            return 1;
+        }
+        // shrink values back to keep clear of overflow
+        if (iter % 16 == 15) {
+            for (int i = 0; i < height; ++i) {
+                for (int j = 0; j < width; ++j) {
+                    m[i][j] = (T)(ref.at(i, j) % 7);
+                    ref.at(i, j) = ref.at(i, j) % 7;
+                }
+            }
+        }
+    }
+
+    // copies are deep
+    Matrix<T, Capacity> copy = m;
+    copy[0][0] += 1;
+    if (!same(m, ref) || copy[0][0] == m[0][0]) {
+        std::cout << "Fail: copy is not deep\n";
+        return 1;
+    }
+    copy = m;
+    if (!same(copy, ref)) {
+        std::cout << "Fail: copy assignment\n";
+        return 1;
+    }
+    // moves keep the contents and leave an empty matrix
+    const T *data = m[0];
+    Matrix<T, Capacity> moved = std::move(m);
+    if (!same(moved, ref) || m.height() != 0 || m.width() != 0) {
+        std::cout << "Fail: move\n";
+        return 1;
+    }
+    bool inline_storage = (size_t)height * moved.stride() <= (size_t)Capacity;
+    if (!inline_storage && moved[0] != data) {
+        std::cout << "Fail: move copies the heap buffer\n";
+        return 1;
+    }
+    m = std::move(moved);
+    if (!same(m, ref)) {
+        std::cout << "Fail: move assignment\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+int main() {
+    std::mt19937 rng(2020);
+    int ret = 0;
+    for (int iter = 0; iter < 50; ++iter) {
+        int height = 1 + rng() % 12;
+        int width = 1 + rng() % 12;
+        // both inline and heap storage
+        ret |= check_ops<int, 64>(rng, height, width);
+        ret |= check_ops<int64_t, 64>(rng, height, width);
+        ret |= check_ops<int64_t, 16 * 16>(rng, height, width);
+    }
+    // resize grows the heap buffer and clears the contents
+    Matrix<int> m(2, 2);
+    m[1][1] = 3;
+    m.resize(40, 40);
+    m[39][39] = 1;
+    m.resize(3, 3);
+    if (m[1][1] != 0 || m.height() != 3) {
+        std::cout << "Fail: resize\n";
+        ret = 1;
+    }
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
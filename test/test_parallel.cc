@@ -0,0 +1,186 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "schedule.h"
+#include "parallel.h"
+#include "pass_manager.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Boost::Pass::Schedule;
+using Boost::Pass::PassManager;
+using Boost::Pass::Pipeline;
+using Bench::check;
+
+
+std::string print(const Stmt &stmt, const std::string &schedule = "") {
+    Boost::codegen::CodeGen_C gen;
+    gen.omp_schedule = schedule;
+    return gen.print(Kernel::make("kernel", {}, {}, {stmt}, KernelType::CPU));
+}
+
+
+/**
+ * C<M, N>[i, j] = C[i, j] + A<M, K>[i, k] * B<K, N>[k, j]
+ */
+struct Gemm {
+    Expr i, j, k, A, B, C;
+    Operation op;
+
+    Gemm(int M, int N, int K) {
+        Type index_type = Type::int_scalar(32);
+        Type data_type = Type::float_scalar(32);
+        i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+        j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+        k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Reduce);
+        A = Var::make(data_type, "A", {i, k}, {(uint64_t)M, (uint64_t)K});
+        B = Var::make(data_type, "B", {k, j}, {(uint64_t)K, (uint64_t)N});
+        C = Var::make(data_type, "C", {i, j}, {(uint64_t)M, (uint64_t)N});
+        Stmt move = Move::make(C, Binary::make(data_type, BinaryOpType::Add, C,
+            Binary::make(data_type, BinaryOpType::Mul, A, B)), MoveType::MemToMem);
+        op = ComputeOp::make({i, j, k}, {move});
+    }
+};
+
+
+/**
+ * which loops get pragmas
+ */
+int test_legality() {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Gemm gemm(64, 64, 64);
+    int ret = 0;
+
+    std::string str = print(Boost::Pass::parallelize(gemm.op.operation_stmt(), 3));
+    std::cout << str;
+    ret |= check(str.find("#pragma omp parallel for collapse(2)\n  for (int32_t i") != std::string::npos,
+        "expect i and j collapsed");
+
+    // the reduce index goes first
+    Schedule reordered(gemm.op);
+    reordered.reorder({gemm.k, gemm.i});
+    str = print(Boost::Pass::parallelize(reordered.lower()));
+    ret |= check(str.find("#pragma") == std::string::npos, "reduce loop run in parallel\n" + str);
+
+    // a split index, with a schedule clause
+    Schedule split(gemm.op);
+    Expr io, ii;
+    split.split(gemm.i, 6, io, ii);
+    split.parallel(io);
+    str = print(split.lower(), "dynamic, 4");
+    std::cout << str;
+    ret |= check(str.find("#pragma omp parallel for schedule(dynamic, 4)\n  for (int32_t i_outer") != std::string::npos,
+        "expect i_outer in parallel");
+    ret |= check(str.find("#pragma") == str.rfind("#pragma"), "expect one pragma");
+
+    // Y[0] = Y[0] + A[i]; Y[i] = Y[i - 1] + A[i]; Y[2 * i + j] = A[i], j in [0, 3)
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 1, 15), IndexType::Thread);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, 3), IndexType::Spatial);
+    Expr A = Var::make(data_type, "A", {i}, {16});
+    Expr Y0 = Var::make(data_type, "Y", {Expr(0)}, {48});
+    Expr Yi = Var::make(data_type, "Y", {i}, {48});
+    Expr Yp = Var::make(data_type, "Y", {Binary::make(index_type, BinaryOpType::Sub, i, Expr(1))}, {48});
+    Expr Yij = Var::make(data_type, "Y", {Binary::make(index_type, BinaryOpType::Add,
+        Binary::make(index_type, BinaryOpType::Mul, i, Expr(2)), j)}, {48});
+    auto add = [&](Expr a, Expr b) { return Binary::make(data_type, BinaryOpType::Add, a, b); };
+    std::vector<Stmt> illegal = {
+        LoopNest::make({i}, {Move::make(Y0, add(Y0, A), MoveType::MemToMem)}),
+        LoopNest::make({i}, {Move::make(Yi, add(Yp, A), MoveType::MemToMem)}),
+        LoopNest::make({i, j}, {Move::make(Yij, A, MoveType::MemToMem)})
+    };
+    for (auto &stmt : illegal) {
+        str = print(stmt);
+        ret |= check(str.find("#pragma") == std::string::npos, "illegal loop run in parallel\n" + str);
+    }
+    Expr Y3ij = Var::make(data_type, "Y", {Binary::make(index_type, BinaryOpType::Add,
+        Binary::make(index_type, BinaryOpType::Mul, i, Expr(3)), j)}, {48});
+    str = print(LoopNest::make({i, j}, {Move::make(Y3ij, A, MoveType::MemToMem)}));
+    ret |= check(str.find("#pragma omp parallel for\n") != std::string::npos, "Y[3 * i + j] not in parallel\n" + str);
+    return ret;
+}
+
+
+/**
+ * scheduled parallel loops keep their pragma through the presets, which
+ * bind the index arithmetic of the args in lets
+ */
+int test_presets() {
+    Gemm gemm(64, 64, 64);
+    Schedule plain(gemm.op);
+    plain.parallel(gemm.i);
+    Schedule tiled(gemm.op);
+    Expr io, jo, ii, ji;
+    tiled.tile(gemm.i, gemm.j, 16, 16, io, jo, ii, ji);
+    tiled.parallel(io);
+    int ret = 0;
+    for (int level = 2; level <= 3; ++level) {
+        for (auto &stmt : {plain.lower(), tiled.lower()}) {
+            PassManager manager;
+            std::string str = print(manager.run(Pipeline::preset(level), stmt));
+            ret |= check(str.find("#pragma omp parallel for\n") != std::string::npos,
+                "expect a parallel loop at -O" + std::to_string(level) + "\n" + str);
+        }
+    }
+
+    PassManager manager;
+    std::string str = print(manager.run(Pipeline::preset(3).then("parallelize"), gemm.op.operation_stmt()));
+    std::cout << str;
+    ret |= check(str.find("#pragma omp parallel for\n  for (int32_t i") != std::string::npos,
+        "expect i in parallel after -O3\n" + str);
+    return ret;
+}
+
+
+/**
+ * the tiled gemm over all threads against one thread
+ */
+int test_gemm() {
+    const int M = 512, N = 512, K = 512;
+    Gemm gemm(M, N, K);
+    Schedule s(gemm.op);
+    Expr io, jo, ii, ji, ko, ki;
+    s.tile(gemm.i, gemm.j, 16, 128, io, jo, ii, ji);
+    s.split(gemm.k, 128, ko, ki);
+    s.reorder({io, jo, ko, ii, ki, ji});
+    Stmt serial = s.lower();
+    Stmt parallel = Boost::Pass::parallelize(serial);
+
+    Boost::codegen::CodeGen_C gen;
+    std::ostringstream oss;
+    oss << "#include <omp.h>\n" << Bench::driver_prelude()
+        << gen.print(Kernel::make("serial", {gemm.A, gemm.B}, {gemm.C}, {serial}, KernelType::CPU)) << "\n"
+        << gen.print(Kernel::make("parallel", {gemm.A, gemm.B}, {gemm.C}, {parallel}, KernelType::CPU)) << "\n";
+    oss << Bench::declare(gemm.A) << Bench::declare(gemm.B)
+        << Bench::declare(gemm.C, "serial_out") << Bench::declare(gemm.C, "parallel_out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)A, sizeof(A) / sizeof(float), 1);\n"
+        << "    fill((float*)B, sizeof(B) / sizeof(float), 2);\n"
+        << "    double t0 = timeit([]() { serial(A, B, serial_out); }, 3);\n"
+        << "    double t1 = timeit([]() { parallel(A, B, parallel_out); }, 3);\n"
+        << "    float err = max_diff((float*)serial_out, (float*)parallel_out, " << M * N << ");\n"
+        << "    printf(\"gemm 512: 1 thread %.3f ms, %d threads %.3f ms (err %g), speedup %.2fx\\n\",\n"
+        << "           t0, omp_get_max_threads(), t1, err, t0 / t1);\n"
+        << "    return err < 1e-2 ? 0 : 1;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_parallel_gemm", oss.str(), "-O2 -fopenmp");
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_legality();
+    ret |= test_presets();
+    ret |= test_gemm();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "autodiff.h"
+#include "pass_manager.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Boost::Pass::Pipeline;
+using Boost::Pass::PassManager;
+using Bench::check;
+
+
+int test_parse() {
+    Pipeline pipeline;
+    int ret = check(Pipeline::parse("-O2", pipeline) && pipeline.steps.size() == 3, "-O2 not parsed");
+    ret |= check(Pipeline::parse("-Ofast", pipeline) && pipeline.steps[0].passes.size() == 2
+        && pipeline.steps[0].passes[1] == "egraph", "-Ofast not parsed");
+    for (auto &step : Pipeline::preset(3).steps) {
+        for (auto &pass : step.passes) {
+            ret |= check(pass != "egraph", "-O3 runs egraph");
+        }
+    }
+    ret |= check(Pipeline::parse("simplify_bounds, [egraph, simplify], cse", pipeline)
+        && pipeline.steps.size() == 3 && pipeline.steps[1].passes.size() == 2
+        && pipeline.steps[1].max_iterations > 1 && pipeline.steps[2].passes[0] == "cse",
+        "pipeline with a fixpoint step not parsed");
+    for (auto spec : {"-O7", "-Ofaster", "simplify,,cse", "[simplify, cse", "simplify cse", "cse,"}) {
+        ret |= check(!Pipeline::parse(spec, pipeline), std::string("bad pipeline parsed: ") + spec);
+    }
+    return ret;
+}
+
+
+/**
+ * a fixpoint step stops at the first iteration leaving the IR unchanged
+ */
+int test_fixpoint() {
+    PassManager manager;
+    manager.add_expr_pass("halve", [](const Expr &e) {
+        Ref<const IntImm> as_int = e.as<IntImm>();
+        return as_int.defined() ? Expr(as_int->value() / 2) : e;
+    });
+    Expr result = manager.run(Pipeline().fixpoint({"halve"}, 8), Expr(5));
+    // 5 -> 2 -> 1 -> 0 -> 0
+    int ret = check(result.as<IntImm>()->value() == 0 && manager.stats()[0].runs == 4,
+        "fixpoint not reached in 4 runs");
+    manager.reset_stats();
+    result = manager.run(Pipeline().fixpoint({"halve"}, 2), Expr(5));
+    return ret | check(result.as<IntImm>()->value() == 1 && manager.stats()[0].runs == 2,
+        "max_iterations not respected");
+}
+
+
+/**
+ * the presets over the stride 2 conv2d backward to the input, the
+ * kernels of all levels and -Ofast compute the same gradient
+ */
+int test_presets() {
+    Bench::Conv2d conv("I", "W", "dO", 4, 16, 16, 14, 14, 3, 3, 2);
+    Stmt stmt = conv.grad();
+
+    PassManager manager;
+    Bench::Benchmark bench("conv2d grad", {conv.output, conv.weight}, Bench::Conv2d::grad_dst(stmt));
+    for (int level = 0; level <= 3; ++level) {
+        bench.add("-O" + std::to_string(level), manager.run(Pipeline::preset(level), stmt));
+    }
+    bench.add("-Ofast", manager.run(Pipeline::preset_fast(), stmt));
+    manager.write_json(std::cout);
+
+    int ret = 0;
+    for (auto name : {"simplify", "simplify_bounds", "egraph", "cse", "licm", "strength_reduce"}) {
+        bool found = false;
+        for (auto &stats : manager.stats()) {
+            found = found || (stats.name == name && stats.runs > 0 && stats.nodes_before > 0);
+        }
+        ret |= check(found, std::string("no statistics of ") + name);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    return bench.run("test_pass_manager_conv2d", 10, 1e-4);
+}
+
+int main() {
+    int ret = 0;
+    ret |= test_parse();
+    ret |= test_fixpoint();
+    ret |= test_presets();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <string>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "arith.h"
+
+using namespace Boost::Internal;
+using namespace Boost::Arith;
+
+
+/**
+ * the range of name inferred from expr in [left, right) is [lo, hi)
+ */
+int check(const Expr &expr, int left, int right, const std::string &name, int lo, int hi) {
+    RangeInference infer(ExtRange(left, right, false, false));
+    infer.do_infer(expr);
+    if (infer.range_map.count(name) == 0) {
+        std::cout << "Fail! no range for " << name << " in " << expr << "\n";
+        return 1;
+    }
+    const ExtRange &range = infer.range_map[name];
+    if (range.range_type() != ExtRangeType::LCRC || !range.left.is_int() || !range.right.is_int() ||
+        range.left.value() != lo || range.right.value() != hi) {
+        std::cout << "Fail! expect " << name << " in [" << lo << ", " << hi << ") from " << expr
+                  << ", got [" << range.left << ", " << range.right << ")\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+int main() {
+    Type index_type = Type::int_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 1, 4), IndexType::Spatial);
+    Expr n = Index::make(index_type, "n", Dom::make(index_type, Expr(0), Expr(-1)), IndexType::Unknown);
+    auto make = [&](BinaryOpType op, Expr a, Expr b) {
+        return Binary::make(index_type, op, a, b);
+    };
+
+    int ret = 0;
+    // affine in one index: 3 * n - 2 in [0, 10) => n in [1, 4)
+    ret |= check(make(BinaryOpType::Sub, make(BinaryOpType::Mul, Expr(3), n), Expr(2)), 0, 10, "n", 1, 4);
+    // 5 - n in [0, 10) => n in [-4, 6)
+    ret |= check(make(BinaryOpType::Sub, Expr(5), n), 0, 10, "n", -4, 6);
+    // n + j in [0, 10), j in [1, 4] => n in [-4, 9)
+    ret |= check(make(BinaryOpType::Add, n, j), 0, 10, "n", -4, 9);
+    // n - j in [0, 10) => n in [1, 14)
+    ret |= check(make(BinaryOpType::Sub, n, j), 0, 10, "n", 1, 14);
+    // n * j in [0, 10) => n in [0, 10)
+    ret |= check(make(BinaryOpType::Mul, n, j), 0, 10, "n", 0, 10);
+    // n * j in [8, 10) => n in [2, 10)
+    ret |= check(make(BinaryOpType::Mul, n, j), 8, 10, "n", 2, 10);
+    // n // 4 in [1, 3) => n in [4, 12)
+    ret |= check(make(BinaryOpType::FloorDiv, n, Expr(4)), 1, 3, "n", 4, 12);
+    // n // j in [0, 2) => n in [0, 8)
+    ret |= check(make(BinaryOpType::FloorDiv, n, j), 0, 2, "n", 0, 8);
+    // nested: (n + i % 4) * 2 in [0, 20) => n + i % 4 in [0, 10), i % 4 in [0, 3] => n in [-3, 10)
+    ret |= check(make(BinaryOpType::Mul,
+        make(BinaryOpType::Add, n, make(BinaryOpType::FloorMod, i, Expr(4))), Expr(2)), 0, 20, "n", -3, 10);
+    // j % 8 is j itself => j in [2, 4)
+    ret |= check(make(BinaryOpType::FloorMod, j, Expr(8)), 2, 4, "j", 2, 4);
+    // every occurrence bounds the index, n * 0 does not widen n // 2 in [0, 3)
+    ret |= check(make(BinaryOpType::Add, make(BinaryOpType::FloorDiv, n, Expr(2)), make(BinaryOpType::Mul, n, Expr(0))),
+        0, 3, "n", 0, 6);
+
+    // symbolic ranges still pass through constant operands
+    Expr m = Index::make(index_type, "m", Dom::make(index_type, 0, 8), IndexType::Spatial);
+    RangeInference infer(ExtRange(0, m, false, false));
+    infer.do_infer(make(BinaryOpType::Add, n, Expr(1)));
+    if (infer.range_map["n"].range_type() != ExtRangeType::LCRC || !infer.range_map["n"].left.is_int() ||
+        infer.range_map["n"].left.value() != -1 || infer.range_map["n"].right.is_int()) {
+        std::cout << "Fail! wrong symbolic range [" << infer.range_map["n"].left << ", "
+                  << infer.range_map["n"].right << ")\n";
+        ret = 1;
+    }
+
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
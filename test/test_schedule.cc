@@ -0,0 +1,208 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <functional>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "schedule.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Boost::Pass::Schedule;
+using Bench::check;
+
+
+std::string names(const std::vector<Expr> &loops) {
+    std::string ret;
+    for (auto &loop : loops) {
+        ret += (ret == "" ? "" : " ") + loop.as<Index>()->name;
+    }
+    return ret;
+}
+
+
+/**
+ * C<M, N>[i, j] = C[i, j] + A<M, K>[i, k] * B<K, N>[k, j]
+ */
+struct Gemm {
+    Expr i, j, k, A, B, C;
+    Operation op;
+
+    Gemm(int M, int N, int K) {
+        Type index_type = Type::int_scalar(32);
+        Type data_type = Type::float_scalar(32);
+        i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+        j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+        k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Reduce);
+        A = Var::make(data_type, "A", {i, k}, {(uint64_t)M, (uint64_t)K});
+        B = Var::make(data_type, "B", {k, j}, {(uint64_t)K, (uint64_t)N});
+        C = Var::make(data_type, "C", {i, j}, {(uint64_t)M, (uint64_t)N});
+        Stmt move = Move::make(C, Binary::make(data_type, BinaryOpType::Add, C,
+            Binary::make(data_type, BinaryOpType::Mul, A, B)), MoveType::MemToMem);
+        op = ComputeOp::make({i, j, k}, {move});
+    }
+
+    std::string print(const std::string &name, const Stmt &stmt) const {
+        Boost::codegen::CodeGen_C gen;
+        return gen.print(Kernel::make(name, {A, B}, {C}, {stmt}, KernelType::CPU));
+    }
+};
+
+
+/**
+ * loops after each primitive, and the tail of a split lowered to a
+ * bounded inner loop or a guard
+ */
+int test_primitives() {
+    Gemm gemm(30, 64, 16);
+    Schedule s(gemm.op);
+    Expr io, ii, jo, ji, ko, ki, fused;
+    s.split(gemm.i, 8, io, ii);
+    int ret = check(names(s.loops()) == "i_outer i_inner j k", "split: " + names(s.loops()));
+    s.reorder({gemm.k, io});
+    ret |= check(names(s.loops()) == "k i_inner j i_outer", "reorder: " + names(s.loops()));
+    s.reorder({io, gemm.k});
+    s.fuse(ii, gemm.j, fused);
+    ret |= check(names(s.loops()) == "i_outer i_inner_j_fused k", "fuse: " + names(s.loops()));
+    std::string str = gemm.print("fused", s.lower());
+    std::cout << str;
+    ret |= check(str.find("if (((i_outer * 8) + (i_inner_j_fused / 64)) < 30)") != std::string::npos,
+        "expect a guard of the fused tail");
+
+    Schedule tiled(gemm.op);
+    tiled.tile(gemm.i, gemm.j, 8, 16, io, jo, ii, ji);
+    ret |= check(names(tiled.loops()) == "i_outer j_outer i_inner j_inner k", "tile: " + names(tiled.loops()));
+    str = gemm.print("tiled", tiled.lower());
+    std::cout << str;
+    ret |= check(str.find("if (") == std::string::npos, "expect a bounded loop instead of a guard");
+    ret |= check(str.find("i_inner < (((i_outer * 8) + 8) <= 30 ? 8 : (30 - (i_outer * 8)))") != std::string::npos, "expect the tail bound of i_inner");
+    return ret;
+}
+
+
+/**
+ * all schedules compute the same gemm, sizes are not multiples of the
+ * factors
+ */
+int test_tails() {
+    const int M = 37, N = 45, K = 29;
+    Gemm gemm(M, N, K);
+    Expr io, ii, jo, ji, ko, ki, fused, fo, fi;
+    std::vector<std::function<Stmt()>> schedules = {
+        [&]() { return Schedule(gemm.op).lower(); },
+        [&]() { Schedule s(gemm.op); s.split(gemm.i, 8, io, ii); return s.lower(); },
+        [&]() { Schedule s(gemm.op); s.tile(gemm.i, gemm.j, 8, 16, io, jo, ii, ji); return s.lower(); },
+        [&]() {
+            // the inner loops run outside the outer ones, guards only
+            Schedule s(gemm.op);
+            s.tile(gemm.i, gemm.j, 4, 7, io, jo, ii, ji);
+            s.reorder({ji, ii, jo, io});
+            return s.lower();
+        },
+        [&]() {
+            Schedule s(gemm.op);
+            s.fuse(gemm.i, gemm.j, fused);
+            s.split(fused, 64, fo, fi);
+            s.split(gemm.k, 8, ko, ki);
+            s.reorder({ko, fo, ki, fi});
+            return s.lower();
+        },
+        [&]() {
+            // splits of a split
+            Schedule s(gemm.op);
+            s.split(gemm.j, 10, jo, ji);
+            s.split(ji, 3, fo, fi);
+            s.reorder({fi, gemm.i});
+            return s.lower();
+        },
+        [&]() {
+            // from the lowered LoopNest of another schedule
+            Schedule s(gemm.op);
+            s.split(gemm.k, 5, ko, ki);
+            Schedule t(s.lower());
+            t.reorder({gemm.j, ko, gemm.i});
+            return t.lower();
+        }
+    };
+    std::ostringstream oss;
+    oss << Bench::driver_prelude();
+    for (size_t n = 0; n < schedules.size(); ++n) {
+        oss << gemm.print("gemm" + std::to_string(n), schedules[n]()) << "\n";
+    }
+    oss << Bench::declare(gemm.A) << Bench::declare(gemm.B) << Bench::declare(gemm.C, "expect")
+        << Bench::declare(gemm.C, "out") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)A, sizeof(A) / sizeof(float), 1);\n"
+        << "    fill((float*)B, sizeof(B) / sizeof(float), 2);\n"
+        << "    gemm0(A, B, expect);\n"
+        << "    int ret = 0;\n";
+    for (size_t n = 1; n < schedules.size(); ++n) {
+        oss << "    for (int i = 0; i < " << M * N << "; ++i) ((float*)out)[i] = 0;\n"
+            << "    gemm" << n << "(A, B, out);\n"
+            << "    if (max_diff((float*)expect, (float*)out, " << M * N << ") > 1e-4) {\n"
+            << "        printf(\"schedule " << n << " differs\\n\");\n"
+            << "        ret = 1;\n"
+            << "    }\n";
+    }
+    oss << "    return ret;\n"
+        << "}\n";
+    return Bench::compile_and_run("test_schedule_tails", oss.str());
+}
+
+
+/**
+ * gemm tiled for the cache against the index_list order
+ */
+int test_gemm() {
+    const int M = 512, N = 512, K = 512;
+    Gemm gemm(M, N, K);
+    Schedule s(gemm.op);
+    Expr io, jo, ii, ji, ko, ki;
+    s.tile(gemm.i, gemm.j, 16, 128, io, jo, ii, ji);
+    s.split(gemm.k, 128, ko, ki);
+    s.reorder({io, jo, ko, ii, ki, ji});
+
+    Bench::Benchmark bench("gemm 512", {gemm.A, gemm.B}, gemm.C);
+    bench.add("plain", Schedule(gemm.op).lower());
+    bench.add("tiled", s.lower());
+    return bench.run("test_schedule_gemm", 3, 1e-2);
+}
+
+
+/**
+ * Y<1, 64, 56, 56>[n, k, p, q] = Y[n, k, p, q] + X<1, 64, 58, 58>[n, c, p + r, q + s] * W<64, 64, 3, 3>[k, c, r, s]
+ * the tiled schedule only has to compute the same output, it is not faster on every host
+ */
+int test_conv2d() {
+    Bench::Conv2d conv("X", "W", "Y", 1, 64, 64, 56, 56, 3, 3);
+    Operation op = ComputeOp::make(conv.loops(), {conv.update()});
+
+    Schedule sched(op);
+    Expr ko, ki, po, pi;
+    sched.split(conv.k, 16, ko, ki);
+    sched.split(conv.p, 8, po, pi);
+    sched.reorder({conv.n, ko, po, conv.c, conv.r, conv.s, ki, pi, conv.q});
+
+    Bench::Benchmark bench("conv2d 64x56x56", {conv.input, conv.weight}, conv.output);
+    bench.add("plain", Schedule(op).lower());
+    bench.add("tiled", sched.lower());
+    return bench.run("test_schedule_conv2d", 0, 1e-2);
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_primitives();
+    ret |= test_tails();
+    ret |= test_gemm();
+    ret |= test_conv2d();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
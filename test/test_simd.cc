@@ -0,0 +1,202 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "type.h"
+#include "schedule.h"
+#include "vectorize.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Boost::Pass::Schedule;
+using Boost::codegen::CodeGen_C;
+using Boost::codegen::VectorBackend;
+using Boost::codegen::VectorISA;
+using Bench::check;
+
+
+/**
+ * C<M, N>[i, j] = C[i, j] + A<M, K>[i, k] * B<K, N>[k, j] in the order
+ * i, k, j, and Y<1>[0] = Y[0] + A[0, k] * A[1, k], a reduction
+ * - N and K leave epilogues for all the lanes used
+ */
+struct Kernels {
+    const int M = 96, N = 200, K = 300;
+    Expr A, B, C, Y;
+    Stmt gemm, gemv;
+
+    Kernels() {
+        Type index_type = Type::int_scalar(32);
+        Type data_type = Type::float_scalar(32);
+        Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+        Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+        Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Reduce);
+        A = Var::make(data_type, "A", {i, k}, {(uint64_t)M, (uint64_t)K});
+        B = Var::make(data_type, "B", {k, j}, {(uint64_t)K, (uint64_t)N});
+        C = Var::make(data_type, "C", {i, j}, {(uint64_t)M, (uint64_t)N});
+        auto mul_add = [&](Expr acc, Expr a, Expr b) {
+            return Binary::make(data_type, BinaryOpType::Add, acc, Binary::make(data_type, BinaryOpType::Mul, a, b));
+        };
+        Schedule s(ComputeOp::make({i, j, k}, {Move::make(C, mul_add(C, A, B), MoveType::MemToMem)}));
+        s.reorder({i, k, j});
+        s.vectorize(j);
+        gemm = s.lower();
+
+        Y = Var::make(data_type, "Y", {Expr(0)}, {1});
+        Expr row = Var::make(data_type, "A", {Expr(0), k}, {(uint64_t)M, (uint64_t)K});
+        Expr col = Var::make(data_type, "A", {Expr(1), k}, {(uint64_t)M, (uint64_t)K});
+        gemv = LoopNest::make({k}, {Move::make(Y, mul_add(Y, row, col), MoveType::MemToMem)});
+    }
+
+    Group kernel(const std::string &name, int lanes) const {
+        Stmt body = gemm, sum = gemv;
+        if (lanes > 1) {
+            body = Boost::Pass::vectorize(gemm, lanes, false);
+            sum = Boost::Pass::vectorize(gemv, lanes);
+        }
+        return Kernel::make(name, {A, B}, {C, Y}, {body, sum}, KernelType::CPU);
+    }
+};
+
+
+/**
+ * Y[j] = select(A[j] > 0, A[j], 0) + (A[j] < B[j]), compares, selects and
+ * casts of GCC vectors
+ */
+Group relu_kernel(int lanes) {
+    const int N = 1003;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr A = Var::make(data_type, "A", {j}, {N});
+    Expr B = Var::make(data_type, "B", {j}, {N});
+    Expr Y = Var::make(data_type, "Y", {j}, {N});
+    Expr zero = FloatImm::make(data_type, 0);
+    Expr relu = Select::make(data_type, Compare::make(Type::bool_scalar(), CompareOpType::GT, A, zero), A, zero);
+    Expr less = Cast::make(data_type, data_type, Compare::make(Type::bool_scalar(), CompareOpType::LT, A, B));
+    Stmt stmt = LoopNest::make({j}, {Move::make(Y, Binary::make(data_type, BinaryOpType::Add, relu, less),
+        MoveType::MemToMem)});
+    if (lanes > 1) {
+        stmt = Boost::Pass::vectorize(stmt, lanes);
+    }
+    return Kernel::make(lanes > 1 ? "relu_vec" : "relu", {A, B}, {Y}, {stmt}, KernelType::CPU);
+}
+
+
+std::string driver(const Kernels &k, const std::string &kernels, const std::string &fast) {
+    std::ostringstream oss;
+    oss << Bench::driver_prelude() << kernels << "\n";
+    oss << Bench::declare(k.A) << Bench::declare(k.B)
+        << Bench::declare(k.C, "C0") << Bench::declare(k.C, "C1")
+        << Bench::declare(k.Y, "Y0") << Bench::declare(k.Y, "Y1") << "\n";
+    oss << "int main() {\n"
+        << "    fill((float*)A, sizeof(A) / sizeof(float), 1);\n"
+        << "    fill((float*)B, sizeof(B) / sizeof(float), 2);\n"
+        << "    double t0 = timeit([]() { scalar(A, B, C0, Y0); }, 20);\n"
+        << "    double t1 = timeit([]() { " << fast << "(A, B, C1, Y1); }, 20);\n"
+        << "    float err = max_diff((float*)C0, (float*)C1, " << k.M * k.N << ");\n"
+        << "    float err_sum = fabsf(Y0[0] - Y1[0]) / (fabsf(Y0[0]) + 1);\n"
+        << "    printf(\"gemm " << k.M << "x" << k.N << "x" << k.K << ", " << fast
+        << ": scalar %.3f ms, simd %.3f ms (err %g, sum err %g), speedup %.2fx\\n\",\n"
+        << "           t0, t1, err, err_sum, t0 / t1);\n"
+        << "    return err < 1e-2 && err_sum < 1e-4 ? 0 : 1;\n"
+        << "}\n";
+    return oss.str();
+}
+
+
+/**
+ * GCC vectors: one kernel for AVX2 by its target attribute, and variants
+ * for AVX-512, AVX2 and SSE behind a CPUID dispatcher falling back to the
+ * baseline ISA the translation unit is compiled for
+ */
+int test_gcc_vector() {
+    Kernels k;
+    CodeGen_C gen;
+    int ret = 0;
+
+    std::string scalar = gen.print(k.kernel("scalar", 1));
+    gen.vector_isa = VectorISA::AVX2;
+    std::string avx2 = gen.print(k.kernel("avx2", Boost::codegen::vector_lanes(VectorISA::AVX2, Type::float_scalar(32))));
+    gen.vector_isa = VectorISA::Native;
+    ret |= check(avx2.find("typedef float float32x8 __attribute__((vector_size(32)));") != std::string::npos
+        && avx2.find("__attribute__((target(\"avx2,fma\"))) void avx2(") != std::string::npos,
+        "expect vector typedefs and the target attribute\n" + avx2);
+    ret |= check(avx2.find("(*(float32x8_u *)&C[i][(j_vec * 8)]) = ") != std::string::npos,
+        "expect vector stores\n" + avx2);
+    ret |= check(avx2.find("_vec[7]; })") != std::string::npos, "expect a reduction\n" + avx2);
+
+    std::vector<std::pair<VectorISA, Group>> variants;
+    for (VectorISA isa : {VectorISA::AVX512, VectorISA::AVX2, VectorISA::SSE}) {
+        variants.push_back({isa, k.kernel("dispatch", Boost::codegen::vector_lanes(isa, Type::float_scalar(32)))});
+    }
+    std::string dispatch = gen.print_dispatch(variants);
+    ret |= check(dispatch.find("void dispatch_avx512(") != std::string::npos
+        && dispatch.find("if (__builtin_cpu_supports(\"avx512f\")) {\n    dispatch_avx512(A, B, C, Y);\n    return;\n")
+        != std::string::npos
+        && dispatch.find("if (__builtin_cpu_supports(\"sse4.2\")) {\n    dispatch_sse(A, B, C, Y);\n    return;\n")
+        != std::string::npos
+        && dispatch.find("  dispatch_native(A, B, C, Y);\n}\n") != std::string::npos,
+        "expect a dispatcher\n" + dispatch);
+    ret |= check(dispatch.find("typedef float float32x16") != std::string::npos
+        && dispatch.find("typedef float float32x4") != std::string::npos,
+        "expect the vector types of all variants\n" + dispatch);
+    if (ret != 0) {
+        return ret;
+    }
+    ret |= Bench::compile_and_run("test_simd_gcc", driver(k, scalar + "\n" + avx2, "avx2"));
+    ret |= Bench::compile_and_run("test_simd_dispatch", driver(k, scalar + "\n" + dispatch, "dispatch"));
+
+    std::string relu = gen.print(relu_kernel(1));
+    std::string relu_vec = gen.print(relu_kernel(8));
+    ret |= check(relu_vec.find("__builtin_convertvector(-(") != std::string::npos,
+        "expect a cast of a mask\n" + relu_vec);
+    std::ostringstream oss;
+    oss << Bench::driver_prelude() << relu << "\n" << relu_vec << "\n"
+        << "static float A[1003], B[1003], Y0[1003], Y1[1003];\n"
+        << "int main() {\n"
+        << "    fill(A, 1003, 1);\n"
+        << "    fill(B, 1003, 2);\n"
+        << "    relu(A, B, Y0);\n"
+        << "    relu_vec(A, B, Y1);\n"
+        << "    return max_diff(Y0, Y1, 1003) == 0 ? 0 : 1;\n"
+        << "}\n";
+    ret |= Bench::compile_and_run("test_simd_relu", oss.str());
+    return ret;
+}
+
+
+/**
+ * Eigen packets, the translation unit compiled for AVX2
+ */
+int test_eigen_packet() {
+    Kernels k;
+    CodeGen_C gen;
+    std::string scalar = gen.print(k.kernel("scalar", 1));
+    gen.vector_backend = VectorBackend::EigenPacket;
+    gen.vector_isa = VectorISA::AVX2;
+    std::string eigen = gen.print(k.kernel("eigen", 8));
+    int ret = check(eigen.find("#if !defined(EIGEN_VECTORIZE_AVX2)") != std::string::npos
+        && eigen.find("Eigen::internal::pstoreu(&C[i][(j_vec * 8)], Eigen::internal::pmadd(") != std::string::npos
+        && eigen.find("Eigen::internal::predux(") != std::string::npos,
+        "expect packet math\n" + eigen);
+    if (ret != 0) {
+        return ret;
+    }
+    return Bench::compile_and_run("test_simd_eigen", driver(k, scalar + "\n" + eigen, "eigen"), "-O2 -mavx2 -mfma");
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_gcc_vector();
+    ret |= test_eigen_packet();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
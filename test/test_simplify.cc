@@ -1,7 +1,272 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "arith.h"
+#include "autodiff.h"
 #include "simplify.h"
 
+using namespace Boost::Internal;
+using namespace Boost::Simplify;
+
+
+int check(const Expr &expr, const std::string &expect, bool bounds = false) {
+    std::ostringstream oss;
+    oss << (bounds ? simplify_bounds(expr) : simplify(expr));
+    std::string got = oss.str();
+    if (got != expect) {
+        std::cout << "Fail! " << expr << " simplifies to " << got << ", expect " << expect << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+struct GradCase {
+    std::string name;
+    Stmt stmt;
+    int budget;
+};
+
+
+/**
+ * gradients of the project1 cases with their budget of arithmetic
+ * operations per inner iteration
+ */
+std::vector<GradCase> project1_grads() {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    auto index = [&](const std::string &name, int extent, IndexType t) {
+        return Index::make(index_type, name, Dom::make(index_type, 0, extent), t);
+    };
+    auto add = [&](Expr a, Expr b) { return Binary::make(index_type, BinaryOpType::Add, a, b); };
+    auto fadd = [&](Expr a, Expr b) { return Binary::make(data_type, BinaryOpType::Add, a, b); };
+    auto fmul = [&](Expr a, Expr b) { return Binary::make(data_type, BinaryOpType::Mul, a, b); };
+    auto grad = [&](const std::string &name, int budget, Expr src, std::vector<Expr> index_list, std::vector<int> out,
+                    Expr grad_to, Expr dout) {
+        return GradCase{name, Boost::Autodiff::grad_loop_nest(src, index_list, out, grad_to.as<Var>(), dout.as<Var>()), budget};
+    };
+    std::vector<GradCase> ret;
+    Expr i, j, k, l;
+    // case3: A<16, 32>[i, j] = B<16, 32>[i, j] + C<16, 32>[i, j]
+    i = index("i", 16, IndexType::Spatial);
+    j = index("j", 32, IndexType::Spatial);
+    {
+        Expr B = Var::make(data_type, "B", {i, j}, {16, 32});
+        Expr C = Var::make(data_type, "C", {i, j}, {16, 32});
+        Expr dA = Var::make(data_type, "dA", {i, j}, {16, 32});
+        ret.push_back(grad("case3 dB", 0, fadd(B, C), {i, j}, {0, 1}, B, dA));
+        ret.push_back(grad("case3 dC", 0, fadd(B, C), {i, j}, {0, 1}, C, dA));
+    }
+    // case4: A<16, 32>[i, j] = A<16, 32>[i, j] + B<16, 32>[i, k] * C<32, 32>[k, j]
+    k = index("k", 32, IndexType::Reduce);
+    {
+        Expr B = Var::make(data_type, "B", {i, k}, {16, 32});
+        Expr C = Var::make(data_type, "C", {k, j}, {32, 32});
+        Expr dA = Var::make(data_type, "dA", {i, j}, {16, 32});
+        ret.push_back(grad("case4 dB", 2, fmul(B, C), {i, j, k}, {0, 1}, B, dA));
+        ret.push_back(grad("case4 dC", 2, fmul(B, C), {i, j, k}, {0, 1}, C, dA));
+    }
+    // case5: A = A + alpha<1> * (B[i, k] * C[k, j]); A = A + beta<1> * D[i, j]
+    {
+        Expr alpha = Var::make(data_type, "alpha", {Expr(0)}, {1});
+        Expr beta = Var::make(data_type, "beta", {Expr(0)}, {1});
+        Expr B = Var::make(data_type, "B", {i, k}, {16, 32});
+        Expr C = Var::make(data_type, "C", {k, j}, {32, 32});
+        Expr D = Var::make(data_type, "D", {i, j}, {16, 32});
+        Expr dA = Var::make(data_type, "dA", {i, j}, {16, 32});
+        Expr src = fmul(alpha, fmul(B, C));
+        ret.push_back(grad("case5 dB", 3, src, {i, j, k}, {0, 1}, B, dA));
+        ret.push_back(grad("case5 dC", 3, src, {i, j, k}, {0, 1}, C, dA));
+        ret.push_back(grad("case5 dD", 1, fmul(beta, D), {i, j}, {0, 1}, D, dA));
+    }
+    // case6: A<2, 8, 5, 5>[n, k, p, q] = A[n, k, p, q] + B<2, 16, 7, 7>[n, c, p + r, q + s] * C<8, 16, 3, 3>[k, c, r, s]
+    {
+        Expr n = index("n", 2, IndexType::Spatial);
+        Expr kk = index("k", 8, IndexType::Spatial);
+        Expr p = index("p", 5, IndexType::Spatial);
+        Expr q = index("q", 5, IndexType::Spatial);
+        Expr c = index("c", 16, IndexType::Reduce);
+        Expr r = index("r", 3, IndexType::Reduce);
+        Expr s = index("s", 3, IndexType::Reduce);
+        Expr B = Var::make(data_type, "B", {n, c, add(p, r), add(q, s)}, {2, 16, 7, 7});
+        Expr C = Var::make(data_type, "C", {kk, c, r, s}, {8, 16, 3, 3});
+        Expr dA = Var::make(data_type, "dA", {n, kk, p, q}, {2, 8, 5, 5});
+        ret.push_back(grad("case6 dB", 4, fmul(B, C), {n, kk, p, q, c, r, s}, {0, 1, 2, 3}, B, dA));
+        ret.push_back(grad("case6 dC", 4, fmul(B, C), {n, kk, p, q, c, r, s}, {0, 1, 2, 3}, C, dA));
+    }
+    // case7: B<16, 32>[i, j] = A<32, 16>[j, i]
+    {
+        Expr A = Var::make(data_type, "A", {j, i}, {32, 16});
+        Expr dB = Var::make(data_type, "dB", {i, j}, {16, 32});
+        ret.push_back(grad("case7 dA", 0, A, {i, j}, {0, 1}, A, dB));
+    }
+    // case8: A<8, 2, 16>[i, j, k] = B<8, 16>[i, k]
+    {
+        Expr i8 = index("i", 8, IndexType::Spatial);
+        Expr j2 = index("j", 2, IndexType::Spatial);
+        Expr k16 = index("k", 16, IndexType::Spatial);
+        Expr B = Var::make(data_type, "B", {i8, k16}, {8, 16});
+        Expr dA = Var::make(data_type, "dA", {i8, j2, k16}, {8, 2, 16});
+        ret.push_back(grad("case8 dB", 1, B, {i8, j2, k16}, {0, 1, 2}, B, dA));
+    }
+    // case9: A<16, 32>[i, j] = A[i, j] + B<16, 32, 8>[i, k, l] * C<32, 32>[k, j] * D<8, 32>[l, j]
+    l = index("l", 8, IndexType::Reduce);
+    {
+        Expr B = Var::make(data_type, "B", {i, k, l}, {16, 32, 8});
+        Expr C = Var::make(data_type, "C", {k, j}, {32, 32});
+        Expr D = Var::make(data_type, "D", {l, j}, {8, 32});
+        Expr dA = Var::make(data_type, "dA", {i, j}, {16, 32});
+        Expr src = fmul(fmul(B, C), D);
+        ret.push_back(grad("case9 dB", 3, src, {i, j, k, l}, {0, 1}, B, dA));
+        ret.push_back(grad("case9 dC", 3, src, {i, j, k, l}, {0, 1}, C, dA));
+        ret.push_back(grad("case9 dD", 3, src, {i, j, k, l}, {0, 1}, D, dA));
+    }
+    // case10: A<8, 8>[i, j] = (B<10, 10>[i, j] + B[i + 1, j] + B[i + 2, j]) / 3
+    {
+        Expr i8 = index("i", 8, IndexType::Spatial);
+        Expr j8 = index("j", 8, IndexType::Spatial);
+        Expr B = Var::make(data_type, "B", {i8, j8}, {10, 10});
+        Expr B1 = Var::make(data_type, "B", {add(i8, Expr(1)), j8}, {10, 10});
+        Expr B2 = Var::make(data_type, "B", {add(i8, Expr(2)), j8}, {10, 10});
+        Expr dA = Var::make(data_type, "dA", {i8, j8}, {8, 8});
+        Expr src = Binary::make(data_type, BinaryOpType::Div, fadd(fadd(B, B1), B2), Expr(3.0f));
+        ret.push_back(grad("case10 dB", 19, src, {i8, j8}, {0, 1}, B, dA));
+    }
+    return ret;
+}
+
 
 int main() {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, 16), IndexType::Spatial);
+    Expr x = Var::make(data_type, "x", {i}, {16});
+    Expr y = Var::make(data_type, "y", {i}, {16});
+    auto make = [&](BinaryOpType op, Expr a, Expr b) {
+        return Binary::make(a.type(), op, a, b);
+    };
+    auto neg = [&](Expr a) {
+        return Unary::make(a.type(), UnaryOpType::Neg, a);
+    };
+    auto less = [&](Expr a, Expr b) {
+        return Compare::make(Type::bool_scalar(), CompareOpType::LT, a, b);
+    };
+
+    int ret = 0;
+    // integer sums: like terms, cancellation, canonical order
+    ret |= check(make(BinaryOpType::Sub, make(BinaryOpType::Add, i, Expr(2)), make(BinaryOpType::Add, i, Expr(1))),
+        "((int32_t <1>) 1)");
+    ret |= check(make(BinaryOpType::Add, make(BinaryOpType::Mul, i, Expr(2)), i),
+        "(i * ((int32_t <1>) 3))");
+    ret |= check(make(BinaryOpType::Add, neg(j), i),
+        "(i - j)");
+    ret |= check(neg(make(BinaryOpType::Add, i, Expr(1))),
+        "(((int32_t <1>) -1) - i)");
+    // (a * b) / b
+    ret |= check(make(BinaryOpType::Div, make(BinaryOpType::Mul, i, j), j),
+        "i");
+    ret |= check(make(BinaryOpType::FloorMod, make(BinaryOpType::Mul, i, Expr(6)), Expr(3)), "((int32_t <1>) 0)");
+    // compares through the difference of the sides
+    ret |= check(less(make(BinaryOpType::Add, i, Expr(1)), make(BinaryOpType::Add, i, Expr(3))), "((bool1_t <1>) 1)");
+    ret |= check(less(make(BinaryOpType::Add, i, j), make(BinaryOpType::Add, j, Expr(4))),
+        "i < ((int32_t <1>) 4)");
+    // select
+    Expr cond = less(i, j);
+    ret |= check(Select::make(data_type, Expr(true), x, y), "x[i]");
+    ret |= check(Select::make(data_type, cond, x, x), "x[i]");
+    ret |= check(Select::make(data_type, Unary::make(Type::bool_scalar(), UnaryOpType::Not, cond), x, y),
+        "select(i >= j, x[i], y[i])");
+    ret |= check(Select::make(data_type, Unary::make(Type::bool_scalar(), UnaryOpType::Not, Call::make(
+        Type::bool_scalar(), {x}, "isnan", CallType::Pure)), x, y), "select(call_pure(isnan, x[i]), y[i], x[i])");
+    // floating point: identities only, x - x and x * 0 may be nan, (x * 3) / 9 rounds differently from x / 3
+    ret |= check(make(BinaryOpType::Sub, x, x), "(x[i] - x[i])");
+    ret |= check(make(BinaryOpType::Mul, x, Expr(0.0f)), "(x[i] * ((float32_t <1>) 0))");
+    ret |= check(make(BinaryOpType::Mul, i, Expr(0)), "((int32_t <1>) 0)");
+    ret |= check(make(BinaryOpType::Add, x, neg(y)), "(x[i] - y[i])");
+    ret |= check(make(BinaryOpType::Div, make(BinaryOpType::Mul, x, Expr(3.0f)), Expr(9.0f)),
+        "((x[i] * ((float32_t <1>) 3)) / ((float32_t <1>) 9))");
+    ret |= check(make(BinaryOpType::Add, x, Expr(-1.0f)), "(x[i] + ((float32_t <1>) -1))");
+    // folded constants keep their type
+    Type long_type = Type::int_scalar(64);
+    Expr folded = simplify(make(BinaryOpType::Add, Boost::Utils::make_const(long_type, 2),
+                                Boost::Utils::make_const(long_type, 3)));
+    if (folded.type() != long_type) {
+        std::cout << "Fail! int64 folds to " << folded.type() << "\n";
+        ret = 1;
+    }
+    // statements: a false guard vanishes
+    Stmt guarded = IfThenElse::make(less(make(BinaryOpType::Add, i, Expr(2)), i),
+        Move::make(x, y, MoveType::MemToMem), Stmt());
+    IRPrinter printer;
+    std::string loop = printer.print(simplify(LoopNest::make({i}, {guarded})));
+    if (loop.find("if") != std::string::npos || loop.find("x[i]") != std::string::npos) {
+        std::cout << "Fail! the false guard is kept\n" << loop;
+        ret = 1;
+    }
+
+    // index ranges from the Doms: i, j in [0, 16)
+    Expr p = Index::make(index_type, "p", Dom::make(index_type, 0, 5), IndexType::Spatial);
+    Expr r = Index::make(index_type, "r", Dom::make(index_type, 0, 3), IndexType::Reduce);
+    ret |= check(make(BinaryOpType::FloorDiv, i, Expr(16)), "((int32_t <1>) 0)", true);
+    ret |= check(make(BinaryOpType::FloorMod, i, Expr(16)), "i", true);
+    ret |= check(make(BinaryOpType::Mod, make(BinaryOpType::Add, i, Expr(32)), Expr(16)), "i", true);
+    ret |= check(make(BinaryOpType::FloorDiv, make(BinaryOpType::Add, i, Expr(32)), Expr(16)), "((int32_t <1>) 2)", true);
+    ret |= check(make(BinaryOpType::FloorDiv, make(BinaryOpType::Add, i, j), Expr(16)),
+        "((i + j) // ((int32_t <1>) 16))", true);
+    ret |= check(make(BinaryOpType::FloorMod, i, Expr(16)), "(i % ((int32_t <1>) 16))");
+    Expr sum = make(BinaryOpType::Add, p, r);
+    ret |= check(Compare::make(Type::bool_scalar(), CompareOpType::LE, Expr(0), sum), "((bool1_t <1>) 1)", true);
+    ret |= check(Compare::make(Type::bool_scalar(), CompareOpType::LT, sum, Expr(7)), "((bool1_t <1>) 1)", true);
+    ret |= check(Compare::make(Type::bool_scalar(), CompareOpType::LT, sum, Expr(6)), "(p + r) < ((int32_t <1>) 6)", true);
+    // max(i // 4, 0) = i // 4, min(i // 4, 3) = i // 4
+    Expr quarter = make(BinaryOpType::FloorDiv, i, Expr(4));
+    ret |= check(Select::make(index_type, Compare::make(Type::bool_scalar(), CompareOpType::GT, quarter, Expr(0)),
+        quarter, Expr(0)), "(i // ((int32_t <1>) 4))", true);
+    ret |= check(Select::make(index_type, Compare::make(Type::bool_scalar(), CompareOpType::LT, quarter, Expr(3)),
+        quarter, Expr(3)), "(i // ((int32_t <1>) 4))", true);
+    // ranges through Doms over outer indices: k in [i, i + 4)
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, i, Expr(4)), IndexType::Reduce);
+    int64_t lo, hi;
+    if (!const_bounds(k, lo, hi) || lo != 0 || hi != 18) {
+        std::cout << "Fail! wrong range of k in [i, i + 4)\n";
+        ret = 1;
+    }
+
+    // Y<4, 16>[a, b] = X<64>[16a + b]: the loop bounds of dX are clamped by
+    // selects the ranges decide
+    {
+        Expr a = Index::make(index_type, "a", Dom::make(index_type, 0, 4), IndexType::Spatial);
+        Expr b = Index::make(index_type, "b", Dom::make(index_type, 0, 16), IndexType::Spatial);
+        Expr X = Var::make(data_type, "X", {make(BinaryOpType::Add, make(BinaryOpType::Mul, a, Expr(16)), b)}, {64});
+        Expr dY = Var::make(data_type, "dY", {a, b}, {4, 16});
+        Stmt grad = Boost::Autodiff::grad_loop_nest(X, {a, b}, {0, 1}, X.as<Var>(), dY.as<Var>());
+        std::string code = printer.print(grad);
+        if (code.find("select") != std::string::npos) {
+            std::cout << "Fail! the clamps are kept\n" << code;
+            ret = 1;
+        }
+    }
+
+    // backward kernels of project1
+    for (auto &grad : project1_grads()) {
+        int ops = inner_loop_ops(grad.stmt);
+        std::cout << grad.name << ": " << ops << " ops per inner iteration\n";
+        if (ops > grad.budget) {
+            std::cout << "Fail! expect at most " << grad.budget << " ops\n";
+            ret = 1;
+        }
+    }
 
-  return 0;
-}
\ No newline at end of file
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <string>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "arith.h"
+#include "autodiff.h"
+#include "session.h"
+
+using namespace Boost::Internal;
+
+
+/**
+ * gradient of C[i, j] = A[i, k] * B[k, j] to A and B
+ */
+Stmt grad_gemm(int M, int N, int K, bool to_A) {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Reduce);
+    Expr expr_A = Var::make(data_type, "A", {i, k}, {(uint64_t)M, (uint64_t)K});
+    Expr expr_B = Var::make(data_type, "B", {k, j}, {(uint64_t)K, (uint64_t)N});
+    Expr expr_dC = Var::make(data_type, "dC", {i, j}, {(uint64_t)M, (uint64_t)N});
+    Expr src = Binary::make(data_type, BinaryOpType::Mul, expr_A, expr_B);
+    Ref<const Var> grad_to = to_A ? expr_A.as<Var>() : expr_B.as<Var>();
+    return Boost::Autodiff::grad_loop_nest(src, {i, j, k}, {0, 1}, grad_to, expr_dC.as<Var>());
+}
+
+
+int main() {
+    Boost::Session &session = Boost::Session::global();
+    session.reset();
+    Boost::Arith::SmithCache &cache = session.smith_cache();
+
+    // the same access pattern in kernels of different shapes
+    IRPrinter printer;
+    std::string first = printer.print(grad_gemm(64, 32, 16, true));
+    if (cache.misses() != 1 || cache.hits() != 0) {
+        std::cout << "Fail! expect one miss for the first kernel.\n";
+        return 1;
+    }
+    grad_gemm(128, 64, 32, true);
+    grad_gemm(1024, 512, 256, true);
+    if (cache.misses() != 1 || cache.hits() != 2) {
+        std::cout << "Fail! expect hits for the same access pattern.\n";
+        return 1;
+    }
+    // B[k, j] has another coefficient matrix
+    grad_gemm(64, 32, 16, false);
+    if (cache.misses() != 2 || cache.size() != 2) {
+        std::cout << "Fail! expect a miss for a new access pattern.\n";
+        return 1;
+    }
+    std::cout << session;
+
+    // cached results give the same loop nest
+    std::string again = printer.print(grad_gemm(64, 32, 16, true));
+    if (again != first) {
+        std::cout << "Fail! cached result gives a different loop nest:\n" << first << "\n" << again << "\n";
+        return 1;
+    }
+
+    // results are the ones of smith_normalize
+    Boost::Arith::SmallMatrix trans(2, 3);
+    trans[0][0] = 2;
+    trans[0][2] = 1;
+    trans[1][1] = 4;
+    const Boost::Arith::SmithNormalForm &snf = cache.get(trans);
+    Boost::Arith::SmallMatrix D = trans;
+    Boost::Arith::SmallMatrix U, V;
+    int rank = Boost::Arith::smith_normalize(D, U, V);
+    if (snf.rank != rank || (int)snf.diagonal.size() != rank) {
+        std::cout << "Fail! wrong rank.\n";
+        return 1;
+    }
+    for (int i = 0; i < rank; ++i) {
+        if (snf.diagonal[i] != D[i][i]) {
+            std::cout << "Fail! wrong diagonal.\n";
+            return 1;
+        }
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
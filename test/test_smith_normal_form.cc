@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "arith.h"
+
+using namespace Boost::Arith;
+
+// U * A * V = D and det(U), det(V) = +-1 are checked modulo a few primes,
+// the exact products do not fit in any machine integer
+const int64_t primes[] = {2147483647, 1000000007, 998244353};
+
+// the unchecked operations of Matrix are not reachable through a SmallMatrix
+static_assert(!std::is_convertible<SmallMatrix *, Matrix<int64_t, 16 * 16> *>::value,
+              "SmallMatrix must not expose its storage");
+
+
+int64_t mod(int64_t x, int64_t p) {
+    int64_t r = x % p;
+    return r < 0 ? r + p : r;
+}
+
+
+int64_t mul_mod(int64_t a, int64_t b, int64_t p) {
+    return (int64_t)((unsigned __int128)a * b % p);
+}
+
+
+int64_t pow_mod(int64_t a, int64_t e, int64_t p) {
+    int64_t r = 1;
+    for (; e > 0; e >>= 1) {
+        if (e & 1) {
+            r = mul_mod(r, a, p);
+        }
+        a = mul_mod(a, a, p);
+    }
+    return r;
+}
+
+
+int64_t det_mod(const SmallMatrix &m, int64_t p) {
+    int n = m.height();
+    int64_t a[SmallMatrix::max_dim][SmallMatrix::max_dim];
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            a[i][j] = mod(m[i][j], p);
+        }
+    }
+    int64_t det = 1;
+    for (int k = 0; k < n; ++k) {
+        int piv = k;
+        while (piv < n && a[piv][k] == 0) {
+            ++piv;
+        }
+        if (piv == n) {
+            return 0;
+        }
+        if (piv != k) {
+            std::swap(a[piv], a[k]);
+            det = p - det;
+        }
+        det = mul_mod(det, a[k][k], p);
+        int64_t inv = pow_mod(a[k][k], p - 2, p);
+        for (int i = k + 1; i < n; ++i) {
+            int64_t f = mul_mod(a[i][k], inv, p);
+            for (int j = k; j < n; ++j) {
+                a[i][j] = mod(a[i][j] - mul_mod(f, a[k][j], p), p);
+            }
+        }
+    }
+    return det;
+}
+
+
+/**
+ * check U * A * V = D, D in smith normal form and U, V unimodular
+ * return the failure reason, or nullptr
+ */
+const char *check_snf(const SmallMatrix &A, const SmallMatrix &D,
+    const SmallMatrix &U, const SmallMatrix &V, int dim) {
+    int rows = A.height();
+    int cols = A.width();
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            if (i != j && D[i][j] != 0) {
+                return "D is not diagonal";
+            }
+        }
+    }
+    for (int i = 0; i < rows && i < cols; ++i) {
+        if ((i < dim) != (D[i][i] > 0)) {
+            return "wrong rank or non-positive diagonal";
+        }
+        if (i + 1 < dim && D[i + 1][i + 1] % D[i][i] != 0) {
+            return "diagonal does not divide";
+        }
+    }
+    for (int64_t p : primes) {
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                int64_t sum = 0;
+                for (int k = 0; k < rows; ++k) {
+                    int64_t ua = 0;
+                    for (int l = 0; l < cols; ++l) {
+                        ua = (ua + mul_mod(mod(A[k][l], p), mod(V[l][j], p), p)) % p;
+                    }
+                    sum = (sum + mul_mod(mod(U[i][k], p), ua, p)) % p;
+                }
+                if (sum != mod(D[i][j], p)) {
+                    return "U * A * V != D";
+                }
+            }
+        }
+        for (const SmallMatrix *m : {&U, &V}) {
+            int64_t det = det_mod(*m, p);
+            if (det != 1 && det != p - 1) {
+                return "transform is not unimodular";
+            }
+        }
+    }
+    return nullptr;
+}
+
+
+SmallMatrix random_matrix(std::mt19937 &rng, int rows, int cols, int64_t bound, int kind) {
+    std::uniform_int_distribution<int64_t> value(-bound, bound);
+    SmallMatrix A(rows, cols);
+    if (kind == 0) {
+        // dense
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                A[i][j] = value(rng);
+            }
+        }
+    } else if (kind == 1) {
+        // scaled permutation, e.g. a transposed or diagonal access
+        std::vector<int> perm(cols);
+        for (int j = 0; j < cols; ++j) {
+            perm[j] = j;
+        }
+        std::shuffle(perm.begin(), perm.end(), rng);
+        for (int i = 0; i < rows && i < cols; ++i) {
+            A[i][perm[i]] = rng() % 2 ? 1 : value(rng);
+        }
+    } else if (kind == 2) {
+        // sparse, like strided/dilated accesses p * 2 + r
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                A[i][j] = rng() % 3 == 0 ? value(rng) : 0;
+            }
+        }
+    } else {
+        // rank deficient: rows are combinations of the first two
+        for (int j = 0; j < cols; ++j) {
+            A[0][j] = value(rng);
+            if (rows > 1) {
+                A[1][j] = value(rng);
+            }
+        }
+        for (int i = 2; i < rows; ++i) {
+            int64_t x = value(rng) % 4;
+            int64_t y = value(rng) % 4;
+            for (int j = 0; j < cols; ++j) {
+                A[i][j] = A[0][j] * x + A[1][j] * y;
+            }
+        }
+    }
+    return A;
+}
+
+
+int main() {
+    std::mt19937 rng(2020);
+    int failed = 0;
+    int tested = 0;
+    int overflows = 0;
+    // small coefficients, like strides and dilations, must never overflow,
+    // larger ones give a valid result or an exception, never a wrong result
+    for (int64_t bound : {1, 2, 3, 20, 1000, 1000000}) {
+        for (int kind = 0; kind < 4; ++kind) {
+            for (int iter = 0; iter < 200; ++iter) {
+                int rows = 1 + rng() % 8;
+                int cols = 1 + rng() % 8;
+                SmallMatrix A = random_matrix(rng, rows, cols, bound, kind);
+                SmallMatrix D = A;
+                SmallMatrix U, V;
+                int dim = 0;
+                tested += 1;
+                try {
+                    dim = smith_normalize(D, U, V);
+                } catch (const std::overflow_error &e) {
+                    overflows += 1;
+                    if (bound <= 3) {
+                        failed += 1;
+                        std::cout << "Fail (" << rows << "x" << cols << ", bound " << (long long)bound
+                                  << ", kind " << kind << "): unexpected overflow\n";
+                    }
+                    continue;
+                }
+                const char *reason = check_snf(A, D, U, V, dim);
+                if (reason != nullptr) {
+                    failed += 1;
+                    std::cout << "Fail (" << rows << "x" << cols << ", bound " << (long long)bound
+                              << ", kind " << kind << "): " << reason << "\n";
+                }
+            }
+        }
+    }
+
+    // the largest shape with small coefficients
+    for (int kind = 0; kind < 4; ++kind) {
+        for (int iter = 0; iter < 50; ++iter) {
+            int dim_max = SmallMatrix::max_dim;
+            SmallMatrix A = random_matrix(rng, dim_max, dim_max, 1, kind);
+            SmallMatrix D = A;
+            SmallMatrix U, V;
+            tested += 1;
+            try {
+                int dim = smith_normalize(D, U, V);
+                const char *reason = check_snf(A, D, U, V, dim);
+                if (reason != nullptr) {
+                    failed += 1;
+                    std::cout << "Fail (" << dim_max << "x" << dim_max << ", kind " << kind << "): "
+                              << reason << "\n";
+                }
+            } catch (const std::overflow_error &e) {
+                overflows += 1;
+            }
+        }
+    }
+
+    // Matrix<int> gives the same result
+    for (int iter = 0; iter < 100; ++iter) {
+        int rows = 1 + rng() % 6;
+        int cols = 1 + rng() % 6;
+        SmallMatrix A = random_matrix(rng, rows, cols, 3, iter % 4);
+        Matrix<int> trans(rows, cols), U(rows, rows), V(cols, cols);
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                trans[i][j] = (int)A[i][j];
+            }
+        }
+        SmallMatrix D = A;
+        SmallMatrix small_U, small_V;
+        int dim = 0;
+        try {
+            dim = smith_normalize(D, small_U, small_V);
+        } catch (const std::overflow_error &e) {
+            continue;
+        }
+        int int_dim = 0;
+        try {
+            int_dim = smith_normalize(trans, U, V);
+        } catch (const std::overflow_error &e) {
+            continue;
+        }
+        if (int_dim != dim) {
+            failed += 1;
+            std::cout << "Fail: Matrix<int> gives a different rank\n";
+            continue;
+        }
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                if (trans[i][j] != D[i][j]) {
+                    failed += 1;
+                    std::cout << "Fail: Matrix<int> gives a different D\n";
+                    i = rows;
+                    break;
+                }
+            }
+        }
+    }
+
+    // huge coefficients
+    for (int iter = 0; iter < 100; ++iter) {
+        SmallMatrix A = random_matrix(rng, 3, 3, INT64_MAX / 2, iter % 4);
+        SmallMatrix D = A;
+        SmallMatrix U, V;
+        tested += 1;
+        try {
+            int dim = smith_normalize(D, U, V);
+            const char *reason = check_snf(A, D, U, V, dim);
+            if (reason != nullptr) {
+                failed += 1;
+                std::cout << "Fail (huge coefficients): " << reason << "\n";
+            }
+        } catch (const std::overflow_error &e) {
+            overflows += 1;
+        }
+    }
+    std::cout << tested << " random matrices checked, " << overflows << " reported overflow\n";
+
+    if (failed != 0) {
+        std::cout << "Fail! " << failed << " wrong results.\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "autodiff.h"
+#include "strength_reduce.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Bench::check;
+using Bench::count;
+
+
+std::string str(const Expr &expr) {
+    std::ostringstream oss;
+    oss << expr;
+    return oss.str();
+}
+
+
+/**
+ * operations of the innermost Move of a kernel, an access of rank n
+ * costs n - 1 multiply-adds for its address
+ */
+int inner_ops(const std::string &code, const std::string &dst) {
+    size_t pos = code.rfind(dst);
+    std::string line = code.substr(code.rfind('\n', pos) + 1);
+    line = line.substr(0, line.find('\n'));
+    int ret = 2 * count(line, "][");
+    for (auto op : {" + ", " - ", " * ", " / ", " % ", " >> ", " & "}) {
+        ret += count(line, op);
+    }
+    return ret;
+}
+
+
+/**
+ * divisions by a power of two, truncating ones only when never negative
+ */
+int test_shifts() {
+    Type index_type = Type::int_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 64), IndexType::Spatial);
+    Expr shifted = Binary::make(index_type, BinaryOpType::Sub, i, Expr(8));
+    auto mk = [&](BinaryOpType op, Expr a, int b) { return Binary::make(index_type, op, a, Expr(b)); };
+    Boost::Pass::StrengthReducer reducer;
+    int ret = 0;
+    ret |= check(str(reducer.mutate(mk(BinaryOpType::FloorDiv, shifted, 16))).find("call_pure(shift_right") == 0,
+        "floor division by 16 not shifted");
+    ret |= check(str(reducer.mutate(mk(BinaryOpType::FloorMod, shifted, 16))).find("call_pure(bitwise_and") == 0,
+        "floor modulo by 16 not masked");
+    ret |= check(str(reducer.mutate(mk(BinaryOpType::Mod, i, 16))).find("call_pure(bitwise_and") == 0,
+        "modulo of a non-negative value not masked");
+    ret |= check(str(reducer.mutate(mk(BinaryOpType::Div, shifted, 16))).find("shift_right") == std::string::npos,
+        "truncating division of a negative value shifted");
+    ret |= check(str(reducer.mutate(mk(BinaryOpType::FloorDiv, i, 12))).find("shift_right") == std::string::npos,
+        "division by 12 shifted");
+    return ret;
+}
+
+
+/**
+ * backward of conv2d with stride 2 to the input:
+ * O[n, k, p, q] += I[n, c, p * 2 + r, q * 2 + s] * W[k, c, r, s]
+ */
+int test_conv2d_grad() {
+    Bench::Conv2d conv("I", "W", "dO", 4, 16, 16, 14, 14, 3, 3, 2);
+    Stmt stmt = conv.grad();
+    Stmt reduced = Boost::Pass::strength_reduce(stmt);
+    Expr dst = Bench::Conv2d::grad_dst(stmt);
+    Boost::codegen::CodeGen_C gen;
+    std::string plain = gen.print(Kernel::make("plain", {conv.output, conv.weight}, {dst}, {stmt}, KernelType::CPU));
+    std::string fast = gen.print(Kernel::make("reduced", {conv.output, conv.weight}, {dst}, {reduced}, KernelType::CPU));
+    std::cout << fast;
+
+    int ops_plain = inner_ops(plain, "dI0[");
+    int ops_fast = inner_ops(fast, "((float *)dI0)[");
+    std::cout << "inner loop ops, address arithmetic included: plain " << ops_plain
+              << ", reduced " << ops_fast << "\n";
+    int ret = check(ops_fast < ops_plain, "no fewer inner loop ops");
+    ret |= check(count(plain, " / ") > 0 && count(fast, " / ") == 0, "divisions by 2 left");
+    if (ret != 0) {
+        return ret;
+    }
+
+    Bench::Benchmark bench("conv2d grad, stride 2", {conv.output, conv.weight}, dst);
+    bench.add("plain", stmt);
+    bench.add("reduced", reduced);
+    return bench.run("test_strength_reduce_conv2d", 10, 1e-4);
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_shifts();
+    ret |= test_conv2d_grad();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "type.h"
+#include "schedule.h"
+#include "unroll.h"
+#include "accumulate.h"
+#include "codegen_C.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Boost::Pass::Schedule;
+using Boost::Pass::UnrollOptions;
+using Bench::check;
+using Bench::count;
+
+
+std::string print(const Stmt &stmt) {
+    Boost::codegen::CodeGen_C gen;
+    return gen.print(Kernel::make("kernel", {}, {}, {stmt}, KernelType::CPU));
+}
+
+
+Expr add(Expr a, Expr b) {
+    return Binary::make(a.type(), BinaryOpType::Add, a, b);
+}
+
+
+Expr mul(Expr a, Expr b) {
+    return Binary::make(a.type(), BinaryOpType::Mul, a, b);
+}
+
+
+/**
+ * A<2, 8, 5, 5>[n, k, p, q] += B<2, 16, 7, 7>[n, c, p + r, q + s] * C<8, 16, 3, 3>[k, c, r, s]
+ * - r and s unrolled into 9 terms, the loops of 5 around c stay
+ */
+int test_conv() {
+    Bench::Conv2d conv("B", "C", "A", 2, 16, 8, 5, 5, 3, 3);
+    Stmt stmt = LoopNest::make(conv.loops(), {conv.update()});
+    Stmt unrolled = Boost::Pass::unroll(stmt);
+    std::string fast = print(unrolled);
+    std::cout << fast;
+    int ret = check(fast.find("for (int32_t r") == std::string::npos && fast.find("for (int32_t s") == std::string::npos
+        && count(fast, "A[n][k][p][q] = ") == 9
+        && fast.find("B[n][c][(p + 2)][(q + 1)] * C[k][c][2][1]") != std::string::npos
+        && fast.find("for (int32_t c") != std::string::npos && fast.find("for (int32_t q") != std::string::npos,
+        "expect r and s unrolled\n" + fast);
+    if (ret != 0) {
+        return ret;
+    }
+
+    Bench::Benchmark bench("conv2d 3x3", {conv.input, conv.weight}, conv.output);
+    bench.add("rolled", stmt);
+    bench.add("unrolled", unrolled);
+    return bench.run("test_unroll_conv", 200, 1e-2);
+}
+
+
+/**
+ * loops marked by Schedule::unroll, in and over the budget, and the
+ * bindings of a body renamed per copy
+ */
+int test_marked() {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, 4), IndexType::Spatial);
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, 16), IndexType::Reduce);
+    Expr X = Var::make(data_type, "X", {i, k}, {4, 16});
+    Expr Y = Var::make(data_type, "Y", {i}, {4});
+    Schedule sched(ComputeOp::make({i, k}, {Move::make(Y, add(Y, X), MoveType::MemToMem)}));
+    sched.unroll(k);
+    Stmt stmt = sched.lower();
+    int ret = 0;
+
+    std::string str = print(Boost::Pass::unroll(stmt));
+    ret |= check(count(str, "Y[i] = ") == 16 && str.find("for (int32_t k") == std::string::npos
+        && str.find("Y[i] = (Y[i] + X[i][15]);") != std::string::npos,
+        "expect the loop of 16 marked unrolled\n" + str);
+
+    UnrollOptions small;
+    small.max_nodes = 32;
+    str = print(Boost::Pass::unroll(stmt, small));
+    ret |= check(str.find("for (int32_t k = 0; k < 16; k = k + 1) {") != std::string::npos,
+        "expect the marked loop rolled over the budget\n" + str);
+
+    // t = X[i, r] * X[i, r]; Y[i] = Y[i] + t, a binding per copy
+    Expr r = Index::make(index_type, "r", Dom::make(index_type, 0, 3), IndexType::Reduce);
+    Expr t = Var::make(data_type, "t", {}, {});
+    Expr Xr = Var::make(data_type, "X", {i, r}, {4, 16});
+    Stmt let = LoopNest::make({r}, {LetStmt::make(t, mul(Xr, Xr), Move::make(Y, add(Y, t), MoveType::MemToMem))});
+    str = print(Boost::Pass::unroll(let));
+    std::cout << str;
+    ret |= check(str.find("for (int32_t r") == std::string::npos
+        && str.find("Y[i] = (Y[i] + t_0);") != std::string::npos
+        && str.find("Y[i] = (Y[i] + t_2);") != std::string::npos && str.find("(Y[i] + t)") == std::string::npos,
+        "expect a binding per copy\n" + str);
+    return ret;
+}
+
+
+/**
+ * C<M, N>[i, j] = C[i, j] + A<M, K>[i, k] * B<N, K>[j, k], j jammed into k
+ * by 4 and the 4 sums kept in locals
+ */
+int test_jam() {
+    const int M = 256, N = 254, K = 256;
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    Expr i = Index::make(index_type, "i", Dom::make(index_type, 0, M), IndexType::Spatial);
+    Expr j = Index::make(index_type, "j", Dom::make(index_type, 0, N), IndexType::Spatial);
+    Expr k = Index::make(index_type, "k", Dom::make(index_type, 0, K), IndexType::Reduce);
+    Expr A = Var::make(data_type, "A", {i, k}, {(uint64_t)M, (uint64_t)K});
+    Expr B = Var::make(data_type, "B", {j, k}, {(uint64_t)N, (uint64_t)K});
+    Expr C = Var::make(data_type, "C", {i, j}, {(uint64_t)M, (uint64_t)N});
+    Stmt gemm = LoopNest::make({i, j, k}, {Move::make(C, add(C, mul(A, B)), MoveType::MemToMem)});
+
+    Stmt acc = Boost::Pass::accumulate(gemm);
+    Stmt jam = Boost::Pass::accumulate(Boost::Pass::unroll(gemm));
+    std::string str = print(jam);
+    std::cout << str;
+    int ret = check(str.find("for (int32_t j_outer = 0; j_outer < 63; j_outer = j_outer + 1) {") != std::string::npos
+        && str.find("float C_acc3 = C[i][((j_outer * 4) + 3)];") != std::string::npos
+        && str.find("C_acc2 = (C_acc2 + (A[i][k] * B[((j_outer * 4) + 2)][k]));") != std::string::npos
+        && str.find("for (int32_t j = 252; j < 252 + 2; j = j + 1) {") != std::string::npos,
+        "expect j jammed by 4 into 4 locals and a rest loop\n" + str);
+
+    // a reduction of dependent iterations stays
+    Expr Cj = Var::make(data_type, "C", {i, Expr(0)}, {(uint64_t)M, (uint64_t)N});
+    Stmt carried = LoopNest::make({i, j, k}, {Move::make(Cj, add(Cj, mul(A, B)), MoveType::MemToMem)});
+    str = print(Boost::Pass::unroll(carried));
+    ret |= check(str.find("j_outer") == std::string::npos, "unexpected jam\n" + str);
+    if (ret != 0) {
+        return ret;
+    }
+
+    Bench::Benchmark bench("gemm 256", {A, B}, C);
+    bench.add("memory", gemm);
+    bench.add("1 local", acc);
+    bench.add("jammed 4 locals", jam);
+    return bench.run("test_unroll_jam", 5, 1e-2);
+}
+
+
+int main() {
+    int ret = 0;
+    ret |= test_conv();
+    ret |= test_marked();
+    ret |= test_jam();
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "IR.h"
+#include "IRPrinter.h"
+#include "type.h"
+#include "schedule.h"
+#include "vectorize.h"
+#include "bench_utils.h"
+
+using namespace Boost::Internal;
+using Boost::Pass::Schedule;
+using Bench::check;
+
+
+std::string print(const Stmt &stmt) {
+    IRPrinter printer;
+    return printer.print(stmt);
+}
+
+
+int main() {
+    Type index_type = Type::int_scalar(32);
+    Type data_type = Type::float_scalar(32);
+    auto index = [&](const std::string &name, int extent, IndexType t) {
+        return Index::make(index_type, name, Dom::make(index_type, 0, extent), t);
+    };
+    auto mk = [&](BinaryOpType op, Expr a, Expr b) { return Binary::make(data_type, op, a, b); };
+    Expr i = index("i", 4, IndexType::Spatial);
+    Expr j = index("j", 20, IndexType::Spatial);
+    Expr A = Var::make(data_type, "A", {i, j}, {4, 20});
+    Expr At = Var::make(data_type, "A", {j, i}, {20, 4});
+    Expr B = Var::make(data_type, "B", {j}, {20});
+    Expr alpha = Var::make(data_type, "alpha", {Expr(0)}, {1});
+    Expr Y = Var::make(data_type, "Y", {i, j}, {4, 20});
+    Expr C = Var::make(data_type, "C", {i}, {4});
+    int ret = 0;
+
+    // Y[i, j] = A[i, j] * alpha[0] + B[j]
+    Stmt stmt = LoopNest::make({i, j}, {Move::make(Y, mk(BinaryOpType::Add, mk(BinaryOpType::Mul, A, alpha), B))});
+    std::string str = print(Boost::Pass::vectorize(stmt));
+    std::cout << str;
+    ret |= check(str.find("Y[i, ramp((j_vec * ((int32_t <1>) 8)), 1, 8)] =<mem_to_mem> ((A[i, ramp(") != std::string::npos
+        && str.find("ramp(alpha[((int32_t <1>) 0)], 0, 8)") != std::string::npos, "expect vector loads and stores");
+    ret |= check(str.find("for j_vec<spatial> in dom[((int32_t <1>) 0), ((int32_t <1>) 2))") != std::string::npos
+        && str.find("for j<spatial> in dom[((int32_t <1>) 16), ((int32_t <1>) 4))") != std::string::npos,
+        "expect two vectors and an epilogue of 4");
+
+    // C[i] = C[i] + A[i, j] * B[j]
+    stmt = LoopNest::make({i, j}, {Move::make(C, mk(BinaryOpType::Add, C, mk(BinaryOpType::Mul, A, B)))});
+    str = print(Boost::Pass::vectorize(stmt, 4));
+    std::cout << str;
+    ret |= check(str.find("C[i] =<mem_to_mem> (C[i] + call_pure(vector_reduce_add, (A[i, ramp(") != std::string::npos,
+        "expect a reduction");
+    ret |= check(str.find("for j<") == std::string::npos, "no epilogue expected for 20 of 4 lanes");
+
+    // stays scalar: gather, dependence, short loop
+    Expr Yp = Var::make(data_type, "Y", {i, Binary::make(index_type, BinaryOpType::Sub, j, Expr(1))}, {4, 20});
+    Expr k = index("k", 7, IndexType::Vectorized);
+    Expr Yk = Var::make(data_type, "Y", {i, k}, {4, 20});
+    std::vector<Stmt> scalar = {
+        LoopNest::make({i, j}, {Move::make(Y, At)}),
+        LoopNest::make({i, j}, {Move::make(Y, mk(BinaryOpType::Add, Yp, B))}),
+        LoopNest::make({i, k}, {Move::make(Yk, B)})
+    };
+    for (auto &s : scalar) {
+        str = print(Boost::Pass::vectorize(s));
+        ret |= check(str.find("ramp") == std::string::npos, "unexpected vectors in\n" + str);
+    }
+
+    // marked by a schedule, only the loop of j_inner
+    Stmt move = Move::make(Y, mk(BinaryOpType::Mul, A, B));
+    Schedule sched(ComputeOp::make({i, j}, {move}));
+    Expr jo, ji;
+    sched.split(j, 16, jo, ji);
+    sched.reorder({jo, i, ji});
+    sched.vectorize(ji);
+    str = print(Boost::Pass::vectorize(sched.lower(), 8, false));
+    std::cout << str;
+    ret |= check(str.find("for j_inner_vec<spatial>") != std::string::npos
+        && str.find("ramp(((j_outer * ((int32_t <1>) 16)) + (j_inner_vec * ((int32_t <1>) 8))), 1, 8)")
+        != std::string::npos,
+        "expect the split loop vectorized");
+
+    if (ret != 0) {
+        std::cout << "Fail!\n";
+        return 1;
+    }
+    std::cout << "Success!\n";
+    return 0;
+}